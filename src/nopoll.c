@@ -191,52 +191,53 @@ int nopoll_vprintf_len (const char * format, va_list args)
  * @param chunk The message chunk to print.
  * @param args The arguments for the chunk.
  * 
- * @return A newly allocated string.
- *
- * IMPLEMENTATION NOTE: This function may have a fundamental bug due
- * to the design of va_list arguments under amd64 platforms. In short,
- * a function receiving a va_list argument can't use it twice. In you
- * are running amd64, check your nopoll_config.h did find NOPOLL_HAVE_VASPRINTF.
+ * @return A newly allocated string (taken from the allocator
+ * installed, see \ref nopoll_set_allocator, so it must be released
+ * with \ref nopoll_free).
  */
 char  * nopoll_strdup_printfv    (const char * chunk, va_list args)
 {
 	/** IMPLEMENTATION NOTE: place update exarg_strdup_printfv
 	 * code in the case this code is updated **/
-#if defined(SHOW_DEBUG_LOG) && ! defined(NOPOLL_HAVE_VASPRINTF)
+#if defined(SHOW_DEBUG_LOG)
 	noPollCtx * ctx = NULL;
 #endif
-
-#if !defined(NOPOLL_HAVE_VASPRINTF)
-	int       size;
-#endif
-	char    * result   = NULL;
+	int         size;
+	char      * result   = NULL;
+	va_list     copy;
 
 	if (chunk == NULL)
 		return NULL;
 
-#ifdef NOPOLL_HAVE_VASPRINTF
-	/* do the operation using the GNU extension */
-	if (vasprintf (&result, chunk, args) == -1)
-	        return NULL;
+	/* get the amount of memory to be allocated (using a copy:
+	 * a va_list can't be used twice on some platforms) */
+#if defined(va_copy)
+	va_copy (copy, args);
+#elif defined(__va_copy)
+	__va_copy (copy, args);
 #else
-	/* get the amount of memory to be allocated */
-	size = nopoll_vprintf_len (chunk, args);
+	copy = args;
+#endif
+	size = nopoll_vprintf_len (chunk, copy);
+	va_end (copy);
 
 	/* check result */
-	if (size == -1) {
+	if (size <= 0) {
 		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "unable to calculate the amount of memory for the strdup_printf operation");
 		return NULL;
 	} /* end if */
 
-	/* allocate memory */
+	/* allocate memory (not with vasprintf: content must be
+	 * released with nopoll_free) */
 	result   = nopoll_new (char, size + 2);
+	if (result == NULL)
+		return NULL;
 	
 	/* copy current size */
-#    if defined(NOPOLL_OS_WIN32) && ! defined (__GNUC__)
+#if defined(NOPOLL_OS_WIN32) && ! defined (__GNUC__)
 	size = _vsnprintf_s (result, size + 1, size, chunk, args);
-#    else
+#else
 	size = vsnprintf (result, size + 1, chunk, args);
-#    endif
 #endif
 	/* return the result */
 	return result;
@@ -373,6 +374,11 @@ noPollMutexDestroy  __nopoll_mutex_destroy = NULL;
 noPollMutexLock     __nopoll_mutex_lock    = NULL;
 noPollMutexUnlock   __nopoll_mutex_unlock  = NULL;
 
+noPollMalloc        __nopoll_malloc        = NULL;
+noPollRealloc       __nopoll_realloc       = NULL;
+noPollFree          __nopoll_free          = NULL;
+noPollUsableSize    __nopoll_usable_size   = NULL;
+
 /** 
  * @brief Creates a mutex with the defined create mutex handler.
  *
@@ -487,6 +493,58 @@ void        nopoll_thread_handlers (noPollMutexCreate  mutex_create,
 	return;
 }
 
+/** 
+ * @brief Global optional memory handlers used by noPoll library to
+ * allocate, reallocate and release memory (\ref nopoll_new, \ref
+ * nopoll_calloc, \ref nopoll_realloc, \ref nopoll_free and \ref
+ * nopoll_strdup, including memory used by zlib streams), for example
+ * to route the library to a different allocator or to account the
+ * memory it uses.
+ *
+ * If you don't provide these, the library will use calloc, realloc
+ * and free.
+ *
+ * Handlers must be installed before any other library function is
+ * used (and not changed while references allocated are alive):
+ * memory allocated with a set of handlers must be released with the
+ * same set. Memory allocated by OpenSSL isn't affected.
+ *
+ * @param malloc_handler The handler used to allocate memory (the
+ * library clears it when required).
+ *
+ * @param realloc_handler The handler used to reallocate memory.
+ *
+ * @param free_handler The handler used to release memory.
+ *
+ * @param usable_size_handler Optional handler used to report the
+ * usable size of a reference (see \ref nopoll_usable_size).
+ *
+ * The function must receive malloc, realloc and free handlers
+ * defined. In the case NULL values are provided, they will be
+ * uninstalled.
+ */
+void        nopoll_set_allocator (noPollMalloc      malloc_handler,
+				  noPollRealloc     realloc_handler,
+				  noPollFree        free_handler,
+				  noPollUsableSize  usable_size_handler)
+{
+	if (malloc_handler == NULL || realloc_handler == NULL || free_handler == NULL) {
+		/* uninstall handlers */
+		malloc_handler      = NULL;
+		realloc_handler     = NULL;
+		free_handler        = NULL;
+		usable_size_handler = NULL;
+	} /* end if */
+
+	/* configured received handlers */
+	__nopoll_malloc      = malloc_handler;
+	__nopoll_realloc     = realloc_handler;
+	__nopoll_free        = free_handler;
+	__nopoll_usable_size = usable_size_handler;
+
+	return;
+}
+
 /** 
  * @brief Allows to encode the provided content, leaving the output on
  * the buffer allocated by the caller.
@@ -646,10 +704,20 @@ int     nopoll_timeval_substract                  (struct timeval * a,
  */
 char      * nopoll_strdup (const char * buffer)
 {
+	char   * result;
+	size_t   length;
+
 	if (buffer == NULL)
 		return NULL;
 
-	return strdup (buffer);
+	/* copy with the allocator configured */
+	length = strlen (buffer);
+	result = nopoll_new (char, length + 1);
+	if (result == NULL)
+		return NULL;
+	memcpy (result, buffer, length + 1);
+
+	return result;
 }
 
 
@@ -961,6 +1029,7 @@ void nopoll_cleanup_library (void)
  * - \ref nopoll_implementing_mutual_auth
  * - \ref nopoll_implementing_tls_extended_validation_post_check
  * - \ref nopoll_implementing_tls_context_creator
+ * - \ref nopoll_tls_session_resumption
  *
  * <b>Section 4: Android platfom notes: </b>
  * 
@@ -1293,6 +1362,51 @@ void nopoll_cleanup_library (void)
  * bytes_written = nopoll_conn_flush_writes (conn, 2000000, bytes_written);
  *
  * \endcode
+ *
+ * Send operations never block nor retry internally: the part of the
+ * frame that couldn't be written (and every frame sent after it, to
+ * keep order) is queued on the connection. When the connection is
+ * watched by \ref nopoll_loop_wait, the loop writes the queue as
+ * soon as the socket becomes writable, so you don't need to retry
+ * at all. To know when the queue was written (for example, to
+ * continue sending a big content without queueing all of it), use:
+ *
+ * - \ref nopoll_conn_set_on_writable
+ *
+ * \code
+ * void on_writable (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data) {
+ *         // everything queued was written, continue sending
+ *         send_next_block (conn);
+ * }
+ *
+ * nopoll_conn_set_on_writable (conn, on_writable, NULL);
+ * \endcode
+ *
+ * To limit memory used by peers that stop reading (slow consumers),
+ * configure high and low watermarks for the queue on the connection
+ * options. When the queue goes above the high watermark, the handler
+ * is notified (to pause producers) and the configured policy is
+ * applied: keep queueing (\ref NOPOLL_SLOW_CONSUMER_NOTIFY), close
+ * the connection (\ref NOPOLL_SLOW_CONSUMER_DROP_CONN), drop oldest
+ * queued messages (\ref NOPOLL_SLOW_CONSUMER_DROP_OLDEST) or block the
+ * send operation (\ref NOPOLL_SLOW_CONSUMER_BLOCK). The handler is
+ * notified again once the queue goes down to the low watermark:
+ *
+ * - \ref nopoll_conn_opts_set_write_watermarks
+ * - \ref nopoll_conn_opts_set_slow_consumer_policy
+ * - \ref nopoll_conn_opts_set_on_watermark
+ *
+ * \code
+ * void on_watermark (noPollCtx * ctx, noPollConn * conn, nopoll_bool above, noPollPtr user_data) {
+ *         // pause producers while above the high watermark
+ *         set_producers_paused (conn, above);
+ * }
+ *
+ * opts = nopoll_conn_opts_new ();
+ * nopoll_conn_opts_set_write_watermarks (opts, 1048576, 262144);
+ * nopoll_conn_opts_set_slow_consumer_policy (opts, NOPOLL_SLOW_CONSUMER_DROP_OLDEST);
+ * nopoll_conn_opts_set_on_watermark (opts, on_watermark, NULL);
+ * \endcode
  * 
  * \section nopoll_implementing_port_sharing  2.2. Implementing protocol port sharing: running WebSocket and legacy protocol on the same port
  *
@@ -1490,6 +1604,30 @@ void nopoll_cleanup_library (void)
  * As you can see, the function must return an SSL_CTX for every
  * connection received and attempting to start TLS session.
  *
+ * \section nopoll_tls_session_resumption  3.4. TLS session resumption
+ *
+ * Client TLS connections save the session negotiated so next
+ * connections to the same site (same host, port and TLS options)
+ * created on the same context resume it, skipping the full TLS
+ * handshake. This can be disabled with \ref
+ * nopoll_ctx_set_tls_session_reuse. Note sessions are only resumed
+ * when previous connections were closed with \ref nopoll_conn_close.
+ *
+ * Listeners keep a session cache and issue session tickets. By
+ * default ticket keys are random (for each listener TLS context). To
+ * let clients resume sessions on any listener or process (for
+ * example, several servers behind a balancer), configure the same
+ * keys on all of them (and call it again to rotate them):
+ *
+ * \code
+ * // 80 bytes: key name, HMAC secret and AES key
+ * nopoll_ctx_set_tls_ticket_keys (ctx, keys, 80);
+ * \endcode
+ *
+ * Use \ref nopoll_conn_tls_session_reused and \ref
+ * nopoll_ctx_get_tls_stats to check how many handshakes were
+ * resumed.
+ *
  *
  */
 
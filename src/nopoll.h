@@ -79,6 +79,11 @@ void        nopoll_thread_handlers (noPollMutexCreate  mutex_create,
 				    noPollMutexLock    mutex_lock,
 				    noPollMutexUnlock  mutex_unlock);
 
+void        nopoll_set_allocator (noPollMalloc      malloc_handler,
+				  noPollRealloc     realloc_handler,
+				  noPollFree        free_handler,
+				  noPollUsableSize  usable_size_handler);
+
 noPollPtr   nopoll_mutex_create (void);
 
 void        nopoll_mutex_lock    (noPollPtr mutex);
@@ -50,6 +50,19 @@
 
 #if defined(NOPOLL_OS_UNIX)
 # include <netinet/tcp.h>
+# include <sys/uio.h>
+#endif
+
+/* vector instructions used to mask/unmask frames */
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+#if defined(NOPOLL_HAVE_AVX2)
+# include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define NOPOLL_HAVE_NEON (1)
 #endif
 
 
@@ -228,45 +241,22 @@ nopoll_bool                 nopoll_conn_set_bind_interface (NOPOLL_SOCKET socket
 	return nopoll_true;
 } /* end */
 
-NOPOLL_SOCKET __nopoll_conn_sock_connect_opts_internal (noPollCtx       * ctx,
-							noPollTransport   transport,
-							const char      * host,
-							const char      * port,
-							noPollConnOpts  * options)
+/** 
+ * @internal Creates the socket (not connected) used by a client
+ * connection, configured as non blocking.
+ */
+NOPOLL_SOCKET __nopoll_conn_sock_open (noPollCtx       * ctx,
+				       noPollTransport   transport,
+				       noPollConnOpts  * options)
 {
-
-	struct addrinfo      hints, *res = NULL;
 	NOPOLL_SOCKET        session     = NOPOLL_INVALID_SOCKET;
 
-	/* clear hints structure */
-	memset (&hints, 0, sizeof(struct addrinfo));
-
 	switch (transport) {
 	case NOPOLL_TRANSPORT_IPV4:
-		/* configure hints */
-		hints.ai_family   = AF_INET;
-		hints.ai_socktype = SOCK_STREAM;
-		
-		/* resolve hosting name */
-		if (getaddrinfo (host, port, &hints, &res) != 0) {
-			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "unable to resolve host name %s, errno=%d", host, errno);
-			return -1;
-		} /* end if */
-
 		/* create the socket and check if it */
 		session      = socket (AF_INET, SOCK_STREAM, 0);
 		break;
 	case NOPOLL_TRANSPORT_IPV6:
-		/* configure hints */
-		hints.ai_family   = AF_INET6;
-		hints.ai_socktype = SOCK_STREAM;
-		
-		/* resolve hosting name */
-		if (getaddrinfo (host, port, &hints, &res) != 0) {
-			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "unable to resolve host name %s, errno=%d", host, errno);
-			return -1;
-		} /* end if */
-
 		/* create the socket and check if it */
 		session      = socket (AF_INET6, SOCK_STREAM, 0);
 		break;
@@ -274,9 +264,6 @@ NOPOLL_SOCKET __nopoll_conn_sock_connect_opts_internal (noPollCtx       * ctx,
 	
 	if (session == NOPOLL_INVALID_SOCKET) {
 		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "unable to create socket");
-
-		/* relase address info */
-		freeaddrinfo (res);
 		return -1;
 	} /* end if */
 
@@ -287,34 +274,63 @@ NOPOLL_SOCKET __nopoll_conn_sock_connect_opts_internal (noPollCtx       * ctx,
 	if( nopoll_true != nopoll_conn_set_bind_interface (session, options) ) {
 		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "unable to bind to specified interface");
 		nopoll_close_socket (session);
-
-		/* relase address info */
-		freeaddrinfo (res);
-		
 		return -1;
 	} /* end if */
 
 	/* set non blocking status */
 	nopoll_conn_set_sock_block (session, nopoll_false);
-	
+
+	return session;
+}
+
+/** 
+ * @internal Starts the TCP connect of the provided socket to the
+ * address resolved. The socket is closed if it fails.
+ */
+nopoll_bool __nopoll_conn_sock_start_connect (noPollCtx               * ctx,
+					      NOPOLL_SOCKET             session,
+					      struct sockaddr_storage * addr,
+					      int                       addr_size,
+					      const char              * host,
+					      const char              * port)
+{
 	/* do a tcp connect */
-        if (connect (session, res->ai_addr, res->ai_addrlen) < 0) {
+        if (connect (session, (struct sockaddr *) addr, addr_size) < 0) {
 		if(errno != NOPOLL_EINPROGRESS && errno != NOPOLL_EWOULDBLOCK && errno != NOPOLL_ENOTCONN) { 
 		        shutdown (session, SHUT_RDWR);
                         nopoll_close_socket (session);
 
 			nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "unable to connect to remote host %s:%s errno=%d",
 				    host, port, errno);
-
-			/* relase address info */
-			freeaddrinfo (res);
-			
-			return -1;
+			return nopoll_false;
 		} /* end if */
 	} /* end if */
 
-	/* relase address info */
-	freeaddrinfo (res);
+	return nopoll_true;
+}
+
+NOPOLL_SOCKET __nopoll_conn_sock_connect_opts_internal (noPollCtx       * ctx,
+							noPollTransport   transport,
+							const char      * host,
+							const char      * port,
+							noPollConnOpts  * options)
+{
+	struct sockaddr_storage   addr;
+	int                       addr_size   = 0;
+	NOPOLL_SOCKET             session     = NOPOLL_INVALID_SOCKET;
+
+	/* resolve hosting name (or get it from the cache) */
+	if (! __nopoll_ctx_dns_resolve (ctx, host, port, transport, &addr, &addr_size)) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "unable to resolve host name %s", host);
+		return -1;
+	} /* end if */
+
+	/* create the socket and connect it */
+	session = __nopoll_conn_sock_open (ctx, transport, options);
+	if (session == NOPOLL_INVALID_SOCKET)
+		return -1;
+	if (! __nopoll_conn_sock_start_connect (ctx, session, &addr, addr_size, host, port))
+		return -1;
 
 	/* return socket created */
 	return session;
@@ -364,6 +380,559 @@ NOPOLL_SOCKET nopoll_conn_sock_connect (noPollCtx       * ctx,
 }
 
 
+/** 
+ * @internal Returns next token found on the provided cursor (up to
+ * the separator provided) without surrounding white spaces, updating
+ * the cursor to the next one (NULL when no more tokens are found).
+ * Used to parse Sec-WebSocket-Extensions values.
+ */
+char * __nopoll_conn_deflate_token (char ** cursor, char separator)
+{
+	char * token;
+	char * end;
+
+	if (*cursor == NULL)
+		return NULL;
+
+	/* find token end */
+	token = *cursor;
+	end   = strchr (token, separator);
+	if (end) {
+		*end    = 0;
+		*cursor = end + 1;
+	} else
+		*cursor = NULL;
+
+	/* remove white spaces */
+	while (*token == ' ' || *token == '\t')
+		token++;
+	end = token + strlen (token);
+	while (end > token && (end[-1] == ' ' || end[-1] == '\t'))
+		end--;
+	*end = 0;
+
+	return token;
+}
+
+/** 
+ * @internal Parses permessage-deflate extension parameters (the part
+ * after the extension name) into the values provided (window bits
+ * are 0 when not found and -1 when found without value).
+ *
+ * @return nopoll_false when an unknown, repeated or invalid parameter
+ * is found.
+ */
+nopoll_bool __nopoll_conn_deflate_params (char        * params, 
+					  nopoll_bool * client_no_context_takeover,
+					  nopoll_bool * server_no_context_takeover,
+					  int         * client_max_window_bits,
+					  int         * server_max_window_bits)
+{
+	char        * param;
+	char        * name;
+	char        * value;
+	nopoll_bool * flag;
+	int         * bits;
+	int           iterator;
+
+	*client_no_context_takeover = nopoll_false;
+	*server_no_context_takeover = nopoll_false;
+	*client_max_window_bits     = 0;
+	*server_max_window_bits     = 0;
+
+	while ((param = __nopoll_conn_deflate_token (&params, ';')) != NULL) {
+		/* split name=value */
+		name  = __nopoll_conn_deflate_token (&param, '=');
+		value = __nopoll_conn_deflate_token (&param, ';');
+		if (strlen (name) == 0 && value == NULL)
+			continue;
+
+		/* flags (without value) */
+		flag = NULL;
+		if (strcasecmp (name, "client_no_context_takeover") == 0)
+			flag = client_no_context_takeover;
+		else if (strcasecmp (name, "server_no_context_takeover") == 0)
+			flag = server_no_context_takeover;
+		if (flag) {
+			if (value || *flag)
+				return nopoll_false;
+			*flag = nopoll_true;
+			continue;
+		} /* end if */
+
+		/* window bits */
+		if (strcasecmp (name, "client_max_window_bits") == 0)
+			bits = client_max_window_bits;
+		else if (strcasecmp (name, "server_max_window_bits") == 0)
+			bits = server_max_window_bits;
+		else
+			return nopoll_false;
+		if (*bits != 0)
+			return nopoll_false;
+
+		/* only client_max_window_bits can be found without value */
+		if (value == NULL) {
+			if (bits == server_max_window_bits)
+				return nopoll_false;
+			*bits = -1;
+			continue;
+		} /* end if */
+
+		/* value (may be quoted) */
+		if (value[0] == '"' && strlen (value) > 1 && value[strlen (value) - 1] == '"') {
+			value[strlen (value) - 1] = 0;
+			value++;
+		} /* end if */
+		iterator = 0;
+		while (value[iterator] >= '0' && value[iterator] <= '9')
+			iterator++;
+		if (iterator == 0 || value[iterator] != 0)
+			return nopoll_false;
+		*bits = atoi (value);
+		if (*bits < 8 || *bits > 15)
+			return nopoll_false;
+	} /* end while */
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Builds the permessage-deflate offer sent by clients
+ * (Sec-WebSocket-Extensions value) or NULL if not configured.
+ */
+char * __nopoll_conn_deflate_offer (noPollConn * conn)
+{
+	noPollDeflate * state = conn->deflate;
+	char            client_bits[32];
+	char            server_bits[48];
+
+	if (state == NULL)
+		return NULL;
+
+	/* client_max_window_bits is always announced so the server
+	 * can limit the window used by the client */
+	client_bits[0] = 0;
+	if (state->client_max_window_bits)
+		sprintf (client_bits, "=%d", state->client_max_window_bits);
+	server_bits[0] = 0;
+	if (state->server_max_window_bits)
+		sprintf (server_bits, "; server_max_window_bits=%d", state->server_max_window_bits);
+
+	return nopoll_strdup_printf ("permessage-deflate; client_max_window_bits%s%s%s%s",
+				     client_bits,
+				     state->client_no_context_takeover ? "; client_no_context_takeover" : "",
+				     state->server_no_context_takeover ? "; server_no_context_takeover" : "",
+				     server_bits);
+}
+
+/** 
+ * @internal Accepts the first permessage-deflate offer received from
+ * the client that is supported (listener side), configuring the
+ * connection.
+ *
+ * @return The Sec-WebSocket-Extensions value to reply or NULL if
+ * the extension is not used.
+ */
+char * __nopoll_conn_deflate_accept (noPollCtx * ctx, noPollConn * conn)
+{
+	noPollDeflate * state = conn->deflate;
+	char          * offers;
+	char          * cursor;
+	char          * offer;
+	char          * name;
+	nopoll_bool     client_no_context_takeover;
+	nopoll_bool     server_no_context_takeover;
+	int             client_max_window_bits;
+	int             server_max_window_bits;
+	int             window_bits;
+	char            client_bits[48];
+	char            server_bits[48];
+	char          * result = NULL;
+
+	if (state == NULL || conn->handshake->extensions == NULL)
+		return NULL;
+
+	offers = nopoll_strdup (conn->handshake->extensions);
+	cursor = offers;
+	while ((offer = __nopoll_conn_deflate_token (&cursor, ',')) != NULL) {
+		name = __nopoll_conn_deflate_token (&offer, ';');
+		if (strcasecmp (name, "permessage-deflate") != 0)
+			continue;
+		if (! __nopoll_conn_deflate_params (offer, &client_no_context_takeover, &server_no_context_takeover,
+						    &client_max_window_bits, &server_max_window_bits)) {
+			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Declining permessage-deflate offer with unsupported parameters from %s:%s",
+				    conn->host, conn->port);
+			continue;
+		} /* end if */
+
+		/* window used to compress (zlib doesn't support 8 bits
+		 * windows) */
+		window_bits = state->server_max_window_bits ? state->server_max_window_bits : 15;
+		if (server_max_window_bits > 0 && server_max_window_bits < window_bits)
+			window_bits = server_max_window_bits;
+		if (window_bits < 9) {
+			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Declining permessage-deflate offer with server_max_window_bits=%d from %s:%s",
+				    window_bits, conn->host, conn->port);
+			continue;
+		} /* end if */
+		server_bits[0] = 0;
+		if (server_max_window_bits > 0 || window_bits < 15)
+			sprintf (server_bits, "; server_max_window_bits=%d", window_bits);
+
+		/* window the client can use (only if announced) */
+		client_bits[0] = 0;
+		if (client_max_window_bits != 0 && state->client_max_window_bits &&
+		    (client_max_window_bits < 0 || state->client_max_window_bits < client_max_window_bits))
+			sprintf (client_bits, "; client_max_window_bits=%d", state->client_max_window_bits);
+
+		/* extension accepted */
+		state->enabled       = nopoll_true;
+		state->window_bits   = window_bits;
+		state->deflate_reset = server_no_context_takeover || state->server_no_context_takeover;
+		state->inflate_reset = client_no_context_takeover || state->client_no_context_takeover;
+
+		result = nopoll_strdup_printf ("permessage-deflate%s%s%s%s",
+					       state->deflate_reset ? "; server_no_context_takeover" : "",
+					       state->inflate_reset ? "; client_no_context_takeover" : "",
+					       server_bits, client_bits);
+		break;
+	} /* end while */
+	nopoll_free (offers);
+
+	return result;
+}
+
+/** 
+ * @internal Checks the Sec-WebSocket-Extensions reply received from
+ * the server (client side), configuring the connection if
+ * permessage-deflate was accepted.
+ *
+ * @return nopoll_false if the reply is not valid (the connection
+ * must be closed).
+ */
+nopoll_bool __nopoll_conn_deflate_check_reply (noPollCtx * ctx, noPollConn * conn)
+{
+	noPollDeflate * state = conn->deflate;
+	char          * reply;
+	char          * cursor;
+	char          * name;
+	nopoll_bool     client_no_context_takeover;
+	nopoll_bool     server_no_context_takeover;
+	int             client_max_window_bits;
+	int             server_max_window_bits;
+	nopoll_bool     result;
+
+	/* extension not accepted */
+	if (conn->handshake->extensions == NULL)
+		return nopoll_true;
+	if (state == NULL) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Received Sec-WebSocket-Extensions: %s from server but no extension was requested", 
+			    conn->handshake->extensions);
+		return nopoll_false;
+	} /* end if */
+
+	/* only one extension (permessage-deflate) was offered */
+	reply  = nopoll_strdup (conn->handshake->extensions);
+	cursor = reply;
+	name   = __nopoll_conn_deflate_token (&cursor, ';');
+	result = strchr (conn->handshake->extensions, ',') == NULL && strcasecmp (name, "permessage-deflate") == 0 &&
+		__nopoll_conn_deflate_params (cursor, &client_no_context_takeover, &server_no_context_takeover,
+					      &client_max_window_bits, &server_max_window_bits);
+	nopoll_free (reply);
+
+	/* server can't use bigger windows than requested, and
+	 * client_max_window_bits must have a value supported */
+	if (result && state->server_max_window_bits && server_max_window_bits > state->server_max_window_bits)
+		result = nopoll_false;
+	if (result && (client_max_window_bits < 0 || (client_max_window_bits > 0 && client_max_window_bits < 9)))
+		result = nopoll_false;
+	if (! result) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Received unsupported Sec-WebSocket-Extensions: %s from server", 
+			    conn->handshake->extensions);
+		return nopoll_false;
+	} /* end if */
+
+	/* extension accepted */
+	state->enabled     = nopoll_true;
+	state->window_bits = state->client_max_window_bits ? state->client_max_window_bits : 15;
+	if (client_max_window_bits > 0 && client_max_window_bits < state->window_bits)
+		state->window_bits = client_max_window_bits;
+	state->deflate_reset = client_no_context_takeover || state->client_no_context_takeover;
+	state->inflate_reset = server_no_context_takeover;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Tracks the RSV1 flag of the frame received (compressed
+ * messages), see nopoll_conn_get_msg.
+ *
+ * @return nopoll_false if the flag is not expected (protocol error).
+ */
+nopoll_bool __nopoll_conn_deflate_frame (noPollConn * conn, noPollMsg * msg, nopoll_bool rsv1)
+{
+	noPollDeflate * state = conn->deflate;
+
+	if (state == NULL || ! state->enabled)
+		return ! rsv1;
+
+	if (msg->op_code == NOPOLL_CONTINUATION_FRAME) {
+		/* next frame of the message being received */
+		if (rsv1)
+			return nopoll_false;
+		state->frame_compressed = state->inflating;
+	} else if (msg->op_code == NOPOLL_TEXT_FRAME || msg->op_code == NOPOLL_BINARY_FRAME) {
+		/* first frame of a message */
+		state->inflating        = rsv1;
+		state->frame_compressed = rsv1;
+	} else {
+		/* control frames are never compressed */
+		if (rsv1)
+			return nopoll_false;
+		state->frame_compressed = nopoll_false;
+	} /* end if */
+	state->frame_fin = msg->has_fin;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Decompresses the content received (part of a compressed
+ * message) into a new buffer, to be released by the caller.
+ * Decompression is streamed, so the message can be received in
+ * several parts (final flags the last one). Content decompressed
+ * can't go beyond the max message size configured (see
+ * nopoll_conn_set_max_message_size).
+ */
+nopoll_bool __nopoll_conn_inflate_content (noPollConn * conn, const char * content, long length, nopoll_bool final, 
+					   char ** result, long * result_size)
+{
+#if defined(NOPOLL_HAVE_ZLIB)
+	noPollDeflate       * state   = conn->deflate;
+	z_stream            * stream;
+	unsigned char         trailer[4];
+	char                * buffer;
+	char                * aux;
+	long                  size;
+	long                  used;
+	long                  limit;
+	int                   status;
+	int                   pass;
+
+	/* get decompression context: taken from the context pool
+	 * until the message is received when the peer resets it
+	 * after each message */
+	if (state->inflate_stream == NULL) {
+		state->inflate_stream = __nopoll_ctx_zstream_get (conn->ctx, nopoll_false, 15, state->inflate_reset);
+		if (state->inflate_stream == NULL) {
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to create decompression context for conn-id=%d", conn->id);
+			return nopoll_false;
+		} /* end if */
+	} /* end if */
+	stream = &state->inflate_stream->stream;
+
+	size   = length * 4 + 64;
+	buffer = nopoll_new (char, size);
+	if (buffer == NULL)
+		return nopoll_false;
+	used   = 0;
+
+	/* the message ends with an empty deflate block without its
+	 * trailer (removed by the sender), which is added here */
+	trailer[0] = 0x00;
+	trailer[1] = 0x00;
+	trailer[2] = 0xff;
+	trailer[3] = 0xff;
+	limit      = nopoll_conn_get_max_message_size (conn);
+	for (pass = 0; pass < 2; pass++) {
+		if (pass == 0) {
+			stream->next_in  = (Bytef *) content;
+			stream->avail_in = length;
+		} else if (final) {
+			stream->next_in  = trailer;
+			stream->avail_in = 4;
+		} else 
+			break;
+
+		do {
+			/* grow buffer (keeping room for the string terminator) */
+			if (used + 1 >= size) {
+				aux = nopoll_realloc (buffer, size * 2);
+				if (aux == NULL) {
+					nopoll_free (buffer);
+					return nopoll_false;
+				} /* end if */
+				buffer = aux;
+				size   = size * 2;
+			} /* end if */
+			stream->next_out  = (Bytef *) buffer + used;
+			stream->avail_out = size - used - 1;
+
+			status = inflate (stream, Z_SYNC_FLUSH);
+			used   = size - 1 - stream->avail_out;
+			if (status == Z_STREAM_END) {
+				/* final block found (BFINAL), continue
+				 * with a new stream */
+				inflateReset (stream);
+			} else if (status == Z_BUF_ERROR) {
+				/* no progress possible */
+				break;
+			} else if (status != Z_OK) {
+				nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Failed to decompress message received over conn-id=%d (zlib status %d)", 
+					    conn->id, status);
+				nopoll_free (buffer);
+				return nopoll_false;
+			} /* end if */
+
+			/* check max message size */
+			if (limit > 0 && state->inflated + used > limit) {
+				nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Message decompressed over conn-id=%d goes beyond max message size allowed (%ld bytes)", 
+					    conn->id, limit);
+				nopoll_free (buffer);
+				return nopoll_false;
+			} /* end if */
+		} while (stream->avail_in > 0 || stream->avail_out == 0);
+	} /* end for */
+
+	/* reset context when the peer doesn't keep it (returning it
+	 * to the pool) */
+	if (final && state->inflate_reset && state->inflate_stream->pooled) {
+		__nopoll_ctx_zstream_release (conn->ctx, state->inflate_stream);
+		state->inflate_stream = NULL;
+	} else if (final && state->inflate_reset)
+		inflateReset (stream);
+
+	/* bytes of the message decompressed */
+	state->inflated = final ? 0 : state->inflated + used;
+
+	buffer[used]   = 0;
+	(*result)      = buffer;
+	(*result_size) = used;
+	return nopoll_true;
+#else
+	return nopoll_false;
+#endif
+}
+
+/** 
+ * @internal Replaces the payload of the message received (part of a
+ * compressed message) with its content decompressed (see
+ * __nopoll_conn_inflate_content).
+ */
+nopoll_bool __nopoll_conn_inflate (noPollConn * conn, noPollMsg * msg, nopoll_bool final)
+{
+	char * buffer;
+	long   size;
+
+	if (! __nopoll_conn_inflate_content (conn, msg->payload, msg->payload_size, final, &buffer, &size))
+		return nopoll_false;
+
+	/* replace content */
+	__nopoll_msg_buffer_release (msg);
+	msg->payload      = buffer;
+	msg->payload_size = size;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Compresses the message to be sent into a new buffer
+ * (permessage-deflate), to be released by the caller. Must be called
+ * holding conn->ref_mutex so messages are written in the order they
+ * are compressed.
+ */
+nopoll_bool __nopoll_conn_deflate (noPollConn * conn, const char * content, long length, char ** result, long * result_size)
+{
+#if defined(NOPOLL_HAVE_ZLIB)
+	noPollDeflate       * state   = conn->deflate;
+	z_stream            * stream;
+	char                * buffer;
+	char                * aux;
+	long                  size;
+	long                  used;
+	int                   status;
+
+	/* get compression context: taken from the context pool while
+	 * the message is compressed when it is reset after each
+	 * message */
+	if (state->deflate_stream == NULL) {
+		state->deflate_stream = __nopoll_ctx_zstream_get (conn->ctx, nopoll_true, state->window_bits, state->deflate_reset);
+		if (state->deflate_stream == NULL) {
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to create compression context for conn-id=%d", conn->id);
+			return nopoll_false;
+		} /* end if */
+	} /* end if */
+	stream = &state->deflate_stream->stream;
+
+	size   = deflateBound (stream, length) + 16;
+	buffer = nopoll_new (char, size);
+	if (buffer == NULL)
+		return nopoll_false;
+	used   = 0;
+
+	stream->next_in  = (Bytef *) content;
+	stream->avail_in = length;
+	while (nopoll_true) {
+		stream->next_out  = (Bytef *) buffer + used;
+		stream->avail_out = size - used;
+
+		status = deflate (stream, Z_SYNC_FLUSH);
+		used   = size - stream->avail_out;
+		if (status != Z_OK && status != Z_BUF_ERROR) {
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Failed to compress message over conn-id=%d (zlib status %d)", conn->id, status);
+			nopoll_free (buffer);
+			return nopoll_false;
+		} /* end if */
+
+		/* everything flushed */
+		if (stream->avail_out > 0)
+			break;
+
+		aux = nopoll_realloc (buffer, size * 2);
+		if (aux == NULL) {
+			nopoll_free (buffer);
+			return nopoll_false;
+		} /* end if */
+		buffer = aux;
+		size   = size * 2;
+	} /* end while */
+
+	/* remove empty block trailer added by the flush (see RFC 7692
+	 * 7.2.1) */
+	if (used >= 4 && memcmp (buffer + used - 4, "\x00\x00\xff\xff", 4) == 0)
+		used -= 4;
+
+	/* reset context when it is not kept between messages
+	 * (returning it to the pool) */
+	if (state->deflate_stream->pooled) {
+		__nopoll_ctx_zstream_release (conn->ctx, state->deflate_stream);
+		state->deflate_stream = NULL;
+	} else if (state->deflate_reset)
+		deflateReset (stream);
+	__nopoll_ctx_deflate_count (conn->ctx, length, used);
+
+	*result      = buffer;
+	*result_size = used;
+	return nopoll_true;
+#else
+	return nopoll_false;
+#endif
+}
+
+/** 
+ * @internal Releases permessage-deflate state of the connection.
+ */
+void __nopoll_conn_deflate_release (noPollConn * conn)
+{
+	if (conn->deflate == NULL)
+		return;
+	__nopoll_ctx_zstream_release (conn->ctx, conn->deflate->deflate_stream);
+	__nopoll_ctx_zstream_release (conn->ctx, conn->deflate->inflate_stream);
+	nopoll_free (conn->deflate);
+	conn->deflate = NULL;
+	return;
+}
+
 /** 
  * @internal Function that builds the client init greetings that will
  * be send to the server according to registered implementation.
@@ -374,6 +943,8 @@ char * __nopoll_conn_get_client_init (noPollConn * conn, noPollConnOpts * opts)
 	char key[50];
 	int  key_size = 50;
 	char nonce[17];
+	char * extensions;
+	char * result;
 
 	/* get the nonce */
 	if (! nopoll_nonce (nonce, 16)) {
@@ -393,8 +964,11 @@ char * __nopoll_conn_get_client_init (noPollConn * conn, noPollConnOpts * opts)
 	conn->handshake = nopoll_new (noPollHandShake, 1);
 	conn->handshake->expected_accept = nopoll_strdup (key);
 
+	/* permessage-deflate offer (if configured) */
+	extensions = __nopoll_conn_deflate_offer (conn);
+
 	/* send initial handshake */
-	return nopoll_strdup_printf ("GET %s HTTP/1.1"
+	result = nopoll_strdup_printf ("GET %s HTTP/1.1"
 				     "\r\nHost: %s"
 				     "\r\nUpgrade: websocket"
 				     "\r\nConnection: Upgrade"
@@ -403,6 +977,7 @@ char * __nopoll_conn_get_client_init (noPollConn * conn, noPollConnOpts * opts)
 				     "\r\nOrigin: %s"
 				     "%s%s"  /* Cookie */
 				     "%s%s"  /* protocol part */
+				     "%s%s"  /* extensions */
 				     "%s"    /* extra arbitrary headers */
 				     "\r\n\r\n",
 				     conn->get_url,
@@ -419,8 +994,13 @@ char * __nopoll_conn_get_client_init (noPollConn * conn, noPollConnOpts * opts)
 				     /* protocol part */
 				     conn->protocols ? "\r\nSec-WebSocket-Protocol: " : "",
 				     conn->protocols ? conn->protocols : "",
+				     /* extensions */
+				     extensions ? "\r\nSec-WebSocket-Extensions: " : "",
+				     extensions ? extensions : "",
 				     /* extra arbitrary headers */
 				     (opts && opts->extra_headers) ? opts->extra_headers : "");
+	nopoll_free (extensions);
+	return result;
 }
 
 
@@ -562,9 +1142,15 @@ int nopoll_conn_tls_send (noPollConn * conn, char * buffer, int buffer_size)
 {
 	int         res;
 	nopoll_bool needs_retry;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && ! defined(LIBRESSL_VERSION_NUMBER)
+	size_t      written = 0;
 
-	/* call to read content */
+	/* call to write content */
+	res = SSL_write_ex (conn->ssl, buffer, buffer_size, &written) ? (int) written : -1;
+#else
+	/* call to write content */
 	res = SSL_write (conn->ssl, buffer, buffer_size);
+#endif
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "SSL: sent %d bytes (requested: %d)..", res, buffer_size); 
 
 	/* call to handle error */
@@ -711,33 +1297,176 @@ int __nopoll_conn_ssl_verify_callback (int ok, X509_STORE_CTX * store) {
 	return ok; /* return same value */
 }
 
-nopoll_bool __nopoll_conn_set_ssl_client_options (noPollCtx * ctx, noPollConn * conn, noPollConnOpts * options)
+/** 
+ * @internal Checks if the provided host name is an IPv4 or IPv6
+ * address.
+ */
+nopoll_bool __nopoll_conn_is_ip_address (const char * host_name)
 {
-	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Checking to establish SSL options (%p)", options);
+	const char * iterator = host_name;
 
-	if (options && options->ca_certificate) {
-		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting CA certificate: %s", options->ca_certificate);
-		if (SSL_CTX_load_verify_locations (conn->ssl_ctx, options->ca_certificate, NULL) != 1) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure CA certificate (%s), SSL_CTX_load_verify_locations () failed", options->ca_certificate);
+	/* IPv6 address */
+	if (strchr (host_name, ':'))
+		return nopoll_true;
+
+	/* IPv4 address */
+	while (*iterator) {
+		if ((*iterator < '0' || *iterator > '9') && *iterator != '.')
 			return nopoll_false;
-		} /* end if */
-		
-	} /* end if */
+		iterator++;
+	} /* end while */
+	return nopoll_true;
+}
 
-	/* enable default verification paths */
-	/* printf ("conn = %p, conn->ssl_ctx = %p\n", conn, conn->ssl_ctx); */
-	if (SSL_CTX_set_default_verify_paths (conn->ssl_ctx) != 1) {
-		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to configure default verification paths, SSL_CTX_set_default_verify_paths () failed");
-		return nopoll_false;
+/** 
+ * @internal Builds the key used to save and resume the TLS session
+ * of the provided client connection: sessions are only resumed by
+ * connections to the same site with the same TLS options.
+ */
+char * __nopoll_conn_tls_session_key (noPollConn * conn, noPollConnOpts * options)
+{
+	return nopoll_strdup_printf ("%s:%s|%s|%d|%s|%s|%d", 
+				     conn->host, conn->port, 
+				     conn->host_name ? conn->host_name : "",
+				     options ? (int) options->ssl_protocol : -1,
+				     (options && options->certificate) ? options->certificate : "",
+				     (options && options->ca_certificate) ? options->ca_certificate : "",
+				     (options == NULL || ! options->disable_ssl_verify));
+}
+
+/** 
+ * @internal New session callback configured on client TLS contexts
+ * (SSL_CTX_sess_set_new_cb): saves the session received on the
+ * context to resume it on next connections to the same site. With
+ * TLS 1.3 it is called after the handshake, when session tickets are
+ * read.
+ *
+ * @return 1 when the reference to the session is kept, otherwise 0.
+ */
+int __nopoll_conn_tls_new_session (SSL * ssl, SSL_SESSION * session)
+{
+	noPollConn       * conn = (noPollConn *) SSL_get_app_data (ssl);
+	noPollCtx        * ctx;
+	noPollTlsSession * entry;
+
+	if (conn == NULL || conn->tls_session_key == NULL)
+		return 0;
+	ctx = conn->ctx;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (! ctx->tls_session_reuse) {
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		return 0;
 	} /* end if */
 
-	if (options && options->chain_certificate) {
-		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting chain certificate: %s", options->chain_certificate);
-		if (SSL_CTX_use_certificate_chain_file (conn->ssl_ctx, options->chain_certificate) != 1) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure chain certificate (%s), SSL_CTX_use_certificate_chain_file () failed", options->chain_certificate);
-			return nopoll_false;
+	entry = ctx->tls_sessions;
+	while (entry) {
+		if (nopoll_cmp (entry->key, conn->tls_session_key))
+			break;
+		entry = entry->next;
+	} /* end while */
+
+	if (entry == NULL) {
+		entry = nopoll_new (noPollTlsSession, 1);
+		if (entry == NULL) {
+			nopoll_mutex_unlock (ctx->ref_mutex);
+			return 0;
 		} /* end if */
-	} /* end if */
+		entry->key        = nopoll_strdup (conn->tls_session_key);
+		entry->next       = ctx->tls_sessions;
+		ctx->tls_sessions = entry;
+	} else
+		SSL_SESSION_free (entry->session);
+
+	/* keep reference received */
+	entry->session = session;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Saved TLS session for %s (conn-id=%d)", conn->tls_session_key, conn->id);
+	return 1;
+}
+
+/** 
+ * @internal Configures the session saved by a previous connection to
+ * the same site (if any) on the provided client connection so the
+ * TLS handshake resumes it.
+ */
+void __nopoll_conn_tls_session_restore (noPollCtx * ctx, noPollConn * conn, noPollConnOpts * options)
+{
+	noPollTlsSession * entry;
+
+	/* used by __nopoll_conn_tls_new_session */
+	SSL_set_app_data (conn->ssl, conn);
+
+	if (! ctx->tls_session_reuse)
+		return;
+
+	nopoll_free (conn->tls_session_key);
+	conn->tls_session_key = __nopoll_conn_tls_session_key (conn, options);
+	if (conn->tls_session_key == NULL)
+		return;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	entry = ctx->tls_sessions;
+	while (entry) {
+		if (nopoll_cmp (entry->key, conn->tls_session_key)) {
+			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Resuming TLS session for %s (conn-id=%d)", conn->tls_session_key, conn->id);
+			SSL_set_session (conn->ssl, entry->session);
+			break;
+		} /* end if */
+		entry = entry->next;
+	} /* end while */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return;
+}
+
+/** 
+ * @internal Updates context TLS statistics once the TLS handshake of
+ * the provided connection (client or listener side) is completed.
+ */
+void __nopoll_conn_tls_handshake_done (noPollConn * conn)
+{
+	nopoll_bool resumed = SSL_session_reused (conn->ssl) ? nopoll_true : nopoll_false;
+
+	nopoll_mutex_lock (conn->ctx->ref_mutex);
+	if (resumed)
+		conn->ctx->tls_resumed_handshakes++;
+	else
+		conn->ctx->tls_full_handshakes++;
+	nopoll_mutex_unlock (conn->ctx->ref_mutex);
+
+	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "TLS handshake completed for conn-id=%d (session resumed: %d)", conn->id, resumed);
+	return;
+}
+
+nopoll_bool __nopoll_conn_set_ssl_client_options (noPollCtx * ctx, noPollConn * conn, noPollConnOpts * options)
+{
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Checking to establish SSL options (%p)", options);
+
+	if (options && options->ca_certificate) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting CA certificate: %s", options->ca_certificate);
+		if (SSL_CTX_load_verify_locations (conn->ssl_ctx, options->ca_certificate, NULL) != 1) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure CA certificate (%s), SSL_CTX_load_verify_locations () failed", options->ca_certificate);
+			return nopoll_false;
+		} /* end if */
+		
+	} /* end if */
+
+	/* enable default verification paths */
+	/* printf ("conn = %p, conn->ssl_ctx = %p\n", conn, conn->ssl_ctx); */
+	if (SSL_CTX_set_default_verify_paths (conn->ssl_ctx) != 1) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to configure default verification paths, SSL_CTX_set_default_verify_paths () failed");
+		return nopoll_false;
+	} /* end if */
+
+	if (options && options->chain_certificate) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting chain certificate: %s", options->chain_certificate);
+		if (SSL_CTX_use_certificate_chain_file (conn->ssl_ctx, options->chain_certificate) != 1) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure chain certificate (%s), SSL_CTX_use_certificate_chain_file () failed", options->chain_certificate);
+			return nopoll_false;
+		} /* end if */
+	} /* end if */
 
 	if (options && options->certificate) {
 		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting certificate: %s", options->certificate);
@@ -774,6 +1503,277 @@ nopoll_bool __nopoll_conn_set_ssl_client_options (noPollCtx * ctx, noPollConn *
 		SSL_CTX_set_verify_depth (conn->ssl_ctx, 10); 
 	} /* end if */
 
+	/* save sessions received to resume them on next connections
+	 * (see __nopoll_conn_tls_new_session) */
+	if (ctx->tls_session_reuse) {
+		SSL_CTX_set_session_cache_mode (conn->ssl_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb (conn->ssl_ctx, __nopoll_conn_tls_new_session);
+	} /* end if */
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Checks the state of the TCP connect started (in a non
+ * blocking manner) on the provided client connection.
+ *
+ * @return 1 if connected, 0 if still in progress or -1 if it failed
+ * (errno is updated).
+ */
+int __nopoll_conn_connect_tcp_status (noPollConn * conn)
+{
+	struct sockaddr_in6   peer;
+	int                   error      = 0;
+#if defined(NOPOLL_OS_WIN32)
+	int                   peer_size  = sizeof (peer);
+	int                   error_size = sizeof (error);
+#else
+	socklen_t             peer_size  = sizeof (peer);
+	socklen_t             error_size = sizeof (error);
+#endif
+
+	/* connected */
+	if (getpeername (conn->session, (struct sockaddr *) &peer, &peer_size) == 0)
+		return 1;
+
+	/* failed or still in progress */
+	if (getsockopt (conn->session, SOL_SOCKET, SO_ERROR, (char *) &error, &error_size) != 0 || error != 0) {
+		if (error != 0)
+			errno = error;
+		return -1;
+	} /* end if */
+
+	return 0;
+}
+
+/** 
+ * @internal Enables or disables write readiness watching for a client
+ * connection in the middle of the connect process (it is not
+ * disabled while content is queued).
+ */
+void __nopoll_conn_connect_watch_write (noPollConn * conn, nopoll_bool enable)
+{
+	nopoll_mutex_lock (conn->ctx->ref_mutex);
+	if (conn->write_watched != enable && (enable || conn->write_queue == NULL))
+		__nopoll_io_watch_write (conn->ctx, conn, enable);
+	nopoll_mutex_unlock (conn->ctx->ref_mutex);
+	return;
+}
+
+/** 
+ * @internal Waits (up to the microseconds provided) until the socket
+ * of a client connection is ready to continue the connect process or
+ * the websocket handshake.
+ */
+void __nopoll_conn_connect_wait (noPollConn * conn, long microseconds)
+{
+	fd_set         read_set;
+	fd_set         write_set;
+	struct timeval tv;
+
+#if defined(NOPOLL_OS_UNIX)
+	/* socket can't be watched with select */
+	if (conn->session >= FD_SETSIZE) {
+		nopoll_sleep (microseconds);
+		return;
+	} /* end if */
+#endif
+
+	FD_ZERO (&read_set);
+	FD_ZERO (&write_set);
+	if (conn->connect_state == NOPOLL_CONNECT_TCP || conn->write_queue ||
+	    (conn->connect_state == NOPOLL_CONNECT_TLS && SSL_want_write (conn->ssl)))
+		FD_SET (conn->session, &write_set);
+	if (conn->connect_state != NOPOLL_CONNECT_TCP)
+		FD_SET (conn->session, &read_set);
+
+	tv.tv_sec  = microseconds / 1000000;
+	tv.tv_usec = microseconds % 1000000;
+	select (conn->session + 1, &read_set, &write_set, NULL, &tv);
+	return;
+}
+
+/** 
+ * @internal Advances the connect process of the provided client
+ * connection (TCP connect, TLS handshake and sending the websocket
+ * client init) without blocking. It is called when the socket gets
+ * ready by the loop (see nopoll_conn_opts_set_async_connect) and by
+ * the handshake code, or in a loop by __nopoll_conn_new_common to
+ * wait for it.
+ *
+ * @return nopoll_true when the process is finished (client init
+ * written or queued), otherwise nopoll_false (still in progress or
+ * failed, check nopoll_conn_is_ok).
+ */
+nopoll_bool __nopoll_conn_connect_step (noPollConn * conn)
+{
+	noPollCtx               * ctx = conn->ctx;
+	int                       ssl_error;
+	X509                    * server_cert;
+	int                       size;
+	int                       bytes_written;
+	struct sockaddr_storage   addr;
+	int                       addr_size = 0;
+
+	if (conn->connect_state == NOPOLL_CONNECT_DONE)
+		return nopoll_true;
+	if (conn->session == NOPOLL_INVALID_SOCKET)
+		return nopoll_false;
+
+	if (conn->connect_state == NOPOLL_CONNECT_RESOLVE) {
+		switch (__nopoll_ctx_dns_entry_take (ctx, &(conn->dns_entry), &addr, &addr_size)) {
+		case 0:
+			return nopoll_false;
+		case -1:
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "unable to resolve host name %s, conn-id=%d", conn->host, conn->id);
+			nopoll_conn_shutdown (conn);
+			return nopoll_false;
+		default:
+			break;
+		} /* end switch */
+
+		if (! __nopoll_conn_sock_start_connect (ctx, conn->session, &addr, addr_size, conn->host, conn->port)) {
+			/* socket already closed */
+			conn->session = NOPOLL_INVALID_SOCKET;
+			nopoll_conn_shutdown (conn);
+			return nopoll_false;
+		} /* end if */
+
+		/* watch the socket from now on */
+		conn->connect_state = NOPOLL_CONNECT_TCP;
+		nopoll_mutex_lock (ctx->ref_mutex);
+		__nopoll_io_add_conn (ctx, conn);
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		__nopoll_conn_connect_watch_write (conn, nopoll_true);
+	} /* end if */
+
+	if (conn->connect_state == NOPOLL_CONNECT_TCP) {
+		switch (__nopoll_conn_connect_tcp_status (conn)) {
+		case 0:
+			return nopoll_false;
+		case -1:
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "unable to connect to remote host %s:%s errno=%d, conn-id=%d",
+				    conn->host, conn->port, errno, conn->id);
+			nopoll_conn_shutdown (conn);
+			return nopoll_false;
+		default:
+			break;
+		} /* end switch */
+
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "connected to remote site %s:%s, conn-id=%d", conn->host, conn->port, conn->id);
+		__nopoll_conn_connect_watch_write (conn, nopoll_false);
+		conn->connect_state = conn->ssl ? NOPOLL_CONNECT_TLS : NOPOLL_CONNECT_INIT;
+	} /* end if */
+
+	if (conn->connect_state == NOPOLL_CONNECT_TLS) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "connecting to remote TLS site %s:%s", conn->host, conn->port);
+		if (SSL_connect (conn->ssl) <= 0) {
+		
+			/* get ssl error */
+			ssl_error = SSL_get_error (conn->ssl, -1);
+ 
+			switch (ssl_error) {
+			case SSL_ERROR_WANT_READ:
+			        nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "still not prepared to continue because read wanted, conn-id=%d (%p, session: %d), errno=%d",
+					    conn->id, conn, conn->session, errno);
+				__nopoll_conn_connect_watch_write (conn, nopoll_false);
+				return nopoll_false;
+			case SSL_ERROR_WANT_WRITE:
+			        nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "still not prepared to continue because write wanted, conn-id=%d (%p)",
+					    conn->id, conn);
+				__nopoll_conn_connect_watch_write (conn, nopoll_true);
+				return nopoll_false;
+			case SSL_ERROR_SYSCALL:
+				/* Check ENOTCONN on SSL_connect error (only happening on windows). See:
+				 * https://github.com/ASPLes/nopoll/pull/19
+				 */
+				if (errno == NOPOLL_ENOTCONN) {
+					nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "the socket is not yet connected, retrying, conn-id=%d (%p)",
+					            conn->id, conn);
+					return nopoll_false;
+				}
+				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "syscall error while doing TLS handshake, ssl error (code:%d), conn-id: %d (%p), errno: %d, session: %d",
+					    ssl_error, conn->id, conn, errno, conn->session);
+				nopoll_conn_log_ssl (conn);
+				nopoll_conn_shutdown (conn);
+				return nopoll_false;
+			default:
+				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "there was an error with the TLS negotiation, ssl error (code:%d) : %s",
+					    ssl_error, ERR_error_string (ssl_error, NULL));
+				/* show log stack */
+				nopoll_conn_log_ssl (conn);
+					
+				/* call to release connection */
+				nopoll_conn_shutdown (conn);
+				return nopoll_false;
+			} /* end switch */
+		} /* end if */
+
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Client TLS handshake finished, configuring I/O handlers");
+		__nopoll_conn_tls_handshake_done (conn);
+
+		/* check remote certificate (if it is present) */
+		server_cert = SSL_get_peer_certificate (conn->ssl);
+		if (server_cert == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "server side didn't set a certificate for this session, these are bad news");
+			nopoll_conn_shutdown (conn);
+			return nopoll_false;
+		}
+		X509_free (server_cert);
+
+		/* call to check post ssl checks after SSL finalization */
+		if (conn->ctx && conn->ctx->post_ssl_check) {
+			if (! conn->ctx->post_ssl_check (conn->ctx, conn, conn->ssl_ctx, conn->ssl, conn->ctx->post_ssl_check_data)) {
+				/* TLS post check failed */
+				nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "TLS/SSL post check function failed, dropping connection");
+				nopoll_conn_shutdown (conn);
+				return nopoll_false;
+			} /* end if */
+		} /* end if */
+
+		/* configure default handlers */
+		conn->receive = nopoll_conn_tls_receive;
+		conn->send    = nopoll_conn_tls_send;
+
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "TLS I/O handlers configured");
+		conn->tls_on        = nopoll_true;
+		conn->connect_state = NOPOLL_CONNECT_INIT;
+	} /* end if */
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Sending websocket client init: %s", conn->connect_init);
+	size = strlen (conn->connect_init);
+
+	/* call to send content (queuing what is not written) */
+	nopoll_mutex_lock (conn->ref_mutex);
+	bytes_written = conn->send (conn, conn->connect_init, size);
+	if (bytes_written < 0) {
+	        /* for some reason, under FreeBSD, a ENOTCONN is reported when they should be returning EINPROGRESS and/or EWOULDBLOCK */
+		if (errno != NOPOLL_EWOULDBLOCK && errno != NOPOLL_EINPROGRESS && errno != NOPOLL_ENOTCONN) {
+			nopoll_mutex_unlock (conn->ref_mutex);
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to send websocket init message, error code was: %d (2), closing session", errno);
+			nopoll_conn_shutdown (conn);
+			return nopoll_false;
+		} /* end if */
+		bytes_written = 0;
+	} /* end if */
+	if (bytes_written < size && ! __nopoll_conn_queue_write (conn, NULL, 0, conn->connect_init, bytes_written, size - bytes_written, nopoll_false)) {
+		nopoll_mutex_unlock (conn->ref_mutex);
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to queue websocket init message, closing session");
+		nopoll_conn_shutdown (conn);
+		return nopoll_false;
+	} /* end if */
+	nopoll_mutex_unlock (conn->ref_mutex);
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Web socket initial client handshake sent");
+
+	/* release content */
+	nopoll_free (conn->connect_init);
+	conn->connect_init  = NULL;
+	conn->connect_state = NOPOLL_CONNECT_DONE;
+
+	/* stop watching write readiness (unless something was queued) */
+	__nopoll_conn_connect_watch_write (conn, nopoll_false);
+
 	return nopoll_true;
 }
 
@@ -795,10 +1795,7 @@ noPollConn * __nopoll_conn_new_common (noPollCtx       * ctx,
 	noPollConn     * conn;
 	NOPOLL_SOCKET    session;
 	char           * content;
-	int              size;
-	int              ssl_error;
-	X509           * server_cert;
-	int              iterator;
+	nopoll_bool      async_connect;
 	long             remaining_timeout;
 
 	if (! ctx || ! host_ip) {
@@ -811,9 +1808,13 @@ noPollConn * __nopoll_conn_new_common (noPollCtx       * ctx,
 	if (host_port == NULL)
 		host_port = "80";
 
-	session = socket;
-	/* create socket connection in a non block manner */
-	if (session == NOPOLL_INVALID_SOCKET)
+	session       = socket;
+	async_connect = options && options->async_connect;
+	/* create socket connection in a non block manner (connected
+	 * once the host name is resolved for asynchronous connects) */
+	if (session == NOPOLL_INVALID_SOCKET && async_connect)
+		session = __nopoll_conn_sock_open (ctx, transport, options);
+	else if (session == NOPOLL_INVALID_SOCKET)
 		session = __nopoll_conn_sock_connect_opts_internal (ctx, transport, host_ip, host_port, options);
 	if (session == NOPOLL_INVALID_SOCKET) {
 		/* release connection options */
@@ -836,6 +1837,22 @@ noPollConn * __nopoll_conn_new_common (noPollCtx       * ctx,
 	conn->ref_mutex = nopoll_mutex_create ();
 	conn->handshake_mutex = nopoll_mutex_create ();
 
+	/* configure context (before registering so the socket can be
+	 * added to the io engine) */
+	conn->ctx     = ctx;
+	conn->session = session;
+	conn->role    = NOPOLL_ROLE_CLIENT;
+
+	/* not watched until resolved (see __nopoll_conn_connect_step) */
+	if (session != socket && async_connect)
+		conn->connect_state = NOPOLL_CONNECT_RESOLVE;
+
+	/* outbound queue watermarks and slow consumer policy */
+	__nopoll_conn_opts_apply_watermarks (options, conn);
+
+	/* permessage-deflate settings (negotiated during handshake) */
+	__nopoll_conn_opts_apply_deflate (options, conn);
+
 	/* register connection into context */
 	if (! nopoll_ctx_register_conn (ctx, conn)) {
 		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to register connection into the context, unable to create connection");
@@ -848,11 +1865,6 @@ noPollConn * __nopoll_conn_new_common (noPollCtx       * ctx,
 
 	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Created noPoll conn-id=%d (ptr: %p, context: %p, socket: %d)",
 		    conn->id, conn, ctx, session);
-	
-	/* configure context */
-	conn->ctx     = ctx;
-	conn->session = session;
-	conn->role    = NOPOLL_ROLE_CLIENT;
 
 	/* record host and port */
 	conn->host    = nopoll_strdup (host_ip);
@@ -914,162 +1926,77 @@ noPollConn * __nopoll_conn_new_common (noPollCtx       * ctx,
 		if (! __nopoll_conn_set_ssl_client_options (ctx, conn, options)) {
 			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to configure additional SSL options, unable to continue, conn->ssl_ctx=%p, conn->ssl=%p",
 				    conn->ssl_ctx, conn->ssl);
-			goto fail_ssl_connection;
-		} /* end if */
-
-		/* create context and check for result */
-		conn->ssl      = SSL_new (conn->ssl_ctx);       
-		if (conn->ssl_ctx == NULL || conn->ssl == NULL) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to create SSL context internal references are null (conn->ssl_ctx=%p, conn->ssl=%p)",
-				    conn->ssl_ctx, conn->ssl);
-		fail_ssl_connection:
-
-			nopoll_free (content);
-			nopoll_conn_shutdown (conn);
-
-			/* release connection options */
-			__nopoll_conn_opts_release_if_needed (options);
-
-			return conn;
-		} /* end if */
-		
-		/* set socket */
-		SSL_set_fd (conn->ssl, conn->session);
-
-		/* do the initial connect connect */
-		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "connecting to remote TLS site %s:%s", conn->host, conn->port);
-		iterator = 0;
-		while (SSL_connect (conn->ssl) <= 0) {
-		
-			/* get ssl error */
-			ssl_error = SSL_get_error (conn->ssl, -1);
- 
-			switch (ssl_error) {
-			case SSL_ERROR_WANT_READ:
-			        nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "still not prepared to continue because read wanted, conn-id=%d (%p, session: %d), errno=%d",
-					    conn->id, conn, conn->session, errno);
-				break;
-			case SSL_ERROR_WANT_WRITE:
-			        nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "still not prepared to continue because write wanted, conn-id=%d (%p)",
-					    conn->id, conn);
-				break;
-			case SSL_ERROR_SYSCALL:
-				/* Check ENOTCONN on SSL_connect error (only happening on windows). See:
-				 * https://github.com/ASPLes/nopoll/pull/19
-				 */
-				if (errno == NOPOLL_ENOTCONN) {
-					nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "the socket is not yet connected, retrying, conn-id=%d (%p)",
-					            conn->id, conn);
-					break;
-				}
-				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "syscall error while doing TLS handshake, ssl error (code:%d), conn-id: %d (%p), errno: %d, session: %d",
-					    ssl_error, conn->id, conn, errno, conn->session);
-				nopoll_conn_log_ssl (conn);
-				nopoll_conn_shutdown (conn);
-				nopoll_free (content);
-
-				/* release connection options */
-				__nopoll_conn_opts_release_if_needed (options);
-
-				return conn;
-			default:
-				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "there was an error with the TLS negotiation, ssl error (code:%d) : %s",
-					    ssl_error, ERR_error_string (ssl_error, NULL));
-				/* show log stack */
-				nopoll_conn_log_ssl (conn);
-					
-				/* call to release connection */
-				nopoll_conn_shutdown (conn);
-				nopoll_free (content);
-
-				/* release connection options */
-				__nopoll_conn_opts_release_if_needed (options);
-
-				return conn;
-			} /* end switch */
-			
-			/* try and limit max reconnect allowed */
-			iterator++;
-
-			if (iterator > 1000) {
-				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Max retry calls=%d to SSL_connect reached, shutting down connection id=%d, errno=%d",
-					    iterator, conn->id, errno);
-				nopoll_free (content);
-
-				/* release connection options */
-				__nopoll_conn_opts_release_if_needed (options);
-
-				return conn;
-			} /* end if */
-
-			/* wait a bit before retry */
-			nopoll_sleep (10000);
-
-		} /* end while */
-
-		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Client TLS handshake finished, configuring I/O handlers");
-
-		/* check remote certificate (if it is present) */
-		server_cert = SSL_get_peer_certificate (conn->ssl);
-		if (server_cert == NULL) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "server side didn't set a certificate for this session, these are bad news");
-
-			/* release connection options */
-			nopoll_free (content);
-			__nopoll_conn_opts_release_if_needed (options);
-
-			return conn;
-		}
-		X509_free (server_cert);
-
-		/* call to check post ssl checks after SSL finalization */
-		if (conn->ctx && conn->ctx->post_ssl_check) {
-			if (! conn->ctx->post_ssl_check (conn->ctx, conn, conn->ssl_ctx, conn->ssl, conn->ctx->post_ssl_check_data)) {
-				/* TLS post check failed */
-				nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "TLS/SSL post check function failed, dropping connection");
-				nopoll_conn_shutdown (conn);
-				return NULL;
-			} /* end if */
-		} /* end if */
-
-		/* configure default handlers */
-		conn->receive = nopoll_conn_tls_receive;
-		conn->send    = nopoll_conn_tls_send;
+			goto fail_ssl_connection;
+		} /* end if */
 
-		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "TLS I/O handlers configured");
-		conn->tls_on = nopoll_true;
-	} /* end if */
+		/* create context and check for result */
+		conn->ssl      = SSL_new (conn->ssl_ctx);       
+		if (conn->ssl_ctx == NULL || conn->ssl == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to create SSL context internal references are null (conn->ssl_ctx=%p, conn->ssl=%p)",
+				    conn->ssl_ctx, conn->ssl);
+		fail_ssl_connection:
 
-	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Sending websocket client init: %s", content);
-	size = strlen (content);
+			nopoll_free (content);
+			nopoll_conn_shutdown (conn);
 
-	/* call to send content */
-	remaining_timeout = ctx->conn_connect_std_timeout;
-	while (remaining_timeout > 0) {
-		if (size != conn->send (conn, content, size)) {
-		        /* for some reason, under FreeBSD, a ENOTCONN is reported when they should be returning EINPROGRESS and/or EWOULDBLOCK */
-			if (errno == NOPOLL_EWOULDBLOCK || errno == NOPOLL_EINPROGRESS || errno == NOPOLL_ENOTCONN) {
-				/* nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Connection in progress (errno=%d), session: %d", errno, session); */
-				nopoll_sleep (10000);
-				remaining_timeout -= 10000;
-				continue;
-			} /* end if */
+			/* release connection options */
+			__nopoll_conn_opts_release_if_needed (options);
 
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to send websocket init message, error code was: %d (2), closing session", errno);
-			nopoll_conn_shutdown (conn);
+			return conn;
 		} /* end if */
+		
+		/* set socket */
+		SSL_set_fd (conn->ssl, conn->session);
 
-		break;
-	}
+		/* pending writes are retried from a different buffer */
+		SSL_set_mode (conn->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 
-	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Web socket initial client handshake sent");
+		/* request the certificate for the server name (SNI,
+		 * not used with IP addresses) */
+		if (conn->host_name && ! __nopoll_conn_is_ip_address (conn->host_name))
+			SSL_set_tlsext_host_name (conn->ssl, conn->host_name);
 
-	/* release content */
-	nopoll_free (content);
+		/* resume previous session to this site (if any) */
+		__nopoll_conn_tls_session_restore (ctx, conn, options);
+	} /* end if */
+
+	/* connect process (TCP connect, TLS handshake and websocket
+	 * client init) is completed by __nopoll_conn_connect_step */
+	conn->connect_init  = content;
+	if (conn->connect_state == NOPOLL_CONNECT_RESOLVE) {
+		/* resolve host name (continues right away if it is
+		 * cached) */
+		conn->dns_entry = __nopoll_ctx_dns_resolve_async (ctx, host_ip, host_port, transport);
+		if (conn->dns_entry == NULL)
+			nopoll_conn_shutdown (conn);
+		else
+			__nopoll_conn_connect_step (conn);
+	} else {
+		conn->connect_state = NOPOLL_CONNECT_TCP;
+		__nopoll_conn_connect_watch_write (conn, nopoll_true);
+	} /* end if */
 
 	/* release connection options */
 	__nopoll_conn_opts_release_if_needed (options);
 
+	/* completed later by the loop (or nopoll_conn_is_ready) */
+	if (async_connect)
+		return conn;
+
+	/* wait for the connect process to finish */
+	remaining_timeout = ctx->conn_connect_std_timeout;
+	while (! __nopoll_conn_connect_step (conn) && nopoll_conn_is_ok (conn)) {
+		if (remaining_timeout <= 0) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Connect timeout reached while connecting to %s:%s (conn-id=%d), shutting down",
+				    conn->host, conn->port, conn->id);
+			nopoll_conn_shutdown (conn);
+			break;
+		} /* end if */
+
+		__nopoll_conn_connect_wait (conn, 10000);
+		remaining_timeout -= 10000;
+	} /* end while */
+
 	/* return connection created */
 	return conn;
 }
@@ -1518,13 +2445,8 @@ nopoll_bool    nopoll_conn_ref (noPollConn * conn)
 	if (conn == NULL)
 		return nopoll_false;
 
-	/* lock the mutex */
-	nopoll_mutex_lock (conn->ref_mutex);
-	conn->refs++;
-	nopoll_mutex_unlock (conn->ref_mutex);
-		
 	/* report */
-	return conn->refs > 1;
+	return nopoll_atomic_inc (&conn->refs) > 1;
 }
 
 /** 
@@ -1539,7 +2461,7 @@ int            nopoll_conn_ref_count (noPollConn * conn)
 {
 	if (! conn)
 		return -1;
-	return conn->refs;
+	return nopoll_atomic_get (&conn->refs);
 }
 
 /** 
@@ -1623,6 +2545,45 @@ nopoll_bool    nopoll_conn_is_tls_on (noPollConn * conn)
 	return conn->tls_on;
 }
 
+/** 
+ * @brief Allows to check if the permessage-deflate extension was
+ * negotiated on the provided connection (see \ref
+ * nopoll_conn_opts_set_permessage_deflate).
+ *
+ * @param conn The connection to check.
+ *
+ * @return nopoll_true in the case messages can be compressed,
+ * otherwise nopoll_false is returned (also when the reference
+ * received is NULL).
+ */
+nopoll_bool    nopoll_conn_is_deflate_on (noPollConn * conn)
+{
+	if (! conn || ! conn->deflate)
+		return nopoll_false;
+
+	return conn->deflate->enabled;
+}
+
+/** 
+ * @brief Allows to check if the TLS handshake of the provided
+ * connection resumed a previous session (see \ref
+ * nopoll_ctx_set_tls_session_reuse) instead of doing a full
+ * handshake.
+ *
+ * @param conn The connection to check.
+ *
+ * @return nopoll_true if the TLS session was resumed, otherwise
+ * nopoll_false is returned (also when TLS is not enabled or conn is
+ * NULL).
+ */
+nopoll_bool    nopoll_conn_tls_session_reused (noPollConn * conn)
+{
+	if (! conn || ! conn->ssl)
+		return nopoll_false;
+
+	return SSL_session_reused (conn->ssl) ? nopoll_true : nopoll_false;
+}
+
 /** 
  * @brief Allows to get the socket associated to this nopoll
  * connection.
@@ -1648,6 +2609,17 @@ void           nopoll_conn_set_socket (noPollConn * conn, NOPOLL_SOCKET _socket)
 {
 	if (conn == NULL)
 		return;
+
+	/* update io engine registration (if any) */
+	if (conn->ctx) {
+		nopoll_mutex_lock (conn->ctx->ref_mutex);
+		__nopoll_io_remove_conn (conn->ctx, conn);
+		conn->session = _socket;
+		__nopoll_io_add_conn (conn->ctx, conn);
+		nopoll_mutex_unlock (conn->ctx->ref_mutex);
+		return;
+	} /* end if */
+
 	conn->session = _socket;
 	return;
 }
@@ -1926,6 +2898,14 @@ void          nopoll_conn_shutdown (noPollConn * conn)
 
 	/* shutdown connection here */
 	if (conn->session != NOPOLL_INVALID_SOCKET) {
+		/* remove socket from io engine before closing it */
+		if (conn->ctx) {
+			nopoll_mutex_lock (conn->ctx->ref_mutex);
+			__nopoll_io_remove_conn (conn->ctx, conn);
+			__nopoll_loop_get (conn->ctx, conn)->io_engine_cleanup = nopoll_true;
+			nopoll_mutex_unlock (conn->ctx->ref_mutex);
+		} /* end if */
+
 	        shutdown (conn->session, SHUT_RDWR);
 		nopoll_close_socket (conn->session);
 	}
@@ -1949,8 +2929,9 @@ void          nopoll_conn_shutdown (noPollConn * conn)
  */ 
 void          nopoll_conn_close_ext  (noPollConn  * conn, int status, const char * reason, int reason_size)
 {
-	int    refs;
-	char * content;
+	int          refs;
+	char       * content;
+	noPollConn * next;
 #if defined(SHOW_DEBUG_LOG)
 	const char * role = "unknown";
 #endif
@@ -1972,6 +2953,14 @@ void          nopoll_conn_close_ext  (noPollConn  * conn, int status, const char
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Calling to close close id=%d (session %d, refs: %d, role: %s)", 
 		    conn->id, conn->session, conn->refs, role);
 #endif
+	/* close listeners opened on the same port for other workers
+	 * (see nopoll_conn_opts_set_reuse_port) */
+	if (conn->role == NOPOLL_ROLE_MAIN_LISTENER && conn->listener_next) {
+		next                = conn->listener_next;
+		conn->listener_next = NULL;
+		nopoll_conn_close (next);
+	} /* end if */
+
 	if (conn->session != NOPOLL_INVALID_SOCKET) {
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "requested proper connection close id=%d (session %d)", conn->id, conn->session);
 
@@ -1998,6 +2987,16 @@ void          nopoll_conn_close_ext  (noPollConn  * conn, int status, const char
 		/* release content (if defined) */
 		nopoll_free (content);
 
+		/* write content queued (including the close frame)
+		 * before shutting down */
+		if (conn->write_queue && nopoll_conn_complete_pending_write (conn) >= 0 && conn->write_queue)
+			nopoll_conn_flush_writes (conn, NOPOLL_CLOSE_FLUSH_TIMEOUT, 0);
+
+		/* send TLS close notify (sessions of connections not
+		 * properly closed can't be resumed) */
+		if (conn->ssl && SSL_is_init_finished (conn->ssl))
+			SSL_shutdown (conn->ssl);
+
 		/* call to shutdown connection */
 		nopoll_conn_shutdown (conn);
 	} /* end if */
@@ -2067,6 +3066,104 @@ noPollPtr     nopoll_conn_get_hook (noPollConn * conn)
 	return conn->hook;
 }
 
+/** 
+ * @brief Allows to configure how many messages are read and notified
+ * from the provided connection each time \ref nopoll_loop_wait finds
+ * it ready, before moving to other connections.
+ *
+ * The loop keeps reading and notifying messages while there is
+ * content available (in the socket or already read into internal
+ * buffers) until the budget is consumed. Content left is notified on
+ * next loop iterations. Lower values favour fairness between
+ * connections, higher values reduce wait operations for busy ones.
+ *
+ * @param conn The connection to configure.
+ *
+ * @param budget Messages to read on each readiness notification (1
+ * or more). Use 0 to use the context value (see \ref
+ * nopoll_ctx_set_read_budget).
+ */
+void          nopoll_conn_set_read_budget (noPollConn * conn, int budget)
+{
+	if (conn == NULL || budget < 0)
+		return;
+	conn->read_budget = budget;
+	return;
+}
+
+/** 
+ * @brief Allows to get the read budget used by the provided
+ * connection (see \ref nopoll_conn_set_read_budget).
+ *
+ * @param conn The connection to check.
+ *
+ * @return The read budget or -1 if conn is NULL.
+ */
+int           nopoll_conn_get_read_budget (noPollConn * conn)
+{
+	if (conn == NULL)
+		return -1;
+	if (conn->read_budget > 0)
+		return conn->read_budget;
+	return nopoll_ctx_get_read_budget (conn->ctx);
+}
+
+/** 
+ * @brief Allows to configure the max message size accepted by the
+ * provided connection. Frames announcing a message bigger than the
+ * limit (all frames of a fragmented message are accumulated) are
+ * rejected before acquiring memory for them: the connection is
+ * closed reporting status 1009 (message too big). Compressed
+ * messages are also checked as they are decompressed.
+ *
+ * @param conn The connection to configure.
+ *
+ * @param max_size Max message size in bytes. Use 0 to use the
+ * context value (see \ref nopoll_ctx_set_max_message_size) or -1 to
+ * accept messages of any size.
+ */
+void          nopoll_conn_set_max_message_size (noPollConn * conn, long max_size)
+{
+	if (conn == NULL || max_size < -1)
+		return;
+	conn->max_message_size = max_size;
+	return;
+}
+
+/** 
+ * @brief Allows to get the max message size accepted by the provided
+ * connection (see \ref nopoll_conn_set_max_message_size).
+ *
+ * @param conn The connection to check.
+ *
+ * @return The max message size in bytes, 0 when there is no limit or
+ * -1 if conn is NULL.
+ */
+long          nopoll_conn_get_max_message_size (noPollConn * conn)
+{
+	if (conn == NULL)
+		return -1;
+	if (conn->max_message_size > 0)
+		return conn->max_message_size;
+	if (conn->max_message_size < 0)
+		return 0;
+	return nopoll_ctx_get_max_message_size (conn->ctx);
+}
+
+/** 
+ * @internal Releases the queue item provided (and the content or
+ * message reference it holds).
+ */
+void __nopoll_conn_free_write_item (noPollWriteItem * item)
+{
+	if (item->msg)
+		nopoll_msg_unref (item->msg);
+	else
+		nopoll_free (item->buffer);
+	nopoll_free (item);
+	return;
+}
+
 /** 
  * @brief Allows to unref connection reference acquired via \ref
  * nopoll_conn_ref.
@@ -2075,21 +3172,16 @@ noPollPtr     nopoll_conn_get_hook (noPollConn * conn)
  */
 void nopoll_conn_unref (noPollConn * conn)
 {
-	int value;
+	int               value;
+	noPollWriteItem * item;
 	
 	if (conn == NULL)
 		return;
 
-	/* acquire here the mutex */
-	nopoll_mutex_lock (conn->ref_mutex);
-
-	conn->refs--;
-	value = conn->refs;
+	value = nopoll_atomic_dec (&conn->refs);
 	
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Releasing connection id %d reference, current ref count status is: %d", 
 		    conn->id, value);
-	/* release here the mutex */
-	nopoll_mutex_unlock (conn->ref_mutex);
 	
 	if (value != 0) 
 		return;
@@ -2098,6 +3190,10 @@ void nopoll_conn_unref (noPollConn * conn)
 	if (conn->pending_msg)
 		nopoll_msg_unref (conn->pending_msg);
 
+	/* release permessage-deflate state (streams are returned to
+	 * the context) */
+	__nopoll_conn_deflate_release (conn);
+
 	/* release ctx */
 	if (conn->ctx) {
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Released context refs, now: %d", conn->ctx->refs);
@@ -2126,10 +3222,18 @@ void nopoll_conn_unref (noPollConn * conn)
 	if (conn->previous_msg) 
 		nopoll_msg_unref (conn->previous_msg);
 
+	/* release read buffer */
+	nopoll_free (conn->read_buf);
+	nopoll_free (conn->io_input);
+	nopoll_free (conn->pending_line);
+
 	if (conn->ssl)
 		SSL_free (conn->ssl);
 	if (conn->ssl_ctx)
 		SSL_CTX_free (conn->ssl_ctx);
+	__nopoll_conn_release_ssl_ctx_cache (conn);
+	nopoll_free (conn->tls_session_key);
+	nopoll_free (conn->connect_init);
 
 	/* release handshake internal data */
 	if (conn->handshake) {
@@ -2138,6 +3242,7 @@ void nopoll_conn_unref (noPollConn * conn)
 		nopoll_free (conn->handshake->websocket_accept);
 		nopoll_free (conn->handshake->expected_accept);
 		nopoll_free (conn->handshake->cookie);
+		nopoll_free (conn->handshake->extensions);
 		nopoll_free (conn->handshake);
 	} /* end if */
 
@@ -2145,8 +3250,12 @@ void nopoll_conn_unref (noPollConn * conn)
 	if (conn->opts && ! conn->opts->reuse)
 		nopoll_conn_opts_free (conn->opts);
 
-	/* release pending write buffer */
-	nopoll_free (conn->pending_write);
+	/* release content queued */
+	while (conn->write_queue) {
+		item              = conn->write_queue;
+		conn->write_queue = item->next;
+		__nopoll_conn_free_write_item (item);
+	} /* end while */
 
 	/* release mutexes */
 	nopoll_mutex_destroy (conn->handshake_mutex);
@@ -2174,9 +3283,13 @@ int nopoll_conn_default_send (noPollConn * conn, char * buffer, int buffer_size)
 }
 
 /** 
- * @internal Read the next line, byte by byte until it gets a \n or
- * maxlen is reached. Some code errors are used to manage exceptions
- * (see return values)
+ * @internal Read the next line (until it gets a \n or maxlen is
+ * reached) from the connection read buffer, reading from the wire as
+ * much content as available each time the buffer has no complete
+ * line. Content after the line (next handshake lines or even early
+ * frames) is kept on the read buffer for the next read
+ * operation. Some code errors are used to manage exceptions (see
+ * return values)
  * 
  * @param connection The connection where the read operation will be done.
  *
@@ -2193,18 +3306,17 @@ int nopoll_conn_default_send (noPollConn * conn, char * buffer, int buffer_size)
  **/
 int          nopoll_conn_readline (noPollConn * conn, char  * buffer, int  maxlen)
 {
-	int         n, rc;
 	int         desp;
-	char        c, *ptr;
+	int         length;
+	int         bytes;
+	char      * start;
+	char      * end;
 #if defined(SHOW_DEBUG_LOG)
 # if !defined(SHOW_FORMAT_BUGS)
 	noPollCtx * ctx = conn->ctx;
 # endif
 #endif
 
-	/* clear the buffer received */
-	/* memset (buffer, 0, maxlen * sizeof (char ));  */
-
 	/* check for pending line read */
 	desp         = 0;
 	if (conn->pending_line) {
@@ -2226,48 +3338,50 @@ int          nopoll_conn_readline (noPollConn * conn, char  * buffer, int  maxle
 		conn->pending_line = NULL;
 	}
 
-	/* read current next line */
-	ptr = (buffer + desp);
-	for (n = 1; n < (maxlen - desp); n++) {
-	nopoll_readline_again:
-		if (( rc = conn->receive (conn, &c, 1)) == 1) {
-			*ptr++ = c;
-			if (c == '\x0A')
-				break;
-		}else if (rc == 0) {
-			if (n == 1)
-				return 0;
-			else
-				break;
-		} else {
-			if (errno == NOPOLL_EINTR) 
-				goto nopoll_readline_again;
-			if ((errno == NOPOLL_EWOULDBLOCK) || (errno == NOPOLL_EAGAIN) || (rc == -2)) {
-				if (n > 0) {
-					/* store content read until now */
-					if ((n + desp - 1) > 0) {
-						buffer[n+desp - 1] = 0;
-						conn->pending_line = nopoll_strdup (buffer);
-					} /* end if */
-				} /* end if */
-				return -2;
-			}
+	while (nopoll_true) {
+		/* take content buffered until the end of line */
+		if (conn->read_buf_end > conn->read_buf_start) {
+			start  = conn->read_buf + conn->read_buf_start;
+			length = conn->read_buf_end - conn->read_buf_start;
+			end    = memchr (start, '\x0A', length);
+			if (end)
+				length = end - start + 1;
+			if ((desp + length) >= maxlen) {
+				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, 
+					    "found line header bigger than allowed size (%d >= maxlen:%d)", desp + length, maxlen);
+				nopoll_conn_shutdown (conn);
+				return -1;
+			} /* end if */
+			memcpy (buffer + desp, start, length);
+			conn->read_buf_start += length;
+			desp                 += length;
 
-			if (nopoll_conn_is_ok (conn) && errno == 0 && rc == 0) {
-				nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "unable to read line, but errno is 0, and connection is ok, return to keep on trying..");
-				return -2;
-			}
-			
-			/* if the conn is closed, just return
-			 * without logging a message */
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "unable to read line, error code errno: %d, rc: %d (%s)", 
-				    errno, rc, strerror (errno));
-			return (-1);
-		}
-	}
-	*ptr = 0;
-	return (n + desp);
+			if (end) {
+				buffer[desp] = 0;
+				return desp;
+			} /* end if */
+		} /* end if */
+
+		/* read as much content as available */
+		bytes = __nopoll_conn_read_buffer_fill (conn);
+		if (bytes < 0)
+			return -1;
+		if (bytes > 0)
+			continue;
+
+		/* connection closed */
+		if (! nopoll_conn_is_ok (conn)) 
+			return 0;
 
+		/* no data: store content read until now */
+		if (desp > 0) {
+			buffer[desp]       = 0;
+			conn->pending_line = nopoll_strdup (buffer);
+		} /* end if */
+		return -2;
+	} /* end while */
+
+	return -1;
 }
 
 /** 
@@ -2292,63 +3406,15 @@ noPollConn  * nopoll_conn_get_listener (noPollConn * conn)
 	return conn->listener;
 }
 
-void __nopoll_pack_content (char * buffer, int start, int bytes)
-{
-	int iterator = 0;
-	while (iterator < bytes) {
-		/* copy bytes to the begining of the array */
-		buffer[iterator] = buffer[start + iterator];
-		
-		/* next position */
-		iterator++;
-	} /* end while */
-
-	return;
-}
-
 /** 
  * @internal Function used to read bytes from the wire. 
  *
  * @return The function returns the number of bytes read, 0 when no
  * bytes were available and -1 when it fails.
  */
-int         __nopoll_conn_receive  (noPollConn * conn, char  * buffer, int  maxlen)
+int         __nopoll_conn_receive_wire  (noPollConn * conn, char  * buffer, int  maxlen)
 {
 	int         nread;
-	int         bytes;
-
-	if (conn->pending_buf_bytes > 0) {
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Calling with bytes we can reuse (%d), requested: %d",
-			    conn->pending_buf_bytes, maxlen);
-
-		if (conn->pending_buf_bytes >= maxlen) {
-			/* we have more in the buffer to serve than
-			 * requested, ok, copy into the buffer and
-			 * pack */
-
-			memcpy (buffer, conn->pending_buf, maxlen);
-			__nopoll_pack_content (conn->pending_buf, maxlen, conn->pending_buf_bytes - maxlen);
-			conn->pending_buf_bytes -= maxlen;
-			return maxlen;
-		} 
-
-		/* ok, we don't have enough bytes to serve
-		 * directly, so copy what we have */
-		memcpy (buffer, conn->pending_buf, conn->pending_buf_bytes);
-
-		/* copy number of bytes served to reduce next request */
-		nread = conn->pending_buf_bytes;
-		conn->pending_buf_bytes = 0;
-
-		/* call again to get bytes reducing the request in the
-		 * amount of bytes served */
-		bytes = __nopoll_conn_receive (conn, buffer + nread, maxlen - nread);
-		if (bytes < 0) {
-			return -1;
-		}
-
-		return bytes + nread;
-	} /* end if */
 
  keep_reading:
 	/* clear buffer */
@@ -2360,10 +3426,10 @@ int         __nopoll_conn_receive  (noPollConn * conn, char  * buffer, int  maxl
 #endif
 	if ((nread = conn->receive (conn, buffer, maxlen)) < 0) {
 		/* nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, " returning errno=%d (%s)", errno, strerror (errno)); */
-		if (errno == NOPOLL_EAGAIN) 
-			return 0;
-		if (errno == NOPOLL_EWOULDBLOCK) 
+		if (errno == NOPOLL_EAGAIN || errno == NOPOLL_EWOULDBLOCK) {
+			conn->read_blocked = nopoll_true;
 			return 0;
+		} /* end if */
 		if (errno == NOPOLL_EINTR) 
 			goto keep_reading;
 		
@@ -2378,6 +3444,7 @@ int         __nopoll_conn_receive  (noPollConn * conn, char  * buffer, int  maxl
 		if (errno == NOPOLL_EAGAIN || errno == NOPOLL_EWOULDBLOCK) {
 			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "unable to read from conn-id=%d (%s:%s), connection is not ready (errno: %d : %s)",
 				    conn->id, conn->host, conn->port, errno, strerror (errno));
+			conn->read_blocked = nopoll_true;
 			return 0;
 		} /* end if */
 
@@ -2387,9 +3454,184 @@ int         __nopoll_conn_receive  (noPollConn * conn, char  * buffer, int  maxl
 		nopoll_conn_shutdown (conn);
 	} /* end if */
 
-	return nread;
+	return nread;
+}
+
+/** 
+ * @internal Function used to read bytes from the wire into the
+ * connection read buffer (as much content as available up to the
+ * free space), moving pending content to the beginning of the buffer
+ * first.
+ *
+ * @return The function returns the number of bytes read, 0 when no
+ * bytes were available and -1 when it fails.
+ */
+int         __nopoll_conn_read_buffer_fill (noPollConn * conn)
+{
+	int pending;
+	int bytes;
+
+	/* create read buffer on first use */
+	if (conn->read_buf == NULL) {
+		conn->read_buf = nopoll_new (char, NOPOLL_READ_BUFFER_SIZE);
+		if (conn->read_buf == NULL) {
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to acquire memory for read buffer, shutting down connection id=%d", conn->id);
+			nopoll_conn_shutdown (conn);
+			return -1;
+		} /* end if */
+	} /* end if */
+
+	/* move pending content to the beginning */
+	pending = conn->read_buf_end - conn->read_buf_start;
+	if (conn->read_buf_start > 0) {
+		if (pending > 0)
+			memmove (conn->read_buf, conn->read_buf + conn->read_buf_start, pending);
+		conn->read_buf_start = 0;
+		conn->read_buf_end   = pending;
+	} /* end if */
+
+	if (pending == NOPOLL_READ_BUFFER_SIZE)
+		return 0;
+
+	bytes = __nopoll_conn_receive_wire (conn, conn->read_buf + pending, NOPOLL_READ_BUFFER_SIZE - pending);
+	if (bytes > 0)
+		conn->read_buf_end += bytes;
+	return bytes;
+}
+
+/** 
+ * @internal Function used to get bytes received: content already
+ * available in the connection read buffer is served first. Small
+ * requests are served by reading into the read buffer as much content
+ * as available (so next frames are parsed from memory) while big
+ * requests are read directly into the caller buffer.
+ *
+ * @return The function returns the number of bytes read, 0 when no
+ * bytes were available and -1 when it fails.
+ */
+int         __nopoll_conn_receive  (noPollConn * conn, char  * buffer, int  maxlen)
+{
+	int         nread = 0;
+	int         bytes;
+
+	/* serve content already read */
+	if (conn->read_buf_end > conn->read_buf_start) {
+		nread = conn->read_buf_end - conn->read_buf_start;
+		if (nread > maxlen)
+			nread = maxlen;
+		memcpy (buffer, conn->read_buf + conn->read_buf_start, nread);
+		conn->read_buf_start += nread;
+		if (nread == maxlen)
+			return nread;
+	} /* end if */
+
+	if ((maxlen - nread) >= NOPOLL_READ_BUFFER_SIZE) {
+		/* big request, read directly */
+		bytes = __nopoll_conn_receive_wire (conn, buffer + nread, maxlen - nread);
+		if (bytes < 0)
+			return -1;
+		return bytes + nread;
+	} /* end if */
+
+	/* small request, read through the read buffer */
+	bytes = __nopoll_conn_read_buffer_fill (conn);
+	if (bytes < 0)
+		return -1;
+	if (bytes > maxlen - nread)
+		bytes = maxlen - nread;
+	memcpy (buffer + nread, conn->read_buf + conn->read_buf_start, bytes);
+	conn->read_buf_start += bytes;
+
+	return bytes + nread;
+}
+
+/** 
+ * @internal Checks if the connection read buffer holds a complete
+ * frame header (2 bytes, extended payload length and mask).
+ *
+ * @param conn The connection to check.
+ *
+ * @param payload_size Reference where the payload size is reported
+ * (127 is reported when the payload size is a 64 bit value).
+ *
+ * @return The header size or 0 if it is not complete.
+ */
+int         __nopoll_conn_buffered_header (noPollConn * conn, long * payload_size)
+{
+	unsigned char * header;
+	int             pending;
+	int             header_size = 2;
+
+	pending = conn->read_buf_end - conn->read_buf_start;
+	if (pending < 2)
+		return 0;
+
+	header        = (unsigned char *) conn->read_buf + conn->read_buf_start;
+	*payload_size = header[1] & 0x7F;
+	if (*payload_size == 126)
+		header_size += 2;
+	else if (*payload_size == 127)
+		header_size += 8;
+	if (nopoll_get_bit (header[1], 7))
+		header_size += 4;
+
+	if (pending < header_size)
+		return 0;
+
+	if (*payload_size == 126)
+		*payload_size = nopoll_get_16bit ((const char *) header + 2);
+	return header_size;
+}
+
+/** 
+ * @internal Checks if the connection read buffer holds a complete
+ * frame (which is not going to be reported by the io engine because
+ * it was already read from the wire).
+ */
+nopoll_bool __nopoll_conn_frame_buffered (noPollConn * conn)
+{
+	int  header_size;
+	long payload_size;
+
+	if (conn->previous_msg)
+		return nopoll_false;
+
+	/* content of the frame being streamed */
+	if (conn->chunk_remain > 0)
+		return conn->read_buf_end > conn->read_buf_start;
+
+	header_size = __nopoll_conn_buffered_header (conn, &payload_size);
+	if (header_size == 0 || payload_size == 127)
+		return nopoll_false;
+
+	return (conn->read_buf_end - conn->read_buf_start) >= (header_size + payload_size);
+}
+
+/** 
+ * @internal Checks if there is content already read that is not
+ * going to be reported by the io engine: a complete frame in the read
+ * buffer, content received by a completion based io engine or
+ * decrypted content retained by OpenSSL.
+ *
+ * @param conn The connection to check.
+ */
+nopoll_bool __nopoll_conn_data_pending (noPollConn * conn)
+{
+	if (__nopoll_conn_frame_buffered (conn))
+		return nopoll_true;
+
+	/* received by the io engine but not read yet */
+	if (conn->io_input_end > conn->io_input_start)
+		return nopoll_true;
+
+	/* records already read from the socket by OpenSSL */
+	if (conn->ssl && SSL_pending (conn->ssl) > 0)
+		return nopoll_true;
+
+	return nopoll_false;
 }
 
+
 nopoll_bool nopoll_conn_get_http_url (noPollConn * conn, const char * buffer, int buffer_size, const char * method, char ** url)
 {
 	int          iterator;
@@ -2629,6 +3871,7 @@ nopoll_bool nopoll_conn_complete_handshake_check_listener (noPollCtx * ctx, noPo
 	char                 * accept_key;
 	const char           * protocol;
 	nopoll_bool            origin_check;
+	char                 * extensions;
 
 	/* call to check listener handshake */
 	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Checking client handshake data..");
@@ -2684,6 +3927,9 @@ nopoll_bool nopoll_conn_complete_handshake_check_listener (noPollCtx * ctx, noPo
 
 	/* produce accept key */
 	accept_key = nopoll_conn_produce_accept_key (ctx, conn->handshake->websocket_key);
+
+	/* permessage-deflate negotiation (if configured) */
+	extensions = __nopoll_conn_deflate_accept (ctx, conn);
 	
 	/* ok, send handshake reply */
 	if (conn->protocols || conn->accepted_protocol) {
@@ -2694,15 +3940,18 @@ nopoll_bool nopoll_conn_complete_handshake_check_listener (noPollCtx * ctx, noPo
 			protocol = conn->protocols;
 
 		/* send accept header accepting protocol requested by the user */
-		reply = nopoll_strdup_printf ("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\nSec-WebSocket-Protocol: %s\r\n\r\n", 
-					      accept_key, protocol);
+		reply = nopoll_strdup_printf ("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\nSec-WebSocket-Protocol: %s%s%s\r\n\r\n", 
+					      accept_key, protocol,
+					      extensions ? "\r\nSec-WebSocket-Extensions: " : "", extensions ? extensions : "");
 	} else {
 		/* send accept header without telling anything about protocols */
-		reply = nopoll_strdup_printf ("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", 
-					      accept_key);
+		reply = nopoll_strdup_printf ("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s%s%s\r\n\r\n", 
+					      accept_key,
+					      extensions ? "\r\nSec-WebSocket-Extensions: " : "", extensions ? extensions : "");
 	}
 		
 	nopoll_free (accept_key);
+	nopoll_free (extensions);
 	if (reply == NULL) {
 		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to build reply, closing session");
 		return nopoll_false;
@@ -2752,6 +4001,12 @@ nopoll_bool nopoll_conn_complete_handshake_check_client (noPollCtx * ctx, noPoll
 	}
 	nopoll_free (accept);
 
+	/* check permessage-deflate reply */
+	if (result && ! __nopoll_conn_deflate_check_reply (ctx, conn)) {
+		nopoll_conn_shutdown (conn);
+		return nopoll_false;
+	} /* end if */
+
 	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Sec-Websocket-Accept matches expected value..nopoll_conn_complete_handshake_check_client (%p, %p)=%d",
 		    ctx, conn, result);
 
@@ -2792,6 +4047,27 @@ void nopoll_conn_complete_handshake_check (noPollConn * conn)
 	return;
 }
 
+/** 
+ * @internal Records the Sec-WebSocket-Extensions value received
+ * (joined with previous values when the header is repeated),
+ * releasing the value provided.
+ */
+void __nopoll_conn_add_extensions (noPollConn * conn, char * value)
+{
+	char * joined;
+
+	if (conn->handshake->extensions == NULL) {
+		conn->handshake->extensions = value;
+		return;
+	} /* end if */
+
+	joined = nopoll_strdup_printf ("%s, %s", conn->handshake->extensions, value);
+	nopoll_free (conn->handshake->extensions);
+	nopoll_free (value);
+	conn->handshake->extensions = joined;
+	return;
+}
+
 /** 
  * @internal Handler that implements one step of the websocket
  * listener handshake received from client, until it is completed.
@@ -2857,6 +4133,9 @@ int nopoll_conn_complete_handshake_listener (noPollCtx * ctx, noPollConn * conn,
 	} else if (strcasecmp (header, "Cookie") == 0) {
 		/* record cookie so it can be used by the application level */
 		conn->handshake->cookie = value;
+	} else if (strcasecmp (header, "Sec-WebSocket-Extensions") == 0) {
+		/* extensions requested (see __nopoll_conn_deflate_accept) */
+		__nopoll_conn_add_extensions (conn, value);
 	} else {
 		/* release value, no body claimed it */
 		nopoll_free (value);
@@ -2926,6 +4205,9 @@ int nopoll_conn_complete_handshake_client (noPollCtx * ctx, noPollConn * conn, c
 	} else if (strcasecmp (header, "Connection") == 0) {
 		conn->handshake->connection_upgrade = 1;
 		nopoll_free (value);
+	} else if (strcasecmp (header, "Sec-WebSocket-Extensions") == 0) {
+		/* extensions accepted (see __nopoll_conn_deflate_check_reply) */
+		__nopoll_conn_add_extensions (conn, value);
 	} else {
 		/* release value, no body claimed it */
 		nopoll_free (value);
@@ -2954,6 +4236,15 @@ void nopoll_conn_complete_handshake (noPollConn * conn)
 	if (conn->handshake_ok)
 		return;
 
+	/* client connect still in progress (see
+	 * nopoll_conn_opts_set_async_connect) */
+	if (! __nopoll_conn_connect_step (conn))
+		return;
+
+	/* write client init queued */
+	if (conn->write_queue)
+		nopoll_conn_complete_pending_write (conn);
+
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Checking to complete conn-id=%d WebSocket handshake, role %d", conn->id, conn->role);
 
 	/* ensure handshake object is created */
@@ -3010,21 +4301,320 @@ void nopoll_conn_complete_handshake (noPollConn * conn)
 	return;
 }
 
-void nopoll_conn_mask_content (noPollCtx * ctx, char * payload, int payload_size, char * mask, int desp)
+/** 
+ * @internal Masking kernels: all of them apply the provided mask
+ * (already rotated, so mask[0] applies to payload[0]) to the
+ * payload. Vector kernels process blocks and pass the rest to the
+ * next smaller kernel (blocks are multiple of 4 bytes so the mask
+ * rotation is kept).
+ */
+void __nopoll_conn_mask_bytes (char * payload, int payload_size, const unsigned char * mask)
 {
-	int iter       = 0;
-	int mask_index = 0;
+	int iter = 0;
 
 	while (iter < payload_size) {
-		/* rotate mask and apply it */
-		mask_index = (iter + desp) % 4;
-		payload[iter] ^= mask[mask_index];
+		payload[iter] ^= mask[iter & 3];
 		iter++;
 	} /* end while */
 
 	return;
-} 
+}
+
+void __nopoll_conn_mask_words (char * payload, int payload_size, const unsigned char * mask)
+{
+	unsigned long word;
+	unsigned long value;
+	int           iter;
+
+	/* repeat the mask over a machine word */
+	for (iter = 0; iter < (int) sizeof (word); iter++)
+		((unsigned char *) &word)[iter] = mask[iter & 3];
+
+	/* memcpy is used to allow unaligned payloads (translated
+	 * into plain loads/stores by the compiler) */
+	iter = 0;
+	while (iter + (int) sizeof (word) <= payload_size) {
+		memcpy (&value, payload + iter, sizeof (value));
+		value ^= word;
+		memcpy (payload + iter, &value, sizeof (value));
+		iter += sizeof (word);
+	} /* end while */
+
+	__nopoll_conn_mask_bytes (payload + iter, payload_size - iter, mask);
+	return;
+}
+
+#if defined(__SSE2__)
+void __nopoll_conn_mask_sse2 (char * payload, int payload_size, const unsigned char * mask)
+{
+	__m128i word;
+	__m128i value;
+	int     iter;
+
+	word = _mm_set1_epi32 ((int) (mask[0] | (mask[1] << 8) | (mask[2] << 16) | ((unsigned int) mask[3] << 24)));
+
+	iter = 0;
+	while (iter + 16 <= payload_size) {
+		value = _mm_loadu_si128 ((__m128i *) (payload + iter));
+		_mm_storeu_si128 ((__m128i *) (payload + iter), _mm_xor_si128 (value, word));
+		iter += 16;
+	} /* end while */
+
+	__nopoll_conn_mask_words (payload + iter, payload_size - iter, mask);
+	return;
+}
+#endif
+
+#if defined(NOPOLL_HAVE_AVX2)
+__attribute__ ((target ("avx2")))
+void __nopoll_conn_mask_avx2 (char * payload, int payload_size, const unsigned char * mask)
+{
+	__m256i word;
+	__m256i value;
+	int     iter;
+
+	word = _mm256_set1_epi32 ((int) (mask[0] | (mask[1] << 8) | (mask[2] << 16) | ((unsigned int) mask[3] << 24)));
+
+	iter = 0;
+	while (iter + 32 <= payload_size) {
+		value = _mm256_loadu_si256 ((__m256i *) (payload + iter));
+		_mm256_storeu_si256 ((__m256i *) (payload + iter), _mm256_xor_si256 (value, word));
+		iter += 32;
+	} /* end while */
+
+	__nopoll_conn_mask_words (payload + iter, payload_size - iter, mask);
+	return;
+}
+#endif
+
+#if defined(NOPOLL_HAVE_NEON)
+void __nopoll_conn_mask_neon (char * payload, int payload_size, const unsigned char * mask)
+{
+	uint8_t    pattern[16];
+	uint8x16_t word;
+	uint8x16_t value;
+	int        iter;
+
+	for (iter = 0; iter < 16; iter++)
+		pattern[iter] = mask[iter & 3];
+	word = vld1q_u8 (pattern);
+
+	iter = 0;
+	while (iter + 16 <= payload_size) {
+		value = vld1q_u8 ((uint8_t *) (payload + iter));
+		vst1q_u8 ((uint8_t *) (payload + iter), veorq_u8 (value, word));
+		iter += 16;
+	} /* end while */
+
+	__nopoll_conn_mask_words (payload + iter, payload_size - iter, mask);
+	return;
+}
+#endif
+
+/** 
+ * @internal Masking kernel selected for the running CPU (on first
+ * use, see __nopoll_conn_mask_kernel_select).
+ */
+void (*__nopoll_conn_mask_kernel) (char * payload, int payload_size, const unsigned char * mask) = NULL;
+
+void __nopoll_conn_mask_kernel_select (void)
+{
+#if defined(NOPOLL_HAVE_AVX2)
+	if (__builtin_cpu_supports ("avx2")) {
+		__nopoll_conn_mask_kernel = __nopoll_conn_mask_avx2;
+		return;
+	} /* end if */
+#endif
+#if defined(__SSE2__)
+	__nopoll_conn_mask_kernel = __nopoll_conn_mask_sse2;
+#elif defined(NOPOLL_HAVE_NEON)
+	__nopoll_conn_mask_kernel = __nopoll_conn_mask_neon;
+#else
+	__nopoll_conn_mask_kernel = __nopoll_conn_mask_words;
+#endif
+	return;
+}
+
+/** 
+ * @brief Applies (or removes) the provided websocket mask to the
+ * payload, using vector instructions when available.
+ *
+ * @param ctx The context where the operation takes place.
+ *
+ * @param payload The content to mask/unmask (updated in place).
+ *
+ * @param payload_size The amount of bytes to mask.
+ *
+ * @param mask The 4 bytes mask to apply.
+ *
+ * @param desp Offset of the payload inside the frame (masks are
+ * applied from the frame start, used for frames received in
+ * several reads).
+ */
+void nopoll_conn_mask_content (noPollCtx * ctx, char * payload, int payload_size, char * mask, int desp)
+{
+	unsigned char rotated[4];
+	int           iter;
+
+	if (payload_size <= 0)
+		return;
+
+	/* rotate mask so it starts at the payload offset */
+	for (iter = 0; iter < 4; iter++)
+		rotated[iter] = (unsigned char) mask[(iter + desp) % 4];
+
+	/* small payloads (control frames) */
+	if (payload_size < 16) {
+		__nopoll_conn_mask_bytes (payload, payload_size, rotated);
+		return;
+	} /* end if */
+
+	/* select kernel on first use (selection always produces the
+	 * same value, so concurrent calls are harmless) */
+	if (__nopoll_conn_mask_kernel == NULL)
+		__nopoll_conn_mask_kernel_select ();
+
+	__nopoll_conn_mask_kernel (payload, payload_size, rotated);
+	return;
+}
+
+
+/** 
+ * @internal Checks the frame received against the max message size
+ * configured (see nopoll_conn_set_max_message_size), before acquiring
+ * memory for it. Frames of a fragmented message are accumulated.
+ *
+ * @return nopoll_false if the message goes beyond the limit.
+ */
+nopoll_bool __nopoll_conn_message_size_check (noPollConn * conn, noPollMsg * msg)
+{
+	long limit;
+
+	/* control frames are bounded by the protocol */
+	if (msg->op_code >= NOPOLL_CLOSE_FRAME)
+		return nopoll_true;
+
+	/* first frame of a message */
+	if (msg->op_code != NOPOLL_CONTINUATION_FRAME)
+		conn->message_bytes = 0;
+	conn->message_bytes += msg->payload_size;
+
+	limit = nopoll_conn_get_max_message_size (conn);
+	return limit == 0 || conn->message_bytes <= limit;
+}
+
+/** 
+ * @internal Closes the connection provided because a message bigger
+ * than allowed was received, reporting status 1009 (message too
+ * big) to the remote peer.
+ */
+void __nopoll_conn_close_too_big (noPollConn * conn)
+{
+	char status[2];
+
+	nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Received message bigger than max message size allowed (%ld bytes) over conn-id=%d, closing session", 
+		    nopoll_conn_get_max_message_size (conn), conn->id);
+
+	nopoll_set_16bit (1009, status);
+	nopoll_conn_send_frame (conn, nopoll_true, conn->role == NOPOLL_ROLE_CLIENT, NOPOLL_CLOSE_FRAME, 2, status, 0);
+	if (conn->write_queue && nopoll_conn_complete_pending_write (conn) >= 0 && conn->write_queue)
+		nopoll_conn_flush_writes (conn, NOPOLL_CLOSE_FLUSH_TIMEOUT, 0);
+
+	nopoll_conn_shutdown (conn);
+	return;
+}
+
+/** 
+ * @internal Feeds the content of the frame being streamed (see
+ * nopoll_conn_set_on_frame_chunk) to the on frame chunk handler:
+ * content already in the connection read buffer is delivered and, if
+ * more is pending, the buffer is filled once from the wire (so the
+ * caller isn't blocked).
+ */
+void __nopoll_conn_read_chunks (noPollConn * conn)
+{
+	nopoll_bool                 filled = nopoll_false;
+	nopoll_bool                 final;
+	nopoll_bool                 is_last;
+	char                      * chunk;
+	char                      * buffer;
+	long                        length;
+	int                         bytes;
+
+	/* keep the connection while the handler is notified (it may
+	 * close it) */
+	nopoll_conn_ref (conn);
+	while (conn->chunk_remain > 0 && nopoll_conn_is_ok (conn)) {
+		/* read more content */
+		if (conn->read_buf_end == conn->read_buf_start) {
+			if (filled)
+				break;
+			filled = nopoll_true;
+			bytes  = __nopoll_conn_read_buffer_fill (conn);
+			if (bytes < 0) {
+				nopoll_conn_shutdown (conn);
+				break;
+			} /* end if */
+			continue;
+		} /* end if */
+
+		/* next chunk (up to the end of the frame) */
+		chunk  = conn->read_buf + conn->read_buf_start;
+		length = conn->read_buf_end - conn->read_buf_start;
+		if (length > conn->chunk_remain)
+			length = conn->chunk_remain;
+		conn->read_buf_start += length;
+		conn->chunk_remain   -= length;
+
+		if (conn->chunk_masked) {
+			nopoll_conn_mask_content (conn->ctx, chunk, length, conn->chunk_mask, (int) (conn->chunk_desp % 4));
+			conn->chunk_desp += length;
+		} /* end if */
+		is_last = conn->chunk_remain == 0 && conn->chunk_fin;
+
+		/* decompress content (permessage-deflate) */
+		buffer = NULL;
+		if (conn->deflate && conn->deflate->frame_compressed) {
+			final = conn->deflate->frame_fin && conn->chunk_remain == 0;
+			if (! __nopoll_conn_inflate_content (conn, chunk, length, final, &buffer, &length)) {
+				nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to decompress frame received, closing session id: %d", conn->id);
+				nopoll_conn_shutdown (conn);
+				break;
+			} /* end if */
+			if (final)
+				conn->deflate->inflating = nopoll_false;
+			chunk = buffer;
+		} /* end if */
+
+		/* notify content (parts without content decompressed
+		 * are skipped but the last one) to the handler taken
+		 * when the message started (even if it was changed
+		 * meanwhile) */
+		if (conn->chunk_handler && (length > 0 || is_last))
+			conn->chunk_handler (conn->ctx, conn, (noPollOpCode) conn->chunk_op_code, chunk, length, conn->chunk_offset, is_last, conn->chunk_handler_data);
+		nopoll_free (buffer);
+
+		/* next message starts at 0 (with the handler
+		 * configured at that time) */
+		conn->chunk_offset = is_last ? 0 : conn->chunk_offset + length;
+		if (is_last) {
+			conn->chunk_handler      = NULL;
+			conn->chunk_handler_data = NULL;
+		} /* end if */
+	} /* end while */
+	nopoll_conn_unref (conn);
+
+	return;
+}
 
+/** 
+ * @internal Checks if the provided connection streams messages
+ * received (see nopoll_conn_set_on_frame_chunk).
+ */
+nopoll_bool __nopoll_conn_streaming (noPollConn * conn)
+{
+	return conn->on_frame_chunk != NULL || conn->ctx->on_frame_chunk != NULL;
+}
 
 /** 
  * @brief Allows to get the next message available on the provided
@@ -3051,22 +4641,38 @@ void nopoll_conn_mask_content (noPollCtx * ctx, char * payload, int payload_size
  */
 noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 {
-	char        buffer[20];
-	int         bytes;
-	noPollMsg * msg;
-	int         ssl_error;
-	int         header_size = 2;
+	int             bytes;
+	noPollMsg     * msg;
+	int             ssl_error;
+	int             header_size;
+	long            payload_size;
+	unsigned char * header;
 #if defined(SHOW_DEBUG_LOG)
-	long        result;
+	long            result;
 #endif
-	unsigned char *len;
+	unsigned char * len;
+	nopoll_bool     final;
 
 	if (conn == NULL)
 		return NULL;
 
+	/* updated by the reads done below (see
+	 * __nopoll_conn_receive_wire) */
+	conn->read_blocked = nopoll_false;
+
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, 
 		    "=== START: conn-id=%d (errno=%d, session: %d, conn->handshake_ok: %d, conn->pending_ssl_accept: %d) ===", 
 		    conn->id, errno, conn->session, conn->handshake_ok, conn->pending_ssl_accept);
+
+	/* client connect still in progress (see
+	 * nopoll_conn_opts_set_async_connect) */
+	if (! __nopoll_conn_connect_step (conn))
+		return NULL;
+
+	/* progress content queued (connections not watched by a
+	 * loop only write it on the next operation) */
+	if (conn->write_queue)
+		nopoll_conn_complete_pending_write (conn);
 	
 	/* check for accept SSL connection */
 	if (conn->pending_ssl_accept) {
@@ -3104,6 +4710,7 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 		/* ssl accept */
 		conn->pending_ssl_accept = nopoll_false;
 		nopoll_conn_set_sock_block (conn->session, nopoll_false);
+		__nopoll_conn_tls_handshake_done (conn);
 
 #if defined(SHOW_DEBUG_LOG)
 		result = SSL_get_verify_result (conn->ssl);
@@ -3156,21 +4763,19 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 			return NULL;
 	} /* end if */
 
+	/* continue with the frame being streamed */
+	if (conn->chunk_remain > 0) {
+		__nopoll_conn_read_chunks (conn);
+		return NULL;
+	} /* end if */
+
 	if (conn->previous_msg) {
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Reading bytes (previously read %d) from a previous unfinished frame (pending: %d) over conn-id=%d",
 			    conn->previous_msg->payload_size, conn->previous_msg->remain_bytes, conn->id);
 
-		if (conn->read_pending_header) {
-			/* detected pending read header, continue from here */
-			msg                       = conn->previous_msg;
-			conn->previous_msg        = NULL;
-			conn->read_pending_header = nopoll_false;
-			goto read_pending_header;
-		} /* end if */
-		
 		/* build next message holder to continue with this content */
-		if (conn->previous_msg->payload_size > 0) {
-			msg = nopoll_msg_new ();
+		if (conn->previous_msg_ref) {
+			msg = __nopoll_msg_new (conn->ctx);
 			if (msg == NULL) {
 				nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Failed to allocate memory for received message, closing session id: %d", 
 					    conn->id);
@@ -3209,7 +4814,7 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 
 			/* update remaining bytes */
 			msg->payload_size = msg->remain_bytes;
-			nopoll_free (msg->payload);
+			__nopoll_msg_buffer_release (msg);
 			nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "reusing noPollMsg reference (%p) since last payload read was 0, remaining: %d", msg,
 				    msg->payload_size);
 		}
@@ -3243,41 +4848,46 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 	*/
 	/* nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Found data in opened connection id %d..", conn->id);*/ 
 
-	/* get the first 2 bytes from the websocket header */
-	bytes = __nopoll_conn_receive (conn, buffer, 2);
-	if (bytes == 0) {
-		/* connection not ready */
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Connection id=%d without data, errno=%d : %s, returning no message", 
-			    conn->id, errno, strerror (errno));
-		return NULL;
-	}
+	/* get the complete websocket header (2 bytes, extended
+	 * payload length and mask) into the read buffer: content is
+	 * read once with all bytes available so the header (and
+	 * usually the payload) are parsed from memory */
+	header_size = __nopoll_conn_buffered_header (conn, &payload_size);
+	if (header_size == 0) {
+		bytes = __nopoll_conn_read_buffer_fill (conn);
+		if (bytes == 0) {
+			/* connection not ready */
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Connection id=%d without data, errno=%d : %s, returning no message", 
+				    conn->id, errno, strerror (errno));
+			return NULL;
+		}
 
-	if (bytes <= 0) {
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Received connection close, finishing connection session");
-		nopoll_conn_shutdown (conn);
-		return NULL;
-	} /* end if */
+		if (bytes < 0) {
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Received connection close, finishing connection session");
+			nopoll_conn_shutdown (conn);
+			return NULL;
+		} /* end if */
 
-	if (bytes != 2) { 
-		/* ok, store content read into the pending buffer for next call */
-		memcpy (conn->pending_buf + conn->pending_buf_bytes, buffer, bytes);
-		conn->pending_buf_bytes += bytes;
-		
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, 
-			    "Expected to receive complete websocket frame header but found only %d bytes over conn-id=%d, saving to reuse later",
-			    bytes, conn->id);
-		return NULL;
+		header_size = __nopoll_conn_buffered_header (conn, &payload_size);
+		if (header_size == 0) {
+			/* keep content read in the buffer for next call */
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, 
+				    "Expected to receive complete websocket frame header but found only %d bytes over conn-id=%d, saving to reuse later",
+				    conn->read_buf_end - conn->read_buf_start, conn->id);
+			return NULL;
+		} /* end if */
 	} /* end if */
 
-	/* record header size */
-	header_size = 2;
+	/* header is consumed from here */
+	header                = (unsigned char *) conn->read_buf + conn->read_buf_start;
+	conn->read_buf_start += header_size;
 
-	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Received %d bytes for websocket header", bytes);
-	nopoll_show_byte (conn->ctx, buffer[0], "header[0]");
-	nopoll_show_byte (conn->ctx, buffer[1], "header[1]");
+	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Received %d bytes for websocket header", header_size);
+	nopoll_show_byte (conn->ctx, header[0], "header[0]");
+	nopoll_show_byte (conn->ctx, header[1], "header[1]");
 
 	/* build next message */
-	msg = nopoll_msg_new ();
+	msg = __nopoll_msg_new (conn->ctx);
 	if (msg == NULL) {
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Failed to allocate memory for received message, closing session id: %d", 
 			    conn->id);
@@ -3286,10 +4896,10 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 	} /* end if */
 
 	/* get fin bytes */
-	msg->has_fin      = nopoll_get_bit (buffer[0], 7);
-	msg->op_code      = buffer[0] & 0x0F;
-	msg->is_masked    = nopoll_get_bit (buffer[1], 7);
-	msg->payload_size = buffer[1] & 0x7F;
+	msg->has_fin      = nopoll_get_bit (header[0], 7);
+	msg->op_code      = header[0] & 0x0F;
+	msg->is_masked    = nopoll_get_bit (header[1], 7);
+	msg->payload_size = payload_size;
 
 	/* ensure FIN = 1 in case we are listener */
 	if (conn->role == NOPOLL_ROLE_LISTENER && ! msg->is_masked) {
@@ -3300,68 +4910,21 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 		return NULL;
 	} /* end if */
 
-	/* check payload size value */
-	if (msg->payload_size < 0) {
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Received wrong payload size at first 7 bits, closing session id: %d", 
-			    conn->id);
+	/* RSV1 flags compressed messages (permessage-deflate),
+	 * otherwise it must be zero */
+	if (! __nopoll_conn_deflate_frame (conn, msg, nopoll_get_bit (header[0], 6))) {
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Received websocket frame with RSV1 bit set but not expected (op code %d), closing session id: %d", 
+			    msg->op_code, conn->id);
 		nopoll_msg_unref (msg);
 		nopoll_conn_shutdown (conn);
 		return NULL;
 	} /* end if */
 
- read_pending_header:
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "interim payload size received: %d", (int) msg->payload_size);
 
-	/* read the rest */
-	if (msg->payload_size < 126) {
-		/* nothing to declare here */
-
-	} else if (msg->payload_size == 126) {
-		/* get extended 2 bytes length as unsigned 16 bit
-		   unsigned integer */
-		bytes = __nopoll_conn_receive (conn, buffer + 2, 2);
-		if (bytes != 2) {
-			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Failed to get next 2 bytes to read header from the wire, but received=%d, failed to received content, shutting down id=%d the connection, errno=%d (%s)",
-				    bytes, conn->id, errno, strerror (errno));
-			if (errno == NOPOLL_EWOULDBLOCK || errno == 0) { 
-				/* connection is not ready at this point */
-				conn->previous_msg = msg;
-				conn->read_pending_header = nopoll_true;
-
-				/* check amount of bytes to reuse them */
-				nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Detected broken WebSocket peer sending header content using different frames, trying to save and resume later");
-				if (bytes > 0) {
-					/* ok, store content read into the pending buffer for next call */
-					memcpy (conn->pending_buf + conn->pending_buf_bytes, buffer + 2, bytes);
-					conn->pending_buf_bytes += bytes;
-				}
-				
-				return NULL;
-			}
-
-			nopoll_msg_unref (msg);
-			nopoll_conn_shutdown (conn);
-			return NULL; 	
-		} /* end if */
-
-		/* add to the header bytes read */
-		header_size += bytes;
-			
-		msg->payload_size = nopoll_get_16bit (buffer + 2);
-
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Received (%d) bytes in header (size %d) for payload size indication, which finally is: %d", bytes, header_size,(int) msg->payload_size);
-		
-	} else if (msg->payload_size == 127) {
-		/* read more content (next 8 bytes) */
-		if ((bytes = __nopoll_conn_receive (conn, buffer, 8)) != 8) {
-			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, 
-				    "Expected to receive next 6 bytes for websocket frame header but found only %d bytes, closing session: %d",
-				    bytes, conn->id);
-			nopoll_conn_shutdown (conn);
-			return NULL;
-		} /* end if */
-
-                len = (unsigned char*)buffer;
+	if (msg->payload_size == 127) {
+		/* get extended 8 bytes length */
+                len = header + 2;
 		msg->payload_size = 0;
 #if defined(NOPOLL_64BIT_PLATFORM)
 		msg->payload_size |= ((long)(len[0]) << 56);
@@ -3382,6 +4945,17 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 		msg->payload_size |= len[7];
 	} /* end if */
 
+	/* get mask (last 4 bytes of the header) */
+	if (msg->is_masked) {
+		memcpy (msg->mask, header + header_size - 4, 4);
+		
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Received mask value = %d", nopoll_get_32bit (msg->mask));
+		nopoll_show_byte (conn->ctx, msg->mask[0], "mask[0]");
+		nopoll_show_byte (conn->ctx, msg->mask[1], "mask[1]");
+		nopoll_show_byte (conn->ctx, msg->mask[2], "mask[2]");
+		nopoll_show_byte (conn->ctx, msg->mask[3], "mask[3]");
+	} /* end if */
+
 	if (msg->op_code == NOPOLL_PONG_FRAME) {
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "PONG received over connection id=%d", conn->id);
 		nopoll_msg_unref (msg);
@@ -3408,41 +4982,6 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 			    conn->id, msg->payload_size);
 	} /* end if */
 
-	/* get more bytes */
-	if (msg->is_masked) {
-		bytes = __nopoll_conn_receive (conn, (char *) msg->mask, 4);
-		if (bytes != 4) {
-			/* record header read so far */
-			memcpy (conn->pending_buf, buffer, header_size);
-			conn->pending_buf_bytes = header_size;
-			/* record mask read so far if required */
-			if (bytes > 0) {
-				memcpy (conn->pending_buf + header_size, msg->mask, bytes);
-				conn->pending_buf_bytes += bytes;
-			} /* end if */
-
-			/* release message because it not available here */
-			nopoll_msg_unref (msg);
-			if (bytes >= 0 && nopoll_conn_is_ok (conn)) {
-				nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, 
-					    "Expected to receive incoming mask after header (4 bytes) but found %d bytes on conn-id=%d, saving %d for future operations ", 
-					    bytes, conn->id, conn->pending_buf_bytes);
-				return NULL;
-			} /* end if */
-
-			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Expected to receive incoming mask after header (4 bytes) but found %d bytes, shutting down id=%d the connection", 
-				    bytes, conn->id);
-			nopoll_conn_shutdown (conn);
-			return NULL; 
-		} /* end if */
-		
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Received mask value = %d", nopoll_get_32bit (msg->mask));
-		nopoll_show_byte (conn->ctx, msg->mask[0], "mask[0]");
-		nopoll_show_byte (conn->ctx, msg->mask[1], "mask[1]");
-		nopoll_show_byte (conn->ctx, msg->mask[2], "mask[2]");
-		nopoll_show_byte (conn->ctx, msg->mask[3], "mask[3]");
-	} /* end if */
-
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Detected incoming websocket frame: fin(%d), op_code(%d), is_masked(%d), payload size(%ld), mask=%d", 
 		    msg->has_fin, msg->op_code, msg->is_masked, msg->payload_size, nopoll_get_32bit (msg->mask));
 
@@ -3468,13 +5007,39 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 		return NULL; 	
 	} /* end if */
 
-	/* check here for the limit of message we are willing to accept */
-	/* FIX SECURITY ISSUE */
+	/* check here for the limit of message we are willing to
+	 * accept (before acquiring memory for it) */
+	if (! __nopoll_conn_message_size_check (conn, msg)) {
+		nopoll_msg_unref (msg);
+		__nopoll_conn_close_too_big (conn);
+		return NULL;
+	} /* end if */
+
+	/* stream data frames to the on frame chunk handler instead
+	 * of buffering them (continuation frames follow what was
+	 * decided for the first frame of the message) */
+	if (msg->op_code < NOPOLL_CLOSE_FRAME && 
+	    (msg->op_code == NOPOLL_CONTINUATION_FRAME ? conn->chunk_handler != NULL : __nopoll_conn_streaming (conn))) {
+		if (msg->op_code != NOPOLL_CONTINUATION_FRAME) {
+			conn->chunk_op_code      = msg->op_code;
+			conn->chunk_handler      = conn->on_frame_chunk ? conn->on_frame_chunk : conn->ctx->on_frame_chunk;
+			conn->chunk_handler_data = conn->on_frame_chunk ? conn->on_frame_chunk_data : conn->ctx->on_frame_chunk_data;
+		} /* end if */
+		conn->chunk_fin    = msg->has_fin;
+		conn->chunk_masked = msg->is_masked;
+		memcpy (conn->chunk_mask, msg->mask, 4);
+		conn->chunk_remain = msg->payload_size;
+		conn->chunk_desp   = 0;
+		nopoll_msg_unref (msg);
+
+		__nopoll_conn_read_chunks (conn);
+		return NULL;
+	} /* end if */
 
 read_payload:
 
 	/* copy payload received */
-	msg->payload = nopoll_new (char, msg->payload_size + 1);	/* allow extra byte for string terminator */
+	msg->payload = __nopoll_msg_buffer_get (msg, msg->payload_size + 1);	/* allow extra byte for string terminator */
 	if (msg->payload == NULL) {
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to acquire memory to read the incoming frame, dropping connection id=%d", conn->id);
 		nopoll_msg_unref (msg);
@@ -3508,7 +5073,8 @@ read_payload:
 		   to the caller (see next lines) */
 		if (bytes > 0)
 			nopoll_msg_ref (msg);
-		conn->previous_msg = msg;
+		conn->previous_msg     = msg;
+		conn->previous_msg_ref = bytes > 0;
 
 		/* flag this message as a fragment */
 		msg->is_fragment = nopoll_true;
@@ -3541,6 +5107,33 @@ read_payload:
 		msg->unmask_desp += msg->payload_size;
 	} /* end if */
 
+	/* decompress content (permessage-deflate) */
+	if (conn->deflate && conn->deflate->frame_compressed) {
+		final = conn->deflate->frame_fin && msg->remain_bytes == 0;
+		if (! __nopoll_conn_inflate (conn, msg, final)) {
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to decompress frame received, closing session id: %d", conn->id);
+			if (msg == conn->previous_msg) {
+				conn->previous_msg = NULL;
+				if (conn->previous_msg_ref)
+					nopoll_msg_unref (msg);
+			} /* end if */
+			nopoll_msg_unref (msg);
+			nopoll_conn_shutdown (conn);
+			return NULL;
+		} /* end if */
+		if (final)
+			conn->deflate->inflating = nopoll_false;
+
+		/* do not notify parts without content decompressed
+		 * (but the last one) */
+		if (msg->payload_size == 0 && ! final) {
+			if (msg == conn->previous_msg) 
+				conn->previous_msg_ref = nopoll_false;
+			nopoll_msg_unref (msg);
+			return NULL;
+		} /* end if */
+	} /* end if */
+
 	/* check here close frame with reason */
 	if (msg->op_code == NOPOLL_CLOSE_FRAME) {
 
@@ -3653,7 +5246,7 @@ int           __nopoll_conn_send_common (noPollConn * conn, const char * content
  *   N : number of bytes sent (user land bytes sent, without including web socket headers).
  *   0 : no bytes sent (see errno indication). See also \ref nopoll_conn_complete_pending_write
  *  -1 : failure found
- *  -2 : retry operation needed (NOPOLL_EWOULDBLOCK)
+ *  -2 : nothing written yet, content queued (NOPOLL_EWOULDBLOCK). See \ref nopoll_conn_set_on_writable
  */
 int           nopoll_conn_send_text (noPollConn * conn, const char * content, long length)
 {
@@ -3691,7 +5284,7 @@ int           nopoll_conn_send_text (noPollConn * conn, const char * content, lo
  *   N : number of bytes sent (user land bytes sent, without including web socket headers).
  *   0 : no bytes sent (see errno indication). See also \ref nopoll_conn_complete_pending_write
  *  -1 : failure found
- *  -2 : retry operation needed (NOPOLL_EWOULDBLOCK)
+ *  -2 : nothing written yet, content queued (NOPOLL_EWOULDBLOCK). See \ref nopoll_conn_set_on_writable
  */
 int           nopoll_conn_send_text_fragment (noPollConn * conn, const char * content, long length)
 {
@@ -3726,7 +5319,7 @@ int           nopoll_conn_send_text_fragment (noPollConn * conn, const char * co
  *   N : number of bytes sent (user land bytes sent, without including web socket headers).
  *   0 : no bytes sent (see errno indication). See also \ref nopoll_conn_complete_pending_write
  *  -1 : failure found
- *  -2 : retry operation needed (NOPOLL_EWOULDBLOCK)
+ *  -2 : nothing written yet, content queued (NOPOLL_EWOULDBLOCK). See \ref nopoll_conn_set_on_writable
  */
 int           nopoll_conn_send_binary (noPollConn * conn, const char * content, long length)
 {
@@ -3764,13 +5357,120 @@ int           nopoll_conn_send_binary (noPollConn * conn, const char * content,
  *   N : number of bytes sent (user land bytes sent, without including web socket headers).
  *   0 : no bytes sent (see errno indication). See also \ref nopoll_conn_complete_pending_write
  *  -1 : failure found
- *  -2 : retry operation needed (NOPOLL_EWOULDBLOCK) 
+ *  -2 : nothing written yet, content queued (NOPOLL_EWOULDBLOCK). See \ref nopoll_conn_set_on_writable
  */
 int           nopoll_conn_send_binary_fragment (noPollConn * conn, const char * content, long length)
 {
 	return __nopoll_conn_send_common (conn, content, length, nopoll_true, 0, NOPOLL_BINARY_FRAME);
 }
 
+/** 
+ * @brief Allows to send a prepared message (see \ref
+ * nopoll_msg_prepare) over the provided connection.
+ *
+ * The frame encoded by the prepared message is written as is: the
+ * header is not built again and the payload is not copied (not even
+ * when it is queued because the socket doesn't accept everything, a
+ * reference to the message is kept instead). Client connections must
+ * mask their frames, so in that case the message payload is sent as a
+ * regular frame (see \ref nopoll_conn_send_text).
+ *
+ * @param conn The connection where the message will be sent.
+ *
+ * @param msg The prepared message to be sent.
+ *
+ * @return The number of payload bytes written (without headers),
+ * -1 in case of failure or -2 if nothing was written yet and the
+ * content was queued (NOPOLL_EWOULDBLOCK), like \ref nopoll_conn_send_text.
+ */
+int           nopoll_conn_send_prepared (noPollConn * conn, noPollMsg * msg)
+{
+	int bytes_written = 0;
+	int bytes_sent    = 0;
+	int error;
+
+	if (conn == NULL || msg == NULL || msg->frame == NULL)
+		return -1;
+
+	if (conn->role == NOPOLL_ROLE_MAIN_LISTENER) {
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Trying to send content over a master listener connection");
+		return -1;
+	} /* end if */
+
+	/* client frames are masked (with a different mask each time) */
+	if (conn->role == NOPOLL_ROLE_CLIENT) 
+		return nopoll_conn_send_frame (conn, msg->has_fin, nopoll_true, msg->op_code, msg->payload_size, msg->payload, 0);
+
+	/* serialize with other send operations and with the loop
+	 * writing queued content, writing queued content first */
+	nopoll_mutex_lock (conn->ref_mutex);
+	if (conn->write_queue)
+		bytes_written = __nopoll_conn_flush_queue (conn);
+	if (conn->write_queue) {
+		/* queued after the content pending (unless writing it
+		 * failed, see below) */
+		if (! __nopoll_conn_send_failed (bytes_written)) {
+			bytes_written = 0;
+#if defined(NOPOLL_OS_UNIX)
+			errno = NOPOLL_EWOULDBLOCK;
+#elif defined(NOPOLL_OS_WIN32)
+			WSASetLastError (NOPOLL_EWOULDBLOCK);
+#endif
+		} /* end if */
+	} else {
+		/* try to write the frame (once, content not written is
+		 * queued) */
+		bytes_written = __nopoll_conn_send_parts (conn, NULL, 0, msg->frame, 0, msg->frame_size);
+		if (bytes_written < 0 && ! __nopoll_conn_send_failed (bytes_written))
+			bytes_written = 0;
+		else if (bytes_written >= 0 && bytes_written < msg->frame_size) {
+			/* report the rest would block */
+#if defined(NOPOLL_OS_UNIX)
+			errno = NOPOLL_EWOULDBLOCK;
+#elif defined(NOPOLL_OS_WIN32)
+			WSASetLastError (NOPOLL_EWOULDBLOCK);
+#endif
+		} /* end if */
+	} /* end if */
+
+	/* hard errors (not would block) close the connection:
+	 * nothing is queued */
+	if (__nopoll_conn_send_failed (bytes_written)) {
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Failed to write prepared message (result=%d, errno=%d : %s), closing conn-id=%d",
+			    bytes_written, errno, strerror (errno), conn->id);
+		nopoll_mutex_unlock (conn->ref_mutex);
+		nopoll_conn_shutdown (conn);
+		return -1;
+	} /* end if */
+
+	/* queue content not written (without copying it) */
+	if (bytes_written < msg->frame_size) {
+		if (! __nopoll_conn_queue_prepared (conn, msg, bytes_written)) {
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to allocate memory to store pending write content, closing conn-id=%d", conn->id);
+			nopoll_mutex_unlock (conn->ref_mutex);
+			nopoll_conn_shutdown (conn);
+			return -1;
+		} /* end if */
+	} /* end if */
+	nopoll_mutex_unlock (conn->ref_mutex);
+
+	/* report payload bytes written (without header) */
+	if (bytes_written > msg->header_size)
+		bytes_sent = bytes_written - msg->header_size;
+	if (bytes_sent == 0 && errno == NOPOLL_EWOULDBLOCK) 
+	        bytes_sent = -2;
+
+	/* apply slow consumer policy (keeping errno reported) */
+	if (conn->write_high > 0) {
+		error = errno;
+		if (! __nopoll_conn_check_watermarks (conn))
+			return -1;
+		errno = error;
+	} /* end if */
+
+	return bytes_sent;
+}
+
 
 /** 
  * @brief Allows to read the provided amount of bytes from the
@@ -4072,6 +5772,42 @@ void          nopoll_conn_set_on_msg (noPollConn              * conn,
 	return;
 }
 
+/** 
+ * @brief Allows to configure an on frame chunk handler on the
+ * provided connection that overrides the one configured at \ref
+ * noPollCtx (see \ref nopoll_ctx_set_on_frame_chunk).
+ *
+ * Once configured, data messages received (text and binary) aren't
+ * buffered nor reported as \ref noPollMsg (by \ref
+ * nopoll_conn_get_msg or the on message handler): their content is
+ * fed to the handler in chunks (bounded by the connection read
+ * buffer) as it is read, so messages of any size can be received
+ * without acquiring memory for them. Control frames are handled as
+ * usual.
+ *
+ * @param conn The connection to be configured.
+ *
+ * @param on_frame_chunk The handler to be called with each chunk
+ * received, or NULL to buffer messages again. Changes apply starting
+ * with the next message: the message being streamed is delivered to
+ * the handler (and user data) configured when it started.
+ *
+ * @param user_data User defined pointer to be passed in into the handler when it is called.
+ */
+void          nopoll_conn_set_on_frame_chunk (noPollConn                * conn,
+					      noPollOnFrameChunkHandler   on_frame_chunk,
+					      noPollPtr                   user_data)
+{
+	if (conn == NULL)
+		return;
+
+	/* configure on frame chunk handler */
+	conn->on_frame_chunk      = on_frame_chunk;
+	conn->on_frame_chunk_data = user_data;
+
+	return;
+}
+
 /** 
  * @brief Allows to configure a handler that is called when the
  * connection provided is ready to send and receive because all
@@ -4135,6 +5871,39 @@ void          nopoll_conn_set_on_close (noPollConn            * conn,
         return;
 }
 
+/** 
+ * @brief Allows to configure an OnWritable handler that will be
+ * called by \ref nopoll_loop_wait when all content queued on the
+ * connection was written.
+ *
+ * Send operations (for example \ref nopoll_conn_send_text) never
+ * block: when the socket can't accept more content, the part not
+ * written is queued on the connection (see \ref
+ * nopoll_conn_pending_write_bytes) and the loop writes it as soon as
+ * the socket becomes writable. Once the queue is empty, this handler
+ * is called so the application can continue sending (instead of
+ * retrying or waiting). See \ref nopoll_manual_retrying_write_operations.
+ *
+ * @param conn The connection to configure with the on writable handler.
+ *
+ * @param on_writable The handler to be configured (NULL to remove it).
+ *
+ * @param user_data A reference pointer to be passed in into the handler.
+ */
+void          nopoll_conn_set_on_writable (noPollConn              * conn,
+					   noPollOnWritableHandler   on_writable,
+					   noPollPtr                 user_data)
+{
+	if (conn == NULL)
+		return;
+
+	/* configure on writable handler */
+	conn->on_writable      = on_writable;
+	conn->on_writable_data = user_data;
+
+	return;
+}
+
 /** 
  * @internal Allows to send a pong message over the Websocket
  * connection provided. The function will not block the caller. This
@@ -4153,28 +5922,360 @@ nopoll_bool      nopoll_conn_send_pong (noPollConn * conn, long length, noPollPt
 	return nopoll_conn_send_frame (conn, nopoll_true, conn->role == NOPOLL_ROLE_CLIENT, NOPOLL_PONG_FRAME, length, content, 0);
 }
 
-int __nopoll_conn_complete_pending_write_reduce_header (noPollConn * conn, int bytes_written)
+/** 
+ * @internal Appends the item to the connection queue and watches
+ * write readiness so the loop writes it when possible. The caller
+ * must hold conn->ref_mutex.
+ */
+void __nopoll_conn_append_write (noPollConn * conn, noPollWriteItem * item)
 {
-        /* now check if the last write operation includes
-	   headers added by noPoll, to remove that size from
-	   reported value. Reported value should only include
-	   in its counting bytes requested by the upper level
-	   application not upper level application plus bytes
-	   added by noPoll */
-        while (conn->pending_write_added_header > 0 && bytes_written > 0) {
-	        bytes_written --;
-		conn->pending_write_added_header--;
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Reduced added header (bytes_written=%d, conn->pending_write_added_header=%d)", 
-			    bytes_written, conn->pending_write_added_header);
+	/* append */
+	if (conn->write_queue_last)
+		conn->write_queue_last->next = item;
+	else
+		conn->write_queue = item;
+	conn->write_queue_last     = item;
+	conn->pending_write_bytes += item->size;
+
+	/* watch write readiness so the loop writes it when
+	 * possible */
+	if (! conn->write_watched) {
+		nopoll_mutex_lock (conn->ctx->ref_mutex);
+		__nopoll_io_watch_write (conn->ctx, conn, nopoll_true);
+		nopoll_mutex_unlock (conn->ctx->ref_mutex);
 	} /* end if */
-	return bytes_written;
+
+	return;
+}
+
+/** 
+ * @internal Puts back at the head of the connection queue the
+ * provided bytes, accepted by a send handler but not written when it
+ * was replaced (see NOPOLL_IO_ENGINE_IO_URING), so they are written
+ * before content queued after them. The caller must hold
+ * conn->ref_mutex.
+ *
+ * @return nopoll_false if memory allocation fails.
+ */
+nopoll_bool __nopoll_conn_requeue_write (noPollConn * conn, const char * buffer, int size)
+{
+	noPollWriteItem * item;
+
+	item = nopoll_new (noPollWriteItem, 1);
+	if (item == NULL)
+		return nopoll_false;
+	item->buffer = nopoll_new (char, size);
+	if (item->buffer == NULL) {
+		nopoll_free (item);
+		return nopoll_false;
+	} /* end if */
+	memcpy (item->buffer, buffer, size);
+	item->size = size;
+
+	/* prepend */
+	item->next        = conn->write_queue;
+	conn->write_queue = item;
+	if (conn->write_queue_last == NULL)
+		conn->write_queue_last = item;
+	conn->pending_write_bytes += size;
+
+	/* watch write readiness so the loop writes it when
+	 * possible */
+	if (! conn->write_watched) {
+		nopoll_mutex_lock (conn->ctx->ref_mutex);
+		__nopoll_io_watch_write (conn->ctx, conn, nopoll_true);
+		nopoll_mutex_unlock (conn->ctx->ref_mutex);
+	} /* end if */
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Appends size bytes of the frame made of the provided
+ * header and payload, starting at desp (offset from the header
+ * start), to the connection queue. The caller must hold
+ * conn->ref_mutex. droppable flags complete messages not started
+ * that can be dropped by \ref NOPOLL_SLOW_CONSUMER_DROP_OLDEST.
+ *
+ * @return nopoll_false if memory allocation fails.
+ */
+nopoll_bool __nopoll_conn_queue_write (noPollConn * conn, char * header, int header_size, char * payload, long desp, long size, nopoll_bool droppable)
+{
+	noPollWriteItem * item;
+	int               chunk = 0;
+
+	item = nopoll_new (noPollWriteItem, 1);
+	if (item == NULL)
+		return nopoll_false;
+	item->buffer = nopoll_new (char, size);
+	if (item->buffer == NULL) {
+		nopoll_free (item);
+		return nopoll_false;
+	} /* end if */
+
+	/* header bytes not written are not reported as written to
+	 * the application (they were added by noPoll) */
+	if (desp < header_size) {
+		chunk = header_size - desp;
+		memcpy (item->buffer, header + desp, chunk);
+		item->added_header = chunk;
+		desp = header_size;
+	} /* end if */
+	if (size > chunk)
+		memcpy (item->buffer + chunk, payload + (desp - header_size), size - chunk);
+	item->size      = size;
+	item->droppable = droppable;
+
+	__nopoll_conn_append_write (conn, item);
+	return nopoll_true;
+}
+
+/** 
+ * @internal Appends the bytes not written of the prepared message
+ * provided (starting at desp) to the connection queue, without
+ * copying them (a reference to the message is kept until they are
+ * written). The caller must hold conn->ref_mutex.
+ *
+ * @return nopoll_false if memory allocation fails.
+ */
+nopoll_bool __nopoll_conn_queue_prepared (noPollConn * conn, noPollMsg * msg, long desp)
+{
+	noPollWriteItem * item;
+
+	item = nopoll_new (noPollWriteItem, 1);
+	if (item == NULL)
+		return nopoll_false;
+	nopoll_msg_ref (msg);
+	item->msg    = msg;
+	item->buffer = msg->frame;
+	item->desp   = desp;
+	item->size   = msg->frame_size - desp;
+	if (desp < msg->header_size)
+		item->added_header = msg->header_size - desp;
+	item->droppable = desp == 0 && msg->has_fin && 
+		(msg->op_code == NOPOLL_TEXT_FRAME || msg->op_code == NOPOLL_BINARY_FRAME);
+
+	__nopoll_conn_append_write (conn, item);
+	return nopoll_true;
+}
+
+/** 
+ * @internal Writes content queued on the connection (in order) until
+ * the queue is empty or the socket does not accept more content. The
+ * caller must hold conn->ref_mutex.
+ *
+ * @return Application bytes written (without headers added by noPoll)
+ * or the send handler error indication if nothing was written.
+ */
+int __nopoll_conn_flush_queue (noPollConn * conn)
+{
+	noPollWriteItem * item;
+	int               bytes_written;
+	int               header;
+	int               total = 0;
+
+	while (conn->write_queue) {
+		item          = conn->write_queue;
+		bytes_written = __nopoll_conn_send_parts (conn, NULL, 0, item->buffer + item->desp, 0, item->size);
+		if (bytes_written <= 0) {
+			if (total > 0)
+				return total;
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Found complete write operation didn't finish well, result=%d, errno=%d, conn-id=%d",
+				    bytes_written, errno, conn->id);
+			return bytes_written;
+		} /* end if */
+		conn->pending_write_bytes -= bytes_written;
+
+		/* reduce/remove bytes written due to header */
+		header = item->added_header < bytes_written ? item->added_header : bytes_written;
+		item->added_header -= header;
+		total              += bytes_written - header;
+
+		if (bytes_written < item->size) {
+			/* bytes written but not everything */
+			item->size -= bytes_written;
+			item->desp += bytes_written;
+			return total;
+		} /* end if */
+
+		/* release item written */
+		conn->write_queue = item->next;
+		if (conn->write_queue == NULL)
+			conn->write_queue_last = NULL;
+		__nopoll_conn_free_write_item (item);
+	} /* end while */
+
+	/* nothing else to write (write readiness is still watched
+	 * until the loop notifies it, see nopoll_conn_set_on_writable) */
+	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Completed pending write operation with bytes=%d", total);
+
+	return total;
+}
+
+/** 
+ * @internal Waits (up to the microseconds provided) until the
+ * connection socket is writable. poll(2) is used so descriptors
+ * above FD_SETSIZE are handled.
+ */
+void __nopoll_conn_wait_writable (noPollConn * conn, long microseconds)
+{
+#if defined(NOPOLL_OS_WIN32)
+	fd_set         write_set;
+	struct timeval tv;
+
+	FD_ZERO (&write_set);
+	FD_SET (conn->session, &write_set);
+	tv.tv_sec  = microseconds / 1000000;
+	tv.tv_usec = microseconds % 1000000;
+	select (conn->session + 1, NULL, &write_set, NULL, &tv);
+#else
+	struct pollfd  fd;
+
+	fd.fd      = conn->session;
+	fd.events  = POLLOUT;
+	fd.revents = 0;
+	/* round up so the wait never ends before the time requested */
+	poll (&fd, 1, (int) ((microseconds + 999) / 1000));
+#endif
+	return;
+}
+
+/** 
+ * @internal Applies the slow consumer policy when content queued on
+ * the connection is above the high watermark and notifies watermark
+ * crossings (see \ref nopoll_conn_opts_set_write_watermarks). Must be
+ * called without holding conn->ref_mutex (the handler is called).
+ *
+ * @return nopoll_false if the policy closed the connection (or it
+ * failed or timed out while blocking), otherwise nopoll_true.
+ */
+nopoll_bool __nopoll_conn_check_watermarks (noPollConn * conn)
+{
+	noPollWriteItem * item;
+	noPollWriteItem * prev;
+	noPollWriteItem * next;
+	nopoll_bool       notify = nopoll_false;
+	nopoll_bool       above  = nopoll_false;
+	int               pending;
+	long              timeout;
+	long              ellapsed;
+	struct timeval    start;
+	struct timeval    stop;
+	struct timeval    diff;
+
+	if (conn->write_high <= 0)
+		return nopoll_true;
+
+	nopoll_mutex_lock (conn->ref_mutex);
+
+	/* check watermark crossings (before dropping content so the
+	 * application knows the peer is not reading) */
+	if (! conn->write_above_high && conn->pending_write_bytes > conn->write_high) {
+		conn->write_above_high = nopoll_true;
+		notify = nopoll_true;
+		above  = nopoll_true;
+	} else if (conn->write_above_high && conn->pending_write_bytes <= conn->write_low) {
+		conn->write_above_high = nopoll_false;
+		notify = nopoll_true;
+	} /* end if */
+
+	if (conn->write_policy == NOPOLL_SLOW_CONSUMER_DROP_OLDEST && conn->pending_write_bytes > conn->write_high) {
+		/* drop oldest complete messages not started */
+		prev = NULL;
+		item = conn->write_queue;
+		while (item && conn->pending_write_bytes > conn->write_low) {
+			next = item->next;
+			if (! item->droppable || item->desp != 0) {
+				prev = item;
+				item = next;
+				continue;
+			} /* end if */
+
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Dropping %d bytes queued on slow consumer conn-id=%d (pending %d, high watermark %d)",
+				    item->size, conn->id, conn->pending_write_bytes, conn->write_high);
+			if (prev)
+				prev->next = next;
+			else
+				conn->write_queue = next;
+			if (conn->write_queue_last == item)
+				conn->write_queue_last = prev;
+			conn->pending_write_bytes -= item->size;
+			__nopoll_conn_free_write_item (item);
+			item = next;
+		} /* end while */
+	} /* end if */
+
+	pending = conn->pending_write_bytes;
+	nopoll_mutex_unlock (conn->ref_mutex);
+
+	if (notify && conn->on_watermark)
+		conn->on_watermark (conn->ctx, conn, above, conn->on_watermark_data);
+
+	/* apply policy if still above the high watermark */
+	if (pending <= conn->write_high)
+		return nopoll_true;
+
+	switch (conn->write_policy) {
+	case NOPOLL_SLOW_CONSUMER_DROP_CONN:
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Closing slow consumer conn-id=%d (pending %d bytes, high watermark %d)",
+			    conn->id, pending, conn->write_high);
+		nopoll_conn_shutdown (conn);
+		return nopoll_false;
+	case NOPOLL_SLOW_CONSUMER_BLOCK:
+		/* wait until the queue goes down to the low watermark
+		 * (bounded: the connection is closed if the peer
+		 * doesn't read in time) */
+		timeout = conn->write_block_timeout > 0 ? conn->write_block_timeout : NOPOLL_SLOW_CONSUMER_BLOCK_TIMEOUT;
+#if defined(NOPOLL_OS_WIN32)
+		nopoll_win32_gettimeofday (&start, NULL);
+#else
+		gettimeofday (&start, NULL);
+#endif
+		while (nopoll_conn_pending_write_bytes (conn) > conn->write_low && nopoll_conn_is_ok (conn)) {
+#if defined(NOPOLL_OS_WIN32)
+			nopoll_win32_gettimeofday (&stop, NULL);
+#else
+			gettimeofday (&stop, NULL);
+#endif
+			nopoll_timeval_substract (&stop, &start, &diff);
+			ellapsed = (diff.tv_sec * 1000000) + diff.tv_usec;
+			if (ellapsed >= timeout) {
+				nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Closing slow consumer conn-id=%d, queue not written in %ld usecs (pending %d bytes, low watermark %d)",
+					    conn->id, timeout, nopoll_conn_pending_write_bytes (conn), conn->write_low);
+				nopoll_conn_shutdown (conn);
+				return nopoll_false;
+			} /* end if */
+
+			__nopoll_conn_wait_writable (conn, (timeout - ellapsed) < 100000 ? (timeout - ellapsed) : 100000);
+			if (nopoll_conn_complete_pending_write (conn) == -1 && errno != NOPOLL_EWOULDBLOCK && errno != NOPOLL_EINPROGRESS && errno != NOPOLL_EINTR) {
+				nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Failed to write queued content (errno=%d) while blocking on slow consumer conn-id=%d", errno, conn->id);
+				nopoll_conn_shutdown (conn);
+				return nopoll_false;
+			} /* end if */
+		} /* end while */
+		if (! nopoll_conn_is_ok (conn))
+			return nopoll_false;
+
+		/* notify low watermark crossing */
+		return __nopoll_conn_check_watermarks (conn);
+	default:
+		break;
+	} /* end switch */
+
+	return nopoll_true;
 }
 
 /** 
- * @brief Allows to call to complete last pending write process that may be
- * pending from a previous uncompleted write operation. The function
+ * @brief Allows to call to complete pending write operations,
+ * writing content queued on the connection by previous send
+ * operations that couldn't write everything (in order). The function
  * returns the number of bytes that were written.
  *
+ * Connections watched by \ref nopoll_loop_wait have its queue
+ * written by the loop as soon as the socket is writable (see \ref
+ * nopoll_conn_set_on_writable), so this function is only required
+ * when no loop is used.
+ *
  * @param conn The connection where the pending write operation
  * operation will take place. In the case conn == NULL is received, 0
  * is returned. Keep in mind this.
@@ -4190,38 +6291,21 @@ int nopoll_conn_complete_pending_write (noPollConn * conn)
 {
 	int    bytes_written = 0;
 
-	if (conn == NULL || conn->pending_write == NULL)
+	if (conn == NULL || conn->write_queue == NULL)
 		return 0;
 
-	/* simple implementation */
-	bytes_written = conn->send (conn, conn->pending_write + conn->pending_write_desp, conn->pending_write_bytes);
-	if (bytes_written == conn->pending_write_bytes) {
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Completed pending write operation with bytes=%d", bytes_written);
-		nopoll_free (conn->pending_write);
-		conn->pending_write = NULL;
-
-		/* reduce/remove bytes written due to header */
-		return __nopoll_conn_complete_pending_write_reduce_header (conn, bytes_written);
-	} /* end if */
-
-	if (bytes_written > 0) {
-		/* bytes written but not everything */
-		conn->pending_write_bytes -= bytes_written;
-		conn->pending_write_desp += bytes_written;
-
-		/* reduce/remove bytes written due to header */
-		return __nopoll_conn_complete_pending_write_reduce_header (conn, bytes_written);
-	}
+	nopoll_mutex_lock (conn->ref_mutex);
+	bytes_written = __nopoll_conn_flush_queue (conn);
+	nopoll_mutex_unlock (conn->ref_mutex);
 
-	nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Found complete write operation didn't finish well, result=%d, errno=%d, conn-id=%d",
-		    bytes_written, errno, conn->id);
 	return bytes_written;
 }
 
 /** 
  * @brief Allows to check if there are pending write bytes. The
- * function returns the number of pending write bytes that are waiting
- * to be flushed. To do so you must call \ref nopoll_conn_complete_pending_write.
+ * function returns the number of pending write bytes queued on the
+ * connection that are waiting to be flushed (by \ref
+ * nopoll_loop_wait or by calling \ref nopoll_conn_complete_pending_write).
  *
  * @param conn The connection to be checked to have pending bytes to be written.
  *
@@ -4230,10 +6314,17 @@ int nopoll_conn_complete_pending_write (noPollConn * conn)
  */
 int           nopoll_conn_pending_write_bytes (noPollConn * conn)
 {
-	if (conn == NULL || conn->pending_write == NULL)
+	int pending;
+
+	if (conn == NULL)
 		return 0;
 
-	return conn->pending_write_bytes;
+	/* updated by send operations and the loop */
+	nopoll_mutex_lock (conn->ref_mutex);
+	pending = conn->write_queue ? conn->pending_write_bytes : 0;
+	nopoll_mutex_unlock (conn->ref_mutex);
+
+	return pending;
 }
 
 /** 
@@ -4311,6 +6402,162 @@ int nopoll_conn_flush_writes (noPollConn * conn, long timeout, int previous_resu
 }
 
 
+/** 
+ * @internal Sends size bytes of the frame made of the provided header
+ * and payload, starting at desp (offset from the header start),
+ * without copying the payload into a single buffer. Frames sent with
+ * the default send handler are written with writev. Other handlers
+ * (TLS) receive the header coalesced with the first payload bytes
+ * (a single record for small frames) and then the rest of the
+ * payload from the caller buffer.
+ *
+ * @return Bytes written or the send handler error indication.
+ */
+int __nopoll_conn_send_parts (noPollConn * conn, char * header, int header_size, char * payload, long desp, long size)
+{
+#if defined(NOPOLL_OS_UNIX)
+	struct iovec iov[2];
+	int          iov_num = 0;
+#endif
+	char         buffer[NOPOLL_SEND_COALESCE_SIZE];
+	int          chunk;
+	int          bytes;
+	int          total = 0;
+
+	if (size <= 0)
+		return 0;
+
+#if defined(NOPOLL_OS_UNIX)
+	if (conn->send == nopoll_conn_default_send) {
+		if (desp < header_size) {
+			iov[0].iov_base = header + desp;
+			iov[0].iov_len  = (header_size - desp) < size ? (header_size - desp) : size;
+			size           -= iov[0].iov_len;
+			desp            = header_size;
+			iov_num         = 1;
+		} /* end if */
+		if (size > 0) {
+			iov[iov_num].iov_base = payload + (desp - header_size);
+			iov[iov_num].iov_len  = size;
+			iov_num++;
+		} /* end if */
+		return writev (conn->session, iov, iov_num);
+	} /* end if */
+#endif
+
+	/* coalesce pending header bytes with the first payload
+	 * bytes */
+	if (desp < header_size) {
+		chunk = header_size - desp;
+		if (chunk > size)
+			chunk = size;
+		memcpy (buffer, header + desp, chunk);
+
+		bytes = size - chunk;
+		if (bytes > (int) sizeof (buffer) - chunk)
+			bytes = sizeof (buffer) - chunk;
+		memcpy (buffer + chunk, payload, bytes);
+		chunk += bytes;
+
+		bytes = conn->send (conn, buffer, chunk);
+		if (bytes != chunk)
+			return bytes;
+
+		total  = chunk;
+		desp  += chunk;
+		size  -= chunk;
+		if (size == 0)
+			return total;
+	} /* end if */
+
+	/* rest of the payload */
+	bytes = conn->send (conn, payload + (desp - header_size), size);
+	if (bytes < 0)
+		return total > 0 ? total : bytes;
+	return total + bytes;
+}
+
+/** 
+ * @internal Checks if the result reported by a send operation (or
+ * by __nopoll_conn_flush_queue) is a hard error, that is, not a
+ * would block indication where content can be queued.
+ */
+nopoll_bool __nopoll_conn_send_failed (int result)
+{
+	if (result >= 0 || result == -2)
+		return nopoll_false;
+	return errno != NOPOLL_EWOULDBLOCK && errno != NOPOLL_EINPROGRESS && errno != NOPOLL_EINTR;
+}
+
+/** 
+ * @internal Builds the websocket frame header for the provided frame
+ * settings into header (at least 14 bytes).
+ *
+ * @return The header size or -1 if length is not supported by this
+ * platform.
+ */
+int __nopoll_conn_build_header (noPollCtx * ctx, char * header, nopoll_bool fin, nopoll_bool masked, 
+				unsigned int mask_value, noPollOpCode op_code, long length)
+{
+	int header_size;
+
+	/* clear header */
+	memset (header, 0, 14);
+
+	/* set header codes */
+	if (fin) 
+		nopoll_set_bit (header, 7);
+	
+	if (masked) 
+		nopoll_set_bit (header + 1, 7);
+
+	if (op_code) {
+		/* set initial 4 bits */
+		header[0]   |= op_code & 0x0f;
+	}
+
+	/* set default header size */
+	header_size  = 2;
+
+	/* according to message length */
+	if (length < 126) {
+		header[1] |= length;
+	} else if (length <= 65535) {
+		/* set the next header length is at least 65535 */
+		header[1] |= 126;
+		header_size += 2;
+		/* set length into the next bytes */
+		nopoll_set_16bit (length, header + 2);
+#if defined(NOPOLL_64BIT_PLATFORM)
+	} else if (length < 0x8000000000000000) {
+		header[2] = (length & 0xFF00000000000000) >> 56;
+		header[3] = (length & 0x00FF000000000000) >> 48;
+		header[4] = (length & 0x0000FF0000000000) >> 40;
+		header[5] = (length & 0x000000FF00000000) >> 32;
+#else
+	} else if (length < 0x80000000) {
+		header[2] = header[3] = header[4] = header[5] = 0;
+#endif
+		header[1] |= 127;
+		header_size += 8;
+		header[6] = (length & 0x00000000FF000000) >> 24;
+		header[7] = (length & 0x0000000000FF0000) >> 16;
+		header[8] = (length & 0x000000000000FF00) >> 8;
+		header[9] = (length & 0x00000000000000FF);
+	} else {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to send the requested message, this requested is bigger than the value that can be supported by this platform");
+		return -1;
+	}
+
+	/* place mask */
+	if (masked) {
+		nopoll_set_32bit (mask_value, header + header_size);
+		header_size += 4;
+	} /* end if */
+
+	return header_size;
+}
+
 /** 
  * @internal Function used to send a frame over the provided
  * connection.
@@ -4335,7 +6582,7 @@ int nopoll_conn_flush_writes (noPollConn * conn, long timeout, int previous_resu
  *   N : number of bytes sent (user land bytes sent, without including web socket headers).
  *   0 : no bytes sent (see errno indication). See also \ref nopoll_conn_complete_pending_write
  *  -1 : failure found
- *  -2 : retry operation needed (NOPOLL_EWOULDBLOCK)
+ *  -2 : nothing written yet, content queued (NOPOLL_EWOULDBLOCK). See \ref nopoll_conn_set_on_writable
  *
  */
 int nopoll_conn_send_frame (noPollConn * conn, nopoll_bool fin, nopoll_bool masked,
@@ -4344,33 +6591,22 @@ int nopoll_conn_send_frame (noPollConn * conn, nopoll_bool fin, nopoll_bool mask
 {
 	char               header[14];
 	int                header_size;
-	char             * send_buffer;
+	char             * payload;
 	int                bytes_written = 0;
 	int                bytes_sent    = 0;
 	char               mask[4];
 	unsigned int       mask_value = 0;
 	int                desp = 0;
-	int                tries;
+	int                error;
+	char             * compressed  = NULL;
+	long               user_length = length;
+	nopoll_bool        locked      = nopoll_false;
 #if defined(SHOW_DEBUG_LOG)
 	noPollDebugLevel   level;
 #endif
 
-	/* check for pending send operation */
-	bytes_written = nopoll_conn_complete_pending_write (conn);
-	if (bytes_written < 0)
-		return bytes_written;
-
-	/* clear header */
-	memset (header, 0, 14);
-
-	/* set header codes */
-	if (fin) 
-		nopoll_set_bit (header, 7);
-	
+	/* define a random mask */
 	if (masked) {
-		nopoll_set_bit (header + 1, 7);
-		
-		/* define a random mask */
 #if defined(NOPOLL_OS_WIN32)
 		mask_value = (unsigned int) rand ();
 #else
@@ -4380,112 +6616,110 @@ int nopoll_conn_send_frame (noPollConn * conn, nopoll_bool fin, nopoll_bool mask
 		nopoll_set_32bit (mask_value, mask);
 	} /* end if */
 
-	if (op_code) {
-		/* set initial 4 bits */
-		header[0]   |= op_code & 0x0f;
-	}
-
-	/* set default header size */
-	header_size  = 2;
-
-	/* according to message length */
-	if (length < 126) {
-		header[1] |= length;
-	} else if (length <= 65535) {
-		/* set the next header length is at least 65535 */
-		header[1] |= 126;
-		header_size += 2;
-		/* set length into the next bytes */
-		nopoll_set_16bit (length, header + 2);
-#if defined(NOPOLL_64BIT_PLATFORM)
-	} else if (length < 0x8000000000000000) {
-		header[2] = (length & 0xFF00000000000000) >> 56;
-		header[3] = (length & 0x00FF000000000000) >> 48;
-		header[4] = (length & 0x0000FF0000000000) >> 40;
-		header[5] = (length & 0x000000FF00000000) >> 32;
-#else
-	} else if (length < 0x80000000) {
-		header[2] = header[3] = header[4] = header[5] = 0;
-#endif
-		header[1] |= 127;
-		header_size += 8;
-		header[6] = (length & 0x00000000FF000000) >> 24;
-		header[7] = (length & 0x0000000000FF0000) >> 16;
-		header[8] = (length & 0x000000000000FF00) >> 8;
-		header[9] = (length & 0x00000000000000FF);
-	} else {
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to send the requested message, this requested is bigger than the value that can be supported by this platform");
-		return -1;
-	}
-
-	/* place mask */
-	if (masked) {
-		nopoll_set_32bit (mask_value, header + header_size);
-		header_size += 4;
+	/* compress complete text and binary messages
+	 * (permessage-deflate): frames must be written in the same
+	 * order they are compressed, so the lock is acquired here */
+	if (conn->deflate && conn->deflate->enabled && fin && length >= conn->deflate->min_size &&
+	    (op_code == NOPOLL_TEXT_FRAME || op_code == NOPOLL_BINARY_FRAME)) {
+		nopoll_mutex_lock (conn->ref_mutex);
+		locked = nopoll_true;
+		if (! __nopoll_conn_deflate (conn, (const char *) content, length, &compressed, &length)) {
+			nopoll_mutex_unlock (conn->ref_mutex);
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to compress content to implement send operation");
+			return -1;
+		} /* end if */
+		content = compressed;
 	} /* end if */
 
-	/* allocate enough memory to send content */
-	send_buffer = nopoll_new (char, length + header_size + 2);
-	if (send_buffer == NULL) {
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to allocate memory to implement send operation");
+	/* build frame header (RSV1 flags compressed messages) */
+	header_size = __nopoll_conn_build_header (conn->ctx, header, fin, masked, mask_value, op_code, length);
+	if (header_size < 0) {
+		if (locked)
+			nopoll_mutex_unlock (conn->ref_mutex);
+		nopoll_free (compressed);
 		return -1;
 	} /* end if */
-	
-	/* copy content to be sent */
-	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Copying into the buffer %d bytes of header (total memory allocated: %d)", 
-		    header_size, (int) length + header_size + 1);
-	memcpy (send_buffer, header, header_size);
-	if (length > 0) {
-		memcpy (send_buffer + header_size, content, length);
-
-		/* mask content before sending if requested */
-		if (masked) {
-			nopoll_conn_mask_content (conn->ctx, send_buffer + header_size, length, mask, 0);
-		}
+	if (compressed)
+		header[0] |= 0x40;
+
+	/* masked frames need a copy of the content (unmasked frames
+	 * are sent from the caller buffer, compressed content is
+	 * masked in place) */
+	payload = (char *) content;
+	if (masked && length > 0 && compressed == NULL) {
+		payload = nopoll_new (char, length);
+		if (payload == NULL) {
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to allocate memory to implement send operation");
+			return -1;
+		} /* end if */
+		memcpy (payload, content, length);
+	} /* end if */
+	if (masked && length > 0) {
+		/* mask content before sending */
+		nopoll_conn_mask_content (conn->ctx, payload, length, mask, 0);
 	} /* end if */
 
-	
 	/* send content */
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Mask used for this delivery: %d (about to send %d bytes)",
-		    nopoll_get_32bit (send_buffer + header_size - 2), (int) length + header_size);
-
-	/* clear errno status before writting */
-	desp  = 0;
-	tries = 0;
+		    nopoll_get_32bit (header + header_size - 2), (int) length + header_size);
+
+	/* serialize with other send operations and with the loop
+	 * writing queued content */
+	if (! locked)
+		nopoll_mutex_lock (conn->ref_mutex);
+
+	/* write content queued by previous operations first: if
+	 * something remains, the frame is queued after it to keep
+	 * order */
+	desp = 0;
+	if (conn->write_queue)
+		bytes_written = __nopoll_conn_flush_queue (conn);
+	if (conn->write_queue) {
+		/* the frame is queued after the content pending
+		 * (unless writing it failed, see below) */
+		if (! __nopoll_conn_send_failed (bytes_written)) {
+			bytes_written = 0;
+#if defined(NOPOLL_OS_UNIX)
+			errno = NOPOLL_EWOULDBLOCK;
+#elif defined(NOPOLL_OS_WIN32)
+			WSASetLastError (NOPOLL_EWOULDBLOCK);
+#endif
+		} /* end if */
+	} else {
 
-	/***** BEGIN INTERNAL debug code for test_30, test_31, test_32, test_33, test_34, test_35 : nopoll-regression-client.c ******/
-	if ((conn->__force_stop_after_header > 0) && (conn->__force_stop_after_header < (length + header_size))) {
+		/***** BEGIN INTERNAL debug code for test_30, test_31, test_32, test_33, test_34, test_35 : nopoll-regression-client.c ******/
+		if ((conn->__force_stop_after_header > 0) && (conn->__force_stop_after_header < (length + header_size))) {
 		
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Sending broken header (just %d bytes) and implement a pause on purpose...", conn->__force_stop_after_header);
-
-		/* send just 2 bytes for the header and then implement a very long pause */
-		bytes_written = conn->send (conn, send_buffer, conn->__force_stop_after_header);
-		desp          = conn->__force_stop_after_header;
-		if (bytes_written != conn->__force_stop_after_header) {
-			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Requested to write %d bytes for the header but %d were written",
-				    conn->__force_stop_after_header, bytes_written);
-			desp  = 0;
-		} /* end if */
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Sending broken header (just %d bytes) and implement a pause on purpose...", conn->__force_stop_after_header);
 
-		/* sleep after header ... */
-		nopoll_sleep (5000000); /* 5 seconds */
+			/* send just 2 bytes for the header and then implement a very long pause */
+			bytes_written = __nopoll_conn_send_parts (conn, header, header_size, payload, 0, conn->__force_stop_after_header);
+			desp          = conn->__force_stop_after_header;
+			if (bytes_written != conn->__force_stop_after_header) {
+				nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Requested to write %d bytes for the header but %d were written",
+					    conn->__force_stop_after_header, bytes_written);
+				desp  = 0;
+			} /* end if */
 
-	} /* end if */
-	/****** END INTERNAL debug code for test_30 : nopoll-regression-client.c ******/
+			/* sleep after header ... */
+			nopoll_sleep (5000000); /* 5 seconds */
 
-	while (nopoll_true) {
-		/* try to write bytes */
+		} /* end if */
+		/****** END INTERNAL debug code for test_30 : nopoll-regression-client.c ******/
+
+		/* try to write bytes (once, content not written is
+		 * queued) */
 		if (sleep_in_header == 0) {
-			bytes_written = conn->send (conn, send_buffer + desp, length + header_size - desp);
+			bytes_written = __nopoll_conn_send_parts (conn, header, header_size, payload, desp, length + header_size - desp);
 		} else {
 			nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Found sleep in header indication, sending header: %d bytes (waiting %ld)", header_size, sleep_in_header);
-			bytes_written = conn->send (conn, send_buffer, header_size);
+			bytes_written = __nopoll_conn_send_parts (conn, header, header_size, payload, 0, header_size);
 			if (bytes_written == header_size) {
 				/* sleep after header ... */
 				nopoll_sleep (sleep_in_header);
 				
 				/* now send the rest of the content (without the header) */
-				bytes_written = conn->send (conn, send_buffer + header_size, length);
+				bytes_written = __nopoll_conn_send_parts (conn, header, header_size, payload, header_size, length);
 				nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Rest of content written %d (header size: %d, length: %d)", 
 					    bytes_written, header_size, length);
 				bytes_written = length + header_size;
@@ -4493,100 +6727,118 @@ int nopoll_conn_send_frame (noPollConn * conn, nopoll_bool fin, nopoll_bool mask
 			} else {
 				nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Requested to write %d bytes for the header but %d were written",
 					    header_size, bytes_written);
+				nopoll_mutex_unlock (conn->ref_mutex);
+				if (payload != content)
+					nopoll_free (payload);
+				nopoll_free (compressed);
 				return -1;
 			} /* end if */
 		} /* end if */
-		
-		if ((bytes_written + desp) != (length + header_size)) {
+
+		/* accomulate bytes written */
+		if (bytes_written > 0)
+			desp += bytes_written;
+
+		if (desp != (length + header_size)) {
 			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, 
 				    "Requested to write %d bytes but found %d written (masked? %d, mask: %u, header size: %d, length: %d), errno = %d : %s", 
 				    (int) length + header_size - desp, bytes_written, masked, mask_value, header_size, (int) length, errno, strerror (errno));
 		} else {
-			/* accomulate bytes written to continue */
-			if (bytes_written > 0)
-				desp += bytes_written;
-
 			nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Bytes written to the wire %d (masked? %d, mask: %u, header size: %d, length: %d)", 
 				    bytes_written, masked, mask_value, header_size, (int) length);
-			break;
 		} /* end if */
+	} /* end if */
 
-		/* accomulate bytes written to continue */
-		if (bytes_written > 0)
-			desp += bytes_written;
-
-		/* increase tries */
-		tries++;
-
-		if ((errno != 0) || tries > 50) {
-			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Found errno=%d (%s) value while trying to bytes to the WebSocket conn-id=%d or max tries reached=%d",
-				    errno, strerror (errno), conn->id, tries);
-			break;
-		} /* end if */
-
-		/* wait a bit */
-		nopoll_sleep (100000);
-
-	} /* end while */
-
-	/* record pending write bytes */
-	conn->pending_write_bytes = length + header_size - desp;
-
-	/* record the header to be accurate when reporting the amount
-	   of bytes written: we have to avoid confusing two things:
-
-	   - Bytes written by the protocol (length + headers)
-	   - Bytes requested by the upper level application to be written (just length)
-	   
-	   By recording the following value, we try to make
-	   nopoll_conn_complete_pending_write to report amount of
-	   upper level bytes written (without headers, which is
-	   something created by noPoll and not requested by the upper
-	   level application).
-	*/
-	conn->pending_write_added_header = header_size;
+	/* hard errors (not would block) close the connection:
+	 * nothing is queued */
+	if (__nopoll_conn_send_failed (bytes_written)) {
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Failed to write frame (result=%d, errno=%d : %s), closing conn-id=%d",
+			    bytes_written, errno, strerror (errno), conn->id);
+		nopoll_mutex_unlock (conn->ref_mutex);
+		if (payload != content)
+			nopoll_free (payload);
+		nopoll_free (compressed);
+		nopoll_conn_shutdown (conn);
+		return -1;
+	} /* end if */
 
-	/* record and report useful userland payload's bytes sent  */
+	/* record and report useful userland payload's bytes sent
+	   (without headers, which is something created by noPoll and
+	   not requested by the upper level application) */
 	bytes_sent = 0;
-	if ((desp - header_size) > 0) {
+	if ((desp - header_size) > 0) 
 	        bytes_sent = (desp - header_size);
 
-		/* make conn->pending_write_added_header 0 because it
-		   have written enought bytes including the header */
-		conn->pending_write_added_header = 0;
-	} /* end if */
+	/* compressed messages report bytes relative to the content
+	 * provided: everything or a part (the rest is queued) */
+	if (compressed && desp == (length + header_size))
+		bytes_sent = user_length;
+	else if (compressed && bytes_sent >= user_length)
+		bytes_sent = user_length - 1;
 	
 #if defined(SHOW_DEBUG_LOG)
 	level = NOPOLL_LEVEL_DEBUG;
 	if (desp != (length + header_size))
-		level = NOPOLL_LEVEL_CRITICAL;
-	else if (errno == NOPOLL_EWOULDBLOCK && conn->pending_write_bytes > 0)
 		level = NOPOLL_LEVEL_WARNING;
 
 	nopoll_log (conn->ctx, level, 
-		    "Write operation finished with last result=%d (bytes_written), bytes-sent=%d, desp=%d, header_size=%d, requested=%d (length), remaining=%d (conn->pending_write_bytes), errno=%d (conn-id=%d)",
+		    "Write operation finished with last result=%d (bytes_written), bytes-sent=%d, desp=%d, header_size=%d, requested=%d (length), remaining=%d, errno=%d (conn-id=%d)",
 		    /* report want we are going to report: result */
 		    bytes_written,
 		    /* bytes sent */
 		    bytes_sent, desp, header_size,
-		    length, conn->pending_write_bytes, errno, conn->id);
+		    length, (int) (length + header_size - desp), errno, conn->id);
 #endif
 
-	/* check pending bytes for the next operation */
-	if (conn->pending_write_bytes > 0) {
-		conn->pending_write = send_buffer;
-		conn->pending_write_desp = desp;
+	/* queue content not written: only the content not written is
+	 * copied, and it is written by the loop when the socket is
+	 * writable (or by the next operation) */
+	if (desp < (length + header_size)) {
+		/* frames can be dropped (slow consumer policy) unless
+		 * the peer decompression context depends on them */
+		if (! __nopoll_conn_queue_write (conn, header, header_size, payload, desp, length + header_size - desp,
+						 desp == 0 && fin && (op_code == NOPOLL_TEXT_FRAME || op_code == NOPOLL_BINARY_FRAME) &&
+						 (compressed == NULL || conn->deflate->deflate_reset))) {
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to allocate memory to store pending write content, closing conn-id=%d", conn->id);
+			nopoll_mutex_unlock (conn->ref_mutex);
+			if (payload != content)
+				nopoll_free (payload);
+			nopoll_free (compressed);
+			nopoll_conn_shutdown (conn);
+			return -1;
+		} /* end if */
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Stored %d bytes starting from %d out of %d bytes (header size: %d)", 
-			    conn->pending_write_bytes, desp, length + header_size, header_size);
-	} else {
-		/* release memory */
-		nopoll_free (send_buffer);
+			    (int) (length + header_size - desp), desp, length + header_size, header_size);
+
+		/* report the rest would block (unless an error was
+		 * found) */
+		if (bytes_written >= 0) {
+#if defined(NOPOLL_OS_UNIX)
+			errno = NOPOLL_EWOULDBLOCK;
+#elif defined(NOPOLL_OS_WIN32)
+			WSASetLastError (NOPOLL_EWOULDBLOCK);
+#endif
+		} /* end if */
 	} /* end if */
+	nopoll_mutex_unlock (conn->ref_mutex);
+
+	/* release masked and compressed content */
+	if (payload != content)
+		nopoll_free (payload);
+	nopoll_free (compressed);
 
 	/* if no byte was sent and errno is set to non-blocking error
 	   operation that indicates a retry, report -2 */
 	if (bytes_sent == 0 && errno == NOPOLL_EWOULDBLOCK) 
-	        return -2;
+	        bytes_sent = -2;
+
+	/* apply slow consumer policy (keeping errno reported) */
+	if (conn->write_high > 0) {
+		error = errno;
+		if (! __nopoll_conn_check_watermarks (conn))
+			return -1;
+		errno = error;
+	} /* end if */
 
 	/* report what was was written (which can be everything, part,
 	   anything or error) */
@@ -4647,8 +6899,9 @@ noPollConn * nopoll_conn_accept_socket (noPollCtx * ctx, noPollConn * listener,
 
 	nopoll_return_val_if_fail (ctx, ctx && listener, NULL);
 
-	/* create the connection */
-	conn = nopoll_listener_from_socket (ctx, session);
+	/* create the connection (watched by the same worker loop as
+	 * the listener) */
+	conn = __nopoll_listener_from_socket_internal (ctx, session, listener->worker);
 	if (conn == NULL) {
 		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Received NULL pointer after calling to create listener from session..");
 		return NULL;
@@ -4664,10 +6917,284 @@ noPollConn * nopoll_conn_accept_socket (noPollCtx * ctx, noPollConn * listener,
 	if (! nopoll_conn_accept_complete (ctx, listener, conn, session, listener->tls_on))
 		return NULL;
 
+	/* hand the connection to a worker loop (round robin) once
+	 * accepted, unless the listener is already watched by a
+	 * worker */
+	if (listener->worker == 0)
+		__nopoll_loop_assign_worker (ctx, conn);
+
 	/* report listener created */
 	return conn;
 }
 
+/** 
+ * @internal Configures on the provided SSL_CTX the session ticket
+ * keys defined on the context (see nopoll_ctx_set_tls_ticket_keys)
+ * if they were changed after the generation provided.
+ *
+ * @return The keys generation configured.
+ */
+int       __nopoll_conn_apply_ticket_keys (noPollCtx * ctx, SSL_CTX * ssl_ctx, int generation)
+{
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (ctx->tls_ticket_keys_generation != generation) {
+		generation = ctx->tls_ticket_keys_generation;
+		if (SSL_CTX_set_tlsext_ticket_keys (ssl_ctx, ctx->tls_ticket_keys, NOPOLL_TLS_TICKET_KEYS_SIZE) != 1)
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure TLS session ticket keys, SSL_CTX_set_tlsext_ticket_keys () failed");
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return generation;
+}
+
+/** 
+ * @internal Creates and configures the SSL_CTX used by connections
+ * accepted on the provided listener with the certificate, private key
+ * and chain certificate provided (reading them from disk).
+ *
+ * @return A new SSL_CTX reference or NULL if it fails.
+ */
+SSL_CTX * __nopoll_conn_build_listener_ssl_context (noPollCtx      * ctx, 
+						    noPollConn     * conn,
+						    noPollConn     * listener,
+						    noPollConnOpts * options,
+						    const char     * certificateFile,
+						    const char     * privateKey,
+						    const char     * chainCertificate)
+{
+	SSL_CTX * ssl_ctx;
+
+	/* create ssl context */
+	ssl_ctx  = __nopoll_conn_get_ssl_context (ctx, conn, listener->opts, nopoll_false);
+	if (ssl_ctx == NULL) {
+	        nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to get Ssl Context (__nopoll_conn_get_ssl_context), function returned NULL");
+		return NULL;
+	} /* end if */
+
+	/* Configure ca certificate in the case it is defined */
+	if (options && options->ca_certificate) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting up CA certificate: %s", options->ca_certificate);
+		if (SSL_CTX_load_verify_locations (ssl_ctx, options->ca_certificate, NULL) != 1) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure CA certificate (%s), SSL_CTX_load_verify_locations () failed", options->ca_certificate);
+			SSL_CTX_free (ssl_ctx);
+			return NULL;
+		} /* end if */
+
+	} /* end if */
+
+	/* enable default verification paths */
+	if (SSL_CTX_set_default_verify_paths (ssl_ctx) != 1) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to configure default verification paths, SSL_CTX_set_default_verify_paths () failed");
+		SSL_CTX_free (ssl_ctx);
+		return NULL;
+	} /* end if */
+
+	/* configure chain certificate */
+	if (chainCertificate) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting up chain certificate: %s", chainCertificate);
+		if (SSL_CTX_use_certificate_chain_file (ssl_ctx, chainCertificate) != 1) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure chain certificate (%s), SSL_CTX_use_certificate_chain_file () failed", chainCertificate);
+			SSL_CTX_free (ssl_ctx);
+			return NULL;
+		} /* end if */
+	} /* end if */
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Using certificate file: %s (with ssl context ref: %p)", certificateFile, ssl_ctx);
+	if (SSL_CTX_use_certificate_chain_file (ssl_ctx, certificateFile) != 1) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "there was an error while setting certificate file into the SSl context, unable to start TLS profile. Failure found at SSL_CTX_use_certificate_file function. Tried certificate file: %s", 
+			    certificateFile);
+		SSL_CTX_free (ssl_ctx);
+		return NULL;
+	} /* end if */
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Using certificate key: %s", privateKey);
+	if (SSL_CTX_use_PrivateKey_file (ssl_ctx, privateKey, SSL_FILETYPE_PEM) != 1) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, 
+			    "there was an error while setting private file into the SSl context, unable to start TLS profile. Failure found at SSL_CTX_use_PrivateKey_file function. Tried private file: %s", 
+			    privateKey);
+		SSL_CTX_free (ssl_ctx);
+		return NULL;
+	}
+
+	/* check for private key and certificate file to match. */
+	if (! SSL_CTX_check_private_key (ssl_ctx)) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, 
+			    "seems that certificate file and private key doesn't match!, unable to start TLS profile. Failure found at SSL_CTX_check_private_key function. Used certificate %s, and key: %s",
+			    certificateFile, privateKey);
+		SSL_CTX_free (ssl_ctx);
+		return NULL;
+	} /* end if */
+
+	if (options != NULL && ! options->disable_ssl_verify) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Enabling certificate client peer verification from server");
+		/** really, really ugly hack to let
+		 * __nopoll_conn_ssl_verify_callback to be able to get
+		 * access to the context required to drop some logs */
+		__nopoll_conn_ssl_ctx_debug = ctx;
+		SSL_CTX_set_verify (ssl_ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, __nopoll_conn_ssl_verify_callback); 
+		SSL_CTX_set_verify_depth (ssl_ctx, 5);
+	} /* end if */
+
+	/* let clients resume their sessions (session cache and
+	 * tickets) */
+	SSL_CTX_set_session_cache_mode (ssl_ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_set_session_id_context (ssl_ctx, (const unsigned char *) "nopoll", 6);
+	__nopoll_conn_apply_ticket_keys (ctx, ssl_ctx, 0);
+
+	return ssl_ctx;
+}
+
+/** 
+ * @internal Finds the SSL_CTX cached on the listener for the
+ * certificate, private key and chain certificate provided.
+ *
+ * @return A new reference to the SSL_CTX found (to be released with
+ * SSL_CTX_free) or NULL if it is not cached.
+ */
+SSL_CTX * __nopoll_conn_cached_ssl_context (noPollConn * listener,
+					    const char * certificateFile,
+					    const char * privateKey,
+					    const char * chainCertificate)
+{
+	noPollSslCtxCache * entry;
+	SSL_CTX           * ssl_ctx = NULL;
+
+	nopoll_mutex_lock (listener->ref_mutex);
+	entry = listener->ssl_ctx_cache;
+	while (entry) {
+		if (nopoll_cmp (entry->certificate, certificateFile) && 
+		    nopoll_cmp (entry->private_key, privateKey) && 
+		    nopoll_cmp (entry->chain_certificate, chainCertificate)) {
+			ssl_ctx = entry->ssl_ctx;
+
+			/* keys rotated after it was cached */
+			entry->ticket_keys_generation = __nopoll_conn_apply_ticket_keys (listener->ctx, ssl_ctx, entry->ticket_keys_generation);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+			SSL_CTX_up_ref (ssl_ctx);
+#else
+			CRYPTO_add (&ssl_ctx->references, 1, CRYPTO_LOCK_SSL_CTX);
+#endif
+			break;
+		} /* end if */
+		entry = entry->next;
+	} /* end while */
+	nopoll_mutex_unlock (listener->ref_mutex);
+
+	return ssl_ctx;
+}
+
+/** 
+ * @internal Caches on the listener the SSL_CTX configured for the
+ * certificate, private key and chain certificate provided (acquiring
+ * a reference) so next accepted connections share it.
+ */
+void      __nopoll_conn_cache_ssl_context (noPollConn * listener,
+					   const char * certificateFile,
+					   const char * privateKey,
+					   const char * chainCertificate,
+					   SSL_CTX    * ssl_ctx)
+{
+	noPollSslCtxCache * entry;
+
+	entry = nopoll_new (noPollSslCtxCache, 1);
+	if (entry == NULL)
+		return;
+	entry->certificate       = nopoll_strdup (certificateFile);
+	entry->private_key       = nopoll_strdup (privateKey);
+	entry->chain_certificate = chainCertificate ? nopoll_strdup (chainCertificate) : NULL;
+	entry->ssl_ctx           = ssl_ctx;
+	entry->ticket_keys_generation = __nopoll_conn_apply_ticket_keys (listener->ctx, ssl_ctx, 0);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	SSL_CTX_up_ref (ssl_ctx);
+#else
+	CRYPTO_add (&ssl_ctx->references, 1, CRYPTO_LOCK_SSL_CTX);
+#endif
+
+	nopoll_mutex_lock (listener->ref_mutex);
+	entry->next             = listener->ssl_ctx_cache;
+	listener->ssl_ctx_cache = entry;
+	nopoll_mutex_unlock (listener->ref_mutex);
+	return;
+}
+
+/** 
+ * @internal Releases SSL_CTX references cached on the listener
+ * (connections already accepted keep their own reference).
+ */
+void      __nopoll_conn_release_ssl_ctx_cache (noPollConn * listener)
+{
+	noPollSslCtxCache * entry;
+
+	nopoll_mutex_lock (listener->ref_mutex);
+	entry                   = listener->ssl_ctx_cache;
+	listener->ssl_ctx_cache = NULL;
+	nopoll_mutex_unlock (listener->ref_mutex);
+
+	while (entry) {
+		listener->ssl_ctx_cache = entry->next;
+		SSL_CTX_free (entry->ssl_ctx);
+		nopoll_free (entry->certificate);
+		nopoll_free (entry->private_key);
+		nopoll_free (entry->chain_certificate);
+		nopoll_free (entry);
+		entry = listener->ssl_ctx_cache;
+	} /* end while */
+	return;
+}
+
+/** 
+ * @internal Servername (SNI) callback configured on listeners TLS
+ * contexts: switches the connection to the TLS context configured
+ * for the certificate installed for the server name requested by the
+ * client (see nopoll_ctx_set_certificate). Contexts are cached on the
+ * listener so certificates are read from disk only once.
+ */
+int __nopoll_conn_tls_servername (SSL * ssl, int * alert, void * user_data)
+{
+	noPollConn * conn = (noPollConn *) SSL_get_app_data (ssl);
+	noPollConn * listener;
+	const char * serverName;
+	const char * certificateFile  = NULL;
+	const char * privateKey       = NULL;
+	const char * chainCertificate = NULL;
+	SSL_CTX    * ssl_ctx;
+
+	if (conn == NULL || conn->listener == NULL)
+		return SSL_TLSEXT_ERR_OK;
+	listener = conn->listener;
+
+	/* no server name or no certificate for it: use the default
+	 * certificate */
+	serverName = SSL_get_servername (ssl, TLSEXT_NAMETYPE_host_name);
+	if (serverName == NULL)
+		return SSL_TLSEXT_ERR_OK;
+	if (! nopoll_ctx_find_certificate (conn->ctx, serverName, &certificateFile, &privateKey, &chainCertificate)) {
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "No certificate installed for serverName=%s (conn-id=%d), using default", serverName, conn->id);
+		return SSL_TLSEXT_ERR_OK;
+	} /* end if */
+
+	ssl_ctx = __nopoll_conn_cached_ssl_context (listener, certificateFile, privateKey, chainCertificate);
+	if (ssl_ctx == NULL) {
+		ssl_ctx = __nopoll_conn_build_listener_ssl_context (conn->ctx, conn, listener, listener->opts, certificateFile, privateKey, chainCertificate);
+		if (ssl_ctx == NULL) {
+			(*alert) = SSL_AD_INTERNAL_ERROR;
+			return SSL_TLSEXT_ERR_ALERT_FATAL;
+		} /* end if */
+		SSL_CTX_set_tlsext_servername_callback (ssl_ctx, __nopoll_conn_tls_servername);
+		__nopoll_conn_cache_ssl_context (listener, certificateFile, privateKey, chainCertificate, ssl_ctx);
+	} /* end if */
+
+	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Using certificate %s for serverName=%s (conn-id=%d)", certificateFile, serverName, conn->id);
+	if (ssl_ctx != conn->ssl_ctx) {
+		SSL_set_SSL_CTX (ssl, ssl_ctx);
+		SSL_CTX_free (conn->ssl_ctx);
+		conn->ssl_ctx = ssl_ctx;
+	} else
+		SSL_CTX_free (ssl_ctx);
+
+	return SSL_TLSEXT_ERR_OK;
+}
+
 /**
  * @internal Function to support accept listener operations.
  */
@@ -4690,7 +7217,13 @@ nopoll_bool __nopoll_conn_accept_complete_common (noPollCtx * ctx, noPollConnOpt
 	} /* end if */
 
 	/* configure non blocking mode */
-	nopoll_conn_set_sock_block (session, nopoll_true);
+	nopoll_conn_set_sock_block (session, nopoll_false);
+
+	/* outbound queue watermarks and slow consumer policy */
+	__nopoll_conn_opts_apply_watermarks (options, conn);
+
+	/* permessage-deflate settings (negotiated during handshake) */
+	__nopoll_conn_opts_apply_deflate (options, conn);
 	
 	/* now check for accept handler */
 	if (ctx->on_accept) {
@@ -4716,7 +7249,10 @@ nopoll_bool __nopoll_conn_accept_complete_common (noPollCtx * ctx, noPollConnOpt
 		 * session */
 		conn->tls_on = nopoll_true;
 
-		/* get here SNI to query about the serverName */
+		/* serverName requested through SNI is only known
+		 * during the TLS handshake: certificate configured
+		 * here is replaced (if needed) at
+		 * __nopoll_conn_tls_servername */
 
 		/* 1) GET FROM OPTIONS: detect here if we have
 		 * certificates provided through options */
@@ -4764,97 +7300,31 @@ nopoll_bool __nopoll_conn_accept_complete_common (noPollCtx * ctx, noPollConnOpt
 		else if (options && options->chain_certificate)
 			chainCertificate = options->chain_certificate;
 
-		/* create ssl context */
-		conn->ssl_ctx  = __nopoll_conn_get_ssl_context (ctx, conn, listener->opts, nopoll_false);
+		/* get the ssl context configured for these
+		 * certificates (created and cached on the listener
+		 * the first time, unless a context creator is
+		 * defined) */
+		conn->ssl_ctx = NULL;
+		if (ctx->context_creator == NULL)
+			conn->ssl_ctx = __nopoll_conn_cached_ssl_context (listener, certificateFile, privateKey, chainCertificate);
 		if (conn->ssl_ctx == NULL) {
-		        nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to get Ssl Context (conn->ssl_ctx = __nopoll_conn_get_ssl_context), function returned NULL");
-			return nopoll_false;
-		} /* end if */
-
-		/* Configure ca certificate in the case it is defined */
-		if (options && options->ca_certificate) {
-			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting up CA certificate: %s", options->ca_certificate);
-			if (SSL_CTX_load_verify_locations (conn->ssl_ctx, options->ca_certificate, NULL) != 1) {
-				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure CA certificate (%s), SSL_CTX_load_verify_locations () failed", options->ca_certificate);
-				return nopoll_false;
-			} /* end if */
-
-		} /* end if */
+			conn->ssl_ctx = __nopoll_conn_build_listener_ssl_context (ctx, conn, listener, options, certificateFile, privateKey, chainCertificate);
+			if (conn->ssl_ctx == NULL) {
+				nopoll_conn_shutdown (conn);
+				nopoll_ctx_unregister_conn (ctx, conn);
 
-		/* enable default verification paths */
-		if (SSL_CTX_set_default_verify_paths (conn->ssl_ctx) != 1) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to configure default verification paths, SSL_CTX_set_default_verify_paths () failed");
-			return nopoll_false;
-		} /* end if */
+				/* release connection options */
+				__nopoll_conn_opts_release_if_needed (options);
 
-		/* configure chain certificate */
-		if (chainCertificate) {
-			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting up chain certificate: %s", chainCertificate);
-			if (SSL_CTX_use_certificate_chain_file (conn->ssl_ctx, chainCertificate) != 1) {
-				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure chain certificate (%s), SSL_CTX_use_certificate_chain_file () failed", chainCertificate);
 				return nopoll_false;
 			} /* end if */
+			if (ctx->context_creator == NULL) {
+				/* select certificates through SNI */
+				SSL_CTX_set_tlsext_servername_callback (conn->ssl_ctx, __nopoll_conn_tls_servername);
+				__nopoll_conn_cache_ssl_context (listener, certificateFile, privateKey, chainCertificate, conn->ssl_ctx);
+			} /* end if */
 		} /* end if */
 
-		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Using certificate file: %s (with ssl context ref: %p)", certificateFile, conn->ssl_ctx);
-		if (conn->ssl_ctx == NULL || SSL_CTX_use_certificate_chain_file (conn->ssl_ctx, certificateFile) != 1) {
-			/* drop an error log */
-			if (conn->ssl_ctx == NULL)
-				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to accept incoming connection, failed to create SSL context. Context creator returned NULL pointer");
-			else 
-				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "there was an error while setting certificate file into the SSl context, unable to start TLS profile. Failure found at SSL_CTX_use_certificate_file function. Tried certificate file: %s", 
-					    certificateFile);
-
-			/* dump error stack */
-			nopoll_conn_shutdown (conn);
-			nopoll_ctx_unregister_conn (ctx, conn);
-
-			/* release connection options */
-			__nopoll_conn_opts_release_if_needed (options);
-
-			return nopoll_false;
-		} /* end if */
-
-		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Using certificate key: %s", privateKey);
-		if (SSL_CTX_use_PrivateKey_file (conn->ssl_ctx, privateKey, SSL_FILETYPE_PEM) != 1) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, 
-				    "there was an error while setting private file into the SSl context, unable to start TLS profile. Failure found at SSL_CTX_use_PrivateKey_file function. Tried private file: %s", 
-				    privateKey);
-			/* dump error stack */
-			nopoll_conn_shutdown (conn);
-			nopoll_ctx_unregister_conn (ctx, conn);
-
-			/* release connection options */
-			__nopoll_conn_opts_release_if_needed (options);
-
-			return nopoll_false;
-		}
-
-		/* check for private key and certificate file to match. */
-		if (! SSL_CTX_check_private_key (conn->ssl_ctx)) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, 
-				    "seems that certificate file and private key doesn't match!, unable to start TLS profile. Failure found at SSL_CTX_check_private_key function. Used certificate %s, and key: %s",
-				    certificateFile, privateKey);
-			/* dump error stack */
-			nopoll_conn_shutdown (conn);
-
-			/* release connection options */
-			__nopoll_conn_opts_release_if_needed (options);
-
-			return nopoll_false;
-		} /* end if */
-
-		if (options != NULL && ! options->disable_ssl_verify) {
-			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Enabling certificate client peer verification from server");
-			/** really, really ugly hack to let
-			 * __nopoll_conn_ssl_verify_callback to be able to get
-			 * access to the context required to drop some logs */
-			__nopoll_conn_ssl_ctx_debug = ctx;
-			SSL_CTX_set_verify (conn->ssl_ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, __nopoll_conn_ssl_verify_callback); 
-			SSL_CTX_set_verify_depth (conn->ssl_ctx, 5);
-		} /* end if */
-
-
 		/* create SSL context */
 		conn->ssl = SSL_new (conn->ssl_ctx);       
 		if (conn->ssl == NULL) {
@@ -4871,6 +7341,12 @@ nopoll_bool __nopoll_conn_accept_complete_common (noPollCtx * ctx, noPollConnOpt
 		/* set the file descriptor */
 		SSL_set_fd (conn->ssl, conn->session);
 
+		/* used by __nopoll_conn_tls_servername */
+		SSL_set_app_data (conn->ssl, conn);
+
+		/* pending writes are retried from a different buffer */
+		SSL_set_mode (conn->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
 		/* don't complete here the operation but flag it as
 		 * pending */
 		conn->pending_ssl_accept = nopoll_true;
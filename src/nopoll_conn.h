@@ -128,6 +128,10 @@ nopoll_bool    nopoll_conn_is_ready (noPollConn * conn);
 
 nopoll_bool    nopoll_conn_is_tls_on (noPollConn * conn);
 
+nopoll_bool    nopoll_conn_is_deflate_on (noPollConn * conn);
+
+nopoll_bool    nopoll_conn_tls_session_reused (noPollConn * conn);
+
 NOPOLL_SOCKET nopoll_conn_socket (noPollConn * conn);
 
 void           nopoll_conn_set_socket (noPollConn * conn, NOPOLL_SOCKET _socket);
@@ -170,6 +174,14 @@ void          nopoll_conn_set_hook (noPollConn * conn, noPollPtr ptr);
 
 noPollPtr     nopoll_conn_get_hook (noPollConn * conn);
 
+void          nopoll_conn_set_read_budget (noPollConn * conn, int budget);
+
+int           nopoll_conn_get_read_budget (noPollConn * conn);
+
+void          nopoll_conn_set_max_message_size (noPollConn * conn, long max_size);
+
+long          nopoll_conn_get_max_message_size (noPollConn * conn);
+
 nopoll_bool   nopoll_conn_set_sock_block         (NOPOLL_SOCKET socket,
 						  nopoll_bool   enable);
 
@@ -183,6 +195,8 @@ int           nopoll_conn_send_binary (noPollConn * conn, const char * content,
 
 int           nopoll_conn_send_binary_fragment (noPollConn * conn, const char * content, long length);
 
+int           nopoll_conn_send_prepared (noPollConn * conn, noPollMsg * msg);
+
 int           nopoll_conn_complete_pending_write (noPollConn * conn);
 
 int           nopoll_conn_pending_write_bytes    (noPollConn * conn);
@@ -203,6 +217,10 @@ void          nopoll_conn_set_on_msg (noPollConn              * conn,
 				      noPollOnMessageHandler    on_msg,
 				      noPollPtr                 user_data);
 
+void          nopoll_conn_set_on_frame_chunk (noPollConn                * conn,
+					      noPollOnFrameChunkHandler   on_frame_chunk,
+					      noPollPtr                   user_data);
+
 void          nopoll_conn_set_on_ready (noPollConn            * conn,
 					noPollActionHandler     on_ready,
 					noPollPtr               user_data);
@@ -211,6 +229,10 @@ void          nopoll_conn_set_on_close (noPollConn            * conn,
 					noPollOnCloseHandler    on_close,
 					noPollPtr               user_data);
 
+void          nopoll_conn_set_on_writable (noPollConn              * conn,
+					   noPollOnWritableHandler   on_writable,
+					   noPollPtr                 user_data);
+
 int nopoll_conn_send_frame (noPollConn * conn, nopoll_bool fin, nopoll_bool masked,
 			    noPollOpCode op_code, long length, noPollPtr content,
 			    long sleep_in_header);
@@ -237,6 +259,35 @@ int nopoll_conn_default_receive (noPollConn * conn, char * buffer, int buffer_si
 
 int nopoll_conn_default_send (noPollConn * conn, char * buffer, int buffer_size);
 
+nopoll_bool __nopoll_conn_frame_buffered (noPollConn * conn);
+
+int __nopoll_conn_read_buffer_fill (noPollConn * conn);
+
+void __nopoll_conn_release_ssl_ctx_cache (noPollConn * listener);
+
+nopoll_bool __nopoll_conn_data_pending (noPollConn * conn);
+
+int __nopoll_conn_send_parts (noPollConn * conn, char * header, int header_size, char * payload, long desp, long size);
+
+nopoll_bool __nopoll_conn_queue_write (noPollConn * conn, char * header, int header_size, char * payload, long desp, long size, nopoll_bool droppable);
+
+nopoll_bool __nopoll_conn_requeue_write (noPollConn * conn, const char * buffer, int size);
+
+int __nopoll_conn_flush_queue (noPollConn * conn);
+
+nopoll_bool __nopoll_conn_send_failed (int result);
+
+nopoll_bool __nopoll_conn_queue_prepared (noPollConn * conn, noPollMsg * msg, long desp);
+
+int __nopoll_conn_build_header (noPollCtx * ctx, char * header, nopoll_bool fin, nopoll_bool masked, 
+				unsigned int mask_value, noPollOpCode op_code, long length);
+
+void __nopoll_conn_wait_writable (noPollConn * conn, long microseconds);
+
+nopoll_bool __nopoll_conn_check_watermarks (noPollConn * conn);
+
+nopoll_bool __nopoll_conn_connect_step (noPollConn * conn);
+
 void nopoll_conn_mask_content (noPollCtx * ctx, char * payload, int payload_size, char * mask, int desp);
 
 END_C_DECLS
@@ -78,6 +78,9 @@ noPollConnOpts * nopoll_conn_opts_new (void)
 	/* by default, disable ssl peer verification */
 	result->disable_ssl_verify = nopoll_true;
 
+	/* messages compressed (permessage-deflate) */
+	result->deflate_min_size   = NOPOLL_DEFLATE_MIN_SIZE;
+
 	return result;
 }
 
@@ -324,6 +327,60 @@ void nopoll_conn_opts_set_reuse        (noPollConnOpts * opts, nopoll_bool reuse
 }
 
 
+/** 
+ * @brief Allows to configure listeners created with the provided
+ * options to open one socket per worker on the same port
+ * (SO_REUSEPORT), making each worker accept its own connections (see
+ * \ref nopoll_ctx_set_workers). By default (or on platforms without
+ * SO_REUSEPORT), a single socket is opened and accepted connections
+ * are handed out round robin to workers.
+ *
+ * @param opts The connection options object. 
+ *
+ * @param reuse_port nopoll_true to open one listener socket per worker.
+ */
+void nopoll_conn_opts_set_reuse_port   (noPollConnOpts * opts, nopoll_bool reuse_port)
+{
+	if (opts == NULL)
+		return;
+	opts->reuse_port = reuse_port;
+	return;
+}
+
+/** 
+ * @brief Allows to configure client connections created with the
+ * provided options to not wait for the connect process to finish.
+ *
+ * By default, \ref nopoll_conn_new (and the rest of client
+ * creation functions) returns once the TCP connect and the TLS
+ * handshake are done and the websocket client init was sent. With
+ * this option enabled, the function returns right away and the
+ * process (including reading the websocket handshake reply) is
+ * completed by \ref nopoll_loop_wait as the socket gets ready, so a
+ * single thread can have thousands of connects in progress.
+ *
+ * Use \ref nopoll_conn_set_on_ready (or \ref nopoll_ctx_set_on_ready)
+ * to get notified when the connection is ready and \ref
+ * nopoll_conn_set_on_close to get notified if it fails. \ref
+ * nopoll_conn_is_ready and \ref
+ * nopoll_conn_wait_until_connection_ready also complete the process
+ * when no loop is used.
+ *
+ * Note the host name is still resolved before the function returns.
+ *
+ * @param opts The connection options object. 
+ *
+ * @param async_connect nopoll_true to not wait for the connect
+ * process to finish.
+ */
+void nopoll_conn_opts_set_async_connect (noPollConnOpts * opts, nopoll_bool async_connect)
+{
+	if (opts == NULL)
+		return;
+	opts->async_connect = async_connect;
+	return;
+}
+
 /** 
  * @brief Allows the user to configure the interface to bind the connection to.
  *
@@ -348,6 +405,260 @@ void nopoll_conn_opts_set_interface    (noPollConnOpts * opts, const char * _int
 	return;
 }
 
+/** 
+ * @brief Allows to configure the high and low watermarks of the
+ * outbound queue of connections created with the provided options
+ * (including connections accepted by listeners created with them).
+ *
+ * Send operations never block: content that can't be written is
+ * queued on the connection (see \ref nopoll_conn_set_on_writable). When
+ * the queue goes above the high watermark, the policy configured
+ * with \ref nopoll_conn_opts_set_slow_consumer_policy is applied and
+ * the handler configured with \ref nopoll_conn_opts_set_on_watermark
+ * is notified. Once the queue goes down to the low watermark, the
+ * handler is notified again. This allows to limit the memory used by
+ * peers that stop reading.
+ *
+ * @param opts The connection options object. 
+ *
+ * @param high Max bytes queued before applying the policy (0, the
+ * default, disables the limit).
+ *
+ * @param low Bytes queued to consider the connection writable again
+ * (must be lower than high, otherwise high is used).
+ */
+void nopoll_conn_opts_set_write_watermarks (noPollConnOpts * opts, int high, int low)
+{
+	if (opts == NULL)
+		return;
+
+	if (high < 0)
+		high = 0;
+	if (low < 0 || low > high)
+		low = high;
+	opts->write_high = high;
+	opts->write_low  = low;
+	return;
+}
+
+/** 
+ * @brief Allows to configure the policy applied when the outbound
+ * queue goes above the high watermark (see \ref
+ * nopoll_conn_opts_set_write_watermarks).
+ *
+ * @param opts The connection options object. 
+ *
+ * @param policy The policy to apply (\ref NOPOLL_SLOW_CONSUMER_NOTIFY by default).
+ */
+void nopoll_conn_opts_set_slow_consumer_policy (noPollConnOpts * opts, noPollSlowConsumerPolicy policy)
+{
+	if (opts == NULL)
+		return;
+	opts->write_policy = policy;
+	return;
+}
+
+/** 
+ * @brief Allows to configure how long a send operation may block
+ * with \ref NOPOLL_SLOW_CONSUMER_BLOCK waiting for the outbound queue
+ * to go down to the low watermark. Once expired, the connection is
+ * shutdown and the send operation fails.
+ *
+ * @param opts The connection options object. 
+ *
+ * @param microseconds Max time to wait (<= 0 to use the default:
+ * NOPOLL_SLOW_CONSUMER_BLOCK_TIMEOUT).
+ */
+void nopoll_conn_opts_set_slow_consumer_timeout (noPollConnOpts * opts, long microseconds)
+{
+	if (opts == NULL)
+		return;
+	opts->write_block_timeout = microseconds > 0 ? microseconds : 0;
+	return;
+}
+
+/** 
+ * @brief Allows to configure the handler called when the outbound
+ * queue of a connection goes above the high watermark and when it
+ * goes down to the low watermark (see \ref
+ * nopoll_conn_opts_set_write_watermarks).
+ *
+ * @param opts The connection options object. 
+ *
+ * @param on_watermark The handler to be called.
+ *
+ * @param user_data A reference pointer to be passed in into the handler.
+ */
+void nopoll_conn_opts_set_on_watermark (noPollConnOpts           * opts, 
+					noPollOnWatermarkHandler   on_watermark, 
+					noPollPtr                  user_data)
+{
+	if (opts == NULL)
+		return;
+	opts->on_watermark      = on_watermark;
+	opts->on_watermark_data = user_data;
+	return;
+}
+
+/** 
+ * @brief Enables the permessage-deflate extension (RFC 7692) on
+ * connections created with the provided options: client connections
+ * offer it to the server and listeners created with them accept it
+ * when offered by clients.
+ *
+ * Once negotiated (see \ref nopoll_conn_is_deflate_on), complete
+ * text and binary messages sent (at least \ref
+ * nopoll_conn_opts_set_deflate_min_size bytes) are compressed and
+ * compressed messages received are reported decompressed. Fragmented
+ * messages sent (\ref nopoll_conn_send_text_fragment) and prepared
+ * messages (\ref nopoll_msg_prepare) are sent without compression.
+ *
+ * @param opts The connection options object. 
+ *
+ * @param enable nopoll_true to enable the extension.
+ *
+ * @return nopoll_true if the option was configured, otherwise
+ * nopoll_false is returned (the library was built without zlib
+ * support).
+ */
+nopoll_bool nopoll_conn_opts_set_permessage_deflate (noPollConnOpts * opts, nopoll_bool enable)
+{
+	if (opts == NULL)
+		return nopoll_false;
+#if defined(NOPOLL_HAVE_ZLIB)
+	opts->deflate = enable;
+	return nopoll_true;
+#else
+	return ! enable;
+#endif
+}
+
+/** 
+ * @brief Allows to configure if compression contexts are kept
+ * between messages (context takeover, default) for the
+ * permessage-deflate extension (see \ref
+ * nopoll_conn_opts_set_permessage_deflate).
+ *
+ * Disabling context takeover reduces the memory required by each
+ * connection between messages at the cost of a worse compression
+ * ratio. Clients request these values to the server, and listeners
+ * require them to clients. Contexts reset after each message are
+ * shared by connections through the context pool (see \ref
+ * nopoll_ctx_set_deflate_pool_size).
+ *
+ * @param opts The connection options object. 
+ *
+ * @param client_context_takeover nopoll_false to reset the context
+ * used by the client to compress after each message
+ * (client_no_context_takeover).
+ *
+ * @param server_context_takeover nopoll_false to reset the context
+ * used by the server to compress after each message
+ * (server_no_context_takeover).
+ */
+void nopoll_conn_opts_set_deflate_context_takeover (noPollConnOpts * opts, 
+						    nopoll_bool      client_context_takeover,
+						    nopoll_bool      server_context_takeover)
+{
+	if (opts == NULL)
+		return;
+	opts->deflate_client_no_context_takeover = ! client_context_takeover;
+	opts->deflate_server_no_context_takeover = ! server_context_takeover;
+	return;
+}
+
+/** 
+ * @brief Allows to configure the max LZ77 window size (base 2
+ * logarithm, 9..15) used by the client and the server to compress
+ * with the permessage-deflate extension (see \ref
+ * nopoll_conn_opts_set_permessage_deflate). Smaller windows require
+ * less memory with a worse compression ratio.
+ *
+ * @param opts The connection options object. 
+ *
+ * @param client_max_window_bits Max window used by the client (0 or 15 for default).
+ *
+ * @param server_max_window_bits Max window used by the server (0 or 15 for default).
+ */
+void nopoll_conn_opts_set_deflate_window_bits (noPollConnOpts * opts, 
+					       int              client_max_window_bits,
+					       int              server_max_window_bits)
+{
+	if (opts == NULL)
+		return;
+
+	/* zlib doesn't support 8 bits windows (raw deflate) */
+	if (client_max_window_bits < 9 || client_max_window_bits > 15)
+		client_max_window_bits = 0;
+	if (server_max_window_bits < 9 || server_max_window_bits > 15)
+		server_max_window_bits = 0;
+	opts->deflate_client_max_window_bits = client_max_window_bits;
+	opts->deflate_server_max_window_bits = server_max_window_bits;
+	return;
+}
+
+/** 
+ * @brief Allows to configure the minimum size of messages compressed
+ * once the permessage-deflate extension is negotiated (see \ref
+ * nopoll_conn_opts_set_permessage_deflate). Small messages are sent
+ * without compression because it doesn't save bandwidth.
+ *
+ * @param opts The connection options object. 
+ *
+ * @param min_size Minimum message size in bytes (\ref NOPOLL_DEFLATE_MIN_SIZE by default).
+ */
+void nopoll_conn_opts_set_deflate_min_size (noPollConnOpts * opts, int min_size)
+{
+	if (opts == NULL)
+		return;
+	if (min_size < 1)
+		min_size = 1;
+	opts->deflate_min_size = min_size;
+	return;
+}
+
+/** 
+ * @internal Configures the outbound queue watermarks, policy and
+ * handler defined on the options provided into the connection.
+ */
+void __nopoll_conn_opts_apply_watermarks (noPollConnOpts * opts, noPollConn * conn)
+{
+	if (opts == NULL || conn == NULL)
+		return;
+
+	conn->write_high        = opts->write_high;
+	conn->write_low         = opts->write_low;
+	conn->write_policy      = opts->write_policy;
+	conn->write_block_timeout = opts->write_block_timeout;
+	conn->on_watermark      = opts->on_watermark;
+	conn->on_watermark_data = opts->on_watermark_data;
+	return;
+}
+
+/** 
+ * @internal Configures the permessage-deflate settings defined on
+ * the options provided into the connection (negotiated later during
+ * the handshake).
+ */
+void __nopoll_conn_opts_apply_deflate (noPollConnOpts * opts, noPollConn * conn)
+{
+	noPollDeflate * deflate;
+
+	if (opts == NULL || conn == NULL || ! opts->deflate || conn->deflate)
+		return;
+
+	deflate = nopoll_new (noPollDeflate, 1);
+	if (deflate == NULL)
+		return;
+	deflate->client_no_context_takeover = opts->deflate_client_no_context_takeover;
+	deflate->server_no_context_takeover = opts->deflate_server_no_context_takeover;
+	deflate->client_max_window_bits     = opts->deflate_client_max_window_bits;
+	deflate->server_max_window_bits     = opts->deflate_server_max_window_bits;
+	deflate->min_size                   = opts->deflate_min_size;
+	conn->deflate                       = deflate;
+	return;
+}
+
 void __nopoll_conn_opts_free_common  (noPollConnOpts * opts)
 {
 	if (opts == NULL)
@@ -64,15 +64,45 @@ void        nopoll_conn_opts_unref (noPollConnOpts * opts);
 
 void nopoll_conn_opts_set_reuse        (noPollConnOpts * opts, nopoll_bool reuse);
 
+void nopoll_conn_opts_set_reuse_port   (noPollConnOpts * opts, nopoll_bool reuse_port);
+
+void nopoll_conn_opts_set_async_connect (noPollConnOpts * opts, nopoll_bool async_connect);
+
 void nopoll_conn_opts_set_interface    (noPollConnOpts * opts, const char * _interface);
 
 void nopoll_conn_opts_set_extra_headers (noPollConnOpts * opts, const char * extra_headers);
 
+void nopoll_conn_opts_set_write_watermarks (noPollConnOpts * opts, int high, int low);
+
+void nopoll_conn_opts_set_slow_consumer_policy (noPollConnOpts * opts, noPollSlowConsumerPolicy policy);
+
+void nopoll_conn_opts_set_slow_consumer_timeout (noPollConnOpts * opts, long microseconds);
+
+void nopoll_conn_opts_set_on_watermark (noPollConnOpts           * opts, 
+					noPollOnWatermarkHandler   on_watermark, 
+					noPollPtr                  user_data);
+
+nopoll_bool nopoll_conn_opts_set_permessage_deflate (noPollConnOpts * opts, nopoll_bool enable);
+
+void nopoll_conn_opts_set_deflate_context_takeover (noPollConnOpts * opts, 
+						    nopoll_bool      client_context_takeover,
+						    nopoll_bool      server_context_takeover);
+
+void nopoll_conn_opts_set_deflate_window_bits (noPollConnOpts * opts, 
+					       int              client_max_window_bits,
+					       int              server_max_window_bits);
+
+void nopoll_conn_opts_set_deflate_min_size (noPollConnOpts * opts, int min_size);
+
 void nopoll_conn_opts_free (noPollConnOpts * opts);
 
 /** internal API **/
 void __nopoll_conn_opts_release_if_needed (noPollConnOpts * options);
 
+void __nopoll_conn_opts_apply_watermarks (noPollConnOpts * opts, noPollConn * conn);
+
+void __nopoll_conn_opts_apply_deflate (noPollConnOpts * opts, noPollConn * conn);
+
 END_C_DECLS
 
 #endif
@@ -61,6 +61,62 @@ void __nopoll_ctx_sigpipe_do_nothing (int _signal)
 	return;
 }
 
+/** 
+ * @internal Releases the wake up channel of loops starting at the
+ * provided position (loops must not be running).
+ */
+void __nopoll_ctx_loops_release (noPollCtx * ctx, int from)
+{
+	noPollLoop * loop;
+
+	while (from < ctx->loops_num) {
+		loop = &(ctx->loops[from]);
+		if (loop->wakeup_read != NOPOLL_INVALID_SOCKET)
+			nopoll_close_socket (loop->wakeup_read);
+		if (loop->wakeup_write != NOPOLL_INVALID_SOCKET)
+			nopoll_close_socket (loop->wakeup_write);
+		loop->wakeup_read  = NOPOLL_INVALID_SOCKET;
+		loop->wakeup_write = NOPOLL_INVALID_SOCKET;
+		from++;
+	} /* end while */
+
+	return;
+}
+
+/** 
+ * @internal Configures the provided context to hold loops_num loops
+ * (the first one is run by nopoll_loop_wait caller, the rest by
+ * worker threads). Loops must not be running.
+ */
+nopoll_bool __nopoll_ctx_loops_init (noPollCtx * ctx, int loops_num)
+{
+	noPollLoop * loops;
+	int          iterator;
+
+	/* release loops removed */
+	__nopoll_ctx_loops_release (ctx, loops_num);
+
+	loops = nopoll_realloc (ctx->loops, sizeof (noPollLoop) * loops_num);
+	if (loops == NULL)
+		return nopoll_false;
+
+	/* init new loops */
+	iterator = ctx->loops_num;
+	while (iterator < loops_num) {
+		memset (&(loops[iterator]), 0, sizeof (noPollLoop));
+		loops[iterator].id           = iterator;
+		loops[iterator].ctx          = ctx;
+		loops[iterator].wakeup_read  = NOPOLL_INVALID_SOCKET;
+		loops[iterator].wakeup_write = NOPOLL_INVALID_SOCKET;
+		iterator++;
+	} /* end while */
+
+	ctx->loops        = loops;
+	ctx->loops_num    = loops_num;
+	ctx->workers_next = 0;
+
+	return nopoll_true;
+}
 
 /** 
  * @brief Creates an empty Nopoll context. 
@@ -104,8 +160,34 @@ noPollCtx * nopoll_ctx_new (void) {
 	/* setup default protocol version */
 	result->protocol_version = 13;
 
+	/* messages read from a connection on each readiness
+	 * notification */
+	result->read_budget = NOPOLL_READ_BUDGET;
+
+	/* client connections resume TLS sessions by default */
+	result->tls_session_reuse = nopoll_true;
+
+	/* host names resolved are cached */
+	result->dns_positive_ttl = NOPOLL_DNS_POSITIVE_TTL;
+	result->dns_negative_ttl = NOPOLL_DNS_NEGATIVE_TTL;
+
+	/* compression streams shared by connections without context
+	 * takeover */
+	result->deflate_pool_size = NOPOLL_DEFLATE_POOL_SIZE;
+
+	/* message holders and payload buffers reused */
+	result->msg_pool_size     = NOPOLL_MSG_POOL_SIZE;
+	result->msg_pool_memory   = NOPOLL_MSG_POOL_MEMORY;
+
+	/* default loop (no workers) */
+	if (! __nopoll_ctx_loops_init (result, 1)) {
+		nopoll_free (result);
+		return NULL;
+	} /* end if */
+
 	/* create mutexes */
 	result->ref_mutex = nopoll_mutex_create ();
+	result->msg_pool_mutex = nopoll_mutex_create ();
 
 #if !defined(NOPOLL_OS_WIN32)
 	/* install sigpipe handler */
@@ -116,692 +198,2328 @@ noPollCtx * nopoll_ctx_new (void) {
 }
 
 /** 
- * @brief Allows to acquire a reference to the provided context. This
- * reference is released by calling to \ref nopoll_ctx_unref.
- *
- * @param ctx The context to acquire a reference.
- *
- * @return The function returns nopoll_true in the case the reference
- * was acquired, otherwise nopoll_false is returned.
- */ 
-nopoll_bool    nopoll_ctx_ref (noPollCtx * ctx)
+ * @internal Releases all TLS sessions saved by client connections
+ * (the caller must hold ctx->ref_mutex or be the only owner).
+ */
+void __nopoll_ctx_tls_sessions_release (noPollCtx * ctx)
 {
-	/* return false value */
-	nopoll_return_val_if_fail (ctx, ctx, nopoll_false);
+	noPollTlsSession * entry;
 
-	/* acquire mutex here */
-	nopoll_mutex_lock (ctx->ref_mutex);
+	while (ctx->tls_sessions) {
+		entry             = ctx->tls_sessions;
+		ctx->tls_sessions = entry->next;
 
-	ctx->refs++;
+		SSL_SESSION_free (entry->session);
+		nopoll_free (entry->key);
+		nopoll_free (entry);
+	} /* end while */
+	return;
+}
 
-	/* release mutex here */
-	nopoll_mutex_unlock (ctx->ref_mutex);
+/** 
+ * @internal Releases a reference to the provided host name
+ * resolution entry (the caller must hold ctx->ref_mutex).
+ */
+void __nopoll_ctx_dns_entry_release (noPollDnsEntry * entry)
+{
+	if (entry == NULL)
+		return;
+	entry->refs--;
+	if (entry->refs > 0)
+		return;
 
-	return nopoll_true;
+	nopoll_free (entry->host);
+	nopoll_free (entry->port);
+	nopoll_free (entry);
+	return;
 }
 
+/** 
+ * @internal Removes the provided entry from the host names cache
+ * (the caller must hold ctx->ref_mutex). Connections waiting for it
+ * (and the resolver thread) keep their references.
+ */
+void __nopoll_ctx_dns_unlink (noPollCtx * ctx, noPollDnsEntry * entry)
+{
+	noPollDnsEntry ** link = &(ctx->dns_cache);
+
+	while (*link) {
+		if (*link == entry) {
+			*link         = entry->next;
+			entry->next   = NULL;
+			entry->cached = nopoll_false;
+			ctx->dns_cache_size--;
+			__nopoll_ctx_dns_entry_release (entry);
+			return;
+		} /* end if */
+		link = &((*link)->next);
+	} /* end while */
+	return;
+}
 
 /** 
- * @brief allows to release a reference acquired to the provided
- * noPoll context.
- *
- * @param ctx The noPoll context reference to release..
+ * @internal Removes all entries from the host names cache (the
+ * caller must hold ctx->ref_mutex or be the only owner).
  */
-void           nopoll_ctx_unref (noPollCtx * ctx)
+void __nopoll_ctx_dns_cache_release (noPollCtx * ctx)
 {
-	noPollCertificate * cert;
-	int iterator;
+	while (ctx->dns_cache)
+		__nopoll_ctx_dns_unlink (ctx, ctx->dns_cache);
+	return;
+}
 
-	nopoll_return_if_fail (ctx, ctx);
+/** 
+ * @internal Estimated memory (bytes) used by the provided stream
+ * (see zlib zconf.h memory usage notes).
+ */
+long __nopoll_ctx_zstream_memory (noPollZStream * zstream)
+{
+	if (zstream->is_deflate)
+		return (1L << (zstream->window_bits + 2)) + (1L << (8 + 9)) + (long) sizeof (noPollZStream);
+	return (1L << zstream->window_bits) + 7168 + (long) sizeof (noPollZStream);
+}
 
-	/* acquire mutex here */
-	nopoll_mutex_lock (ctx->ref_mutex);
+/** 
+ * @internal Releases the provided stream (the caller must not hold
+ * ctx->ref_mutex).
+ */
+void __nopoll_ctx_zstream_free (noPollCtx * ctx, noPollZStream * zstream)
+{
+#if defined(NOPOLL_HAVE_ZLIB)
+	if (zstream->is_deflate)
+		deflateEnd (&zstream->stream);
+	else
+		inflateEnd (&zstream->stream);
+#endif
 
-	ctx->refs--;
-	if (ctx->refs != 0) {
-		/* release mutex here */
-		nopoll_mutex_unlock (ctx->ref_mutex);
-		return;
-	}
-	/* release mutex here */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ctx->zstreams--;
+	ctx->zstreams_memory -= __nopoll_ctx_zstream_memory (zstream);
 	nopoll_mutex_unlock (ctx->ref_mutex);
 
-	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Releasing no poll context %p (%d, conns: %d)", ctx, ctx->refs, ctx->conn_length);
-
-	iterator = 0;
-	while (iterator < ctx->certificates_length) {
-		/* get reference */
-		cert = &(ctx->certificates[iterator]);
+	nopoll_free (zstream);
+	return;
+}
 
-		/* release */
-		nopoll_free (cert->serverName);
-		nopoll_free (cert->certificateFile);
-		nopoll_free (cert->privateKey);
-		nopoll_free (cert->optionalChainFile);
+/** 
+ * @internal Removes idle streams from the pool above the max
+ * configured (the caller must not hold ctx->ref_mutex).
+ */
+void __nopoll_ctx_zstream_pool_trim (noPollCtx * ctx, int max_idle)
+{
+	noPollZStream * zstream;
+	int             iterator;
+
+	while (nopoll_true) {
+		/* take next idle stream */
+		zstream = NULL;
+		nopoll_mutex_lock (ctx->ref_mutex);
+		if (ctx->zstreams_idle > max_idle) {
+			if (ctx->inflate_pool) {
+				zstream           = ctx->inflate_pool;
+				ctx->inflate_pool = zstream->next;
+			} else {
+				for (iterator = 0; iterator < 16 && zstream == NULL; iterator++) {
+					zstream = ctx->deflate_pool[iterator];
+					if (zstream)
+						ctx->deflate_pool[iterator] = zstream->next;
+				} /* end for */
+			} /* end if */
+			if (zstream)
+				ctx->zstreams_idle--;
+		} /* end if */
+		nopoll_mutex_unlock (ctx->ref_mutex);
 
-		/* next position */
-		iterator++;
+		if (zstream == NULL)
+			break;
+		__nopoll_ctx_zstream_free (ctx, zstream);
 	} /* end while */
+	return;
+}
 
-	/* release mutex */
-	nopoll_mutex_destroy (ctx->ref_mutex);
-
-	/* release all certificates buckets */
-	nopoll_free (ctx->certificates);
+#if defined(NOPOLL_HAVE_ZLIB)
+/** 
+ * @internal zlib allocation handlers, so memory used by streams is
+ * taken with the allocator configured (see nopoll_set_allocator).
+ */
+voidpf __nopoll_ctx_zalloc (voidpf opaque, uInt items, uInt size)
+{
+	return nopoll_calloc (items, size);
+}
 
-	/* release connection */
-	nopoll_free (ctx->conn_list);
-	ctx->conn_length = 0;
-	nopoll_free (ctx);
+void __nopoll_ctx_zfree (voidpf opaque, voidpf address)
+{
+	nopoll_free (address);
 	return;
 }
+#endif
 
 /** 
- * @brief Allows to get current reference counting for the provided
- * context.
- *
- * @param ctx The context the reference counting is being requested.
+ * @internal Gets a compression (or decompression) stream with the
+ * window bits provided. Shared streams are taken from the context
+ * pool (when enabled) and must be returned with
+ * __nopoll_ctx_zstream_release once the message is processed.
  *
- * @return The reference counting or -1 if it fails.
+ * @return A noPollZStream reference or NULL if it fails.
  */
-int            nopoll_ctx_ref_count (noPollCtx * ctx)
+noPollPtr __nopoll_ctx_zstream_get (noPollCtx * ctx, nopoll_bool is_deflate, int window_bits, nopoll_bool shared)
 {
-	int result;
-	if (! ctx)
-		return -1;
+#if defined(NOPOLL_HAVE_ZLIB)
+	noPollZStream  * zstream = NULL;
+	noPollZStream ** pool;
+	int              status;
+
+	/* decompression accepts any window */
+	if (! is_deflate)
+		window_bits = 15;
+	pool = is_deflate ? &(ctx->deflate_pool[window_bits]) : &(ctx->inflate_pool);
 
-	/* lock */
 	nopoll_mutex_lock (ctx->ref_mutex);
+	shared = shared && ctx->deflate_pool_size > 0;
+	if (shared && *pool) {
+		zstream       = *pool;
+		*pool         = zstream->next;
+		zstream->next = NULL;
+		ctx->zstreams_idle--;
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	if (zstream)
+		return zstream;
 
-	result = ctx->refs;
+	/* create a new one */
+	zstream = nopoll_new (noPollZStream, 1);
+	if (zstream == NULL)
+		return NULL;
+	zstream->is_deflate  = is_deflate;
+	zstream->window_bits = window_bits;
+	zstream->pooled      = shared;
+	zstream->stream.zalloc = __nopoll_ctx_zalloc;
+	zstream->stream.zfree  = __nopoll_ctx_zfree;
+	if (is_deflate)
+		status = deflateInit2 (&zstream->stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, - window_bits, 8, Z_DEFAULT_STRATEGY);
+	else
+		status = inflateInit2 (&zstream->stream, - window_bits);
+	if (status != Z_OK) {
+		nopoll_free (zstream);
+		return NULL;
+	} /* end if */
 
-	/* unlock */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ctx->zstreams++;
+	ctx->zstreams_memory += __nopoll_ctx_zstream_memory (zstream);
 	nopoll_mutex_unlock (ctx->ref_mutex);
 
-	return result;
+	return zstream;
+#else
+	return NULL;
+#endif
 }
 
 /** 
- * @internal Function used to register the provided connection on the
- * provided context.
- *
- * @param ctx The context where the connection will be registered.
- *
- * @param conn The connection to be registered.
- *
- * @return nopoll_true if the connection was registered, otherwise
- * nopoll_false is returned.
+ * @internal Releases the provided stream: shared streams are reset
+ * and returned to the pool (if there is room for them), the rest
+ * are released.
  */
-nopoll_bool           nopoll_ctx_register_conn (noPollCtx  * ctx, 
-						noPollConn * conn)
+void __nopoll_ctx_zstream_release (noPollCtx * ctx, noPollPtr ptr)
 {
-	int iterator;
-
-	nopoll_return_val_if_fail (ctx, ctx && conn, nopoll_false);
+	noPollZStream  * zstream = ptr;
+	noPollZStream ** pool;
 
-	/* acquire mutex here */
-	nopoll_mutex_lock (ctx->ref_mutex);
-
-	/* get connection */
-	conn->id = ctx->conn_id;
-	ctx->conn_id ++;
-
-	/* register connection */
-	iterator = 0;
-	while (iterator < ctx->conn_length) {
-
-		/* register reference */
-		if (ctx->conn_list[iterator] == 0) {
-			ctx->conn_list[iterator] = conn;
-
-			/* update connection list number */
-			ctx->conn_num++;
+	if (zstream == NULL)
+		return;
 
-			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "registered connection id %d, role: %d", conn->id, conn->role);
+	if (zstream->pooled) {
+#if defined(NOPOLL_HAVE_ZLIB)
+		if (zstream->is_deflate)
+			deflateReset (&zstream->stream);
+		else
+			inflateReset (&zstream->stream);
+#endif
+		pool = zstream->is_deflate ? &(ctx->deflate_pool[zstream->window_bits]) : &(ctx->inflate_pool);
 
-			/* release */
+		nopoll_mutex_lock (ctx->ref_mutex);
+		if (ctx->zstreams_idle < ctx->deflate_pool_size) {
+			zstream->next = *pool;
+			*pool         = zstream;
+			ctx->zstreams_idle++;
 			nopoll_mutex_unlock (ctx->ref_mutex);
+			return;
+		} /* end if */
+		nopoll_mutex_unlock (ctx->ref_mutex);
+	} /* end if */
 
-			/* acquire reference */
-			nopoll_ctx_ref (ctx);
-			
-			/* acquire a reference to the conection */
-			nopoll_conn_ref (conn);
+	__nopoll_ctx_zstream_free (ctx, zstream);
+	return;
+}
 
-			/* release mutex here */
-			return nopoll_true;
-		}
-		
-		iterator++;
-	} /* end while */
+/** 
+ * @internal Accounts content compressed (bytes provided and bytes
+ * produced) on the context counters.
+ */
+void __nopoll_ctx_deflate_count (noPollCtx * ctx, long bytes_in, long bytes_out)
+{
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ctx->deflate_bytes_in  += bytes_in;
+	ctx->deflate_bytes_out += bytes_out;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	return;
+}
 
-	/* if reached this place it means no more buckets are
-	 * available, acquire more memory (increase 10 by 10) */
-	ctx->conn_length += 10;
-	ctx->conn_list = (noPollConn**) nopoll_realloc (ctx->conn_list, sizeof (noPollConn *) * (ctx->conn_length));
-	if (ctx->conn_list == NULL) {
-		/* release mutex */
-		nopoll_mutex_unlock (ctx->ref_mutex);
+/** 
+ * @internal Gets a message holder (zeroed) from the context pool or
+ * allocates a new one when the pool is empty. Must be returned with
+ * __nopoll_ctx_msg_release.
+ *
+ * @return A noPollMsg reference or NULL if it fails.
+ */
+noPollPtr __nopoll_ctx_msg_get (noPollCtx * ctx)
+{
+	noPollMsg * msg;
+
+	nopoll_mutex_lock (ctx->msg_pool_mutex);
+	msg = ctx->msg_pool;
+	if (msg) {
+		ctx->msg_pool = msg->next;
+		ctx->msg_pool_idle--;
+		ctx->msg_pool_hits++;
+	} else
+		ctx->msg_pool_misses++;
+	nopoll_mutex_unlock (ctx->msg_pool_mutex);
+
+	if (msg == NULL)
+		return nopoll_new (noPollMsg, 1);
+
+	memset (msg, 0, sizeof (noPollMsg));
+	return msg;
+}
 
-		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "General connection registration error, memory acquisition failed..");
-		return nopoll_false;
+/** 
+ * @internal Returns the provided message holder to the context pool
+ * (if there is room for it), otherwise it is released.
+ */
+void __nopoll_ctx_msg_release (noPollCtx * ctx, noPollPtr ptr)
+{
+	noPollMsg * msg = ptr;
+
+	nopoll_mutex_lock (ctx->msg_pool_mutex);
+	if (ctx->msg_pool_idle < ctx->msg_pool_size) {
+		msg->next     = ctx->msg_pool;
+		ctx->msg_pool = msg;
+		ctx->msg_pool_idle++;
+		nopoll_mutex_unlock (ctx->msg_pool_mutex);
+		return;
 	} /* end if */
-	
-	/* clear new positions */
-	iterator = (ctx->conn_length - 10);
-	while (iterator < ctx->conn_length) {
-		ctx->conn_list[iterator] = 0;
-		/* next position */
-		iterator++;
-	} /* end while */
-
-	/* release mutex here */
-	nopoll_mutex_unlock (ctx->ref_mutex);
+	nopoll_mutex_unlock (ctx->msg_pool_mutex);
 
-	/* ok, now register connection because we have memory */
-	return nopoll_ctx_register_conn (ctx, conn);
+	nopoll_free (msg);
+	return;
 }
 
 /** 
- * @internal Function used to register the provided connection on the
- * provided context.
+ * @internal Gets a buffer of at least the size provided: buffers up
+ * to the biggest size class are taken from the context pool (or
+ * allocated with the size of their class), the rest are allocated
+ * as usual.
  *
- * @param ctx The context where the connection will be registered.
+ * @param buffer_class Reference where the class of the buffer is
+ * reported (to be provided to __nopoll_ctx_buffer_release), 0 when
+ * it doesn't belong to any class.
  *
- * @param conn The connection to be registered.
+ * @return A buffer reference or NULL if it fails.
  */
-void           nopoll_ctx_unregister_conn (noPollCtx  * ctx, 
-					   noPollConn * conn)
+char * __nopoll_ctx_buffer_get (noPollCtx * ctx, long size, int * buffer_class)
 {
-	int iterator;
-
-	nopoll_return_if_fail (ctx, ctx && conn);
+	char * buffer = NULL;
+	int    iterator;
 
-	/* acquire mutex here */
-	nopoll_mutex_lock (ctx->ref_mutex);
-
-	/* find the connection and remove it from the array */
+	/* find size class */
 	iterator = 0;
-	while (iterator < ctx->conn_length) {
+	while (iterator < NOPOLL_MSG_BUFFER_CLASSES && size > NOPOLL_MSG_BUFFER_SIZE (iterator))
+		iterator++;
 
-		/* check the connection reference */
-		if (ctx->conn_list && ctx->conn_list[iterator] && ctx->conn_list[iterator]->id == conn->id) {
-			/* remove reference */
-			ctx->conn_list[iterator] = NULL;
+	nopoll_mutex_lock (ctx->msg_pool_mutex);
+	if (iterator == NOPOLL_MSG_BUFFER_CLASSES || ctx->msg_pool_size == 0) {
+		/* not pooled */
+		nopoll_mutex_unlock (ctx->msg_pool_mutex);
+		(*buffer_class) = 0;
+		return nopoll_new (char, size);
+	} /* end if */
 
-			/* update connection list number */
+	buffer = ctx->buffer_pool[iterator];
+	if (buffer) {
+		/* idle buffers keep the next one at the beginning */
+		memcpy (&(ctx->buffer_pool[iterator]), buffer, sizeof (char *));
+		ctx->buffer_pool_idle[iterator]--;
+		ctx->buffer_pool_memory -= NOPOLL_MSG_BUFFER_SIZE (iterator);
+		ctx->msg_pool_hits++;
+	} else
+		ctx->msg_pool_misses++;
+	nopoll_mutex_unlock (ctx->msg_pool_mutex);
+
+	if (buffer == NULL)
+		buffer = nopoll_new (char, NOPOLL_MSG_BUFFER_SIZE (iterator));
+	(*buffer_class) = buffer ? iterator + 1 : 0;
+	return buffer;
+}
+
+/** 
+ * @internal Returns the provided buffer to the context pool (if
+ * there is room for it), otherwise it is released.
+ */
+void __nopoll_ctx_buffer_release (noPollCtx * ctx, char * buffer, int buffer_class)
+{
+	if (buffer == NULL)
+		return;
+
+	if (buffer_class > 0) {
+		buffer_class--;
+		nopoll_mutex_lock (ctx->msg_pool_mutex);
+		if (ctx->buffer_pool_idle[buffer_class] < ctx->msg_pool_size && 
+		    ctx->buffer_pool_memory + NOPOLL_MSG_BUFFER_SIZE (buffer_class) <= ctx->msg_pool_memory) {
+			memcpy (buffer, &(ctx->buffer_pool[buffer_class]), sizeof (char *));
+			ctx->buffer_pool[buffer_class] = buffer;
+			ctx->buffer_pool_idle[buffer_class]++;
+			ctx->buffer_pool_memory += NOPOLL_MSG_BUFFER_SIZE (buffer_class);
+			nopoll_mutex_unlock (ctx->msg_pool_mutex);
+			return;
+		} /* end if */
+		nopoll_mutex_unlock (ctx->msg_pool_mutex);
+	} /* end if */
+
+	nopoll_free (buffer);
+	return;
+}
+
+/** 
+ * @internal Releases idle message holders and buffers above the max
+ * configured (the caller must not hold ctx->msg_pool_mutex).
+ */
+void __nopoll_ctx_msg_pool_trim (noPollCtx * ctx, int max_idle, long max_memory)
+{
+	noPollMsg * msg;
+	char      * buffer;
+	int         iterator;
+
+	nopoll_mutex_lock (ctx->msg_pool_mutex);
+	while (ctx->msg_pool_idle > max_idle) {
+		msg           = ctx->msg_pool;
+		ctx->msg_pool = msg->next;
+		ctx->msg_pool_idle--;
+		nopoll_free (msg);
+	} /* end while */
+
+	/* release bigger buffers first */
+	iterator = NOPOLL_MSG_BUFFER_CLASSES - 1;
+	while (iterator >= 0) {
+		while (ctx->buffer_pool_idle[iterator] > 0 &&
+		       (ctx->buffer_pool_idle[iterator] > max_idle || ctx->buffer_pool_memory > max_memory)) {
+			buffer = ctx->buffer_pool[iterator];
+			memcpy (&(ctx->buffer_pool[iterator]), buffer, sizeof (char *));
+			ctx->buffer_pool_idle[iterator]--;
+			ctx->buffer_pool_memory -= NOPOLL_MSG_BUFFER_SIZE (iterator);
+			nopoll_free (buffer);
+		} /* end while */
+		iterator--;
+	} /* end while */
+	nopoll_mutex_unlock (ctx->msg_pool_mutex);
+	return;
+}
+
+/** 
+ * @internal Finds the cached entry for the provided host name, port
+ * and transport, removing expired entries found (the caller must
+ * hold ctx->ref_mutex).
+ */
+noPollDnsEntry * __nopoll_ctx_dns_lookup (noPollCtx * ctx, const char * host, const char * port, noPollTransport transport)
+{
+	noPollDnsEntry * entry = ctx->dns_cache;
+	noPollDnsEntry * next;
+	long             now   = (long) time (NULL);
+
+	while (entry) {
+		next = entry->next;
+		if (entry->state != NOPOLL_DNS_RESOLVING && entry->expires <= now)
+			__nopoll_ctx_dns_unlink (ctx, entry);
+		else if (entry->transport == transport && nopoll_cmp (entry->host, host) && nopoll_cmp (entry->port, port))
+			return entry;
+		entry = next;
+	} /* end while */
+
+	return NULL;
+}
+
+/** 
+ * @internal Creates a new entry (in resolving state) for the provided
+ * host name, port and transport, adding it to the cache if requested
+ * (the caller must hold ctx->ref_mutex). The least recently added
+ * entry (not being resolved) is removed when the cache is full.
+ */
+noPollDnsEntry * __nopoll_ctx_dns_entry_new (noPollCtx * ctx, const char * host, const char * port, noPollTransport transport, nopoll_bool cached)
+{
+	noPollDnsEntry * entry;
+	noPollDnsEntry * oldest;
+	noPollDnsEntry * next;
+
+	entry = nopoll_new (noPollDnsEntry, 1);
+	if (entry == NULL)
+		return NULL;
+	entry->host      = nopoll_strdup (host);
+	entry->port      = nopoll_strdup (port);
+	entry->transport = transport;
+	entry->state     = NOPOLL_DNS_RESOLVING;
+	entry->ctx       = ctx;
+	entry->refs      = 1;
+	if (! cached)
+		return entry;
+
+	/* make room */
+	if (ctx->dns_cache_size >= NOPOLL_DNS_CACHE_SIZE) {
+		oldest = NULL;
+		next   = ctx->dns_cache;
+		while (next) {
+			if (next->state != NOPOLL_DNS_RESOLVING)
+				oldest = next;
+			next = next->next;
+		} /* end while */
+		if (oldest)
+			__nopoll_ctx_dns_unlink (ctx, oldest);
+	} /* end if */
+
+	entry->cached  = nopoll_true;
+	entry->next    = ctx->dns_cache;
+	ctx->dns_cache = entry;
+	ctx->dns_cache_size++;
+
+	/* reference for the caller */
+	entry->refs++;
+	return entry;
+}
+
+/** 
+ * @internal Records the result of the host name resolution on the
+ * provided entry (the caller must hold ctx->ref_mutex). The TTL
+ * reported (-1 if unknown) is limited to the one configured on the
+ * context.
+ */
+void __nopoll_ctx_dns_entry_set (noPollCtx * ctx, noPollDnsEntry * entry, nopoll_bool resolved,
+				 struct sockaddr_storage * addr, int addr_size, int ttl)
+{
+	int max_ttl = resolved ? ctx->dns_positive_ttl : ctx->dns_negative_ttl;
+
+	if (ttl < 0 || ttl > max_ttl)
+		ttl = max_ttl;
+
+	entry->state   = resolved ? NOPOLL_DNS_RESOLVED : NOPOLL_DNS_FAILED;
+	entry->expires = (long) time (NULL) + ttl;
+	if (resolved) {
+		memcpy (&(entry->addr), addr, addr_size);
+		entry->addr_size = addr_size;
+	} /* end if */
+
+	/* not worth caching */
+	if (ttl <= 0 && entry->cached)
+		__nopoll_ctx_dns_unlink (ctx, entry);
+	return;
+}
+
+/** 
+ * @internal Gets the result of the provided entry (the caller must
+ * hold ctx->ref_mutex).
+ *
+ * @return 1 if resolved (addr updated), -1 if failed or 0 if still
+ * resolving.
+ */
+int __nopoll_ctx_dns_entry_get (noPollDnsEntry * entry, struct sockaddr_storage * addr, int * addr_size)
+{
+	switch (entry->state) {
+	case NOPOLL_DNS_RESOLVED:
+		memcpy (addr, &(entry->addr), entry->addr_size);
+		*addr_size = entry->addr_size;
+		return 1;
+	case NOPOLL_DNS_FAILED:
+		return -1;
+	default:
+		return 0;
+	} /* end switch */
+}
+
+/** 
+ * @internal Resolves the provided host name if it is a numeric
+ * address (no query is done).
+ */
+nopoll_bool __nopoll_ctx_dns_numeric (const char * host, const char * port, noPollTransport transport,
+				      struct sockaddr_storage * addr, int * addr_size)
+{
+	struct addrinfo   hints, *res = NULL;
+
+	memset (&hints, 0, sizeof (struct addrinfo));
+	hints.ai_family   = (transport == NOPOLL_TRANSPORT_IPV6) ? AF_INET6 : AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags    = AI_NUMERICHOST;
+
+	if (getaddrinfo (host, port, &hints, &res) != 0 || res == NULL)
+		return nopoll_false;
+
+	memcpy (addr, res->ai_addr, res->ai_addrlen);
+	*addr_size = res->ai_addrlen;
+	freeaddrinfo (res);
+	return nopoll_true;
+}
+
+/** 
+ * @internal Resolves the provided host name (blocking the caller)
+ * with the resolver handler configured or getaddrinfo. The TTL
+ * reported by the resolver handler (or -1) is placed on ttl.
+ */
+nopoll_bool __nopoll_ctx_dns_query (noPollCtx * ctx, const char * host, const char * port, noPollTransport transport,
+				    struct sockaddr_storage * addr, int * addr_size, int * ttl)
+{
+	struct addrinfo   hints, *res = NULL;
+	char              address[128];
+
+	*ttl = -1;
+	if (ctx->resolver) {
+		memset (address, 0, sizeof (address));
+		if (! ctx->resolver (ctx, host, port, transport, address, sizeof (address) - 1, ttl, ctx->resolver_data)) {
+			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "unable to resolve host name %s, resolver handler failed", host);
+			return nopoll_false;
+		} /* end if */
+
+		/* numeric address reported */
+		if (! __nopoll_ctx_dns_numeric (address, port, transport, addr, addr_size)) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "resolver handler reported a wrong address for %s: %s", host, address);
+			return nopoll_false;
+		} /* end if */
+		return nopoll_true;
+	} /* end if */
+
+	memset (&hints, 0, sizeof (struct addrinfo));
+	hints.ai_family   = (transport == NOPOLL_TRANSPORT_IPV6) ? AF_INET6 : AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo (host, port, &hints, &res) != 0 || res == NULL) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "unable to resolve host name %s, errno=%d", host, errno);
+		return nopoll_false;
+	} /* end if */
+
+	memcpy (addr, res->ai_addr, res->ai_addrlen);
+	*addr_size = res->ai_addrlen;
+	freeaddrinfo (res);
+	return nopoll_true;
+}
+
+/** 
+ * @internal Resolves the provided host name, blocking the caller
+ * unless the result is cached (results are cached according to the
+ * TTL configured).
+ */
+nopoll_bool __nopoll_ctx_dns_resolve (noPollCtx * ctx, const char * host, const char * port, noPollTransport transport,
+				      struct sockaddr_storage * addr, int * addr_size)
+{
+	noPollDnsEntry * entry;
+	nopoll_bool      result;
+	int              ttl;
+
+	if (__nopoll_ctx_dns_numeric (host, port, transport, addr, addr_size))
+		return nopoll_true;
+
+	/* check cache */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	entry = __nopoll_ctx_dns_lookup (ctx, host, port, transport);
+	if (entry && entry->state != NOPOLL_DNS_RESOLVING) {
+		result = __nopoll_ctx_dns_entry_get (entry, addr, addr_size) == 1;
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "host name %s:%s found in cache (resolved: %d)", host, port, result);
+		return result;
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	result = __nopoll_ctx_dns_query (ctx, host, port, transport, addr, addr_size, &ttl);
+
+	/* record result (unless being resolved by the resolver
+	 * thread) */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (__nopoll_ctx_dns_lookup (ctx, host, port, transport) == NULL) {
+		entry = __nopoll_ctx_dns_entry_new (ctx, host, port, transport, nopoll_true);
+		if (entry) {
+			__nopoll_ctx_dns_entry_set (ctx, entry, result, addr, *addr_size, ttl);
+			__nopoll_ctx_dns_entry_release (entry);
+		} /* end if */
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return result;
+}
+
+/** 
+ * @internal Resolver thread: resolves the host name of the provided
+ * entry and wakes up loops so connections waiting for it continue.
+ */
+#if defined(NOPOLL_OS_WIN32)
+DWORD WINAPI __nopoll_ctx_dns_worker (LPVOID data)
+#else
+noPollPtr __nopoll_ctx_dns_worker (noPollPtr data)
+#endif
+{
+	noPollDnsEntry          * entry = (noPollDnsEntry *) data;
+	noPollCtx               * ctx   = entry->ctx;
+	struct sockaddr_storage   addr;
+	int                       addr_size = 0;
+	int                       ttl;
+	nopoll_bool               result;
+	int                       iterator;
+
+	result = __nopoll_ctx_dns_query (ctx, entry->host, entry->port, entry->transport, &addr, &addr_size, &ttl);
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	__nopoll_ctx_dns_entry_set (ctx, entry, result, &addr, addr_size, ttl);
+	__nopoll_ctx_dns_entry_release (entry);
+
+	/* notify loops */
+	iterator = 0;
+	while (iterator < ctx->loops_num) {
+		ctx->loops[iterator].resolve_pending = nopoll_true;
+		if (ctx->loops[iterator].io_waiting)
+			__nopoll_loop_wakeup_loop (&(ctx->loops[iterator]));
+		iterator++;
+	} /* end while */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* release reference acquired for the thread */
+	nopoll_ctx_unref (ctx);
+	return 0;
+}
+
+/** 
+ * @internal Starts the resolver thread for the provided entry (the
+ * caller must hold ctx->ref_mutex).
+ */
+nopoll_bool __nopoll_ctx_dns_worker_start (noPollCtx * ctx, noPollDnsEntry * entry)
+{
+#if defined(NOPOLL_OS_WIN32)
+	HANDLE      thread;
+#else
+	pthread_t   thread;
+	int         error;
+#endif
+
+	/* references for the thread */
+	entry->refs++;
+	nopoll_atomic_inc (&ctx->refs);
+
+#if defined(NOPOLL_OS_WIN32)
+	thread = CreateThread (NULL, 0, __nopoll_ctx_dns_worker, entry, 0, NULL);
+	if (thread != NULL) {
+		CloseHandle (thread);
+		return nopoll_true;
+	} /* end if */
+	nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Failed to create resolver thread for %s, error code was: %d", entry->host, GetLastError ());
+#else
+	error = pthread_create (&thread, NULL, __nopoll_ctx_dns_worker, entry);
+	if (error == 0) {
+		pthread_detach (thread);
+		return nopoll_true;
+	} /* end if */
+	nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Failed to create resolver thread for %s, error code was: %d", entry->host, error);
+#endif
+
+	entry->refs--;
+	nopoll_atomic_dec (&ctx->refs);
+	return nopoll_false;
+}
+
+/** 
+ * @internal Starts resolving the provided host name without blocking
+ * the caller: the result is taken from the cache (or the host is a
+ * numeric address) or it is resolved by a resolver thread (only one
+ * for each host name at a time), see __nopoll_ctx_dns_entry_take.
+ *
+ * @return A reference to the entry (noPollDnsEntry) holding the
+ * result or NULL if it fails.
+ */
+noPollPtr __nopoll_ctx_dns_resolve_async (noPollCtx * ctx, const char * host, const char * port, noPollTransport transport)
+{
+	noPollDnsEntry          * entry;
+	struct sockaddr_storage   addr;
+	int                       addr_size;
+	int                       ttl;
+	nopoll_bool               result;
+
+	if (__nopoll_ctx_dns_numeric (host, port, transport, &addr, &addr_size)) {
+		/* numeric address (not cached) */
+		entry = __nopoll_ctx_dns_entry_new (ctx, host, port, transport, nopoll_false);
+		if (entry)
+			__nopoll_ctx_dns_entry_set (ctx, entry, nopoll_true, &addr, addr_size, 0);
+		return entry;
+	} /* end if */
+
+	/* cached or being resolved */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	entry = __nopoll_ctx_dns_lookup (ctx, host, port, transport);
+	if (entry) {
+		entry->refs++;
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		return entry;
+	} /* end if */
+
+	/* resolver thread (only with threading support installed) */
+	entry = __nopoll_ctx_dns_entry_new (ctx, host, port, transport, nopoll_true);
+	if (entry == NULL || (ctx->ref_mutex && __nopoll_ctx_dns_worker_start (ctx, entry))) {
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		return entry;
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* no thread available, resolve it now */
+	result = __nopoll_ctx_dns_query (ctx, host, port, transport, &addr, &addr_size, &ttl);
+	nopoll_mutex_lock (ctx->ref_mutex);
+	__nopoll_ctx_dns_entry_set (ctx, entry, result, &addr, addr_size, ttl);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return entry;
+}
+
+/** 
+ * @internal Gets the result of the host name resolution referenced
+ * by entry (see __nopoll_ctx_dns_resolve_async). Once finished, the
+ * reference is released and entry is cleared.
+ *
+ * @return 1 if resolved (addr updated), -1 if failed or 0 if still
+ * resolving (or entry is NULL).
+ */
+int __nopoll_ctx_dns_entry_take (noPollCtx * ctx, noPollPtr * entry, struct sockaddr_storage * addr, int * addr_size)
+{
+	int result = 0;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (*entry) {
+		result = __nopoll_ctx_dns_entry_get ((noPollDnsEntry *) *entry, addr, addr_size);
+		if (result != 0) {
+			__nopoll_ctx_dns_entry_release ((noPollDnsEntry *) *entry);
+			*entry = NULL;
+		} /* end if */
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return result;
+}
+
+/** 
+ * @brief Allows to acquire a reference to the provided context. This
+ * reference is released by calling to \ref nopoll_ctx_unref.
+ *
+ * @param ctx The context to acquire a reference.
+ *
+ * @return The function returns nopoll_true in the case the reference
+ * was acquired, otherwise nopoll_false is returned.
+ */ 
+nopoll_bool    nopoll_ctx_ref (noPollCtx * ctx)
+{
+	/* return false value */
+	nopoll_return_val_if_fail (ctx, ctx, nopoll_false);
+
+	nopoll_atomic_inc (&ctx->refs);
+
+	return nopoll_true;
+}
+
+
+/** 
+ * @brief allows to release a reference acquired to the provided
+ * noPoll context.
+ *
+ * @param ctx The noPoll context reference to release..
+ */
+void           nopoll_ctx_unref (noPollCtx * ctx)
+{
+	noPollCertificate * cert;
+	int iterator;
+
+	nopoll_return_if_fail (ctx, ctx);
+
+	if (nopoll_atomic_dec (&ctx->refs) != 0)
+		return;
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Releasing no poll context %p (%d, conns: %d)", ctx, ctx->refs, ctx->conn_length);
+
+	iterator = 0;
+	while (iterator < ctx->certificates_length) {
+		/* get reference */
+		cert = &(ctx->certificates[iterator]);
+
+		/* release */
+		nopoll_free (cert->serverName);
+		nopoll_free (cert->certificateFile);
+		nopoll_free (cert->privateKey);
+		nopoll_free (cert->optionalChainFile);
+
+		/* next position */
+		iterator++;
+	} /* end while */
+
+	/* release compression streams pooled */
+	__nopoll_ctx_zstream_pool_trim (ctx, 0);
+
+	/* release message holders and buffers pooled */
+	__nopoll_ctx_msg_pool_trim (ctx, 0, 0);
+	nopoll_mutex_destroy (ctx->msg_pool_mutex);
+
+	/* release mutex */
+	nopoll_mutex_destroy (ctx->ref_mutex);
+
+	/* release loops */
+	__nopoll_ctx_loops_release (ctx, 0);
+	nopoll_free (ctx->loops);
+
+	/* release all certificates buckets */
+	nopoll_free (ctx->certificates);
+	nopoll_free (ctx->certificates_index);
+
+	/* release TLS sessions saved */
+	__nopoll_ctx_tls_sessions_release (ctx);
+
+	/* release host names cached */
+	__nopoll_ctx_dns_cache_release (ctx);
+
+	/* release connection */
+	nopoll_free (ctx->conn_list);
+	ctx->conn_length = 0;
+	nopoll_free (ctx);
+	return;
+}
+
+/** 
+ * @brief Allows to get current reference counting for the provided
+ * context.
+ *
+ * @param ctx The context the reference counting is being requested.
+ *
+ * @return The reference counting or -1 if it fails.
+ */
+int            nopoll_ctx_ref_count (noPollCtx * ctx)
+{
+	if (! ctx)
+		return -1;
+
+	return nopoll_atomic_get (&ctx->refs);
+}
+
+/** 
+ * @internal Function used to register the provided connection on the
+ * provided context.
+ *
+ * @param ctx The context where the connection will be registered.
+ *
+ * @param conn The connection to be registered.
+ *
+ * @return nopoll_true if the connection was registered, otherwise
+ * nopoll_false is returned.
+ */
+nopoll_bool           nopoll_ctx_register_conn (noPollCtx  * ctx, 
+						noPollConn * conn)
+{
+	int iterator;
+
+	nopoll_return_val_if_fail (ctx, ctx && conn, nopoll_false);
+
+	/* acquire mutex here */
+	nopoll_mutex_lock (ctx->ref_mutex);
+
+	/* get connection */
+	conn->id = ctx->conn_id;
+	ctx->conn_id ++;
+
+	/* register connection */
+	iterator = 0;
+	while (iterator < ctx->conn_length) {
+
+		/* register reference */
+		if (ctx->conn_list[iterator] == 0) {
+			ctx->conn_list[iterator] = conn;
+
+			/* update connection list number */
+			ctx->conn_num++;
+
+			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "registered connection id %d, role: %d, worker: %d", conn->id, conn->role, conn->worker);
+
+			/* register socket into the io engine (only
+			 * for engines with persistent registration) */
+			if (! __nopoll_io_add_conn (ctx, conn))
+				nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Failed to add socket %d to the io engine for conn-id=%d", conn->session, conn->id);
+
+			/* release */
+			nopoll_mutex_unlock (ctx->ref_mutex);
+
+			/* acquire reference */
+			nopoll_ctx_ref (ctx);
+			
+			/* acquire a reference to the conection */
+			nopoll_conn_ref (conn);
+
+			/* release mutex here */
+			return nopoll_true;
+		}
+		
+		iterator++;
+	} /* end while */
+
+	/* if reached this place it means no more buckets are
+	 * available, acquire more memory (increase 10 by 10) */
+	ctx->conn_length += 10;
+	ctx->conn_list = (noPollConn**) nopoll_realloc (ctx->conn_list, sizeof (noPollConn *) * (ctx->conn_length));
+	if (ctx->conn_list == NULL) {
+		/* release mutex */
+		nopoll_mutex_unlock (ctx->ref_mutex);
+
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "General connection registration error, memory acquisition failed..");
+		return nopoll_false;
+	} /* end if */
+	
+	/* clear new positions */
+	iterator = (ctx->conn_length - 10);
+	while (iterator < ctx->conn_length) {
+		ctx->conn_list[iterator] = 0;
+		/* next position */
+		iterator++;
+	} /* end while */
+
+	/* release mutex here */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* ok, now register connection because we have memory */
+	return nopoll_ctx_register_conn (ctx, conn);
+}
+
+/** 
+ * @internal Function used to register the provided connection on the
+ * provided context.
+ *
+ * @param ctx The context where the connection will be registered.
+ *
+ * @param conn The connection to be registered.
+ */
+void           nopoll_ctx_unregister_conn (noPollCtx  * ctx, 
+					   noPollConn * conn)
+{
+	int iterator;
+
+	nopoll_return_if_fail (ctx, ctx && conn);
+
+	/* acquire mutex here */
+	nopoll_mutex_lock (ctx->ref_mutex);
+
+	/* find the connection and remove it from the array */
+	iterator = 0;
+	while (iterator < ctx->conn_length) {
+
+		/* check the connection reference */
+		if (ctx->conn_list && ctx->conn_list[iterator] && ctx->conn_list[iterator]->id == conn->id) {
+			/* remove reference */
+			ctx->conn_list[iterator] = NULL;
+
+			/* remove socket from the io engine */
+			__nopoll_io_remove_conn (ctx, conn);
+
+			/* stop waiting for host name resolution */
+			__nopoll_ctx_dns_entry_release ((noPollDnsEntry *) conn->dns_entry);
+			conn->dns_entry = NULL;
+
+			/* let loops notifying this connection know it
+			 * is no longer available */
+			iterator = 0;
+			while (iterator < ctx->loops_num) {
+				if (ctx->loops[iterator].dispatch_conn == conn)
+					ctx->loops[iterator].dispatch_conn = NULL;
+				iterator++;
+			} /* end while */
+
+			/* update connection list number */
 			ctx->conn_num--;
 
-			/* release */
+			/* release */
+			nopoll_mutex_unlock (ctx->ref_mutex);
+
+			/* acquire a reference to the conection */
+			nopoll_conn_unref (conn);
+
+			return; 
+		} /* end if */
+		
+		iterator++;
+	} /* end while */
+
+	/* release mutex here */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return;
+}
+
+/** 
+ * @brief Allows to get number of connections currently registered.
+ *
+ * @param ctx The context where the operation is requested.
+ *
+ * @return Number of connections registered on this context or -1 if it fails.
+ */ 
+int            nopoll_ctx_conns (noPollCtx * ctx)
+{
+	nopoll_return_val_if_fail (ctx, ctx, -1);
+	return ctx->conn_num;
+}
+
+/** 
+ * @internal Lower case version of the character provided (server
+ * names are case insensitive).
+ */
+int __nopoll_ctx_name_lower (int value)
+{
+	if (value >= 'A' && value <= 'Z')
+		return value - 'A' + 'a';
+	return value;
+}
+
+/** 
+ * @internal Hash for the serverName provided (case insensitive).
+ */
+unsigned int __nopoll_ctx_name_hash (const char * serverName)
+{
+	unsigned int hash = 5381;
+
+	while (*serverName) {
+		hash = (hash * 33) + (unsigned int) __nopoll_ctx_name_lower ((unsigned char) *serverName);
+		serverName++;
+	} /* end while */
+
+	return hash;
+}
+
+/** 
+ * @internal Compares both server names (case insensitive).
+ */
+nopoll_bool __nopoll_ctx_name_cmp (const char * name1, const char * name2)
+{
+	while (*name1 && *name2) {
+		if (__nopoll_ctx_name_lower ((unsigned char) *name1) != __nopoll_ctx_name_lower ((unsigned char) *name2))
+			return nopoll_false;
+		name1++;
+		name2++;
+	} /* end while */
+
+	return *name1 == *name2;
+}
+
+/** 
+ * @internal Adds the certificate at the provided position to the
+ * serverName index, growing (and rebuilding) it when needed.
+ */
+void __nopoll_ctx_index_certificate (noPollCtx * ctx, int position)
+{
+	noPollCertificate * cert;
+	int                 size;
+	int               * index;
+	int                 iterator;
+	int                 bucket;
+
+	ctx->certificates[position].next = -1;
+	if (ctx->certificates[position].serverName == NULL)
+		return;
+
+	if (ctx->certificates_length > ctx->certificates_index_size) {
+		/* grow index and add again all certificates */
+		size = ctx->certificates_index_size ? ctx->certificates_index_size * 2 : 16;
+		index = nopoll_new (int, size);
+		if (index == NULL)
+			return;
+		nopoll_free (ctx->certificates_index);
+		ctx->certificates_index      = index;
+		ctx->certificates_index_size = size;
+
+		iterator = 0;
+		while (iterator < size) {
+			index[iterator] = -1;
+			iterator++;
+		} /* end while */
+
+		iterator = 0;
+		while (iterator < ctx->certificates_length) {
+			cert = &(ctx->certificates[iterator]);
+			if (cert->serverName) {
+				bucket                      = __nopoll_ctx_name_hash (cert->serverName) % size;
+				cert->next                  = index[bucket];
+				index[bucket]               = iterator;
+			} /* end if */
+			iterator++;
+		} /* end while */
+		return;
+	} /* end if */
+
+	bucket                              = __nopoll_ctx_name_hash (ctx->certificates[position].serverName) % ctx->certificates_index_size;
+	ctx->certificates[position].next    = ctx->certificates_index[bucket];
+	ctx->certificates_index[bucket]     = position;
+	return;
+}
+
+/** 
+ * @internal Finds the certificate installed for exactly the
+ * serverName provided.
+ */
+noPollCertificate * __nopoll_ctx_lookup_certificate (noPollCtx * ctx, const char * serverName)
+{
+	noPollCertificate * cert;
+	int                 position;
+
+	if (ctx->certificates_index == NULL)
+		return NULL;
+
+	position = ctx->certificates_index[__nopoll_ctx_name_hash (serverName) % ctx->certificates_index_size];
+	while (position != -1) {
+		cert = &(ctx->certificates[position]);
+		if (__nopoll_ctx_name_cmp (cert->serverName, serverName))
+			return cert;
+		position = cert->next;
+	} /* end while */
+
+	return NULL;
+}
+
+/** 
+ * @brief Allows to find the certificate associated to the provided serverName. 
+ *
+ * @param ctx The context where the operation will take place.
+ *
+ * @param serverName the servername to use as pattern to find the
+ * right certificate (case insensitive). If no certificate was
+ * installed for it, the wildcard certificate for its domain is
+ * returned (for example *.example.com for www.example.com). If NULL
+ * is provided the first certificate not refering to any serverName
+ * will be returned.
+ *
+ * @param certificateFile If provided a reference and the function
+ * returns nopoll_true, it will contain the certificateFile found.
+ *
+ * @param privateKey If provided a reference and the function
+ * returns nopoll_true, it will contain the privateKey found.
+ *
+ * @param optionalChainFile If provided a reference and the function
+ * returns nopoll_true, it will contain the optionalChainFile found.
+ *
+ * @return nopoll_true in the case the certificate was found,
+ * otherwise nopoll_false is returned.
+ */
+nopoll_bool    nopoll_ctx_find_certificate (noPollCtx   * ctx, 
+					    const char  * serverName, 
+					    const char ** certificateFile, 
+					    const char ** privateKey, 
+					    const char ** optionalChainFile)
+{
+	noPollCertificate * cert;
+	const char        * domain;
+	char                wildcard[256];
+
+	int iterator = 0;
+	nopoll_return_val_if_fail (ctx, ctx, nopoll_false);
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Finding a certificate for serverName=%s", serverName ? serverName : "<not defined>");
+
+	if (serverName) {
+		/* find exact serverName and then the wildcard
+		 * certificate for its domain (*.domain) */
+		cert = __nopoll_ctx_lookup_certificate (ctx, serverName);
+		domain = strchr (serverName, '.');
+		if (cert == NULL && domain && strlen (domain) < (sizeof (wildcard) - 1)) {
+			wildcard[0] = '*';
+			memcpy (wildcard + 1, domain, strlen (domain) + 1);
+			cert = __nopoll_ctx_lookup_certificate (ctx, wildcard);
+		} /* end if */
+
+		if (cert == NULL)
+			return nopoll_false;
+
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "   certificate stored associated to serverName=%s", cert->serverName);
+		if (certificateFile)
+			(*certificateFile)   = cert->certificateFile;
+		if (privateKey)
+			(*privateKey)        = cert->privateKey;
+		if (optionalChainFile)
+			(*optionalChainFile) = cert->optionalChainFile;
+		return nopoll_true;
+	} /* end if */
+
+	while (iterator < ctx->certificates_length) {
+		/* get cert */
+		cert = &(ctx->certificates[iterator]);
+		if (cert) {
+			/* found a certificate */
+		        nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "   certificate stored associated to serverName=%s", cert->serverName ? cert->serverName : "<not defined>");
+			if (serverName == NULL && cert->serverName == NULL) {
+				if (certificateFile)
+					(*certificateFile)   = cert->certificateFile;
+				if (privateKey)
+					(*privateKey)        = cert->privateKey;
+				if (optionalChainFile)
+					(*optionalChainFile) = cert->optionalChainFile;
+				return nopoll_true;
+			} /* end if */
+		} /* end if */
+
+		/* next position */
+		iterator++;
+	}
+
+	/* check for default certificate when serverName isn't defined */
+	if (serverName == NULL) {
+	        /* requested a certificate for an undefined serverName */
+	        iterator = 0;
+		while (iterator < ctx->certificates_length) {
+		        /* get cert */
+		        cert = &(ctx->certificates[iterator]);
+			if (cert) {
+			      /* found a certificate */
+			      nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "   serverName not defined, selecting first certificate from the list");
+			      if (certificateFile)
+			              (*certificateFile)   = cert->certificateFile;
+			      if (privateKey)
+			              (*privateKey)        = cert->privateKey;
+			      if (optionalChainFile)
+			              (*optionalChainFile) = cert->optionalChainFile;
+			      return nopoll_true;
+			} /* end if */
+		} /* end if */
+
+		/* next position */
+		iterator++;
+	} /* end if */
+
+	return nopoll_false;
+}
+
+/** 
+ * @brief Allows to install a certificate to be used in general by all
+ * listener connections working under the provided context.
+ *
+ * @param ctx The context where the certificate will be installed.
+ *
+ * @param serverName The optional server name to to limit the use of
+ * this certificate to the value provided here. Provide a NULL value
+ * to make the certificate provide to work under any server notified
+ * (Host: header) or via SNI (server name identification associated to
+ * the TLS transport). Use *.domain (for example *.example.com) to
+ * install a wildcard certificate for all names in a domain.
+ *
+ * Listeners select the certificate for the server name requested by
+ * clients through SNI when the TLS handshake starts (certificates are
+ * read from disk only the first time they are used).
+ *
+ * @param certificateFile The certificate file to be installed. 
+ *
+ * @param privateKey The private key file to use used.
+ *
+ * @param optionalChainFile Optional chain file with additional
+ * material to complete the certificate definition.
+ *
+ * @return nopoll_true if the certificate was installed otherwise
+ * nopoll_false. The function returns nopoll_false when ctx, certificateFile or privateKey are NULL.
+ */ 
+nopoll_bool           nopoll_ctx_set_certificate (noPollCtx  * ctx, 
+						  const char * serverName, 
+						  const char * certificateFile, 
+						  const char * privateKey, 
+						  const char * optionalChainFile)
+{
+	int length;
+	noPollCertificate * cert;
+
+	/* check values before proceed */
+	nopoll_return_val_if_fail (ctx, ctx && certificateFile && privateKey, nopoll_false);
+
+	/* check if the certificate is already installed (exactly for
+	 * this serverName, not through a wildcard) */
+	if (serverName && __nopoll_ctx_lookup_certificate (ctx, serverName))
+		return nopoll_true;
+	if (serverName == NULL && nopoll_ctx_find_certificate (ctx, NULL, NULL, NULL, NULL))
+		return nopoll_true;
+
+	/* update certificate storage to hold all values */
+	ctx->certificates_length++;
+	length = ctx->certificates_length;
+	if (length == 1)
+		ctx->certificates = nopoll_new (noPollCertificate, 1);
+	else
+		ctx->certificates = (noPollCertificate *) nopoll_realloc (ctx->certificates, sizeof (noPollCertificate) * (length));
+
+	/* hold certificate */
+	cert = &(ctx->certificates[length - 1]);
+
+	cert->serverName = NULL;
+	if (serverName)
+		cert->serverName         = nopoll_strdup (serverName);
+
+	cert->certificateFile = NULL;
+	if (certificateFile)
+		cert->certificateFile    = nopoll_strdup (certificateFile);
+
+	cert->privateKey = NULL;
+	if (privateKey)
+		cert->privateKey         = nopoll_strdup (privateKey);
+
+	cert->optionalChainFile = NULL;
+	if (optionalChainFile)
+		cert->optionalChainFile  = nopoll_strdup (optionalChainFile);
+
+	/* index it by serverName */
+	__nopoll_ctx_index_certificate (ctx, length - 1);
+
+	return nopoll_true;
+}
+
+/** 
+ * @brief Allows to configure the on open handler, the handler that is
+ * called when it is received an incoming websocket connection and all
+ * websocket client handshake data was received (but still not required).
+ *
+ * This handler differs from \ref nopoll_ctx_set_on_accept this
+ * handler is called after all client handshake data was received.
+ *
+ * Note the connection is still not fully working at this point
+ * because the handshake hasn't been sent to the remote peer yet. This
+ * means that attempting to send any content inside this handler (for
+ * example by using \ref nopoll_conn_send_text) will cause a protocol
+ * violation (because remote side is expecting a handshake reply but
+ * received something different). 
+ *
+ * In the case you want to sent content right away after receiving a
+ * connection (on a listener), you can use \ref
+ * nopoll_ctx_set_on_ready "On Ready" handler which is called just
+ * after the connection has been fully accepted and handshake reply is
+ * fully written.
+ *
+ * @param ctx The context that will be configured.
+ *
+ * @param on_open The handler to be configured on this context.
+ *
+ * @param user_data User defined pointer to be passed to the on open
+ * handler
+ */
+void           nopoll_ctx_set_on_open (noPollCtx            * ctx,
+				       noPollActionHandler    on_open,
+				       noPollPtr              user_data)
+{
+	nopoll_return_if_fail (ctx, ctx && on_open);
+
+	/* set the handler */
+	ctx->on_open = on_open;
+	if (ctx->on_open == NULL)
+		ctx->on_open_data = NULL;
+	else
+		ctx->on_open_data = user_data;
+	return;
+}
+
+/** 
+ * @brief Allows to configure a handler that is called when a
+ * connection is received and it is ready to send and receive because
+ * all WebSocket handshake protocol finished OK.
+ *
+ * Unlike handlers configured at \ref nopoll_ctx_set_on_open and \ref
+ * nopoll_ctx_set_on_accept which get notified when the connection
+ * isn't still working (because WebSocket handshake wasn't finished
+ * yet), on read handlers configured here will get called just after
+ * the WebSocket handshake has taken place.
+ *
+ * @param ctx The context that will be configured.
+ *
+ * @param on_ready The handler to be called when a connection is fully
+ * ready to send and receive content because WebSocket handshake has
+ * finished. The function must return nopoll_true to accept the
+ * connection. By returning nopoll_false the handler is signalling to
+ * terminate the connection.
+ *
+ * @param user_data Optional user data pointer passed to the on ready
+ * handler.
+ * 
+ */
+void           nopoll_ctx_set_on_ready (noPollCtx          * ctx,
+					noPollActionHandler  on_ready,
+					noPollPtr            user_data)
+{
+	nopoll_return_if_fail (ctx, ctx && on_ready);
+
+	/* set the handler */
+	ctx->on_ready = on_ready;
+	if (ctx->on_ready == NULL)
+		ctx->on_ready_data = NULL;
+	else
+		ctx->on_ready_data = user_data;
+	return;
+}
+
+/** 
+ * @brief Allows to configure the accept handler that will be called
+ * when a connection is received but before any handshake takes place.
+ *
+ * @param ctx The context that will be configured.
+ *
+ * @param on_accept The handler to be called when a connection is
+ * received. Here the handler must return nopoll_true to accept the
+ * connection, otherwise nopoll_false should be returned.
+ *
+ * @param user_data Optional user data pointer passed to the on accept
+ * handler.
+ *
+ */
+void              nopoll_ctx_set_on_accept (noPollCtx            * ctx,
+					    noPollActionHandler    on_accept,
+					    noPollPtr              user_data)
+{
+	nopoll_return_if_fail (ctx, ctx && on_accept);
+
+	/* set the handler */
+	ctx->on_accept = on_accept;
+	if (ctx->on_accept == NULL)
+		ctx->on_accept_data = NULL;
+	else
+		ctx->on_accept_data = user_data;
+	return;
+}
+
+/** 
+ * @brief Allows to set a general handler to get notifications about a
+ * message received over any connection that is running under the
+ * provided context (noPollCtx).
+ *
+ * @param ctx The context where the notification will happen
+ *
+ * @param on_msg The handler to be called when an incoming message is
+ * received.
+ *
+ * @param user_data User defined pointer that is passed in into the
+ * handler when called.
+ *
+ * Note that the handler configured here will be overriden by the handler configured by \ref nopoll_conn_set_on_msg
+ *
+ */
+void           nopoll_ctx_set_on_msg    (noPollCtx              * ctx,
+					 noPollOnMessageHandler   on_msg,
+					 noPollPtr                user_data)
+{
+	nopoll_return_if_fail (ctx, ctx);
+	
+	/* set new handler */
+	ctx->on_msg      = on_msg;
+	ctx->on_msg_data = user_data;
+
+	return;
+}
+
+/** 
+ * @brief Allows to configure the handler that will be used to
+ * receive data messages in chunks, as they are read, on all
+ * connections registered on the provided context (instead of
+ * buffering them into \ref noPollMsg references). See \ref
+ * nopoll_conn_set_on_frame_chunk for more information.
+ *
+ * Note that the handler configured here will be overriden by the
+ * handler configured by \ref nopoll_conn_set_on_frame_chunk
+ *
+ * @param ctx The context to be configured.
+ *
+ * @param on_frame_chunk The handler to be called with each chunk
+ * received (NULL to buffer messages).
+ *
+ * @param user_data User defined pointer to be passed in into the handler when it is called.
+ */
+void           nopoll_ctx_set_on_frame_chunk (noPollCtx                 * ctx,
+					      noPollOnFrameChunkHandler   on_frame_chunk,
+					      noPollPtr                   user_data)
+{
+	nopoll_return_if_fail (ctx, ctx);
+	
+	/* set new handler */
+	ctx->on_frame_chunk      = on_frame_chunk;
+	ctx->on_frame_chunk_data = user_data;
+
+	return;
+}
+
+/** 
+ * @brief Allows to configure the handler that will be used to let
+ * user land code to define OpenSSL SSL_CTX object.
+ *
+ * By default, SSL_CTX (SSL Context) object is created by default
+ * settings that works for most of the cases. In the case you want to
+ * configure particular configurations that should be enabled on the
+ * provided SSL_CTX that is going to be used by the client ---while
+ * connecting--- or server ---while receiving a connection--- then use
+ * this function to setup your creator handler.
+ *
+ * See \ref noPollSslContextCreator for more information about this
+ * handler.
+ *
+ */
+void           nopoll_ctx_set_ssl_context_creator (noPollCtx                * ctx,
+						   noPollSslContextCreator    context_creator,
+						   noPollPtr                  user_data)
+{
+	if (ctx == NULL)
+		return;
+
+	/* set handlers as indicated by the caller */
+	ctx->context_creator      = context_creator;
+	ctx->context_creator_data = user_data;
+	return;
+}
+
+/** 
+ * @brief Allows to configure a function that will implement an post SSL/TLS check.
+ *
+ * See the following function to get more information: \ref noPollSslPostCheck
+ *
+ * @param ctx The context where the operation is taking place.
+ *
+ * @param post_ssl_check The handler that is going to be called
+ * everything a new connection with SSL is established by a client or
+ * received by a server. The handler is executed right after the SSL
+ * handshake finishes without error.
+ *
+ * @param user_data A reference to user defined pointer that will be
+ * passed in to the handler.
+ */
+void           nopoll_ctx_set_post_ssl_check (noPollCtx          * ctx,
+					      noPollSslPostCheck   post_ssl_check,
+					      noPollPtr            user_data)
+{
+	if (ctx == NULL)
+		return;
+
+	/* set handlers as indicated by the caller */
+	ctx->post_ssl_check      = post_ssl_check;
+	ctx->post_ssl_check_data = user_data;
+	return;
+}
+
+/** 
+ * @brief Allows to iterate over all connections currently registered
+ * on the provided context, optionally stopping the foreach process,
+ * returning the connection reference selected if the foreach handler
+ * returns nopoll_true.
+ *
+ * @param ctx The nopoll context where the foreach operation will take
+ * place.
+ *
+ * @param foreach The foreach handler to be called for each connection
+ * registered.
+ *
+ * @param user_data An optional reference to a pointer that will be
+ * passed to the handler.
+ *
+ * @return Returns the connection selected (in the case the foreach
+ * function returns nopoll_false) or NULL in the case all foreach
+ * executions returned nopoll_true. Keep in mind the function also
+ * returns NULL if ctx or foreach parameter is NULL.
+ *
+ * See \ref noPollForeachConn for a signature example.
+ */
+noPollConn   * nopoll_ctx_foreach_conn (noPollCtx          * ctx, 
+					noPollForeachConn    foreach, 
+					noPollPtr            user_data)
+{
+	noPollConn * result;
+	int          iterator;
+	nopoll_return_val_if_fail (ctx, ctx && foreach, NULL);
+
+	/* acquire here the mutex to protect connection list */
+	nopoll_mutex_lock (ctx->ref_mutex);
+
+	/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Doing foreach over conn_length array (%p): %d", ctx, ctx->conn_length); */
+	
+	/* find the connection and remove it from the array */
+	iterator = 0;
+	while (iterator < ctx->conn_length) {
+
+		/* check the connection reference */
+		if (ctx->conn_list[iterator]) {
+
+			result = ctx->conn_list[iterator];
+			
 			nopoll_mutex_unlock (ctx->ref_mutex);
+			
+			/* call to notify connection */
+			if (foreach (ctx, result, user_data)) {
+				
+				/* release here the mutex to protect connection list */
+				return result;
+			} /* end if */
 
-			/* acquire a reference to the conection */
-			nopoll_conn_unref (conn);
+			/* realloc again */
+			nopoll_mutex_lock (ctx->ref_mutex);
 
-			return; 
 		} /* end if */
 		
 		iterator++;
 	} /* end while */
 
-	/* release mutex here */
+	/* release here the mutex to protect connection list */
 	nopoll_mutex_unlock (ctx->ref_mutex);
 
-	return;
+	return NULL;
 }
 
+
 /** 
- * @brief Allows to get number of connections currently registered.
- *
- * @param ctx The context where the operation is requested.
- *
- * @return Number of connections registered on this context or -1 if it fails.
- */ 
-int            nopoll_ctx_conns (noPollCtx * ctx)
+ * @internal Sends the broadcast message to the connection provided
+ * if it is a ready, non listener connection accepted by the filter
+ * (called without the context lock and with a reference acquired on
+ * the connection).
+ */
+nopoll_bool __nopoll_ctx_broadcast_conn (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
 {
-	nopoll_return_val_if_fail (ctx, ctx, -1);
-	return ctx->conn_num;
+	noPollBroadcast * broadcast = (noPollBroadcast *) user_data;
+	int               result;
+
+	if (conn->role == NOPOLL_ROLE_MAIN_LISTENER || ! nopoll_conn_is_ready (conn))
+		return nopoll_false;
+	if (broadcast->filter && ! broadcast->filter (ctx, conn, broadcast->filter_data))
+		return nopoll_false;
+
+	result = nopoll_conn_send_prepared (conn, broadcast->msg);
+	if (result >= 0 || result == -2)
+		broadcast->sent++;
+	return nopoll_false;
 }
 
 /** 
- * @brief Allows to find the certificate associated to the provided serverName. 
+ * @brief Sends the prepared message (see \ref nopoll_msg_prepare) to
+ * all connections registered on the context (or those accepted by
+ * the filter provided), encoding the frame once and without copying
+ * it for each connection (see \ref nopoll_conn_send_prepared).
  *
- * @param ctx The context where the operation will take place.
+ * Master listeners and connections that haven't completed the
+ * handshake are skipped.
  *
- * @param serverName the servername to use as pattern to find the
- * right certificate. If NULL is provided the first certificate not
- * refering to any serverName will be returned.
+ * @param ctx The context where the operation will take place.
  *
- * @param certificateFile If provided a reference and the function
- * returns nopoll_true, it will contain the certificateFile found.
+ * @param msg The prepared message to send.
  *
- * @param privateKey If provided a reference and the function
- * returns nopoll_true, it will contain the privateKey found.
+ * @param filter Optional handler to select connections: it must
+ * return nopoll_true to send the message to the connection provided
+ * (unlike \ref nopoll_ctx_foreach_conn, the iteration never stops).
  *
- * @param optionalChainFile If provided a reference and the function
- * returns nopoll_true, it will contain the optionalChainFile found.
+ * @param user_data Optional pointer passed to the filter.
  *
- * @return nopoll_true in the case the certificate was found,
- * otherwise nopoll_false is returned.
+ * @return The number of connections where the message was written or
+ * queued, or -1 if ctx or msg are NULL (or msg is not a prepared
+ * message).
  */
-nopoll_bool    nopoll_ctx_find_certificate (noPollCtx   * ctx, 
-					    const char  * serverName, 
-					    const char ** certificateFile, 
-					    const char ** privateKey, 
-					    const char ** optionalChainFile)
+int            nopoll_ctx_broadcast (noPollCtx          * ctx, 
+				     noPollMsg          * msg,
+				     noPollForeachConn    filter,
+				     noPollPtr            user_data)
 {
-	noPollCertificate * cert;
+	noPollBroadcast   broadcast;
+	noPollConn      * conn;
+	int               iterator;
 
-	int iterator = 0;
-	nopoll_return_val_if_fail (ctx, ctx, nopoll_false);
+	if (ctx == NULL || msg == NULL || msg->frame == NULL)
+		return -1;
 
-	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Finding a certificate for serverName=%s", serverName ? serverName : "<not defined>");
+	broadcast.msg         = msg;
+	broadcast.filter      = filter;
+	broadcast.filter_data = user_data;
+	broadcast.sent        = 0;
 
-	while (iterator < ctx->certificates_length) {
-		/* get cert */
-		cert = &(ctx->certificates[iterator]);
-		if (cert) {
-			/* found a certificate */
-		        nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "   certificate stored associated to serverName=%s", cert->serverName ? cert->serverName : "<not defined>");
-			if ((serverName == NULL && cert->serverName == NULL)  ||
-			    (nopoll_cmp (serverName, cert->serverName))) {
-				if (certificateFile)
-					(*certificateFile)   = cert->certificateFile;
-				if (privateKey)
-					(*privateKey)        = cert->privateKey;
-				if (optionalChainFile)
-					(*optionalChainFile) = cert->optionalChainFile;
-				return nopoll_true;
-			} /* end if */
-		} /* end if */
+	/* acquire here the mutex to protect connection list */
+	nopoll_mutex_lock (ctx->ref_mutex);
 
-		/* next position */
-		iterator++;
-	}
+	iterator = 0;
+	while (iterator < ctx->conn_length) {
+		conn = ctx->conn_list[iterator];
+		if (conn) {
+			/* acquire a reference while the list is locked:
+			 * the lock is released during the send so
+			 * other threads may unregister (and release)
+			 * the connection meanwhile */
+			nopoll_conn_ref (conn);
+			nopoll_mutex_unlock (ctx->ref_mutex);
 
-	/* check for default certificate when serverName isn't defined */
-	if (serverName == NULL) {
-	        /* requested a certificate for an undefined serverName */
-	        iterator = 0;
-		while (iterator < ctx->certificates_length) {
-		        /* get cert */
-		        cert = &(ctx->certificates[iterator]);
-			if (cert) {
-			      /* found a certificate */
-			      nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "   serverName not defined, selecting first certificate from the list");
-			      if (certificateFile)
-			              (*certificateFile)   = cert->certificateFile;
-			      if (privateKey)
-			              (*privateKey)        = cert->privateKey;
-			      if (optionalChainFile)
-			              (*optionalChainFile) = cert->optionalChainFile;
-			      return nopoll_true;
-			} /* end if */
+			__nopoll_ctx_broadcast_conn (ctx, conn, &broadcast);
+			nopoll_conn_unref (conn);
+
+			nopoll_mutex_lock (ctx->ref_mutex);
 		} /* end if */
 
-		/* next position */
 		iterator++;
-	} /* end if */
+	} /* end while */
 
-	return nopoll_false;
+	/* release here the mutex to protect connection list */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return broadcast.sent;
 }
 
 /** 
- * @brief Allows to install a certificate to be used in general by all
- * listener connections working under the provided context.
+ * @brief Allows to change the protocol version that is send in all
+ * client connections created under the provided context and the
+ * protocol version accepted by listener created under this context
+ * too.
  *
- * @param ctx The context where the certificate will be installed.
+ * This is a really basic (mostly fake) protocol version support
+ * because it only allows to change the version string sent (but
+ * nothing more for now). It is useful for testing purposes.
  *
- * @param serverName The optional server name to to limit the use of
- * this certificate to the value provided here. Provide a NULL value
- * to make the certificate provide to work under any server notified
- * (Host: header) or via SNI (server name identification associated to
- * the TLS transport).
+ * @param ctx The noPoll context where the protocol version change
+ * will be applied.
  *
- * @param certificateFile The certificate file to be installed. 
+ * @param version The value representing the protocol version. By
+ * default this function isn't required to be called because it
+ * already has the right protocol value configured (13). 
+ */ 
+void           nopoll_ctx_set_protocol_version (noPollCtx * ctx, int version)
+{
+	/* check input data */
+	nopoll_return_if_fail (ctx, ctx || version);
+
+	/* setup the new protocol version */
+	ctx->protocol_version = version;
+
+	return;
+}
+
+/** 
+ * @brief Allows to configure the IO engine (\ref noPollIoEngineType)
+ * to be used by \ref nopoll_loop_wait on the provided context.
  *
- * @param privateKey The private key file to use used.
+ * By default, \ref NOPOLL_IO_ENGINE_DEFAULT is used, which selects
+ * the best mechanism available on the platform (epoll(7) on Linux,
+ * otherwise select(2)). The change takes effect the next time \ref
+ * nopoll_loop_wait is called (or \ref nopoll_loop_init).
  *
- * @param optionalChainFile Optional chain file with additional
- * material to complete the certificate definition.
+ * @param ctx The context to configure.
  *
- * @return nopoll_true if the certificate was installed otherwise
- * nopoll_false. The function returns nopoll_false when ctx, certificateFile or privateKey are NULL.
- */ 
-nopoll_bool           nopoll_ctx_set_certificate (noPollCtx  * ctx, 
-						  const char * serverName, 
-						  const char * certificateFile, 
-						  const char * privateKey, 
-						  const char * optionalChainFile)
+ * @param engine_type The IO engine to use.
+ */
+void           nopoll_ctx_set_io_engine (noPollCtx * ctx, noPollIoEngineType engine_type)
 {
-	int length;
-	noPollCertificate * cert;
+	/* check input data */
+	nopoll_return_if_fail (ctx, ctx);
 
-	/* check values before proceed */
-	nopoll_return_val_if_fail (ctx, ctx && certificateFile && privateKey, nopoll_false);
+	/* setup io engine to be used on next loop */
+	ctx->io_engine_type = engine_type;
 
-	/* check if the certificate is already installed */
-	if (nopoll_ctx_find_certificate (ctx, serverName, NULL, NULL, NULL))
-		return nopoll_true;
+	return;
+}
 
-	/* update certificate storage to hold all values */
-	ctx->certificates_length++;
-	length = ctx->certificates_length;
-	if (length == 1)
-		ctx->certificates = nopoll_new (noPollCertificate, 1);
-	else
-		ctx->certificates = (noPollCertificate *) nopoll_realloc (ctx->certificates, sizeof (noPollCertificate) * (length));
+/** 
+ * @brief Allows to configure the number of worker threads used by
+ * \ref nopoll_loop_wait on the provided context (multi-reactor mode).
+ *
+ * When workers are configured, \ref nopoll_loop_wait starts one
+ * thread per worker, each one running its own io engine over its own
+ * subset of connections. Connections accepted by a listener are
+ * handed out round robin to workers, or accepted directly by each
+ * worker when the listener was created with \ref
+ * nopoll_conn_opts_set_reuse_port. Connections created by the caller
+ * (client connections and listeners) are watched by the thread
+ * calling \ref nopoll_loop_wait.
+ *
+ * All handlers (on_msg, on_ready, on_close...) of a connection are
+ * invoked on the thread watching it, so they must be thread safe.
+ *
+ * Workers require threading support to be installed before creating
+ * the context (see \ref nopoll_thread_handlers).
+ *
+ * @param ctx The context to configure.
+ *
+ * @param workers Number of worker threads (0, the default, disables
+ * workers).
+ *
+ * @return nopoll_true if workers were configured, otherwise
+ * nopoll_false is returned (threading support not installed, loop
+ * running or invalid parameters).
+ */
+nopoll_bool    nopoll_ctx_set_workers (noPollCtx * ctx, int workers)
+{
+	nopoll_bool result;
+	int         iterator;
 
-	/* hold certificate */
-	cert = &(ctx->certificates[length - 1]);
+	/* check input data */
+	nopoll_return_val_if_fail (ctx, ctx && workers >= 0, nopoll_false);
 
-	cert->serverName = NULL;
-	if (serverName)
-		cert->serverName         = nopoll_strdup (serverName);
+	if (workers > 0 && ctx->ref_mutex == NULL) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to configure %d workers, threading support is not installed (see nopoll_thread_handlers)", workers);
+		return nopoll_false;
+	} /* end if */
 
-	cert->certificateFile = NULL;
-	if (certificateFile)
-		cert->certificateFile    = nopoll_strdup (certificateFile);
+	nopoll_mutex_lock (ctx->ref_mutex);
 
-	cert->privateKey = NULL;
-	if (privateKey)
-		cert->privateKey         = nopoll_strdup (privateKey);
+	/* loops can't be changed while running */
+	iterator = 0;
+	while (iterator < ctx->loops_num) {
+		if (ctx->loops[iterator].io_engine) {
+			nopoll_mutex_unlock (ctx->ref_mutex);
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to configure workers while nopoll_loop_wait is running");
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
 
-	cert->optionalChainFile = NULL;
-	if (optionalChainFile)
-		cert->optionalChainFile  = nopoll_strdup (optionalChainFile);
+	result = __nopoll_ctx_loops_init (ctx, workers + 1);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return result;
+}
+
+/** 
+ * @brief Allows to get the number of worker threads configured on the
+ * provided context (see \ref nopoll_ctx_set_workers).
+ *
+ * @param ctx The context to check.
+ *
+ * @return Number of workers configured or -1 if ctx is NULL.
+ */
+int            nopoll_ctx_get_workers (noPollCtx * ctx)
+{
+	if (ctx == NULL)
+		return -1;
+	return ctx->loops_num - 1;
+}
+
+/** 
+ * @brief Allows to configure the default read budget used by
+ * connections registered on the provided context: how many messages
+ * are read and notified from a connection each time \ref
+ * nopoll_loop_wait finds it ready (see \ref
+ * nopoll_conn_set_read_budget to configure it per connection).
+ *
+ * @param ctx The context to configure.
+ *
+ * @param budget Messages to read on each readiness notification (1
+ * or more, by default 16).
+ */
+void           nopoll_ctx_set_read_budget (noPollCtx * ctx, int budget)
+{
+	nopoll_return_if_fail (ctx, ctx && budget > 0);
+
+	ctx->read_budget = budget;
+	return;
+}
+
+/** 
+ * @brief Allows to get the default read budget configured on the
+ * provided context (see \ref nopoll_ctx_set_read_budget).
+ *
+ * @param ctx The context to check.
+ *
+ * @return The read budget or -1 if ctx is NULL.
+ */
+int            nopoll_ctx_get_read_budget (noPollCtx * ctx)
+{
+	if (ctx == NULL)
+		return -1;
+	return ctx->read_budget;
+}
+
+/** 
+ * @brief Allows to configure the default max message size accepted
+ * by connections registered on the provided context (see \ref
+ * nopoll_conn_set_max_message_size to configure it per connection).
+ *
+ * @param ctx The context to configure.
+ *
+ * @param max_size Max message size in bytes (0, the default, to
+ * accept messages of any size).
+ */
+void           nopoll_ctx_set_max_message_size (noPollCtx * ctx, long max_size)
+{
+	nopoll_return_if_fail (ctx, ctx && max_size >= 0);
+
+	ctx->max_message_size = max_size;
+	return;
+}
+
+/** 
+ * @brief Allows to get the default max message size configured on
+ * the provided context (see \ref nopoll_ctx_set_max_message_size).
+ *
+ * @param ctx The context to check.
+ *
+ * @return The max message size (0 when there is no limit) or -1 if
+ * ctx is NULL.
+ */
+long           nopoll_ctx_get_max_message_size (noPollCtx * ctx)
+{
+	if (ctx == NULL)
+		return -1;
+	return ctx->max_message_size;
+}
+
+/** 
+ * @brief Allows to get the IO engine type configured on the provided
+ * context (see \ref nopoll_ctx_set_io_engine).
+ *
+ * @param ctx The context to check.
+ *
+ * @return The IO engine configured or \ref NOPOLL_IO_ENGINE_DEFAULT if
+ * nothing was configured (or ctx is NULL).
+ */
+noPollIoEngineType nopoll_ctx_get_io_engine (noPollCtx * ctx)
+{
+	if (ctx == NULL)
+		return NOPOLL_IO_ENGINE_DEFAULT;
+	return ctx->io_engine_type;
+}
+
+/** 
+ * @brief Allows to configure if client TLS connections created on
+ * the provided context save their TLS session to resume it on next
+ * connections to the same site (same host, port and TLS options),
+ * skipping the full TLS handshake (enabled by default).
+ *
+ * Disabling it releases all sessions saved.
+ *
+ * @param ctx The context to configure.
+ *
+ * @param enabled nopoll_true to resume TLS sessions, otherwise
+ * nopoll_false.
+ */
+void           nopoll_ctx_set_tls_session_reuse (noPollCtx * ctx, nopoll_bool enabled)
+{
+	nopoll_return_if_fail (ctx, ctx);
 
-	return nopoll_true;
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ctx->tls_session_reuse = enabled;
+	if (! enabled)
+		__nopoll_ctx_tls_sessions_release (ctx);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	return;
 }
 
 /** 
- * @brief Allows to configure the on open handler, the handler that is
- * called when it is received an incoming websocket connection and all
- * websocket client handshake data was received (but still not required).
+ * @brief Allows to configure the keys used by TLS listeners created on
+ * the provided context to protect session tickets (stateless session
+ * resumption), or to rotate them.
  *
- * This handler differs from \ref nopoll_ctx_set_on_accept this
- * handler is called after all client handshake data was received.
+ * By default, each listener TLS context uses its own random keys
+ * (see \ref nopoll_listener_set_certificate). Configuring the same
+ * keys on several contexts (or processes) allows clients to resume,
+ * on any of them, sessions established with any other. Calling this
+ * function again rotates the keys: tickets issued with previous keys
+ * are no longer accepted (clients do a full handshake).
  *
- * Note the connection is still not fully working at this point
- * because the handshake hasn't been sent to the remote peer yet. This
- * means that attempting to send any content inside this handler (for
- * example by using \ref nopoll_conn_send_text) will cause a protocol
- * violation (because remote side is expecting a handshake reply but
- * received something different). 
+ * Keys are applied to listeners TLS contexts configured by noPoll on
+ * next connection accepted (they are not applied when \ref
+ * nopoll_ctx_set_ssl_context_creator is used).
  *
- * In the case you want to sent content right away after receiving a
- * connection (on a listener), you can use \ref
- * nopoll_ctx_set_on_ready "On Ready" handler which is called just
- * after the connection has been fully accepted and handshake reply is
- * fully written.
+ * @param ctx The context to configure.
  *
- * @param ctx The context that will be configured.
+ * @param keys The keys to use (80 bytes: 16 bytes key name, 32 bytes
+ * HMAC secret and 32 bytes AES key; 48 bytes for OpenSSL before
+ * 1.1.1) or NULL to generate new random keys.
  *
- * @param on_open The handler to be configured on this context.
+ * @param keys_size Size of keys (ignored when keys is NULL).
  *
- * @param user_data User defined pointer to be passed to the on open
- * handler
+ * @return nopoll_true if keys were configured, otherwise nopoll_false
+ * is returned (wrong size or unable to generate random keys).
  */
-void           nopoll_ctx_set_on_open (noPollCtx            * ctx,
-				       noPollActionHandler    on_open,
-				       noPollPtr              user_data)
+nopoll_bool    nopoll_ctx_set_tls_ticket_keys (noPollCtx * ctx, const char * keys, int keys_size)
 {
-	nopoll_return_if_fail (ctx, ctx && on_open);
+	unsigned char new_keys[NOPOLL_TLS_TICKET_KEYS_SIZE];
 
-	/* set the handler */
-	ctx->on_open = on_open;
-	if (ctx->on_open == NULL)
-		ctx->on_open_data = NULL;
-	else
-		ctx->on_open_data = user_data;
-	return;
+	nopoll_return_val_if_fail (ctx, ctx, nopoll_false);
+
+	if (keys == NULL) {
+		if (RAND_bytes (new_keys, NOPOLL_TLS_TICKET_KEYS_SIZE) != 1) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to generate TLS session ticket keys, RAND_bytes () failed");
+			return nopoll_false;
+		} /* end if */
+	} else if (keys_size != NOPOLL_TLS_TICKET_KEYS_SIZE) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Expected %d bytes for TLS session ticket keys but received %d",
+			    NOPOLL_TLS_TICKET_KEYS_SIZE, keys_size);
+		return nopoll_false;
+	} else
+		memcpy (new_keys, keys, NOPOLL_TLS_TICKET_KEYS_SIZE);
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	memcpy (ctx->tls_ticket_keys, new_keys, NOPOLL_TLS_TICKET_KEYS_SIZE);
+	ctx->tls_ticket_keys_generation++;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return nopoll_true;
 }
 
 /** 
- * @brief Allows to configure a handler that is called when a
- * connection is received and it is ready to send and receive because
- * all WebSocket handshake protocol finished OK.
- *
- * Unlike handlers configured at \ref nopoll_ctx_set_on_open and \ref
- * nopoll_ctx_set_on_accept which get notified when the connection
- * isn't still working (because WebSocket handshake wasn't finished
- * yet), on read handlers configured here will get called just after
- * the WebSocket handshake has taken place.
+ * @brief Allows to get how many TLS handshakes were completed by
+ * connections (client and listener side) created on the provided
+ * context, separating full handshakes from resumed sessions.
  *
- * @param ctx The context that will be configured.
+ * @param ctx The context to check.
  *
- * @param on_ready The handler to be called when a connection is fully
- * ready to send and receive content because WebSocket handshake has
- * finished. The function must return nopoll_true to accept the
- * connection. By returning nopoll_false the handler is signalling to
- * terminate the connection.
+ * @param full_handshakes Optional reference where the number of full
+ * handshakes is reported.
  *
- * @param user_data Optional user data pointer passed to the on ready
- * handler.
- * 
+ * @param resumed_handshakes Optional reference where the number of
+ * resumed sessions is reported.
  */
-void           nopoll_ctx_set_on_ready (noPollCtx          * ctx,
-					noPollActionHandler  on_ready,
-					noPollPtr            user_data)
+void           nopoll_ctx_get_tls_stats (noPollCtx * ctx, long * full_handshakes, long * resumed_handshakes)
 {
-	nopoll_return_if_fail (ctx, ctx && on_ready);
+	nopoll_return_if_fail (ctx, ctx);
 
-	/* set the handler */
-	ctx->on_ready = on_ready;
-	if (ctx->on_ready == NULL)
-		ctx->on_ready_data = NULL;
-	else
-		ctx->on_ready_data = user_data;
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (full_handshakes)
+		*full_handshakes = ctx->tls_full_handshakes;
+	if (resumed_handshakes)
+		*resumed_handshakes = ctx->tls_resumed_handshakes;
+	nopoll_mutex_unlock (ctx->ref_mutex);
 	return;
 }
 
 /** 
- * @brief Allows to configure the accept handler that will be called
- * when a connection is received but before any handshake takes place.
+ * @brief Allows to configure how long host names resolved by client
+ * connections created on the provided context are cached (positive
+ * results) and how long resolution failures are remembered
+ * (negative results), so connections created again to the same
+ * site (for example reconnecting after a network failure) don't
+ * resolve the host name each time.
  *
- * @param ctx The context that will be configured.
+ * By default, results are cached up to 60 seconds and failures up to
+ * 5 seconds. A resolver handler (see \ref nopoll_ctx_set_resolver)
+ * can report a shorter TTL for each result.
  *
- * @param on_accept The handler to be called when a connection is
- * received. Here the handler must return nopoll_true to accept the
- * connection, otherwise nopoll_false should be returned.
+ * @param ctx The context to configure.
  *
- * @param user_data Optional user data pointer passed to the on accept
- * handler.
+ * @param positive_ttl Max seconds a host name resolved is cached (0
+ * to not cache them).
  *
+ * @param negative_ttl Max seconds a resolution failure is cached (0
+ * to not cache them).
  */
-void              nopoll_ctx_set_on_accept (noPollCtx            * ctx,
-					    noPollActionHandler    on_accept,
-					    noPollPtr              user_data)
+void           nopoll_ctx_set_dns_cache_ttl (noPollCtx * ctx, int positive_ttl, int negative_ttl)
 {
-	nopoll_return_if_fail (ctx, ctx && on_accept);
+	nopoll_return_if_fail (ctx, ctx);
 
-	/* set the handler */
-	ctx->on_accept = on_accept;
-	if (ctx->on_accept == NULL)
-		ctx->on_accept_data = NULL;
-	else
-		ctx->on_accept_data = user_data;
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ctx->dns_positive_ttl = positive_ttl < 0 ? 0 : positive_ttl;
+	ctx->dns_negative_ttl = negative_ttl < 0 ? 0 : negative_ttl;
+	nopoll_mutex_unlock (ctx->ref_mutex);
 	return;
 }
 
 /** 
- * @brief Allows to set a general handler to get notifications about a
- * message received over any connection that is running under the
- * provided context (noPollCtx).
- *
- * @param ctx The context where the notification will happen
- *
- * @param on_msg The handler to be called when an incoming message is
- * received.
- *
- * @param user_data User defined pointer that is passed in into the
- * handler when called.
- *
- * Note that the handler configured here will be overriden by the handler configured by \ref nopoll_conn_set_on_msg
+ * @brief Removes all host names cached on the provided context (see
+ * \ref nopoll_ctx_set_dns_cache_ttl), so next connections resolve
+ * them again.
  *
+ * @param ctx The context to flush.
  */
-void           nopoll_ctx_set_on_msg    (noPollCtx              * ctx,
-					 noPollOnMessageHandler   on_msg,
-					 noPollPtr                user_data)
+void           nopoll_ctx_dns_cache_flush (noPollCtx * ctx)
 {
 	nopoll_return_if_fail (ctx, ctx);
-	
-	/* set new handler */
-	ctx->on_msg      = on_msg;
-	ctx->on_msg_data = user_data;
 
+	nopoll_mutex_lock (ctx->ref_mutex);
+	__nopoll_ctx_dns_cache_release (ctx);
+	nopoll_mutex_unlock (ctx->ref_mutex);
 	return;
 }
 
 /** 
- * @brief Allows to configure the handler that will be used to let
- * user land code to define OpenSSL SSL_CTX object.
+ * @brief Allows to configure a handler used to resolve host names of
+ * client connections created on the provided context, instead of
+ * getaddrinfo (for example, a stub resolver or one able to report
+ * the TTL of each record).
  *
- * By default, SSL_CTX (SSL Context) object is created by default
- * settings that works for most of the cases. In the case you want to
- * configure particular configurations that should be enabled on the
- * provided SSL_CTX that is going to be used by the client ---while
- * connecting--- or server ---while receiving a connection--- then use
- * this function to setup your creator handler.
+ * Connections created with \ref nopoll_conn_opts_set_async_connect
+ * resolve host names on a resolver thread (the handler is called
+ * from it) when threading support is installed (see \ref
+ * nopoll_thread_handlers), while the rest resolve them on the caller
+ * thread. In
+ * both cases results are cached (see \ref
+ * nopoll_ctx_set_dns_cache_ttl) and numeric addresses are not
+ * resolved.
  *
- * See \ref noPollSslContextCreator for more information about this
- * handler.
+ * @param ctx The context to configure.
  *
+ * @param resolver The handler to use or NULL to use getaddrinfo.
+ *
+ * @param user_data User defined pointer passed to the handler.
  */
-void           nopoll_ctx_set_ssl_context_creator (noPollCtx                * ctx,
-						   noPollSslContextCreator    context_creator,
-						   noPollPtr                  user_data)
+void           nopoll_ctx_set_resolver (noPollCtx             * ctx,
+					noPollResolverHandler   resolver,
+					noPollPtr               user_data)
 {
-	if (ctx == NULL)
-		return;
+	nopoll_return_if_fail (ctx, ctx);
 
-	/* set handlers as indicated by the caller */
-	ctx->context_creator      = context_creator;
-	ctx->context_creator_data = user_data;
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ctx->resolver      = resolver;
+	ctx->resolver_data = user_data;
+	nopoll_mutex_unlock (ctx->ref_mutex);
 	return;
 }
 
 /** 
- * @brief Allows to configure a function that will implement an post SSL/TLS check.
- *
- * See the following function to get more information: \ref noPollSslPostCheck
+ * @brief Allows to configure how many idle compression streams are
+ * kept by the context to be shared by connections that reset their
+ * compression contexts after each message (permessage-deflate
+ * without context takeover, see \ref
+ * nopoll_conn_opts_set_deflate_context_takeover).
  *
- * @param ctx The context where the operation is taking place.
+ * These connections take a stream from the pool only while a
+ * message is compressed (or decompressed) instead of keeping one
+ * each (around 256KB for compression with default window), so
+ * memory used depends on the messages being processed instead of on
+ * the number of connections. Connections keeping context takeover
+ * get a better compression ratio at the cost of keeping their
+ * streams (see \ref nopoll_ctx_get_deflate_stats to compare).
  *
- * @param post_ssl_check The handler that is going to be called
- * everything a new connection with SSL is established by a client or
- * received by a server. The handler is executed right after the SSL
- * handshake finishes without error.
+ * @param ctx The context to configure.
  *
- * @param user_data A reference to user defined pointer that will be
- * passed in to the handler.
+ * @param max_idle Max idle streams kept (\ref
+ * NOPOLL_DEFLATE_POOL_SIZE by default), 0 to disable the pool
+ * (connections keep their own streams).
  */
-void           nopoll_ctx_set_post_ssl_check (noPollCtx          * ctx,
-					      noPollSslPostCheck   post_ssl_check,
-					      noPollPtr            user_data)
+void           nopoll_ctx_set_deflate_pool_size (noPollCtx * ctx, int max_idle)
 {
-	if (ctx == NULL)
-		return;
+	nopoll_return_if_fail (ctx, ctx);
 
-	/* set handlers as indicated by the caller */
-	ctx->post_ssl_check      = post_ssl_check;
-	ctx->post_ssl_check_data = user_data;
+	if (max_idle < 0)
+		max_idle = 0;
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ctx->deflate_pool_size = max_idle;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* release idle streams above the limit */
+	__nopoll_ctx_zstream_pool_trim (ctx, max_idle);
 	return;
 }
 
 /** 
- * @brief Allows to iterate over all connections currently registered
- * on the provided context, optionally stopping the foreach process,
- * returning the connection reference selected if the foreach handler
- * returns nopoll_true.
+ * @brief Allows to get permessage-deflate counters of connections
+ * created on the provided context, to tune memory used against
+ * compression ratio (see \ref nopoll_ctx_set_deflate_pool_size).
  *
- * @param ctx The nopoll context where the foreach operation will take
- * place.
+ * @param ctx The context to check.
  *
- * @param foreach The foreach handler to be called for each connection
- * registered.
+ * @param streams Optional reference where the number of
+ * compression streams allocated (owned by connections, being used
+ * or idle in the pool) is reported.
  *
- * @param user_data An optional reference to a pointer that will be
- * passed to the handler.
+ * @param idle_streams Optional reference where the number of idle
+ * streams kept in the pool is reported.
  *
- * @return Returns the connection selected (in the case the foreach
- * function returns nopoll_false) or NULL in the case all foreach
- * executions returned nopoll_true. Keep in mind the function also
- * returns NULL if ctx or foreach parameter is NULL.
+ * @param memory Optional reference where the estimated memory
+ * (bytes) used by all streams is reported.
  *
- * See \ref noPollForeachConn for a signature example.
+ * @param bytes_in Optional reference where the bytes of messages
+ * compressed are reported.
+ *
+ * @param bytes_out Optional reference where the bytes produced
+ * compressing them are reported (the compression ratio is bytes_in
+ * / bytes_out).
  */
-noPollConn   * nopoll_ctx_foreach_conn (noPollCtx          * ctx, 
-					noPollForeachConn    foreach, 
-					noPollPtr            user_data)
+void           nopoll_ctx_get_deflate_stats (noPollCtx * ctx, 
+					     long      * streams,
+					     long      * idle_streams,
+					     long      * memory,
+					     long      * bytes_in,
+					     long      * bytes_out)
 {
-	noPollConn * result;
-	int          iterator;
-	nopoll_return_val_if_fail (ctx, ctx && foreach, NULL);
+	nopoll_return_if_fail (ctx, ctx);
 
-	/* acquire here the mutex to protect connection list */
 	nopoll_mutex_lock (ctx->ref_mutex);
-
-	/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Doing foreach over conn_length array (%p): %d", ctx, ctx->conn_length); */
-	
-	/* find the connection and remove it from the array */
-	iterator = 0;
-	while (iterator < ctx->conn_length) {
-
-		/* check the connection reference */
-		if (ctx->conn_list[iterator]) {
-
-			result = ctx->conn_list[iterator];
-			
-			nopoll_mutex_unlock (ctx->ref_mutex);
-			
-			/* call to notify connection */
-			if (foreach (ctx, result, user_data)) {
-				
-				/* release here the mutex to protect connection list */
-				return result;
-			} /* end if */
-
-			/* realloc again */
-			nopoll_mutex_lock (ctx->ref_mutex);
-
-		} /* end if */
-		
-		iterator++;
-	} /* end while */
-
-	/* release here the mutex to protect connection list */
+	if (streams)
+		*streams = ctx->zstreams;
+	if (idle_streams)
+		*idle_streams = ctx->zstreams_idle;
+	if (memory)
+		*memory = ctx->zstreams_memory;
+	if (bytes_in)
+		*bytes_in = ctx->deflate_bytes_in;
+	if (bytes_out)
+		*bytes_out = ctx->deflate_bytes_out;
 	nopoll_mutex_unlock (ctx->ref_mutex);
-
-	return NULL;
+	return;
 }
 
+/** 
+ * @brief Allows to configure the message pool of the provided
+ * context: message holders and payload buffers (by size classes of
+ * 128 bytes, 1K, 8K and 64K) of messages received or prepared are
+ * kept once released to be reused by next messages, instead of
+ * being allocated and released for each one.
+ *
+ * @param ctx The context to configure.
+ *
+ * @param max_idle Max idle message holders and max idle buffers of
+ * each size class kept (\ref NOPOLL_MSG_POOL_SIZE by default), 0 to
+ * disable the pool.
+ *
+ * @param max_memory Max memory (bytes) of idle buffers kept (\ref
+ * NOPOLL_MSG_POOL_MEMORY by default).
+ */
+void           nopoll_ctx_set_msg_pool (noPollCtx * ctx, int max_idle, long max_memory)
+{
+	nopoll_return_if_fail (ctx, ctx);
+
+	if (max_idle < 0)
+		max_idle = 0;
+	if (max_memory < 0)
+		max_memory = 0;
+	nopoll_mutex_lock (ctx->msg_pool_mutex);
+	ctx->msg_pool_size   = max_idle;
+	ctx->msg_pool_memory = max_memory;
+	nopoll_mutex_unlock (ctx->msg_pool_mutex);
+
+	/* release idle items above the limits */
+	__nopoll_ctx_msg_pool_trim (ctx, max_idle, max_memory);
+	return;
+}
 
 /** 
- * @brief Allows to change the protocol version that is send in all
- * client connections created under the provided context and the
- * protocol version accepted by listener created under this context
- * too.
+ * @brief Allows to get message pool counters of the provided context
+ * (see \ref nopoll_ctx_set_msg_pool).
  *
- * This is a really basic (mostly fake) protocol version support
- * because it only allows to change the version string sent (but
- * nothing more for now). It is useful for testing purposes.
+ * @param ctx The context to check.
  *
- * @param ctx The noPoll context where the protocol version change
- * will be applied.
+ * @param idle_msgs Optional reference where the number of idle
+ * message holders kept is reported.
  *
- * @param version The value representing the protocol version. By
- * default this function isn't required to be called because it
- * already has the right protocol value configured (13). 
- */ 
-void           nopoll_ctx_set_protocol_version (noPollCtx * ctx, int version)
+ * @param idle_buffers Optional reference where the number of idle
+ * payload buffers kept (all size classes) is reported.
+ *
+ * @param idle_memory Optional reference where the memory (bytes)
+ * of idle payload buffers is reported.
+ *
+ * @param hits Optional reference where the number of message
+ * holders and buffers served from the pool is reported.
+ *
+ * @param misses Optional reference where the number of message
+ * holders and buffers that had to be allocated is reported (the hit
+ * rate is hits / (hits + misses)).
+ */
+void           nopoll_ctx_get_msg_pool_stats (noPollCtx * ctx,
+					      int       * idle_msgs,
+					      int       * idle_buffers,
+					      long      * idle_memory,
+					      long      * hits,
+					      long      * misses)
 {
-	/* check input data */
-	nopoll_return_if_fail (ctx, ctx || version);
+	int iterator;
 
-	/* setup the new protocol version */
-	ctx->protocol_version = version;
+	nopoll_return_if_fail (ctx, ctx);
 
+	nopoll_mutex_lock (ctx->msg_pool_mutex);
+	if (idle_msgs)
+		*idle_msgs = ctx->msg_pool_idle;
+	if (idle_buffers) {
+		*idle_buffers = 0;
+		for (iterator = 0; iterator < NOPOLL_MSG_BUFFER_CLASSES; iterator++)
+			*idle_buffers += ctx->buffer_pool_idle[iterator];
+	} /* end if */
+	if (idle_memory)
+		*idle_memory = ctx->buffer_pool_memory;
+	if (hits)
+		*hits = ctx->msg_pool_hits;
+	if (misses)
+		*misses = ctx->msg_pool_misses;
+	nopoll_mutex_unlock (ctx->msg_pool_mutex);
 	return;
 }
 
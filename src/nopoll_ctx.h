@@ -86,6 +86,10 @@ void           nopoll_ctx_set_on_msg    (noPollCtx              * ctx,
 					 noPollOnMessageHandler   on_msg,
 					 noPollPtr                user_data);
 
+void           nopoll_ctx_set_on_frame_chunk (noPollCtx                 * ctx,
+					      noPollOnFrameChunkHandler   on_frame_chunk,
+					      noPollPtr                   user_data);
+
 void           nopoll_ctx_set_ssl_context_creator (noPollCtx                * ctx,
 						   noPollSslContextCreator    context_creator,
 						   noPollPtr                  user_data);
@@ -96,10 +100,85 @@ void           nopoll_ctx_set_post_ssl_check (noPollCtx          * ctx,
 
 noPollConn   * nopoll_ctx_foreach_conn (noPollCtx * ctx, noPollForeachConn foreach, noPollPtr user_data);
 
+int            nopoll_ctx_broadcast (noPollCtx          * ctx, 
+				     noPollMsg          * msg,
+				     noPollForeachConn    filter,
+				     noPollPtr            user_data);
+
 void           nopoll_ctx_set_protocol_version (noPollCtx * ctx, int version);
 
+void           nopoll_ctx_set_io_engine (noPollCtx * ctx, noPollIoEngineType engine_type);
+
+noPollIoEngineType nopoll_ctx_get_io_engine (noPollCtx * ctx);
+
+nopoll_bool    nopoll_ctx_set_workers (noPollCtx * ctx, int workers);
+
+int            nopoll_ctx_get_workers (noPollCtx * ctx);
+
+void           nopoll_ctx_set_read_budget (noPollCtx * ctx, int budget);
+
+int            nopoll_ctx_get_read_budget (noPollCtx * ctx);
+
+void           nopoll_ctx_set_max_message_size (noPollCtx * ctx, long max_size);
+
+long           nopoll_ctx_get_max_message_size (noPollCtx * ctx);
+
+void           nopoll_ctx_set_tls_session_reuse (noPollCtx * ctx, nopoll_bool enabled);
+
+nopoll_bool    nopoll_ctx_set_tls_ticket_keys (noPollCtx * ctx, const char * keys, int keys_size);
+
+void           nopoll_ctx_get_tls_stats (noPollCtx * ctx, long * full_handshakes, long * resumed_handshakes);
+
+void           nopoll_ctx_set_dns_cache_ttl (noPollCtx * ctx, int positive_ttl, int negative_ttl);
+
+void           nopoll_ctx_dns_cache_flush (noPollCtx * ctx);
+
+void           nopoll_ctx_set_resolver (noPollCtx             * ctx,
+					noPollResolverHandler   resolver,
+					noPollPtr               user_data);
+
+void           nopoll_ctx_set_deflate_pool_size (noPollCtx * ctx, int max_idle);
+
+void           nopoll_ctx_get_deflate_stats (noPollCtx * ctx, 
+					     long      * streams,
+					     long      * idle_streams,
+					     long      * memory,
+					     long      * bytes_in,
+					     long      * bytes_out);
+
+void           nopoll_ctx_set_msg_pool (noPollCtx * ctx, int max_idle, long max_memory);
+
+void           nopoll_ctx_get_msg_pool_stats (noPollCtx * ctx,
+					      int       * idle_msgs,
+					      int       * idle_buffers,
+					      long      * idle_memory,
+					      long      * hits,
+					      long      * misses);
+
 void           nopoll_ctx_free (noPollCtx * ctx);
 
+/** internal api **/
+nopoll_bool    __nopoll_ctx_dns_resolve (noPollCtx * ctx, const char * host, const char * port, noPollTransport transport,
+					 struct sockaddr_storage * addr, int * addr_size);
+
+noPollPtr      __nopoll_ctx_dns_resolve_async (noPollCtx * ctx, const char * host, const char * port, noPollTransport transport);
+
+int            __nopoll_ctx_dns_entry_take (noPollCtx * ctx, noPollPtr * entry, struct sockaddr_storage * addr, int * addr_size);
+
+noPollPtr      __nopoll_ctx_zstream_get (noPollCtx * ctx, nopoll_bool is_deflate, int window_bits, nopoll_bool shared);
+
+void           __nopoll_ctx_zstream_release (noPollCtx * ctx, noPollPtr zstream);
+
+void           __nopoll_ctx_deflate_count (noPollCtx * ctx, long bytes_in, long bytes_out);
+
+noPollPtr      __nopoll_ctx_msg_get (noPollCtx * ctx);
+
+void           __nopoll_ctx_msg_release (noPollCtx * ctx, noPollPtr msg);
+
+char         * __nopoll_ctx_buffer_get (noPollCtx * ctx, long size, int * buffer_class);
+
+void           __nopoll_ctx_buffer_release (noPollCtx * ctx, char * buffer, int buffer_class);
+
 END_C_DECLS
 
 #endif
@@ -36,6 +36,13 @@
  *         info@aspl.es - http://www.aspl.es/nopoll
  */
 #include <nopoll_decl.h>
+#include <nopoll_handlers.h>
+
+/* memory handlers (see nopoll_set_allocator) */
+extern noPollMalloc      __nopoll_malloc;
+extern noPollRealloc     __nopoll_realloc;
+extern noPollFree        __nopoll_free;
+extern noPollUsableSize  __nopoll_usable_size;
 
 /** 
  * \addtogroup nopoll_decl_module
@@ -53,7 +60,20 @@
  */
 noPollPtr nopoll_calloc(size_t count, size_t size)
 {
-   return calloc (count, size);
+	noPollPtr ref;
+
+	if (! __nopoll_malloc)
+		return calloc (count, size);
+
+	/* check overflow */
+	if (size > 0 && count > ((size_t) -1) / size)
+		return NULL;
+
+	/* call defined handler */
+	ref = __nopoll_malloc (count * size);
+	if (ref)
+		memset (ref, 0, count * size);
+	return ref;
 }
 
 /** 
@@ -67,7 +87,11 @@ noPollPtr nopoll_calloc(size_t count, size_t size)
  */
 noPollPtr nopoll_realloc(noPollPtr ref, size_t size)
 {
-   return realloc (ref, size);
+	if (! __nopoll_realloc)
+		return realloc (ref, size);
+
+	/* call defined handler */
+	return __nopoll_realloc (ref, size);
 }
 
 /** 
@@ -78,10 +102,35 @@ noPollPtr nopoll_realloc(noPollPtr ref, size_t size)
  */
 void nopoll_free (noPollPtr ref)
 {
-	free (ref);
+	if (! __nopoll_free) {
+		free (ref);
+		return;
+	} /* end if */
+
+	/* call defined handler */
+	__nopoll_free (ref);
 	return;
 }
 
+/** 
+ * @brief Allows to get the usable size of a reference allocated by
+ * the library, as reported by the usable size handler configured
+ * (see \ref nopoll_set_allocator).
+ *
+ * @param ref The reference allocated.
+ *
+ * @return The usable size or 0 when it is not available (no handler
+ * configured or NULL reference).
+ */
+size_t nopoll_usable_size (noPollPtr ref)
+{
+	if (ref == NULL || ! __nopoll_usable_size)
+		return 0;
+
+	/* call defined handler */
+	return __nopoll_usable_size (ref);
+}
+
 
 /** 
  * @}
@@ -101,6 +101,53 @@
 /* max buffer size to process incoming handshake */
 #define NOPOLL_HANDSHAKE_BUFFER_SIZE 8192
 
+/* per connection buffer size used to read incoming frames */
+#define NOPOLL_READ_BUFFER_SIZE 4096
+
+/* default messages read from a connection each time the loop finds
+ * it ready (see nopoll_ctx_set_read_budget) */
+#define NOPOLL_READ_BUDGET 16
+
+/* default time (seconds) host names resolved (and resolution
+ * failures) are cached, and max entries cached (see
+ * nopoll_ctx_set_dns_cache_ttl) */
+#define NOPOLL_DNS_POSITIVE_TTL 60
+#define NOPOLL_DNS_NEGATIVE_TTL 5
+#define NOPOLL_DNS_CACHE_SIZE   256
+
+/* default minimum message size (bytes) compressed when the
+ * permessage-deflate extension is negotiated (see
+ * nopoll_conn_opts_set_deflate_min_size) */
+#define NOPOLL_DEFLATE_MIN_SIZE 64
+
+/* default max idle compression streams kept by the context to be
+ * shared by connections without context takeover (see
+ * nopoll_ctx_set_deflate_pool_size) */
+#define NOPOLL_DEFLATE_POOL_SIZE 64
+
+/* default max idle message holders (and payload buffers of each
+ * size class) kept by the context to be reused by next messages
+ * (see nopoll_ctx_set_msg_pool) */
+#define NOPOLL_MSG_POOL_SIZE 256
+
+/* default max memory (bytes) of idle payload buffers kept by the
+ * context (see nopoll_ctx_set_msg_pool) */
+#define NOPOLL_MSG_POOL_MEMORY (1024 * 1024)
+
+/* max bytes coalesced into a single write (header and first payload
+ * bytes) by send handlers that can't write several buffers at once
+ * (a TLS record) */
+#define NOPOLL_SEND_COALESCE_SIZE 16384
+
+/* max time (microseconds) a close operation waits to write content
+ * queued on the connection before shutting it down */
+#define NOPOLL_CLOSE_FLUSH_TIMEOUT 1000000
+
+/* default max time (microseconds) a send operation waits for the
+ * outbound queue to go down to the low watermark with
+ * NOPOLL_SLOW_CONSUMER_BLOCK before closing the connection */
+#define NOPOLL_SLOW_CONSUMER_BLOCK_TIMEOUT 10000000
+
 /* include this at this place to load GNU extensions */
 #if defined(__GNUC__)
 #  ifndef _GNU_SOURCE
@@ -217,10 +264,12 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
 #endif
 
 /* additional headers for poll support */
@@ -233,6 +282,13 @@
 #include <sys/epoll.h>
 #endif
 
+/* additional headers for linux io_uring support */
+#if defined(NOPOLL_HAVE_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#endif
+
 #include <errno.h>
 
 #if defined(NOPOLL_OS_WIN32)
@@ -292,6 +348,12 @@ typedef struct _noPollConnOpts noPollConnOpts;
  */
 typedef struct _noPollIoEngine noPollIoEngine;
 
+/** 
+ * @brief Abstraction that represents a loop (io engine and its wake
+ * up channel) watching connections registered on a context.
+ */
+typedef struct _noPollLoop noPollLoop;
+
 /** 
  * @brief Abstraction that represents a single websocket message
  * received.
@@ -377,9 +439,51 @@ typedef enum {
 	/** 
 	 * @brief Selects the epoll(2) based IO wait mechanism.
 	 */
-	NOPOLL_IO_ENGINE_EPOLL
+	NOPOLL_IO_ENGINE_EPOLL,
+	/** 
+	 * @brief Selects the io_uring(7) based IO wait mechanism
+	 * (Linux only, requires kernel 6.0 or later). Plain
+	 * connections are read with multishot receive requests into
+	 * buffers provided to the kernel and written with send
+	 * requests batched into one submission per loop iteration. TLS
+	 * connections and listeners are watched through epoll(7). This
+	 * engine is never selected by \ref NOPOLL_IO_ENGINE_DEFAULT.
+	 */
+	NOPOLL_IO_ENGINE_IO_URING
 } noPollIoEngineType;
 
+/** 
+ * @brief Policies applied when content queued on a connection goes
+ * above its high watermark (see \ref nopoll_conn_opts_set_write_watermarks).
+ */
+typedef enum {
+	/** 
+	 * @brief Content is kept queued: the application is only
+	 * notified (see \ref nopoll_conn_opts_set_on_watermark) so it
+	 * can pause producers. This is the default policy.
+	 */
+	NOPOLL_SLOW_CONSUMER_NOTIFY,
+	/** 
+	 * @brief The connection is shutdown (queued content is
+	 * dropped) and the send operation reports failure.
+	 */
+	NOPOLL_SLOW_CONSUMER_DROP_CONN,
+	/** 
+	 * @brief The oldest messages queued (not fragmented, not
+	 * control frames and not partially written) are dropped until
+	 * the queue goes down to the low watermark.
+	 */
+	NOPOLL_SLOW_CONSUMER_DROP_OLDEST,
+	/** 
+	 * @brief The send operation blocks the caller until the queue
+	 * goes down to the low watermark (or the connection fails). If
+	 * that doesn't happen in time (see \ref
+	 * nopoll_conn_opts_set_slow_consumer_timeout) the connection is
+	 * shutdown and the send operation reports failure.
+	 */
+	NOPOLL_SLOW_CONSUMER_BLOCK
+} noPollSlowConsumerPolicy;
+
 /** 
  * @brief Support macro to allocate memory using nopoll_calloc function,
  * making a casting and using the sizeof keyword.
@@ -563,6 +667,8 @@ noPollPtr  nopoll_realloc (noPollPtr ref, size_t size);
 
 void       nopoll_free    (noPollPtr ref);
 
+size_t     nopoll_usable_size (noPollPtr ref);
+
 END_C_DECLS
 
 #endif
@@ -105,8 +105,11 @@ typedef void (*noPollIoMechClear)  (noPollCtx * ctx, noPollPtr io_object);
  *
  * @param io_object The io object to be created as created by \ref
  * noPollIoMechCreate handler where the wait will be implemented.
+ *
+ * @param timeout Max amount of time to wait (microseconds) or -1 to
+ * wait until some socket changes its status.
  */
-typedef int (*noPollIoMechWait)  (noPollCtx * ctx, noPollPtr io_object);
+typedef int (*noPollIoMechWait)  (noPollCtx * ctx, noPollPtr io_object, long timeout);
 
 
 /** 
@@ -126,6 +129,33 @@ typedef nopoll_bool (*noPollIoMechAddTo)  (int               fds,
 					   noPollPtr         io_object);
 
 
+/** 
+ * @brief Handler used to define the IO remove from set function for
+ * an IO mechanism.
+ *
+ * This handler is only provided by IO mechanisms that keep sockets
+ * registered across wait operations (for example, epoll(7)). In such
+ * case, the socket is added once (through \ref noPollIoMechAddTo) when
+ * the connection is registered and removed through this handler when
+ * the connection is shutdown or unregistered. IO mechanisms that
+ * rebuild its set on each wait operation (like select(2)) leave this
+ * handler undefined (NULL).
+ *
+ * @param fds The socket descriptor to be removed.
+ *
+ * @param ctx The context where the io mechanism was created.
+ *
+ * @param conn The noPollConn to be removed from the working set.
+ *
+ * @param io_object The io object to be created as created by \ref
+ * noPollIoMechCreate handler where the wait will be implemented.
+ */
+typedef nopoll_bool (*noPollIoMechRemoveFrom)  (int               fds, 
+						noPollCtx       * ctx,
+						noPollConn      * conn,
+						noPollPtr         io_object);
+
+
 /** 
  * @brief Handler used to define the IO is set function for an IO
  * mechanism.
@@ -141,6 +171,49 @@ typedef nopoll_bool (*noPollIoMechIsSet)  (noPollCtx       * ctx,
 					   int               fds, 
 					   noPollPtr         io_object);
 
+/** 
+ * @brief Handler used to define the IO set write function for an IO
+ * mechanism: enables or disables watching the socket for write
+ * readiness (in addition to read readiness, that is always
+ * watched). It is used to flush content queued on connections when
+ * their socket becomes writable (see \ref nopoll_conn_set_on_writable).
+ *
+ * @param fds The socket descriptor to be configured (already added
+ * through \ref noPollIoMechAddTo).
+ *
+ * @param ctx The context where the io mechanism was created.
+ *
+ * @param conn The noPollConn associated to the socket.
+ *
+ * @param enable nopoll_true to watch write readiness, otherwise
+ * nopoll_false.
+ *
+ * @param io_object The io object to be created as created by \ref
+ * noPollIoMechCreate handler where the wait will be implemented.
+ */
+typedef nopoll_bool (*noPollIoMechSetWrite)  (int               fds, 
+					      noPollCtx       * ctx,
+					      noPollConn      * conn,
+					      nopoll_bool       enable,
+					      noPollPtr         io_object);
+
+/** 
+ * @brief Handler used to define the IO is writable function for an
+ * IO mechanism: reports if the socket was flagged as writable by the
+ * last wait operation (\ref noPollIoMechIsSet only reports read
+ * readiness).
+ *
+ * @param ctx The context where the io mechanism was created.
+ *
+ * @param fds The socket descriptor to be checked.
+ *
+ * @param io_object The io object to be created as created by \ref
+ * noPollIoMechCreate handler where the wait will be implemented.
+ */
+typedef nopoll_bool (*noPollIoMechIsWritable)  (noPollCtx       * ctx,
+						int               fds, 
+						noPollPtr         io_object);
+
 /** 
  * @brief Handler used to define the foreach function that is used by
  * \ref nopoll_ctx_foreach_conn
@@ -160,6 +233,38 @@ typedef nopoll_bool (*noPollForeachConn)  (noPollCtx  * ctx,
 					   noPollConn * conn,
 					   noPollPtr    user_data);
 
+/** 
+ * @brief Handler used to define the IO foreach ready function for an
+ * IO mechanism.
+ *
+ * This handler is optional. When defined, it is called after a wait
+ * operation that reported changes and must call the provided foreach
+ * handler for each connection that was reported as ready by the last
+ * wait operation (and only for them), stopping in the case foreach
+ * handler returns nopoll_true. This allows \ref nopoll_loop_wait to
+ * dispatch ready connections without checking all connections
+ * registered in the context. When not defined, \ref nopoll_loop_wait
+ * checks all connections with the \ref noPollIoMechIsSet handler.
+ *
+ * The implementation must ensure the connection notified is still
+ * registered (connections shutdown or unregistered by a previous
+ * notification must be skipped).
+ *
+ * @param ctx The context where the io mechanism was created.
+ *
+ * @param io_object The io object to be created as created by \ref
+ * noPollIoMechCreate handler where the wait was implemented.
+ *
+ * @param foreach The handler to be called for each ready connection.
+ *
+ * @param user_data Optional user pointer passed to foreach handler.
+ */
+typedef void (*noPollIoMechForeachReady)  (noPollCtx         * ctx,
+					   noPollPtr           io_object,
+					   noPollForeachConn   foreach,
+					   noPollPtr           user_data);
+
+
 /** 
  * @brief Handler definition used to describe read functions used by \ref noPollConn.
  *
@@ -196,6 +301,42 @@ typedef void (*noPollOnMessageHandler) (noPollCtx  * ctx,
 					noPollMsg  * msg,
 					noPollPtr    user_data);
 
+/** 
+ * @brief Handler definition used to notify websocket messages
+ * received in chunks, as content is read from the connection,
+ * instead of buffering them (see \ref nopoll_conn_set_on_frame_chunk).
+ *
+ * Chunks are fed directly from the connection read buffer, so the
+ * content is only valid during the handler execution.
+ *
+ * @param ctx The context where the message is being received.
+ *
+ * @param conn The connection where the message is being received.
+ *
+ * @param op_code The message type (\ref NOPOLL_TEXT_FRAME or \ref
+ * NOPOLL_BINARY_FRAME).
+ *
+ * @param chunk The content received (unmasked and decompressed).
+ *
+ * @param length The content length.
+ *
+ * @param offset Position of the content inside the message (0 for
+ * the first chunk).
+ *
+ * @param is_last nopoll_true when this is the last chunk of the
+ * message.
+ *
+ * @param user_data An optional user defined pointer.
+ */
+typedef void (*noPollOnFrameChunkHandler) (noPollCtx    * ctx,
+					   noPollConn   * conn,
+					   noPollOpCode   op_code,
+					   const char   * chunk,
+					   int            length,
+					   long           offset,
+					   nopoll_bool    is_last,
+					   noPollPtr      user_data);
+
 /** 
  * @brief Handler definition used by \ref nopoll_conn_set_on_close.
  *
@@ -214,6 +355,49 @@ typedef void (*noPollOnCloseHandler)    (noPollCtx  * ctx,
 					 noPollConn * conn, 
 					 noPollPtr    user_data);
 
+/** 
+ * @brief Handler definition used by \ref nopoll_conn_set_on_writable.
+ *
+ * Handler definition for the function that is called when the loop
+ * (\ref nopoll_loop_wait) finished writing all content queued on the
+ * connection (because the socket wasn't ready when it was sent), so
+ * the application can continue sending.
+ *
+ * @param ctx The context where the operation will take place.
+ *
+ * @param conn The connection where the operation will take place.
+ *
+ * @param user_data The reference that was configured to be passed in
+ * into the handler.
+ */
+typedef void (*noPollOnWritableHandler)    (noPollCtx  * ctx,
+					    noPollConn * conn, 
+					    noPollPtr    user_data);
+
+/** 
+ * @brief Handler definition used by \ref nopoll_conn_opts_set_on_watermark.
+ *
+ * Handler definition for the function that is called when content
+ * queued on the connection goes above the high watermark and, later,
+ * when it goes down to the low watermark (see \ref
+ * nopoll_conn_opts_set_write_watermarks).
+ *
+ * @param ctx The context where the operation will take place.
+ *
+ * @param conn The connection where the operation will take place.
+ *
+ * @param above nopoll_true when the high watermark was crossed (pause
+ * producers), nopoll_false when the queue went down to the low
+ * watermark (resume them).
+ *
+ * @param user_data The reference that was configured to be passed in
+ * into the handler.
+ */
+typedef void (*noPollOnWatermarkHandler)   (noPollCtx  * ctx,
+					    noPollConn * conn, 
+					    nopoll_bool  above,
+					    noPollPtr    user_data);
+
 /** 
  * @brief Mutex creation handler used by the library.
  *
@@ -242,6 +426,47 @@ typedef void (*noPollMutexLock) (noPollPtr mutex);
  */
 typedef void (*noPollMutexUnlock) (noPollPtr mutex);
 
+/** 
+ * @brief Memory allocation handler used by the library (see \ref
+ * nopoll_set_allocator).
+ *
+ * @param size The amount of bytes to allocate.
+ *
+ * @return A reference to the memory allocated or NULL if it fails.
+ */
+typedef noPollPtr (*noPollMalloc) (size_t size);
+
+/** 
+ * @brief Memory reallocation handler used by the library (see \ref
+ * nopoll_set_allocator).
+ *
+ * @param ref The reference to reallocate (it may be NULL).
+ *
+ * @param size The new size.
+ *
+ * @return A reference to the memory reallocated or NULL if it fails
+ * (leaving ref untouched).
+ */
+typedef noPollPtr (*noPollRealloc) (noPollPtr ref, size_t size);
+
+/** 
+ * @brief Memory release handler used by the library (see \ref
+ * nopoll_set_allocator).
+ *
+ * @param ref The reference to release (it may be NULL).
+ */
+typedef void (*noPollFree) (noPollPtr ref);
+
+/** 
+ * @brief Handler used by the library to get the usable size of a
+ * reference allocated (see \ref nopoll_set_allocator).
+ *
+ * @param ref The reference allocated.
+ *
+ * @return The amount of bytes usable.
+ */
+typedef size_t (*noPollUsableSize) (noPollPtr ref);
+
 /** 
  * @brief Handler used by nopoll_log_set_handler to receive all log
  * notifications produced by the library on this function.
@@ -322,6 +547,48 @@ typedef nopoll_bool (*noPollSslPostCheck) (noPollCtx      * ctx,
 					   noPollPtr        SSL,
 					   noPollPtr        user_data);
 
+/** 
+ * @brief Optional user defined handler used to resolve host names
+ * of client connections instead of getaddrinfo (see \ref
+ * nopoll_ctx_set_resolver).
+ *
+ * The handler is called from a resolver thread for connections
+ * created with \ref nopoll_conn_opts_set_async_connect (and from
+ * the caller thread otherwise). Results are cached by the context
+ * (see \ref nopoll_ctx_set_dns_cache_ttl).
+ *
+ * @param ctx The context where the operation happens.
+ *
+ * @param host The host name to resolve.
+ *
+ * @param port The port the connection is being created to.
+ *
+ * @param transport The address family requested (IPv4 or IPv6).
+ *
+ * @param address Buffer where the handler must place the numeric
+ * address resolved (for example "192.168.0.1" or "::1").
+ *
+ * @param address_size The size of the address buffer.
+ *
+ * @param ttl Reference where the handler can report the time (in
+ * seconds) the result can be cached, for example the TTL of the DNS
+ * record (limited to the TTL configured on the context). It is
+ * initialized to -1 (use the TTL configured).
+ *
+ * @param user_data User defined data that is received on this handler as configured at \ref nopoll_ctx_set_resolver
+ *
+ * @return nopoll_true if the host name was resolved, otherwise
+ * nopoll_false.
+ */
+typedef nopoll_bool (*noPollResolverHandler) (noPollCtx       * ctx,
+					      const char      * host,
+					      const char      * port,
+					      noPollTransport   transport,
+					      char            * address,
+					      int               address_size,
+					      int             * ttl,
+					      noPollPtr         user_data);
+
 
 #endif
 
@@ -38,11 +38,21 @@
 #include <nopoll_io.h>
 #include <nopoll_private.h>
 
+/** 
+ * @internal Translates a wait timeout in microseconds (-1 to block)
+ * into milliseconds as used by poll(2) and epoll_wait(2), rounding
+ * up so the engine never returns before the timeout.
+ */
+#define NOPOLL_IO_TIMEOUT_MS(timeout) ((timeout) < 0 ? -1 : (int) (((timeout) + 999) / 1000))
+
 typedef struct _noPollSelect {
 	noPollCtx          * ctx;
 	fd_set               set;
 	int                  length;
 	int                  max_fds;
+	/* sockets watched for write readiness */
+	fd_set               write_set;
+	int                  write_length;
 } noPollSelect;
 
 /** 
@@ -60,6 +70,7 @@ noPollPtr nopoll_io_wait_select_create (noPollCtx * ctx)
 	
 	/* clear the set */
 	FD_ZERO (&(select->set));
+	FD_ZERO (&(select->write_set));
 
 	return select;
 }
@@ -94,6 +105,8 @@ void    nopoll_io_wait_select_clear (noPollCtx * ctx, noPollPtr __fd_group)
 	/* clear the fd set */
 	select->length = 0;
 	FD_ZERO (&(select->set));
+	select->write_length = 0;
+	FD_ZERO (&(select->write_set));
 
 	/* nothing more to do */
 	return;
@@ -105,20 +118,20 @@ void    nopoll_io_wait_select_clear (noPollCtx * ctx, noPollPtr __fd_group)
  * provided.
  * 
  * @param __fd_group The fd set having all sockets to be watched.
- * @param wait_to The operation requested.
+ * @param timeout Max amount of microseconds to wait or -1 to block.
  * 
  * @return Number of connections that changed or -1 if something wailed
  */
-int nopoll_io_wait_select_wait (noPollCtx * ctx, noPollPtr __fd_group)
+int nopoll_io_wait_select_wait (noPollCtx * ctx, noPollPtr __fd_group, long timeout)
 {
 	int                 result = -1;
 	struct timeval      tv;
 	noPollSelect     * _select = (noPollSelect *) __fd_group;
 
 	/* init wait */
-	tv.tv_sec    = 0;
-	tv.tv_usec   = 500000;
-	result       = select (_select->max_fds + 1, &(_select->set), NULL,   NULL, &tv);
+	tv.tv_sec    = timeout / 1000000;
+	tv.tv_usec   = timeout % 1000000;
+	result       = select (_select->max_fds + 1, &(_select->set), _select->write_length > 0 ? &(_select->write_set) : NULL, NULL, timeout < 0 ? NULL : &tv);
 
 	/* check result */
 	if ((result == NOPOLL_SOCKET_ERROR) && (errno == NOPOLL_EINTR))
@@ -192,52 +205,2435 @@ nopoll_bool      nopoll_io_wait_select_is_set (noPollCtx   * ctx,
 	return FD_ISSET (fds, &(select->set));
 }
 
+/** 
+ * @internal noPoll select implementation for the "set write"
+ * operation: the socket (already added to the set) is also watched
+ * for write readiness by the next wait.
+ */
+nopoll_bool  nopoll_io_wait_select_set_write (int               fds, 
+					      noPollCtx       * ctx,
+					      noPollConn      * conn,
+					      nopoll_bool       enable,
+					      noPollPtr         __fd_set)
+{
+	noPollSelect * select = (noPollSelect *) __fd_set;
+
+	if (fds < 0 || fds >= FD_SETSIZE) 
+		return nopoll_false;
+
+	if (! enable) {
+		if (FD_ISSET (fds, &(select->write_set))) {
+			FD_CLR (fds, &(select->write_set));
+			select->write_length--;
+		} /* end if */
+		return nopoll_true;
+	} /* end if */
+
+	if (! FD_ISSET (fds, &(select->write_set))) {
+		FD_SET (fds, &(select->write_set));
+		select->write_length++;
+	} /* end if */
+
+	/* update max fds */
+	if (fds > select->max_fds)
+		select->max_fds = fds;
+
+	return nopoll_true;
+}
 
 /** 
- * @brief Creates an object that represents the best IO wait mechanism
- * found on the current system.
+ * @internal noPoll select implementation for the "is writable"
+ * operation.
+ */
+nopoll_bool      nopoll_io_wait_select_is_writable (noPollCtx   * ctx,
+						    int           fds, 
+						    noPollPtr      __fd_set)
+{
+	noPollSelect * select = (noPollSelect *) __fd_set;
+
+	if (fds < 0 || fds >= FD_SETSIZE || select->write_length == 0) 
+		return nopoll_false;
+
+	return FD_ISSET (fds, &(select->write_set));
+}
+
+
+#if defined(NOPOLL_HAVE_POLL)
+typedef struct _noPollPoll {
+	noPollCtx          * ctx;
+	/* slots passed to poll(2): released slots have fd = -1 and
+	 * are reused through free_slots stack */
+	struct pollfd      * fds;
+	noPollConn        ** conns;
+	int                * conn_ids;
+	int                  length;
+	int                  size;
+	int                * free_slots;
+	int                  free_count;
+	/* socket to slot index to implement is_set in O(1) */
+	int                * slot_by_fd;
+	int                  slot_by_fd_length;
+	/* private copy of fds used by wait operation so other
+	 * threads can register connections while waiting */
+	struct pollfd      * wait_fds;
+	int                  wait_size;
+	int                  ready;
+} noPollPoll;
+
+/** 
+ * @internal nopoll implementation to create the poll(2) based IO wait
+ * mechanism.
  *
- * @param ctx The context where the engine will be created/associated.
+ * @return A newly allocated noPollPoll reference or NULL if it fails.
+ */
+noPollPtr nopoll_io_wait_poll_create (noPollCtx * ctx) 
+{
+	noPollPoll * _poll = nopoll_new (noPollPoll, 1);
+
+	if (_poll == NULL)
+		return NULL;
+
+	_poll->ctx = ctx;
+	return _poll;
+}
+
+/** 
+ * @internal noPoll implementation to destroy the poll(2) IO object
+ * created by \ref nopoll_io_wait_poll_create.
+ */
+void    nopoll_io_wait_poll_destroy (noPollCtx * ctx, noPollPtr io_object)
+{
+	noPollPoll * _poll = (noPollPoll *) io_object;
+
+	if (_poll == NULL)
+		return;
+
+	nopoll_free (_poll->fds);
+	nopoll_free (_poll->conns);
+	nopoll_free (_poll->conn_ids);
+	nopoll_free (_poll->free_slots);
+	nopoll_free (_poll->slot_by_fd);
+	nopoll_free (_poll->wait_fds);
+	nopoll_free (_poll);
+	return;
+}
+
+/** 
+ * @internal Clears events reported by the last wait
+ * operation. Registered sockets are kept. The caller must hold
+ * ctx->ref_mutex.
+ */
+void    nopoll_io_wait_poll_clear (noPollCtx * ctx, noPollPtr io_object)
+{
+	noPollPoll * _poll = (noPollPoll *) io_object;
+	int          iterator;
+
+	iterator = 0;
+	while (iterator < _poll->length) {
+		_poll->fds[iterator].revents = 0;
+		iterator++;
+	} /* end while */
+	_poll->ready = 0;
+
+	return;
+}
+
+/** 
+ * @internal Implements the wait operation over all sockets registered
+ * into the poll set.
  *
- * @param engine Use \ref NOPOLL_IO_ENGINE_DEFAULT or the engine you
- * want to use.
+ * @return Number of sockets that changed or -1 if something failed.
+ */
+int nopoll_io_wait_poll_wait (noPollCtx * ctx, noPollPtr io_object, long timeout)
+{
+	noPollPoll    * _poll = (noPollPoll *) io_object;
+	struct pollfd * wait_fds;
+	int             length;
+	int             result;
+	int             iterator;
+
+	/* take a copy of current slots (under the mutex because
+	 * slots may be updated by other threads registering
+	 * connections) */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	nopoll_io_wait_poll_clear (ctx, io_object);
+	if (_poll->wait_size < _poll->length) {
+		wait_fds = nopoll_realloc (_poll->wait_fds, sizeof (struct pollfd) * _poll->size);
+		if (wait_fds == NULL) {
+			nopoll_mutex_unlock (ctx->ref_mutex);
+			return -1;
+		} /* end if */
+		_poll->wait_fds  = wait_fds;
+		_poll->wait_size = _poll->size;
+	} /* end if */
+	length = _poll->length;
+	if (length > 0)
+		memcpy (_poll->wait_fds, _poll->fds, sizeof (struct pollfd) * length);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	result = poll (_poll->wait_fds, length, NOPOLL_IO_TIMEOUT_MS (timeout));
+	if (result < 0) {
+		if (errno == NOPOLL_EINTR)
+			return 0;
+		return -1;
+	} /* end if */
+
+	/* report events into slots still holding the same socket */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	iterator = 0;
+	while (result > 0 && iterator < length) {
+		if (_poll->wait_fds[iterator].revents && _poll->fds[iterator].fd == _poll->wait_fds[iterator].fd)
+			_poll->fds[iterator].revents = _poll->wait_fds[iterator].revents;
+		iterator++;
+	} /* end while */
+	_poll->ready = result;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return result;
+}
+
+/** 
+ * @internal Grows poll slots arrays (caller must hold ctx->ref_mutex).
+ */
+nopoll_bool __nopoll_io_wait_poll_grow (noPollPoll * _poll)
+{
+	struct pollfd  * fds;
+	noPollConn    ** conns;
+	int            * conn_ids;
+	int            * free_slots;
+	int              size;
+
+	size = _poll->size > 0 ? _poll->size * 2 : 64;
+
+	fds = nopoll_realloc (_poll->fds, sizeof (struct pollfd) * size);
+	if (fds == NULL)
+		return nopoll_false;
+	_poll->fds = fds;
+
+	conns = nopoll_realloc (_poll->conns, sizeof (noPollConn *) * size);
+	if (conns == NULL)
+		return nopoll_false;
+	_poll->conns = conns;
+
+	conn_ids = nopoll_realloc (_poll->conn_ids, sizeof (int) * size);
+	if (conn_ids == NULL)
+		return nopoll_false;
+	_poll->conn_ids = conn_ids;
+
+	free_slots = nopoll_realloc (_poll->free_slots, sizeof (int) * size);
+	if (free_slots == NULL)
+		return nopoll_false;
+	_poll->free_slots = free_slots;
+
+	_poll->size = size;
+	return nopoll_true;
+}
+
+/** 
+ * @internal Registers the provided socket into a poll slot, reusing
+ * released slots in O(1). The socket is kept registered until \ref
+ * nopoll_io_wait_poll_remove_from is called.
+ */
+nopoll_bool  nopoll_io_wait_poll_add_to (int               fds, 
+					 noPollCtx       * ctx,
+					 noPollConn      * conn,
+					 noPollPtr         io_object)
+{
+	noPollPoll * _poll = (noPollPoll *) io_object;
+	int        * slot_by_fd;
+	int          length;
+	int          slot;
+
+	if (fds < 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL,
+			    "received a non valid socket (%d), unable to add to the set", fds);
+		return nopoll_false;
+	} /* end if */
+
+	/* grow socket to slot index to hold this socket */
+	if (fds >= _poll->slot_by_fd_length) {
+		length = _poll->slot_by_fd_length > 0 ? _poll->slot_by_fd_length : 64;
+		while (length <= fds)
+			length = length * 2;
+		slot_by_fd = nopoll_realloc (_poll->slot_by_fd, sizeof (int) * length);
+		if (slot_by_fd == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to add requested socket (%d), memory allocation failed", fds);
+			return nopoll_false;
+		} /* end if */
+		memset (slot_by_fd + _poll->slot_by_fd_length, -1, sizeof (int) * (length - _poll->slot_by_fd_length));
+		_poll->slot_by_fd        = slot_by_fd;
+		_poll->slot_by_fd_length = length;
+	} /* end if */
+
+	/* already registered: just update connection */
+	slot = _poll->slot_by_fd[fds];
+	if (slot >= 0 && _poll->fds[slot].fd == fds) {
+		_poll->conns[slot]    = conn;
+		_poll->conn_ids[slot] = conn ? conn->id : -1;
+		return nopoll_true;
+	} /* end if */
+
+	/* get a free slot */
+	if (_poll->free_count > 0) {
+		_poll->free_count--;
+		slot = _poll->free_slots[_poll->free_count];
+	} else {
+		if (_poll->length == _poll->size && ! __nopoll_io_wait_poll_grow (_poll)) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to add requested socket (%d), memory allocation failed", fds);
+			return nopoll_false;
+		} /* end if */
+		slot = _poll->length;
+		_poll->length++;
+	} /* end if */
+
+	_poll->fds[slot].fd      = fds;
+	_poll->fds[slot].events  = POLLIN;
+	_poll->fds[slot].revents = 0;
+	_poll->conns[slot]       = conn;
+	_poll->conn_ids[slot]    = conn ? conn->id : -1;
+	_poll->slot_by_fd[fds]   = slot;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Removes the provided socket from the poll set, releasing
+ * its slot to be reused by next registration.
+ */
+nopoll_bool  nopoll_io_wait_poll_remove_from (int               fds, 
+					      noPollCtx       * ctx,
+					      noPollConn      * conn,
+					      noPollPtr         io_object)
+{
+	noPollPoll * _poll = (noPollPoll *) io_object;
+	int          slot;
+
+	if (fds < 0 || fds >= _poll->slot_by_fd_length)
+		return nopoll_false;
+
+	/* check the slot belongs to the connection (by id) */
+	slot = _poll->slot_by_fd[fds];
+	if (slot < 0 || _poll->fds[slot].fd != fds)
+		return nopoll_false;
+	if (conn && _poll->conn_ids[slot] != conn->id)
+		return nopoll_false;
+
+	/* release slot (poll(2) ignores negative descriptors) */
+	_poll->fds[slot].fd      = -1;
+	_poll->fds[slot].revents = 0;
+	_poll->conns[slot]       = NULL;
+	_poll->conn_ids[slot]    = -1;
+	_poll->slot_by_fd[fds]   = -1;
+	_poll->free_slots[_poll->free_count] = slot;
+	_poll->free_count++;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Checks if the provided socket was flagged as ready by the
+ * last wait operation.
+ */
+nopoll_bool      nopoll_io_wait_poll_is_set (noPollCtx   * ctx,
+					     int           fds, 
+					     noPollPtr     io_object)
+{
+	noPollPoll * _poll = (noPollPoll *) io_object;
+	nopoll_bool  result = nopoll_false;
+	int          slot;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (fds >= 0 && fds < _poll->slot_by_fd_length) {
+		slot = _poll->slot_by_fd[fds];
+		if (slot >= 0 && _poll->fds[slot].fd == fds)
+			result = (_poll->fds[slot].revents & ~POLLOUT) != 0;
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return result;
+}
+
+/** 
+ * @internal Enables or disables watching write readiness of the
+ * provided socket (caller must hold ctx->ref_mutex). Takes effect on
+ * next wait operation.
+ */
+nopoll_bool  nopoll_io_wait_poll_set_write (int               fds, 
+					    noPollCtx       * ctx,
+					    noPollConn      * conn,
+					    nopoll_bool       enable,
+					    noPollPtr         io_object)
+{
+	noPollPoll * _poll = (noPollPoll *) io_object;
+	int          slot;
+
+	if (fds < 0 || fds >= _poll->slot_by_fd_length)
+		return nopoll_false;
+
+	slot = _poll->slot_by_fd[fds];
+	if (slot < 0 || _poll->fds[slot].fd != fds)
+		return nopoll_false;
+
+	_poll->fds[slot].events = enable ? (POLLIN | POLLOUT) : POLLIN;
+	return nopoll_true;
+}
+
+/** 
+ * @internal Checks if the provided socket was flagged as writable by
+ * the last wait operation.
+ */
+nopoll_bool      nopoll_io_wait_poll_is_writable (noPollCtx   * ctx,
+						  int           fds, 
+						  noPollPtr     io_object)
+{
+	noPollPoll * _poll = (noPollPoll *) io_object;
+	nopoll_bool  result = nopoll_false;
+	int          slot;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (fds >= 0 && fds < _poll->slot_by_fd_length) {
+		slot = _poll->slot_by_fd[fds];
+		if (slot >= 0 && _poll->fds[slot].fd == fds)
+			result = (_poll->fds[slot].revents & POLLOUT) != 0;
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return result;
+}
+
+/** 
+ * @internal Notifies connections reported as ready by the last wait
+ * operation.
+ */
+void         nopoll_io_wait_poll_foreach_ready (noPollCtx         * ctx,
+						noPollPtr           io_object,
+						noPollForeachConn   foreach,
+						noPollPtr           user_data)
+{
+	noPollPoll * _poll = (noPollPoll *) io_object;
+	noPollConn * conn;
+	int          iterator;
+	int          pending;
+
+	iterator = 0;
+	pending  = _poll->ready;
+	while (pending > 0 && iterator < _poll->length) {
+		/* get connection still registered on this slot (see
+		 * nopoll_io_wait_epoll_foreach_ready) */
+		conn = NULL;
+		nopoll_mutex_lock (ctx->ref_mutex);
+		if (iterator < _poll->length && _poll->fds[iterator].revents) {
+			conn = _poll->conns[iterator];
+			pending--;
+		} /* end if */
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		iterator++;
+
+		if (conn == NULL)
+			continue;
+
+		/* notify */
+		if (foreach (ctx, conn, user_data))
+			break;
+	} /* end while */
+
+	return;
+}
+#endif
+
+#if defined(NOPOLL_HAVE_EPOLL)
+/** 
+ * @internal Max number of events that are collected from the kernel
+ * on each epoll_wait call.
+ */
+#define NOPOLL_EPOLL_MAX_EVENTS 512
+
+/** 
+ * @internal Flags stored on the per socket ready table.
+ */
+#define NOPOLL_EPOLL_READ  1
+#define NOPOLL_EPOLL_WRITE 2
+
+typedef struct _noPollEpoll {
+	noPollCtx          * ctx;
+	int                  epoll_fd;
+	/* events reported by last epoll_wait call */
+	struct epoll_event * events;
+	int                  events_ready;
+	/* per socket ready flag and connection registered (both
+	 * indexed by socket) to implement is_set and foreach_ready
+	 * operations in O(1) */
+	char               * ready;
+	noPollConn        ** conns;
+	int                  ready_length;
+} noPollEpoll;
+
+/** 
+ * @internal nopoll implementation to create the epoll(7) based IO
+ * wait mechanism.
  *
- * @return The selected IO wait mechanism or NULL if it fails.
- */ 
-noPollIoEngine * nopoll_io_get_engine (noPollCtx * ctx, noPollIoEngineType engine_type)
+ * @return A newly allocated noPollEpoll reference or NULL if it fails.
+ */
+noPollPtr nopoll_io_wait_epoll_create (noPollCtx * ctx) 
 {
-	noPollIoEngine * engine = nopoll_new (noPollIoEngine, 1);
-	if (engine == NULL)
+	noPollEpoll * epoll = nopoll_new (noPollEpoll, 1);
+
+	if (epoll == NULL)
 		return NULL;
 
-	/* configure default implementation */
-	engine->create  = nopoll_io_wait_select_create;
-	engine->destroy = nopoll_io_wait_select_destroy;
-	engine->clear   = nopoll_io_wait_select_clear;
-	engine->wait    = nopoll_io_wait_select_wait;
-	engine->add_to  = nopoll_io_wait_select_add_to;
-	engine->is_set  = nopoll_io_wait_select_is_set;
+	epoll->ctx      = ctx;
+	epoll->epoll_fd = epoll_create (NOPOLL_EPOLL_MAX_EVENTS);
+	if (epoll->epoll_fd < 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to create epoll descriptor, epoll_create failed, errno=%d", errno);
+		nopoll_free (epoll);
+		return NULL;
+	} /* end if */
 
-	/* call to create the object */
-	engine->ctx       = ctx;
-	engine->io_object = engine->create (ctx);
-	
-	/* return the engine that was created */
-	return engine;
+	/* set close on exec */
+	fcntl (epoll->epoll_fd, F_SETFD, FD_CLOEXEC);
+
+	epoll->events   = nopoll_new (struct epoll_event, NOPOLL_EPOLL_MAX_EVENTS);
+	if (epoll->events == NULL) {
+		nopoll_close_socket (epoll->epoll_fd);
+		nopoll_free (epoll);
+		return NULL;
+	} /* end if */
+
+	return epoll;
 }
 
 /** 
- * @brief Release the io engine created by \ref nopoll_io_get_engine.
- *
- * @param engine The engine to be released.
+ * @internal noPoll implementation to destroy the epoll(7) IO object
+ * created by \ref nopoll_io_wait_epoll_create.
  */
-void             nopoll_io_release_engine (noPollIoEngine * engine)
+void    nopoll_io_wait_epoll_destroy (noPollCtx * ctx, noPollPtr io_object)
 {
-	if (engine == NULL)
+	noPollEpoll * epoll = (noPollEpoll *) io_object;
+
+	if (epoll == NULL)
 		return;
-	engine->destroy (engine->ctx, engine->io_object);
-	nopoll_free (engine);
+
+	nopoll_close_socket (epoll->epoll_fd);
+	nopoll_free (epoll->events);
+	nopoll_free (epoll->ready);
+	nopoll_free (epoll->conns);
+	nopoll_free (epoll);
+	return;
+}
+
+/** 
+ * @internal Clears ready flags reported by the last wait
+ * operation. Registered sockets are kept. The caller must hold
+ * ctx->ref_mutex.
+ */
+void    nopoll_io_wait_epoll_clear (noPollCtx * ctx, noPollPtr io_object)
+{
+	noPollEpoll * epoll = (noPollEpoll *) io_object;
+	int           iterator;
+	int           fds;
+
+	/* only reset flags that were set by last wait */
+	iterator = 0;
+	while (iterator < epoll->events_ready) {
+		fds = epoll->events[iterator].data.fd;
+		if (fds >= 0 && fds < epoll->ready_length)
+			epoll->ready[fds] = 0;
+		iterator++;
+	} /* end while */
+	epoll->events_ready = 0;
+
 	return;
 }
 
+/** 
+ * @internal Implements the wait operation over all sockets registered
+ * into the epoll descriptor.
+ *
+ * @return Number of sockets that changed or -1 if something failed.
+ */
+int nopoll_io_wait_epoll_wait (noPollCtx * ctx, noPollPtr io_object, long timeout)
+{
+	noPollEpoll * epoll = (noPollEpoll *) io_object;
+	int           result;
+	int           iterator;
+	int           fds;
+
+	/* reset previous ready flags (under the mutex because
+	 * ready/conns arrays may be updated by other threads
+	 * registering connections) */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	nopoll_io_wait_epoll_clear (ctx, io_object);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	result = epoll_wait (epoll->epoll_fd, epoll->events, NOPOLL_EPOLL_MAX_EVENTS, NOPOLL_IO_TIMEOUT_MS (timeout));
+	if (result < 0) {
+		if (errno == NOPOLL_EINTR)
+			return 0;
+		return -1;
+	} /* end if */
+
+	/* flag ready sockets */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	iterator = 0;
+	while (iterator < result) {
+		fds = epoll->events[iterator].data.fd;
+		if (fds >= 0 && fds < epoll->ready_length) {
+			/* read readiness (including errors and
+			 * hangups) and write readiness flags */
+			epoll->ready[fds] = 0;
+			if (epoll->events[iterator].events & ~EPOLLOUT)
+				epoll->ready[fds] |= NOPOLL_EPOLL_READ;
+			if (epoll->events[iterator].events & EPOLLOUT)
+				epoll->ready[fds] |= NOPOLL_EPOLL_WRITE;
+		} /* end if */
+		iterator++;
+	} /* end while */
+	epoll->events_ready = result;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return result;
+}
+
+/** 
+ * @internal Registers the provided socket into the epoll
+ * descriptor. The socket is kept registered until \ref
+ * nopoll_io_wait_epoll_remove_from is called or the socket is closed.
+ */
+nopoll_bool  nopoll_io_wait_epoll_add_to (int               fds, 
+					  noPollCtx       * ctx,
+					  noPollConn      * conn,
+					  noPollPtr         io_object)
+{
+	noPollEpoll        * epoll = (noPollEpoll *) io_object;
+	struct epoll_event   event;
+	char               * ready;
+	noPollConn        ** conns;
+	int                  length;
+
+	if (fds < 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL,
+			    "received a non valid socket (%d), unable to add to the set", fds);
+		return nopoll_false;
+	} /* end if */
+
+	/* grow ready flags to hold this socket */
+	if (fds >= epoll->ready_length) {
+		length = epoll->ready_length > 0 ? epoll->ready_length : 64;
+		while (length <= fds)
+			length = length * 2;
+		ready = nopoll_realloc (epoll->ready, length);
+		if (ready == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to add requested socket (%d), memory allocation failed", fds);
+			return nopoll_false;
+		} /* end if */
+		memset (ready + epoll->ready_length, 0, length - epoll->ready_length);
+		epoll->ready        = ready;
+
+		conns = nopoll_realloc (epoll->conns, sizeof (noPollConn *) * length);
+		if (conns == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to add requested socket (%d), memory allocation failed", fds);
+			return nopoll_false;
+		} /* end if */
+		memset (conns + epoll->ready_length, 0, sizeof (noPollConn *) * (length - epoll->ready_length));
+		epoll->conns        = conns;
+		epoll->ready_length = length;
+	} /* end if */
+
+	/* record connection associated to this socket */
+	epoll->conns[fds] = conn;
+
+	memset (&event, 0, sizeof (struct epoll_event));
+	event.events  = EPOLLIN;
+	event.data.fd = fds;
+	if (epoll_ctl (epoll->epoll_fd, EPOLL_CTL_ADD, fds, &event) != 0) {
+		/* already registered, nothing to do */
+		if (errno == EEXIST)
+			return nopoll_true;
+
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL,
+			    "Unable to add requested socket (%d) to epoll set, errno=%d", fds, errno);
+		return nopoll_false;
+	} /* end if */
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Removes the provided socket from the epoll descriptor.
+ */
+nopoll_bool  nopoll_io_wait_epoll_remove_from (int               fds, 
+					       noPollCtx       * ctx,
+					       noPollConn      * conn,
+					       noPollPtr         io_object)
+{
+	noPollEpoll        * epoll = (noPollEpoll *) io_object;
+	struct epoll_event   event;
+
+	if (fds < 0)
+		return nopoll_false;
+
+	/* clear ready flag so it is not reported until next wait */
+	if (fds < epoll->ready_length) {
+		epoll->ready[fds] = 0;
+		if (epoll->conns[fds] == conn)
+			epoll->conns[fds] = NULL;
+	} /* end if */
+
+	/* event is ignored but required by kernels before 2.6.9 */
+	memset (&event, 0, sizeof (struct epoll_event));
+	if (epoll_ctl (epoll->epoll_fd, EPOLL_CTL_DEL, fds, &event) != 0) 
+		return nopoll_false;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Checks if the provided socket was flagged as ready by the
+ * last wait operation.
+ */
+nopoll_bool      nopoll_io_wait_epoll_is_set (noPollCtx   * ctx,
+					      int           fds, 
+					      noPollPtr     io_object)
+{
+	noPollEpoll * epoll = (noPollEpoll *) io_object;
+	nopoll_bool   result = nopoll_false;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (fds >= 0 && fds < epoll->ready_length)
+		result = (epoll->ready[fds] & NOPOLL_EPOLL_READ) != 0;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return result;
+}
+
+/** 
+ * @internal Enables or disables watching write readiness of the
+ * provided socket (already registered).
+ */
+nopoll_bool  nopoll_io_wait_epoll_set_write (int               fds, 
+					     noPollCtx       * ctx,
+					     noPollConn      * conn,
+					     nopoll_bool       enable,
+					     noPollPtr         io_object)
+{
+	noPollEpoll        * epoll = (noPollEpoll *) io_object;
+	struct epoll_event   event;
+
+	if (fds < 0)
+		return nopoll_false;
+
+	memset (&event, 0, sizeof (struct epoll_event));
+	event.events  = enable ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+	event.data.fd = fds;
+	if (epoll_ctl (epoll->epoll_fd, EPOLL_CTL_MOD, fds, &event) != 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_WARNING,
+			    "Unable to update write watching for socket (%d) on epoll set, errno=%d", fds, errno);
+		return nopoll_false;
+	} /* end if */
+
+	return nopoll_true;
+}
 
+/** 
+ * @internal Checks if the provided socket was flagged as writable by
+ * the last wait operation.
+ */
+nopoll_bool      nopoll_io_wait_epoll_is_writable (noPollCtx   * ctx,
+						   int           fds, 
+						   noPollPtr     io_object)
+{
+	noPollEpoll * epoll = (noPollEpoll *) io_object;
+	nopoll_bool   result = nopoll_false;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (fds >= 0 && fds < epoll->ready_length)
+		result = (epoll->ready[fds] & NOPOLL_EPOLL_WRITE) != 0;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return result;
+}
+
+/** 
+ * @internal Notifies connections reported as ready by the last wait
+ * operation, without checking other connections registered.
+ */
+void         nopoll_io_wait_epoll_foreach_ready (noPollCtx         * ctx,
+						 noPollPtr           io_object,
+						 noPollForeachConn   foreach,
+						 noPollPtr           user_data)
+{
+	noPollEpoll * epoll = (noPollEpoll *) io_object;
+	noPollConn  * conn;
+	int           iterator;
+	int           fds;
+
+	iterator = 0;
+	while (iterator < epoll->events_ready) {
+		fds = epoll->events[iterator].data.fd;
+		iterator++;
+
+		/* get connection associated to the socket: the
+		 * reference is cleared when the connection is
+		 * shutdown or unregistered (for example by a previous
+		 * notification) so only registered connections are
+		 * notified (same as nopoll_ctx_foreach_conn, no
+		 * additional reference is acquired) */
+		conn = NULL;
+		nopoll_mutex_lock (ctx->ref_mutex);
+		if (fds >= 0 && fds < epoll->ready_length && epoll->ready[fds]) 
+			conn = epoll->conns[fds];
+		nopoll_mutex_unlock (ctx->ref_mutex);
+
+		if (conn == NULL)
+			continue;
+
+		/* notify */
+		if (foreach (ctx, conn, user_data))
+			break;
+	} /* end while */
+
+	return;
+}
+#endif
+
+#if defined(NOPOLL_HAVE_IO_URING)
+/** 
+ * @internal Number of submission queue entries requested to the
+ * kernel (completion queue is twice this size).
+ */
+#define NOPOLL_IO_URING_ENTRIES 256
+
+/** 
+ * @internal Number (power of 2) and size of the buffers provided to
+ * the kernel to receive content. Each buffer is given back to the
+ * kernel as soon as its content is copied into the connection.
+ */
+#define NOPOLL_IO_URING_BUFFERS     64
+#define NOPOLL_IO_URING_BUFFER_SIZE 16384
+
+/** 
+ * @internal Content received and still not read by the application
+ * that stops receiving on a connection (it is received again once
+ * half of it is read), so a peer writing faster than the application
+ * reads is slowed down by TCP flow control as with the rest of
+ * engines.
+ */
+#define NOPOLL_IO_URING_INPUT_LIMIT 262144
+
+/** 
+ * @internal Content accepted by the send handler of each connection
+ * and still not written by the kernel. Once full, the send handler
+ * reports it would block and content is queued on the connection.
+ */
+#define NOPOLL_IO_URING_OUTPUT_SIZE 65536
+
+/** 
+ * @internal Request kinds. The kind is placed on the user_data top
+ * byte, followed by the socket generation and the socket.
+ */
+#define NOPOLL_IO_URING_RECV   1
+#define NOPOLL_IO_URING_SEND   2
+#define NOPOLL_IO_URING_EPOLL  3
+#define NOPOLL_IO_URING_CANCEL 4
+
+#define NOPOLL_IO_URING_DATA(kind, gen, fds) ((((unsigned long long) (kind)) << 56) | (((unsigned long long) ((gen) & 0xffffff)) << 32) | (unsigned int) (fds))
+
+/** 
+ * @internal Events reported by the wait operation.
+ */
+#define NOPOLL_IO_URING_READ  1
+#define NOPOLL_IO_URING_WRITE 2
+
+/** 
+ * @internal Socket modes: not registered, watched through the epoll(7)
+ * object (listeners, TLS sessions, custom handlers and connections
+ * still connecting), read and written through completions and
+ * completions cancelled while the engine is released.
+ */
+#define NOPOLL_IO_URING_NONE       0
+#define NOPOLL_IO_URING_WATCHED    1
+#define NOPOLL_IO_URING_COMPLETION 2
+#define NOPOLL_IO_URING_RELEASING  3
+
+typedef struct _noPollIoUringSocket {
+	int                   mode;
+	/* connection registered (NULL for internal sockets like
+	 * the context wake up channel) */
+	noPollConn          * conn;
+	/* generation placed on requests to discard completions
+	 * from a previous registration of the same socket */
+	unsigned int          gen;
+	/* waiting to be read and written through completions */
+	nopoll_bool           candidate;
+	/* multishot receive in flight, receive stopped (too much
+	 * content pending to be read), write readiness watched */
+	nopoll_bool           receiving;
+	nopoll_bool           paused;
+	nopoll_bool           writing;
+	/* connection closed by the peer and error reported by a
+	 * request (both reported by the receive handler) */
+	nopoll_bool           eof;
+	int                   error;
+	/* content accepted by the send handler (from out_start to
+	 * out_end), out_sent bytes from out_start are being written
+	 * by a send request */
+	char                * out;
+	int                   out_start;
+	int                   out_end;
+	int                   out_sent;
+	/* events pending to be reported by next wait and events
+	 * reported by last wait */
+	char                  events;
+	char                  ready;
+} noPollIoUringSocket;
+
+/* send buffers of connections removed while a send request was in
+ * flight, released once the request completes */
+typedef struct _noPollIoUringRetired {
+	unsigned long long              user_data;
+	char                          * buffer;
+	struct _noPollIoUringRetired  * next;
+} noPollIoUringRetired;
+
+typedef struct _noPollIoUring {
+	noPollCtx             * ctx;
+	int                     ring_fd;
+
+	/* submission queue ring */
+	void                  * sq_ring;
+	size_t                  sq_ring_size;
+	unsigned int          * sq_head;
+	unsigned int          * sq_tail;
+	unsigned int          * sq_mask;
+	unsigned int          * sq_entries;
+	unsigned int          * sq_array;
+	struct io_uring_sqe   * sqes;
+	size_t                  sqes_size;
+	/* entries queued and still not submitted */
+	unsigned int            sq_pending;
+
+	/* completion queue ring */
+	void                  * cq_ring;
+	size_t                  cq_ring_size;
+	unsigned int          * cq_head;
+	unsigned int          * cq_tail;
+	unsigned int          * cq_mask;
+	struct io_uring_cqe   * cqes;
+
+	/* ring of buffers provided to the kernel (registered as
+	 * buffer group 0) and the buffers */
+	struct io_uring_buf   * buf_ring;
+	size_t                  buf_ring_size;
+	unsigned short        * buf_tail;
+	char                  * buffers;
+
+	/* per socket state (indexed by socket) */
+	noPollIoUringSocket   * sockets;
+	int                     length;
+
+	/* sockets with events pending, sockets reported by last
+	 * wait and sockets waiting to be read and written through
+	 * completions */
+	int                   * pending_fds;
+	int                     pending_count;
+	int                   * ready_fds;
+	int                     ready_count;
+	int                   * candidates;
+	int                     candidates_count;
+
+	/* epoll(7) object watching sockets not read through
+	 * completions: its descriptor is watched with a poll request
+	 * (epoll_armed) that reported it ready (epoll_ready) */
+	noPollPtr               epoll;
+	nopoll_bool             epoll_armed;
+	nopoll_bool             epoll_ready;
+
+	/* a wait operation is blocked (or about to) on the ring, so
+	 * requests are submitted right away instead of with the next
+	 * wait */
+	nopoll_bool             waiting;
+	/* requests in flight */
+	int                     inflight;
+	noPollIoUringRetired  * retired;
+} noPollIoUring;
+
+/** 
+ * @internal Submits queued requests and optionally waits for
+ * completions (up to timeout microseconds or blocking if -1).
+ */
+int __nopoll_io_uring_enter (noPollIoUring * ring, unsigned int to_submit, nopoll_bool wait, long timeout)
+{
+	struct io_uring_getevents_arg   arg;
+	struct __kernel_timespec        ts;
+	unsigned int                    flags = 0;
+
+	if (! wait)
+		return syscall (__NR_io_uring_enter, ring->ring_fd, to_submit, 0, 0, NULL, 0);
+	if (timeout < 0)
+		return syscall (__NR_io_uring_enter, ring->ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+
+	memset (&arg, 0, sizeof (arg));
+	ts.tv_sec  = timeout / 1000000;
+	ts.tv_nsec = (timeout % 1000000) * 1000;
+	arg.ts     = (unsigned long) &ts;
+	flags      = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+
+	return syscall (__NR_io_uring_enter, ring->ring_fd, to_submit, 1, flags, &arg, sizeof (arg));
+}
+
+/** 
+ * @internal Submits requests queued without waiting (caller must hold
+ * ctx->ref_mutex).
+ */
+void __nopoll_io_uring_submit (noPollIoUring * ring)
+{
+	int result;
+
+	if (ring->sq_pending == 0)
+		return;
+
+	result = __nopoll_io_uring_enter (ring, ring->sq_pending, nopoll_false, 0);
+	if (result > 0)
+		ring->sq_pending -= (unsigned int) result > ring->sq_pending ? ring->sq_pending : (unsigned int) result;
+	return;
+}
+
+/** 
+ * @internal Gets next free submission entry (caller must hold
+ * ctx->ref_mutex). If the submission ring is full, queued entries are
+ * submitted first.
+ */
+struct io_uring_sqe * __nopoll_io_uring_get_sqe (noPollIoUring * ring)
+{
+	unsigned int          head;
+	unsigned int          tail;
+	unsigned int          index;
+	struct io_uring_sqe * sqe;
+
+	head = __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE);
+	tail = *ring->sq_tail;
+	if (tail - head >= *ring->sq_entries) {
+		/* ring full: flush queued requests */
+		__nopoll_io_uring_submit (ring);
+		head = __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE);
+		if (tail - head >= *ring->sq_entries)
+			return NULL;
+	} /* end if */
+
+	index = tail & *ring->sq_mask;
+	sqe   = &ring->sqes[index];
+	memset (sqe, 0, sizeof (struct io_uring_sqe));
+	ring->sq_array[index] = index;
+
+	/* publish entry */
+	__atomic_store_n (ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->sq_pending++;
+
+	return sqe;
+}
+
+/** 
+ * @internal Flags events to be reported for the provided socket by
+ * next wait operation (caller must hold ctx->ref_mutex).
+ */
+void __nopoll_io_uring_notify (noPollIoUring * ring, int fds, int events)
+{
+	if (ring->sockets[fds].events == 0) {
+		ring->pending_fds[ring->pending_count] = fds;
+		ring->pending_count++;
+	} /* end if */
+	ring->sockets[fds].events |= events;
+	return;
+}
+
+/** 
+ * @internal Queues a multishot receive request for the provided
+ * socket, reading into buffers selected by the kernel from the
+ * provided buffer ring (caller must hold ctx->ref_mutex).
+ */
+nopoll_bool __nopoll_io_uring_recv (noPollIoUring * ring, int fds)
+{
+	struct io_uring_sqe * sqe = __nopoll_io_uring_get_sqe (ring);
+
+	if (sqe == NULL)
+		return nopoll_false;
+
+	sqe->opcode    = IORING_OP_RECV;
+	sqe->fd        = fds;
+	sqe->ioprio    = IORING_RECV_MULTISHOT;
+	sqe->flags     = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	sqe->user_data = NOPOLL_IO_URING_DATA (NOPOLL_IO_URING_RECV, ring->sockets[fds].gen, fds);
+	ring->sockets[fds].receiving = nopoll_true;
+	ring->inflight++;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Queues a send request with all content accepted by the
+ * send handler on the provided socket (caller must hold
+ * ctx->ref_mutex).
+ */
+nopoll_bool __nopoll_io_uring_send (noPollIoUring * ring, int fds)
+{
+	noPollIoUringSocket * socket = &ring->sockets[fds];
+	struct io_uring_sqe * sqe    = __nopoll_io_uring_get_sqe (ring);
+
+	if (sqe == NULL)
+		return nopoll_false;
+
+	sqe->opcode    = IORING_OP_SEND;
+	sqe->fd        = fds;
+	sqe->addr      = (unsigned long) (socket->out + socket->out_start);
+	sqe->len       = socket->out_end - socket->out_start;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = NOPOLL_IO_URING_DATA (NOPOLL_IO_URING_SEND, socket->gen, fds);
+	socket->out_sent = socket->out_end - socket->out_start;
+	ring->inflight++;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Queues a request to cancel the request identified by the
+ * provided user_data (caller must hold ctx->ref_mutex).
+ */
+nopoll_bool __nopoll_io_uring_cancel (noPollIoUring * ring, unsigned long long user_data)
+{
+	struct io_uring_sqe * sqe = __nopoll_io_uring_get_sqe (ring);
+
+	if (sqe == NULL)
+		return nopoll_false;
+
+	sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+	sqe->fd        = -1;
+	sqe->addr      = user_data;
+	sqe->user_data = NOPOLL_IO_URING_DATA (NOPOLL_IO_URING_CANCEL, 0, 0);
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Gives back to the kernel the provided buffer.
+ */
+void __nopoll_io_uring_recycle (noPollIoUring * ring, int bid)
+{
+	unsigned short        tail = *ring->buf_tail;
+	struct io_uring_buf * buf  = &ring->buf_ring[tail & (NOPOLL_IO_URING_BUFFERS - 1)];
+
+	buf->addr = (unsigned long) (ring->buffers + bid * NOPOLL_IO_URING_BUFFER_SIZE);
+	buf->len  = NOPOLL_IO_URING_BUFFER_SIZE;
+	buf->bid  = bid;
+	__atomic_store_n (ring->buf_tail, (unsigned short) (tail + 1), __ATOMIC_RELEASE);
+	return;
+}
+
+/** 
+ * @internal Appends content received to the connection (read by the
+ * receive handler).
+ */
+nopoll_bool __nopoll_io_uring_store (noPollConn * conn, const char * content, int size)
+{
+	char * input;
+	int    length;
+
+	/* move content pending to the beginning */
+	if (conn->io_input_start == conn->io_input_end) {
+		conn->io_input_start = 0;
+		conn->io_input_end   = 0;
+	} else if (conn->io_input_end + size > conn->io_input_size && conn->io_input_start > 0) {
+		memmove (conn->io_input, conn->io_input + conn->io_input_start, conn->io_input_end - conn->io_input_start);
+		conn->io_input_end  -= conn->io_input_start;
+		conn->io_input_start = 0;
+	} /* end if */
+
+	if (conn->io_input_end + size > conn->io_input_size) {
+		length = conn->io_input_size > 0 ? conn->io_input_size : NOPOLL_IO_URING_BUFFER_SIZE;
+		while (length < conn->io_input_end + size)
+			length = length * 2;
+		input = nopoll_realloc (conn->io_input, length);
+		if (input == NULL)
+			return nopoll_false;
+		conn->io_input      = input;
+		conn->io_input_size = length;
+	} /* end if */
+
+	memcpy (conn->io_input + conn->io_input_end, content, size);
+	conn->io_input_end += size;
+	return nopoll_true;
+}
+
+/** 
+ * @internal Releases the send buffer retired for the provided
+ * request.
+ */
+void __nopoll_io_uring_release_retired (noPollIoUring * ring, unsigned long long user_data)
+{
+	noPollIoUringRetired ** iterator = &ring->retired;
+	noPollIoUringRetired  * retired;
+
+	while (*iterator) {
+		retired = *iterator;
+		if (retired->user_data == user_data) {
+			*iterator = retired->next;
+			nopoll_free (retired->buffer);
+			nopoll_free (retired);
+			return;
+		} /* end if */
+		iterator = &retired->next;
+	} /* end while */
+
+	return;
+}
+
+/** 
+ * @internal Handles the provided completion (caller must hold
+ * ctx->ref_mutex).
+ */
+void __nopoll_io_uring_complete (noPollIoUring * ring, struct io_uring_cqe * cqe)
+{
+	noPollIoUringSocket * socket = NULL;
+	int                   kind   = (int) (cqe->user_data >> 56);
+	unsigned int          gen    = (unsigned int) ((cqe->user_data >> 32) & 0xffffff);
+	int                   fds    = (int) (cqe->user_data & 0xffffffff);
+	nopoll_bool           more   = (cqe->flags & IORING_CQE_F_MORE) != 0;
+	int                   bid;
+
+	/* cancel requests are not tracked */
+	if (kind == NOPOLL_IO_URING_CANCEL)
+		return;
+	if (! more)
+		ring->inflight--;
+
+	/* epoll descriptor ready: sockets watched through epoll are
+	 * collected by the wait operation */
+	if (kind == NOPOLL_IO_URING_EPOLL) {
+		ring->epoll_armed = nopoll_false;
+		if (cqe->res > 0)
+			ring->epoll_ready = nopoll_true;
+		return;
+	} /* end if */
+
+	/* skip completions from previous registrations */
+	if (fds >= 0 && fds < ring->length && (ring->sockets[fds].gen & 0xffffff) == gen &&
+	    (ring->sockets[fds].mode == NOPOLL_IO_URING_COMPLETION || ring->sockets[fds].mode == NOPOLL_IO_URING_RELEASING))
+		socket = &ring->sockets[fds];
+
+	if (kind == NOPOLL_IO_URING_RECV) {
+		/* copy content received and give the buffer back */
+		if (cqe->flags & IORING_CQE_F_BUFFER) {
+			bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+			if (socket && cqe->res > 0 &&
+			    ! __nopoll_io_uring_store (socket->conn, ring->buffers + bid * NOPOLL_IO_URING_BUFFER_SIZE, cqe->res))
+				socket->error = ENOMEM;
+			__nopoll_io_uring_recycle (ring, bid);
+		} /* end if */
+
+		if (socket == NULL)
+			return;
+		if (! more)
+			socket->receiving = nopoll_false;
+		if (socket->mode != NOPOLL_IO_URING_COMPLETION)
+			return;
+
+		if (cqe->res > 0 || cqe->res == -ENOBUFS || cqe->res == -ECANCELED) {
+			/* stop receiving while too much content is
+			 * pending to be read (received again by the
+			 * receive handler) */
+			if (socket->receiving && ! socket->paused &&
+			    socket->conn->io_input_end - socket->conn->io_input_start > NOPOLL_IO_URING_INPUT_LIMIT) {
+				socket->paused = nopoll_true;
+				__nopoll_io_uring_cancel (ring, cqe->user_data);
+			} /* end if */
+
+			/* multishot request finished by the kernel
+			 * (for example, no buffer available): receive
+			 * again */
+			if (! socket->receiving && ! socket->paused && socket->error == 0)
+				__nopoll_io_uring_recv (ring, fds);
+
+			if (cqe->res > 0 || socket->error)
+				__nopoll_io_uring_notify (ring, fds, NOPOLL_IO_URING_READ);
+			return;
+		} /* end if */
+
+		/* connection closed by the peer or failure, reported by
+		 * the receive handler */
+		if (cqe->res == 0)
+			socket->eof = nopoll_true;
+		else
+			socket->error = -cqe->res;
+		__nopoll_io_uring_notify (ring, fds, NOPOLL_IO_URING_READ);
+		return;
+	} /* end if */
+
+	/* send request of a connection removed */
+	if (socket == NULL) {
+		__nopoll_io_uring_release_retired (ring, cqe->user_data);
+		return;
+	} /* end if */
+
+	socket->out_sent = 0;
+	if (cqe->res < 0) {
+		/* cancelled while releasing the engine: content not
+		 * written is handed back to the connection */
+		if (cqe->res == -ECANCELED)
+			return;
+
+		/* failure, reported by the receive handler */
+		socket->error     = -cqe->res;
+		socket->out_start = 0;
+		socket->out_end   = 0;
+		if (socket->mode == NOPOLL_IO_URING_COMPLETION)
+			__nopoll_io_uring_notify (ring, fds, NOPOLL_IO_URING_READ);
+		return;
+	} /* end if */
+
+	/* write the rest (short write) */
+	socket->out_start += cqe->res;
+	if (socket->out_start == socket->out_end) {
+		socket->out_start = 0;
+		socket->out_end   = 0;
+	} else if (socket->mode == NOPOLL_IO_URING_COMPLETION) {
+		__nopoll_io_uring_send (ring, fds);
+	} /* end if */
+
+	/* room to accept more content */
+	if (socket->writing && socket->mode == NOPOLL_IO_URING_COMPLETION)
+		__nopoll_io_uring_notify (ring, fds, NOPOLL_IO_URING_WRITE);
+	return;
+}
+
+/** 
+ * @internal Handles all completions available (caller must hold
+ * ctx->ref_mutex).
+ */
+void __nopoll_io_uring_reap (noPollIoUring * ring)
+{
+	unsigned int head;
+	unsigned int tail;
+
+	head = *ring->cq_head;
+	tail = __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE);
+	while (head != tail) {
+		__nopoll_io_uring_complete (ring, &ring->cqes[head & *ring->cq_mask]);
+		head++;
+	} /* end while */
+
+	/* release entries */
+	__atomic_store_n (ring->cq_head, head, __ATOMIC_RELEASE);
+	return;
+}
+
+/** 
+ * @internal Receive handler installed on connections read through
+ * completions: it reports content received by the multishot receive
+ * request (see nopoll_io_wait_io_uring_wait). Once the engine is
+ * released, content left is reported and then the default receive
+ * handler is restored.
+ */
+int nopoll_io_wait_io_uring_receive (noPollConn * conn, char * buffer, int buffer_size)
+{
+	noPollCtx           * ctx    = conn->ctx;
+	noPollIoUring       * ring;
+	noPollIoUringSocket * socket = NULL;
+	int                   size   = 0;
+	int                   error  = NOPOLL_EWOULDBLOCK;
+	nopoll_bool           eof    = nopoll_false;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ring = conn->io_completion;
+	if (ring) {
+		socket = &ring->sockets[conn->session];
+
+		/* nothing received: handle completions available
+		 * (unless the loop is doing it) */
+		if (conn->io_input_end == conn->io_input_start && ! ring->waiting &&
+		    socket->mode == NOPOLL_IO_URING_COMPLETION)
+			__nopoll_io_uring_reap (ring);
+	} /* end if */
+
+	if (conn->io_input_end > conn->io_input_start) {
+		size = conn->io_input_end - conn->io_input_start;
+		if (size > buffer_size)
+			size = buffer_size;
+		memcpy (buffer, conn->io_input + conn->io_input_start, size);
+		conn->io_input_start += size;
+	} else if (ring == NULL) {
+		/* engine released and content left read */
+		conn->receive = nopoll_conn_default_receive;
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		return nopoll_conn_default_receive (conn, buffer, buffer_size);
+	} else if (socket->error) {
+		error = socket->error;
+	} else if (socket->eof) {
+		eof   = nopoll_true;
+	} /* end if */
+
+	/* receive again once content pending was read */
+	if (ring && socket->paused && socket->mode == NOPOLL_IO_URING_COMPLETION &&
+	    conn->io_input_end - conn->io_input_start <= NOPOLL_IO_URING_INPUT_LIMIT / 2) {
+		socket->paused = nopoll_false;
+		if (! socket->receiving && __nopoll_io_uring_recv (ring, conn->session) && ring->waiting)
+			__nopoll_io_uring_submit (ring);
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	if (size > 0)
+		return size;
+	if (eof) {
+		errno = 0;
+		return 0;
+	} /* end if */
+
+	errno = error;
+	return -1;
+}
+
+/** 
+ * @internal Send handler installed on connections written through
+ * completions: content is copied into the connection send buffer and
+ * written by a send request, submitted with the next wait operation
+ * (batched with the rest of requests) or right away if the loop is
+ * already waiting. Once the engine is released, the default send
+ * handler is restored.
+ */
+int nopoll_io_wait_io_uring_send (noPollConn * conn, char * buffer, int buffer_size)
+{
+	noPollCtx           * ctx   = conn->ctx;
+	noPollIoUring       * ring;
+	noPollIoUringSocket * socket;
+	int                   size  = 0;
+	int                   error = NOPOLL_EWOULDBLOCK;
+
+	if (buffer_size <= 0)
+		return 0;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ring = conn->io_completion;
+	if (ring == NULL) {
+		/* engine released */
+		conn->send = nopoll_conn_default_send;
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		return nopoll_conn_default_send (conn, buffer, buffer_size);
+	} /* end if */
+
+	socket = &ring->sockets[conn->session];
+
+	/* send buffer full: handle completions available (unless the
+	 * loop is doing it) */
+	if (socket->out_end == NOPOLL_IO_URING_OUTPUT_SIZE && socket->out_sent > 0 && ! ring->waiting &&
+	    socket->mode == NOPOLL_IO_URING_COMPLETION)
+		__nopoll_io_uring_reap (ring);
+
+	if (socket->error) {
+		error = socket->error;
+	} else if (socket->mode == NOPOLL_IO_URING_COMPLETION) {
+		/* move content not written to the beginning (only
+		 * when no request is writing from it) */
+		if (socket->out_sent == 0 && socket->out_start > 0) {
+			memmove (socket->out, socket->out + socket->out_start, socket->out_end - socket->out_start);
+			socket->out_end  -= socket->out_start;
+			socket->out_start = 0;
+		} /* end if */
+
+		if (socket->out == NULL)
+			socket->out = nopoll_new (char, NOPOLL_IO_URING_OUTPUT_SIZE);
+		if (socket->out == NULL) {
+			error = ENOMEM;
+		} else {
+			size = NOPOLL_IO_URING_OUTPUT_SIZE - socket->out_end;
+			if (size > buffer_size)
+				size = buffer_size;
+			memcpy (socket->out + socket->out_end, buffer, size);
+			socket->out_end += size;
+
+			/* queue the send request unless one is in
+			 * flight (content is written when it
+			 * finishes) */
+			if (socket->out_sent == 0 && socket->out_end > socket->out_start &&
+			    __nopoll_io_uring_send (ring, conn->session) && ring->waiting)
+				__nopoll_io_uring_submit (ring);
+		} /* end if */
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	if (size > 0)
+		return size;
+
+	errno = error;
+	return -1;
+}
+
+/** 
+ * @internal Starts reading and writing through completions sockets
+ * registered that can be (caller must hold ctx->ref_mutex): plain
+ * connections (client or accepted) already connected, using the
+ * default handlers. Listeners, TLS sessions and connections with
+ * custom handlers are kept watched through epoll(7). The check is
+ * done here (instead of at registration) because connections are
+ * registered before their TLS session is prepared.
+ */
+void __nopoll_io_uring_promote (noPollIoUring * ring)
+{
+	noPollIoUringSocket * socket;
+	noPollConn          * conn;
+	int                   iterator;
+	int                   fds;
+
+	iterator = 0;
+	while (iterator < ring->candidates_count) {
+		fds    = ring->candidates[iterator];
+		socket = &ring->sockets[fds];
+		conn   = socket->conn;
+
+		/* still connecting: check again later */
+		if (conn->session == fds && conn->connect_state != NOPOLL_CONNECT_DONE) {
+			iterator++;
+			continue;
+		} /* end if */
+
+		/* done with this socket */
+		socket->candidate = nopoll_false;
+		ring->candidates_count--;
+		ring->candidates[iterator] = ring->candidates[ring->candidates_count];
+
+		if (conn->session != fds || conn->tls_on || conn->ssl ||
+		    (conn->role != NOPOLL_ROLE_CLIENT && conn->role != NOPOLL_ROLE_LISTENER) ||
+		    conn->send != nopoll_conn_default_send ||
+		    (conn->receive != nopoll_conn_default_receive && conn->receive != nopoll_io_wait_io_uring_receive))
+			continue;
+
+		/* read through a multishot receive request */
+		socket->eof    = nopoll_false;
+		socket->error  = 0;
+		socket->paused = nopoll_false;
+		if (! __nopoll_io_uring_recv (ring, fds)) {
+			nopoll_log (ring->ctx, NOPOLL_LEVEL_WARNING, "Unable to read socket (%d) through io_uring completions, submission queue full, keeping it on epoll", fds);
+			continue;
+		} /* end if */
+
+		nopoll_io_wait_epoll_remove_from (fds, ring->ctx, conn, ring->epoll);
+		socket->mode        = NOPOLL_IO_URING_COMPLETION;
+		conn->io_completion = ring;
+		conn->receive       = nopoll_io_wait_io_uring_receive;
+		conn->send          = nopoll_io_wait_io_uring_send;
+
+		/* content may be already received by the socket and
+		 * writes may be pending */
+		__nopoll_io_uring_notify (ring, fds, socket->writing ? (NOPOLL_IO_URING_READ | NOPOLL_IO_URING_WRITE) : NOPOLL_IO_URING_READ);
+	} /* end while */
+
+	return;
+}
+
+/** 
+ * @internal Grows per socket tables to hold the provided socket
+ * (caller must hold ctx->ref_mutex).
+ */
+nopoll_bool __nopoll_io_uring_grow (noPollIoUring * ring, int fds)
+{
+	noPollIoUringSocket * sockets;
+	int                 * pending_fds;
+	int                 * ready_fds;
+	int                 * candidates;
+	int                   length;
+
+	if (fds < ring->length)
+		return nopoll_true;
+
+	length = ring->length > 0 ? ring->length : 64;
+	while (length <= fds)
+		length = length * 2;
+
+	sockets     = nopoll_realloc (ring->sockets, sizeof (noPollIoUringSocket) * length);
+	if (sockets)
+		ring->sockets = sockets;
+	pending_fds = nopoll_realloc (ring->pending_fds, sizeof (int) * length);
+	if (pending_fds)
+		ring->pending_fds = pending_fds;
+	ready_fds   = nopoll_realloc (ring->ready_fds, sizeof (int) * length);
+	if (ready_fds)
+		ring->ready_fds = ready_fds;
+	candidates  = nopoll_realloc (ring->candidates, sizeof (int) * length);
+	if (candidates)
+		ring->candidates = candidates;
+	if (sockets == NULL || pending_fds == NULL || ready_fds == NULL || candidates == NULL)
+		return nopoll_false;
+
+	memset (ring->sockets + ring->length, 0, sizeof (noPollIoUringSocket) * (length - ring->length));
+	ring->length = length;
+	return nopoll_true;
+}
+
+/** 
+ * @internal Releases the rings, buffers and tables of the provided
+ * io_uring object.
+ */
+void __nopoll_io_uring_free (noPollIoUring * ring)
+{
+	noPollIoUringRetired * retired;
+	int                    iterator;
+
+	if (ring->sqes)
+		munmap (ring->sqes, ring->sqes_size);
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+		munmap (ring->cq_ring, ring->cq_ring_size);
+	if (ring->sq_ring)
+		munmap (ring->sq_ring, ring->sq_ring_size);
+	/* closing the ring releases the buffer ring registration */
+	nopoll_close_socket (ring->ring_fd);
+	if (ring->buf_ring)
+		munmap (ring->buf_ring, ring->buf_ring_size);
+	nopoll_free (ring->buffers);
+	if (ring->epoll)
+		nopoll_io_wait_epoll_destroy (ring->ctx, ring->epoll);
+
+	while (ring->retired) {
+		retired       = ring->retired;
+		ring->retired = retired->next;
+		nopoll_free (retired->buffer);
+		nopoll_free (retired);
+	} /* end while */
+
+	iterator = 0;
+	while (iterator < ring->length) {
+		nopoll_free (ring->sockets[iterator].out);
+		iterator++;
+	} /* end while */
+	nopoll_free (ring->sockets);
+	nopoll_free (ring->pending_fds);
+	nopoll_free (ring->ready_fds);
+	nopoll_free (ring->candidates);
+	nopoll_free (ring);
+	return;
+}
+
+/** 
+ * @internal nopoll implementation to create the io_uring(7) based IO
+ * wait mechanism. Plain connections are read through a multishot
+ * receive request per connection into buffers provided to the kernel
+ * and written through send requests. The rest of sockets (listeners,
+ * TLS sessions and connections with custom handlers) are watched
+ * through an epoll(7) object whose descriptor is watched by a poll
+ * request. All requests queued (receives, sends and the epoll poll)
+ * are submitted and all completions are collected with a single
+ * io_uring_enter call per loop iteration.
+ *
+ * @return A newly allocated noPollIoUring reference or NULL if it
+ * fails (for example, kernel without io_uring support).
+ */
+noPollPtr nopoll_io_wait_io_uring_create (noPollCtx * ctx) 
+{
+	noPollIoUring          * ring = nopoll_new (noPollIoUring, 1);
+	struct io_uring_params   params;
+	struct io_uring_buf_reg  reg;
+	int                      bid;
+
+	if (ring == NULL)
+		return NULL;
+
+	ring->ctx = ctx;
+	memset (&params, 0, sizeof (params));
+	ring->ring_fd = syscall (__NR_io_uring_setup, NOPOLL_IO_URING_ENTRIES, &params);
+	if (ring->ring_fd < 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to create io_uring instance, io_uring_setup failed, errno=%d", errno);
+		nopoll_free (ring);
+		return NULL;
+	} /* end if */
+
+	/* check required features: wait with timeout */
+	if (! (params.features & IORING_FEAT_EXT_ARG)) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to use io_uring engine, kernel without IORING_FEAT_EXT_ARG support");
+		__nopoll_io_uring_free (ring);
+		return NULL;
+	} /* end if */
+
+	/* set close on exec */
+	fcntl (ring->ring_fd, F_SETFD, FD_CLOEXEC);
+
+	/* map rings */
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof (unsigned int);
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_size > ring->sq_ring_size)
+			ring->sq_ring_size = ring->cq_ring_size;
+		ring->cq_ring_size = ring->sq_ring_size;
+	} /* end if */
+
+	ring->sq_ring = mmap (NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		ring->sq_ring = NULL;
+		goto failed;
+	} /* end if */
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap (NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			ring->cq_ring = NULL;
+			goto failed;
+		} /* end if */
+	} /* end if */
+
+	ring->sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+	ring->sqes      = mmap (NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto failed;
+	} /* end if */
+
+	ring->sq_head    = (unsigned int *) ((char *) ring->sq_ring + params.sq_off.head);
+	ring->sq_tail    = (unsigned int *) ((char *) ring->sq_ring + params.sq_off.tail);
+	ring->sq_mask    = (unsigned int *) ((char *) ring->sq_ring + params.sq_off.ring_mask);
+	ring->sq_entries = (unsigned int *) ((char *) ring->sq_ring + params.sq_off.ring_entries);
+	ring->sq_array   = (unsigned int *) ((char *) ring->sq_ring + params.sq_off.array);
+
+	ring->cq_head    = (unsigned int *) ((char *) ring->cq_ring + params.cq_off.head);
+	ring->cq_tail    = (unsigned int *) ((char *) ring->cq_ring + params.cq_off.tail);
+	ring->cq_mask    = (unsigned int *) ((char *) ring->cq_ring + params.cq_off.ring_mask);
+	ring->cqes       = (struct io_uring_cqe *) ((char *) ring->cq_ring + params.cq_off.cqes);
+
+	/* buffer ring (page aligned) provided to the kernel to
+	 * receive content: its tail is stored on the first entry */
+	ring->buf_ring_size = sizeof (struct io_uring_buf) * NOPOLL_IO_URING_BUFFERS;
+	ring->buf_ring      = mmap (NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring->buf_ring == MAP_FAILED) {
+		ring->buf_ring = NULL;
+		goto failed;
+	} /* end if */
+	ring->buf_tail = (unsigned short *) &ring->buf_ring[0].resv;
+	ring->buffers  = nopoll_new (char, NOPOLL_IO_URING_BUFFERS * NOPOLL_IO_URING_BUFFER_SIZE);
+	if (ring->buffers == NULL) {
+		__nopoll_io_uring_free (ring);
+		return NULL;
+	} /* end if */
+
+	memset (&reg, 0, sizeof (reg));
+	reg.ring_addr    = (unsigned long) ring->buf_ring;
+	reg.ring_entries = NOPOLL_IO_URING_BUFFERS;
+	reg.bgid         = 0;
+	if (syscall (__NR_io_uring_register, ring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to use io_uring engine, kernel without provided buffer rings support, errno=%d", errno);
+		__nopoll_io_uring_free (ring);
+		return NULL;
+	} /* end if */
+	bid = 0;
+	while (bid < NOPOLL_IO_URING_BUFFERS) {
+		__nopoll_io_uring_recycle (ring, bid);
+		bid++;
+	} /* end while */
+
+	/* epoll object for the rest of sockets */
+	ring->epoll = nopoll_io_wait_epoll_create (ctx);
+	if (ring->epoll == NULL) {
+		__nopoll_io_uring_free (ring);
+		return NULL;
+	} /* end if */
+
+	return ring;
+
+ failed:
+	nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to map io_uring rings, mmap failed, errno=%d", errno);
+	__nopoll_io_uring_free (ring);
+	return NULL;
+}
+
+/** 
+ * @internal noPoll implementation to destroy the io_uring(7) IO
+ * object created by \ref nopoll_io_wait_io_uring_create. Requests of
+ * connections read and written through completions are cancelled and
+ * connections get back their default handlers: content received and
+ * not read yet is still reported by the receive handler, and content
+ * accepted by the send handler and not written is queued again on the
+ * connection (written by the next loop).
+ */
+void    nopoll_io_wait_io_uring_destroy (noPollCtx * ctx, noPollPtr io_object)
+{
+	noPollIoUring       * ring  = (noPollIoUring *) io_object;
+	noPollIoUringSocket * socket;
+	noPollConn         ** conns = NULL;
+	noPollConn          * conn;
+	int                   conns_count = 0;
+	int                   iterator;
+	int                   size;
+	char                * out;
+
+	if (ring == NULL)
+		return;
+
+	/* cancel requests (after submitting those queued, for
+	 * example a close frame) */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	__nopoll_io_uring_submit (ring);
+	if (ring->length > 0)
+		conns = nopoll_new (noPollConn *, ring->length);
+	iterator = 0;
+	while (iterator < ring->length) {
+		socket = &ring->sockets[iterator];
+		if (socket->mode == NOPOLL_IO_URING_COMPLETION) {
+			socket->mode = NOPOLL_IO_URING_RELEASING;
+			if (socket->receiving)
+				__nopoll_io_uring_cancel (ring, NOPOLL_IO_URING_DATA (NOPOLL_IO_URING_RECV, socket->gen, iterator));
+			if (socket->out_sent > 0)
+				__nopoll_io_uring_cancel (ring, NOPOLL_IO_URING_DATA (NOPOLL_IO_URING_SEND, socket->gen, iterator));
+			if (conns) {
+				nopoll_conn_ref (socket->conn);
+				conns[conns_count] = socket->conn;
+				conns_count++;
+			} /* end if */
+		} /* end if */
+		iterator++;
+	} /* end while */
+	if (ring->epoll_armed)
+		__nopoll_io_uring_cancel (ring, NOPOLL_IO_URING_DATA (NOPOLL_IO_URING_EPOLL, 0, 0));
+	__nopoll_io_uring_submit (ring);
+
+	/* wait for requests to finish (up to a second) */
+	iterator = 0;
+	while (ring->inflight > 0 && iterator < 100) {
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		__nopoll_io_uring_enter (ring, 0, nopoll_true, 10000);
+		nopoll_mutex_lock (ctx->ref_mutex);
+		__nopoll_io_uring_reap (ring);
+		iterator++;
+	} /* end while */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* restore default handlers */
+	iterator = 0;
+	while (iterator < conns_count) {
+		conn = conns[iterator];
+		size = 0;
+		out  = NULL;
+
+		nopoll_mutex_lock (conn->ref_mutex);
+		nopoll_mutex_lock (ctx->ref_mutex);
+		if (conn->io_completion == ring) {
+			socket              = &ring->sockets[conn->session];
+			conn->io_completion = NULL;
+			conn->send          = nopoll_conn_default_send;
+			if (conn->io_input_end == conn->io_input_start)
+				conn->receive = nopoll_conn_default_receive;
+			if (socket->out_sent == 0 && socket->out_end > socket->out_start) {
+				out  = socket->out + socket->out_start;
+				size = socket->out_end - socket->out_start;
+			} /* end if */
+			socket->mode = NOPOLL_IO_URING_NONE;
+		} /* end if */
+		nopoll_mutex_unlock (ctx->ref_mutex);
+
+		if (size > 0 && ! __nopoll_conn_requeue_write (conn, out, size))
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to queue again %d bytes not written on conn-id=%d, memory allocation failed", size, conn->id);
+		nopoll_mutex_unlock (conn->ref_mutex);
+
+		nopoll_conn_unref (conn);
+		iterator++;
+	} /* end while */
+	nopoll_free (conns);
+
+	__nopoll_io_uring_free (ring);
+	return;
+}
+
+/** 
+ * @internal Clears ready flags reported by the last wait
+ * operation. Registered sockets are kept. The caller must hold
+ * ctx->ref_mutex.
+ */
+void    nopoll_io_wait_io_uring_clear (noPollCtx * ctx, noPollPtr io_object)
+{
+	noPollIoUring * ring = (noPollIoUring *) io_object;
+	int             iterator;
+
+	iterator = 0;
+	while (iterator < ring->ready_count) {
+		ring->sockets[ring->ready_fds[iterator]].ready = 0;
+		iterator++;
+	} /* end while */
+	ring->ready_count = 0;
+	nopoll_io_wait_epoll_clear (ctx, ring->epoll);
+
+	return;
+}
+
+/** 
+ * @internal Submits all requests queued (receives, sends and the
+ * epoll descriptor poll) and waits for completions in a single
+ * io_uring_enter call, then handles all completions available and
+ * collects sockets ready on the epoll object (if it was reported).
+ *
+ * @return Number of sockets that changed or -1 if something failed.
+ */
+int nopoll_io_wait_io_uring_wait (noPollCtx * ctx, noPollPtr io_object, long timeout)
+{
+	noPollIoUring       * ring = (noPollIoUring *) io_object;
+	noPollIoUringSocket * socket;
+	struct io_uring_sqe * sqe;
+	unsigned int          to_submit;
+	nopoll_bool           epoll_ready;
+	int                   iterator;
+	int                   fds;
+	int                   result;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	__nopoll_io_uring_promote (ring);
+
+	/* watch the epoll descriptor */
+	if (! ring->epoll_armed) {
+		sqe = __nopoll_io_uring_get_sqe (ring);
+		if (sqe) {
+			sqe->opcode        = IORING_OP_POLL_ADD;
+			sqe->fd            = ((noPollEpoll *) ring->epoll)->epoll_fd;
+			sqe->poll32_events = POLLIN;
+			sqe->user_data     = NOPOLL_IO_URING_DATA (NOPOLL_IO_URING_EPOLL, 0, 0);
+			ring->epoll_armed  = nopoll_true;
+			ring->inflight++;
+		} /* end if */
+	} /* end if */
+
+	/* reset previous ready flags and get pending submissions
+	 * (events already pending are reported without blocking) */
+	nopoll_io_wait_io_uring_clear (ctx, io_object);
+	ring->epoll_ready = nopoll_false;
+	if (ring->pending_count > 0)
+		timeout = 0;
+	to_submit        = ring->sq_pending;
+	ring->sq_pending = 0;
+	ring->waiting    = nopoll_true;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	result = __nopoll_io_uring_enter (ring, to_submit, nopoll_true, timeout);
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ring->waiting = nopoll_false;
+	if (result < 0 && errno != NOPOLL_EINTR && errno != ETIME && errno != EBUSY) {
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		return -1;
+	} /* end if */
+
+	/* handle completions and report sockets with events */
+	__nopoll_io_uring_reap (ring);
+	iterator = 0;
+	while (iterator < ring->pending_count) {
+		fds    = ring->pending_fds[iterator];
+		socket = &ring->sockets[fds];
+		if (socket->mode == NOPOLL_IO_URING_COMPLETION && socket->events) {
+			if (! socket->ready) {
+				ring->ready_fds[ring->ready_count] = fds;
+				ring->ready_count++;
+			} /* end if */
+			socket->ready |= socket->events;
+		} /* end if */
+		socket->events = 0;
+		iterator++;
+	} /* end while */
+	ring->pending_count = 0;
+	result      = ring->ready_count;
+	epoll_ready = ring->epoll_ready;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* collect sockets watched through epoll */
+	if (epoll_ready) {
+		fds = nopoll_io_wait_epoll_wait (ctx, ring->epoll, 0);
+		if (fds > 0)
+			result += fds;
+	} /* end if */
+
+	return result;
+}
+
+/** 
+ * @internal Removes the provided socket. For sockets read and written
+ * through completions, requests queued are submitted first (so
+ * content accepted by the send handler, like a close frame, is
+ * written) and then cancelled.
+ */
+nopoll_bool  nopoll_io_wait_io_uring_remove_from (int               fds, 
+						  noPollCtx       * ctx,
+						  noPollConn      * conn,
+						  noPollPtr         io_object)
+{
+	noPollIoUring        * ring = (noPollIoUring *) io_object;
+	noPollIoUringSocket  * socket;
+	noPollIoUringRetired * retired;
+	int                    iterator;
+
+	if (fds < 0 || fds >= ring->length)
+		return nopoll_false;
+
+	socket = &ring->sockets[fds];
+	if (socket->mode == NOPOLL_IO_URING_NONE || (conn && socket->conn != conn))
+		return nopoll_false;
+
+	if (socket->mode == NOPOLL_IO_URING_WATCHED) {
+		nopoll_io_wait_epoll_remove_from (fds, ctx, socket->conn, ring->epoll);
+	} else if (socket->mode == NOPOLL_IO_URING_COMPLETION) {
+		__nopoll_io_uring_submit (ring);
+		if (socket->receiving)
+			__nopoll_io_uring_cancel (ring, NOPOLL_IO_URING_DATA (NOPOLL_IO_URING_RECV, socket->gen, fds));
+		if (socket->out_sent > 0) {
+			__nopoll_io_uring_cancel (ring, NOPOLL_IO_URING_DATA (NOPOLL_IO_URING_SEND, socket->gen, fds));
+
+			/* keep the buffer until the request finishes */
+			retired = nopoll_new (noPollIoUringRetired, 1);
+			if (retired) {
+				retired->user_data = NOPOLL_IO_URING_DATA (NOPOLL_IO_URING_SEND, socket->gen, fds);
+				retired->buffer    = socket->out;
+				retired->next      = ring->retired;
+				ring->retired      = retired;
+				socket->out        = NULL;
+			} /* end if */
+		} /* end if */
+		__nopoll_io_uring_submit (ring);
+
+		socket->conn->io_completion = NULL;
+		socket->conn->send          = nopoll_conn_default_send;
+	} /* end if */
+
+	/* stop checking it */
+	if (socket->candidate) {
+		iterator = 0;
+		while (iterator < ring->candidates_count) {
+			if (ring->candidates[iterator] == fds) {
+				ring->candidates_count--;
+				ring->candidates[iterator] = ring->candidates[ring->candidates_count];
+				break;
+			} /* end if */
+			iterator++;
+		} /* end while */
+		socket->candidate = nopoll_false;
+	} /* end if */
+
+	/* events pending are discarded by next wait (the socket is
+	 * kept on the pending list) */
+	socket->gen++;
+	socket->mode      = NOPOLL_IO_URING_NONE;
+	socket->conn      = NULL;
+	socket->ready     = 0;
+	socket->receiving = nopoll_false;
+	socket->paused    = nopoll_false;
+	socket->writing   = nopoll_false;
+	socket->out_start = 0;
+	socket->out_end   = 0;
+	socket->out_sent  = 0;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Registers the provided socket. It is watched through the
+ * epoll object until the next wait operation checks if it can be read
+ * and written through completions (see __nopoll_io_uring_promote).
+ */
+nopoll_bool  nopoll_io_wait_io_uring_add_to (int               fds, 
+					     noPollCtx       * ctx,
+					     noPollConn      * conn,
+					     noPollPtr         io_object)
+{
+	noPollIoUring       * ring = (noPollIoUring *) io_object;
+	noPollIoUringSocket * socket;
+
+	if (fds < 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL,
+			    "received a non valid socket (%d), unable to add to the set", fds);
+		return nopoll_false;
+	} /* end if */
+
+	if (! __nopoll_io_uring_grow (ring, fds)) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to add requested socket (%d), memory allocation failed", fds);
+		return nopoll_false;
+	} /* end if */
+
+	/* already registered */
+	socket = &ring->sockets[fds];
+	if (socket->mode == NOPOLL_IO_URING_COMPLETION && socket->conn == conn)
+		return nopoll_true;
+	if (socket->mode == NOPOLL_IO_URING_COMPLETION)
+		nopoll_io_wait_io_uring_remove_from (fds, ctx, NULL, io_object);
+
+	if (! nopoll_io_wait_epoll_add_to (fds, ctx, conn, ring->epoll))
+		return nopoll_false;
+
+	if (socket->mode != NOPOLL_IO_URING_WATCHED)
+		socket->writing = nopoll_false;
+	socket->mode = NOPOLL_IO_URING_WATCHED;
+	socket->conn = conn;
+	if (conn && ! socket->candidate) {
+		socket->candidate = nopoll_true;
+		ring->candidates[ring->candidates_count] = fds;
+		ring->candidates_count++;
+	} /* end if */
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Checks if the provided socket was flagged as ready by the
+ * last wait operation.
+ */
+nopoll_bool      nopoll_io_wait_io_uring_is_set (noPollCtx   * ctx,
+						 int           fds, 
+						 noPollPtr     io_object)
+{
+	noPollIoUring * ring   = (noPollIoUring *) io_object;
+	nopoll_bool     result = nopoll_false;
+	nopoll_bool     epoll  = nopoll_true;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (fds >= 0 && fds < ring->length && ring->sockets[fds].mode == NOPOLL_IO_URING_COMPLETION) {
+		result = (ring->sockets[fds].ready & NOPOLL_IO_URING_READ) != 0;
+		epoll  = nopoll_false;
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	if (epoll)
+		return nopoll_io_wait_epoll_is_set (ctx, fds, ring->epoll);
+	return result;
+}
+
+/** 
+ * @internal Enables or disables watching write readiness of the
+ * provided socket (already registered). Sockets written through
+ * completions are reported writable while the send handler accepts
+ * content.
+ */
+nopoll_bool  nopoll_io_wait_io_uring_set_write (int               fds, 
+						noPollCtx       * ctx,
+						noPollConn      * conn,
+						nopoll_bool       enable,
+						noPollPtr         io_object)
+{
+	noPollIoUring       * ring = (noPollIoUring *) io_object;
+	noPollIoUringSocket * socket;
+
+	if (fds < 0 || fds >= ring->length || ring->sockets[fds].mode == NOPOLL_IO_URING_NONE)
+		return nopoll_false;
+
+	socket          = &ring->sockets[fds];
+	socket->writing = enable;
+	if (socket->mode != NOPOLL_IO_URING_COMPLETION)
+		return nopoll_io_wait_epoll_set_write (fds, ctx, conn, enable, ring->epoll);
+
+	if (enable && (socket->out_sent == 0 || socket->out_end < NOPOLL_IO_URING_OUTPUT_SIZE))
+		__nopoll_io_uring_notify (ring, fds, NOPOLL_IO_URING_WRITE);
+	return nopoll_true;
+}
+
+/** 
+ * @internal Checks if the provided socket was flagged as writable by
+ * the last wait operation.
+ */
+nopoll_bool      nopoll_io_wait_io_uring_is_writable (noPollCtx   * ctx,
+						      int           fds, 
+						      noPollPtr     io_object)
+{
+	noPollIoUring * ring   = (noPollIoUring *) io_object;
+	nopoll_bool     result = nopoll_false;
+	nopoll_bool     epoll  = nopoll_true;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (fds >= 0 && fds < ring->length && ring->sockets[fds].mode == NOPOLL_IO_URING_COMPLETION) {
+		result = (ring->sockets[fds].ready & NOPOLL_IO_URING_WRITE) != 0;
+		epoll  = nopoll_false;
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	if (epoll)
+		return nopoll_io_wait_epoll_is_writable (ctx, fds, ring->epoll);
+	return result;
+}
+
+/** 
+ * @internal Notifies connections reported as ready by the last wait
+ * operation: those read through completions and then those reported
+ * by the epoll object (see nopoll_io_wait_epoll_foreach_ready).
+ */
+void         nopoll_io_wait_io_uring_foreach_ready (noPollCtx         * ctx,
+						    noPollPtr           io_object,
+						    noPollForeachConn   foreach,
+						    noPollPtr           user_data)
+{
+	noPollIoUring * ring = (noPollIoUring *) io_object;
+	noPollConn    * conn;
+	int             iterator;
+	int             fds;
+
+	iterator = 0;
+	while (iterator < ring->ready_count) {
+		conn = NULL;
+		nopoll_mutex_lock (ctx->ref_mutex);
+		if (iterator < ring->ready_count) {
+			fds = ring->ready_fds[iterator];
+			if (ring->sockets[fds].ready && ring->sockets[fds].mode == NOPOLL_IO_URING_COMPLETION)
+				conn = ring->sockets[fds].conn;
+		} /* end if */
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		iterator++;
+
+		if (conn == NULL)
+			continue;
+
+		/* notify */
+		if (foreach (ctx, conn, user_data))
+			return;
+	} /* end while */
+
+	nopoll_io_wait_epoll_foreach_ready (ctx, ring->epoll, foreach, user_data);
+	return;
+}
+#endif
+
+/** 
+ * @brief Creates an object that represents the best IO wait mechanism
+ * found on the current system.
+ *
+ * @param ctx The context where the engine will be created/associated.
+ *
+ * @param engine Use \ref NOPOLL_IO_ENGINE_DEFAULT or the engine you
+ * want to use. \ref NOPOLL_IO_ENGINE_DEFAULT selects epoll(7) when
+ * available, then poll(2), otherwise select(2).
+ *
+ * @return The selected IO wait mechanism or NULL if it fails (or the
+ * engine requested is not supported on this platform).
+ */ 
+noPollIoEngine * nopoll_io_get_engine (noPollCtx * ctx, noPollIoEngineType engine_type)
+{
+	noPollIoEngine * engine = nopoll_new (noPollIoEngine, 1);
+	if (engine == NULL)
+		return NULL;
+
+	/* get best engine available */
+	if (engine_type == NOPOLL_IO_ENGINE_DEFAULT) {
+#if defined(NOPOLL_HAVE_EPOLL)
+		engine_type = NOPOLL_IO_ENGINE_EPOLL;
+#elif defined(NOPOLL_HAVE_POLL)
+		engine_type = NOPOLL_IO_ENGINE_POLL;
+#else
+		engine_type = NOPOLL_IO_ENGINE_SELECT;
+#endif
+	} /* end if */
+
+	switch (engine_type) {
+#if defined(NOPOLL_HAVE_EPOLL)
+	case NOPOLL_IO_ENGINE_EPOLL:
+		/* configure epoll implementation: sockets are
+		 * registered once and removed on shutdown, and only
+		 * ready connections are dispatched */
+		engine->create        = nopoll_io_wait_epoll_create;
+		engine->destroy       = nopoll_io_wait_epoll_destroy;
+		engine->clear         = nopoll_io_wait_epoll_clear;
+		engine->wait          = nopoll_io_wait_epoll_wait;
+		engine->add_to        = nopoll_io_wait_epoll_add_to;
+		engine->is_set        = nopoll_io_wait_epoll_is_set;
+		engine->remove_from   = nopoll_io_wait_epoll_remove_from;
+		engine->foreach_ready = nopoll_io_wait_epoll_foreach_ready;
+		engine->set_write     = nopoll_io_wait_epoll_set_write;
+		engine->is_writable   = nopoll_io_wait_epoll_is_writable;
+		break;
+#endif
+#if defined(NOPOLL_HAVE_POLL)
+	case NOPOLL_IO_ENGINE_POLL:
+		/* configure poll implementation: same persistent
+		 * registration as epoll over a growable pollfd array */
+		engine->create        = nopoll_io_wait_poll_create;
+		engine->destroy       = nopoll_io_wait_poll_destroy;
+		engine->clear         = nopoll_io_wait_poll_clear;
+		engine->wait          = nopoll_io_wait_poll_wait;
+		engine->add_to        = nopoll_io_wait_poll_add_to;
+		engine->is_set        = nopoll_io_wait_poll_is_set;
+		engine->remove_from   = nopoll_io_wait_poll_remove_from;
+		engine->foreach_ready = nopoll_io_wait_poll_foreach_ready;
+		engine->set_write     = nopoll_io_wait_poll_set_write;
+		engine->is_writable   = nopoll_io_wait_poll_is_writable;
+		break;
+#endif
+#if defined(NOPOLL_HAVE_IO_URING)
+	case NOPOLL_IO_ENGINE_IO_URING:
+		/* configure io_uring implementation: plain
+		 * connections read and written through completions,
+		 * submitted and collected with one io_uring_enter
+		 * call per iteration (the rest through epoll) */
+		engine->create        = nopoll_io_wait_io_uring_create;
+		engine->destroy       = nopoll_io_wait_io_uring_destroy;
+		engine->clear         = nopoll_io_wait_io_uring_clear;
+		engine->wait          = nopoll_io_wait_io_uring_wait;
+		engine->add_to        = nopoll_io_wait_io_uring_add_to;
+		engine->is_set        = nopoll_io_wait_io_uring_is_set;
+		engine->remove_from   = nopoll_io_wait_io_uring_remove_from;
+		engine->foreach_ready = nopoll_io_wait_io_uring_foreach_ready;
+		engine->set_write     = nopoll_io_wait_io_uring_set_write;
+		engine->is_writable   = nopoll_io_wait_io_uring_is_writable;
+		break;
+#endif
+	case NOPOLL_IO_ENGINE_SELECT:
+		/* configure default implementation */
+		engine->create  = nopoll_io_wait_select_create;
+		engine->destroy = nopoll_io_wait_select_destroy;
+		engine->clear   = nopoll_io_wait_select_clear;
+		engine->wait    = nopoll_io_wait_select_wait;
+		engine->add_to  = nopoll_io_wait_select_add_to;
+		engine->is_set  = nopoll_io_wait_select_is_set;
+		engine->set_write   = nopoll_io_wait_select_set_write;
+		engine->is_writable = nopoll_io_wait_select_is_writable;
+		break;
+	default:
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Requested IO engine type %d which is not supported on this platform", engine_type);
+		nopoll_free (engine);
+		return NULL;
+	} /* end switch */
+
+	/* call to create the object */
+	engine->ctx       = ctx;
+	engine->io_object = engine->create (ctx);
+	if (engine->io_object == NULL) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to create IO engine object (engine type %d)", engine_type);
+		nopoll_free (engine);
+		return NULL;
+	} /* end if */
+	
+	/* return the engine that was created */
+	return engine;
+}
+
+/** 
+ * @brief Release the io engine created by \ref nopoll_io_get_engine.
+ *
+ * @param engine The engine to be released.
+ */
+void             nopoll_io_release_engine (noPollIoEngine * engine)
+{
+	if (engine == NULL)
+		return;
+	engine->destroy (engine->ctx, engine->io_object);
+	nopoll_free (engine);
+	return;
+}
+
+/** 
+ * @internal Adds the socket of the provided connection into the io
+ * engine of the loop watching it (if running), but only when
+ * the engine keeps registrations across wait operations (that is,
+ * it defines remove_from handler). Engines that rebuild its set on
+ * each wait (select) are populated by \ref nopoll_loop_wait.
+ *
+ * If the loop is waiting, it is woken up so the new socket is watched
+ * right away (see \ref nopoll_loop_wakeup).
+ *
+ * The caller must hold ctx->ref_mutex.
+ *
+ * @param ctx The context where the io engine is installed.
+ *
+ * @param conn The connection to be registered.
+ *
+ * @return nopoll_false if the engine failed to register the socket,
+ * otherwise nopoll_true (including when no registration was needed).
+ */
+nopoll_bool      __nopoll_io_add_conn (noPollCtx * ctx, noPollConn * conn)
+{
+	noPollLoop     * loop;
+	noPollIoEngine * engine;
+	nopoll_bool      result = nopoll_true;
+
+	if (ctx == NULL || conn == NULL)
+		return nopoll_false;
+
+	/* get loop watching this connection */
+	loop   = __nopoll_loop_get (ctx, conn);
+	engine = loop->io_engine;
+	if (engine == NULL || conn->session == NOPOLL_INVALID_SOCKET)
+		return nopoll_true;
+
+	/* socket not connected yet (waiting for the host name) */
+	if (conn->connect_state == NOPOLL_CONNECT_RESOLVE)
+		return nopoll_true;
+
+	if (engine->remove_from) {
+		result = engine->add_to (conn->session, ctx, conn, engine->io_object);
+
+		/* keep watching write readiness */
+		if (result && conn->write_watched)
+			engine->set_write (conn->session, ctx, conn, nopoll_true, engine->io_object);
+	} /* end if */
+
+	/* wake up loop waiting with the old set */
+	if (loop->io_waiting)
+		__nopoll_loop_wakeup_loop (loop);
+
+	return result;
+}
+
+/** 
+ * @internal Removes the socket of the provided connection from the io
+ * engine of the loop watching it (if running and only if the
+ * engine keeps registrations across wait operations).
+ *
+ * The caller must hold ctx->ref_mutex.
+ *
+ * @param ctx The context where the io engine is installed.
+ *
+ * @param conn The connection to be unregistered.
+ */
+void             __nopoll_io_remove_conn (noPollCtx * ctx, noPollConn * conn)
+{
+	noPollIoEngine * engine;
+
+	if (ctx == NULL || conn == NULL)
+		return;
+
+	engine = __nopoll_loop_get (ctx, conn)->io_engine;
+	if (engine == NULL || engine->remove_from == NULL || conn->session == NOPOLL_INVALID_SOCKET)
+		return;
+	if (conn->connect_state == NOPOLL_CONNECT_RESOLVE)
+		return;
+
+	engine->remove_from (conn->session, ctx, conn, engine->io_object);
+	return;
+}
+
+/** 
+ * @internal Enables or disables watching write readiness of the
+ * socket of the provided connection on the io engine of the loop
+ * watching it (if running), see \ref nopoll_conn_set_on_writable.
+ * Engines that rebuild its set on each wait (select) are configured
+ * by \ref nopoll_loop_wait, according to the flag recorded on the
+ * connection.
+ *
+ * If the loop is waiting and write readiness is enabled, it is woken
+ * up so the socket is watched right away.
+ *
+ * The caller must hold ctx->ref_mutex.
+ *
+ * @param ctx The context where the io engine is installed.
+ *
+ * @param conn The connection to be configured.
+ *
+ * @param enable nopoll_true to watch write readiness, otherwise
+ * nopoll_false.
+ */
+void             __nopoll_io_watch_write (noPollCtx * ctx, noPollConn * conn, nopoll_bool enable)
+{
+	noPollLoop     * loop;
+	noPollIoEngine * engine;
+
+	if (ctx == NULL || conn == NULL)
+		return;
+
+	conn->write_watched = enable;
+
+	loop   = __nopoll_loop_get (ctx, conn);
+	engine = loop->io_engine;
+	if (engine == NULL || conn->session == NOPOLL_INVALID_SOCKET)
+		return;
+
+	if (engine->remove_from)
+		engine->set_write (conn->session, ctx, conn, enable, engine->io_object);
+
+	/* wake up loop waiting without watching the socket */
+	if (enable && loop->io_waiting)
+		__nopoll_loop_wakeup_loop (loop);
+
+	return;
+}
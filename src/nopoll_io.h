@@ -46,6 +46,13 @@ noPollIoEngine * nopoll_io_get_engine (noPollCtx * ctx, noPollIoEngineType engin
 
 void             nopoll_io_release_engine (noPollIoEngine * engine);
 
+/** internal api **/
+nopoll_bool      __nopoll_io_add_conn (noPollCtx * ctx, noPollConn * conn);
+
+void             __nopoll_io_remove_conn (noPollCtx * ctx, noPollConn * conn);
+
+void             __nopoll_io_watch_write (noPollCtx * ctx, noPollConn * conn, nopoll_bool enable);
+
 END_C_DECLS
 
 #endif 
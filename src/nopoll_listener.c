@@ -53,7 +53,8 @@
 NOPOLL_SOCKET     __nopoll_listener_sock_listen_internal      (noPollCtx        * ctx,
 							       noPollTransport    transport,
 							       const char       * host,
-							       const char       * port)
+							       const char       * port,
+							       nopoll_bool        reuse_port)
 {
 	struct sockaddr_in   sin;
 	NOPOLL_SOCKET        fd;
@@ -137,6 +138,16 @@ NOPOLL_SOCKET     __nopoll_listener_sock_listen_internal      (noPollCtx
 	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &unit, sizeof (unit));
 #endif 
 
+#if defined(SO_REUSEPORT)
+	/* share the port with listeners opened for other workers */
+	if (reuse_port && setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &unit, sizeof (unit)) != 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "unable to enable SO_REUSEPORT on socket %d (errno=%d)", fd, errno);
+		nopoll_close_socket (fd);
+		freeaddrinfo (res);
+		return -1;
+	} /* end if */
+#endif
+
 #if defined(SHOW_DEBUG_LOG)
 	/* get integer port */
 	int_port  = (uint16_t) atoi (port);
@@ -191,7 +202,11 @@ NOPOLL_SOCKET     __nopoll_listener_sock_listen_internal      (noPollCtx
 }
 
 /** 
- * @internal Function to create a WebSocket listener
+ * @internal Function to create a WebSocket listener. When the
+ * context has workers and the options request it (see \ref
+ * nopoll_conn_opts_set_reuse_port), one listener is opened for each
+ * worker on the same port (SO_REUSEPORT), chained through
+ * listener_next on the listener returned.
  */
 noPollConn      * __nopoll_listener_new_opts_internal (noPollCtx      * ctx,
 						       noPollTransport  transport,
@@ -200,48 +215,82 @@ noPollConn      * __nopoll_listener_new_opts_internal (noPollCtx      * ctx,
 						       const char     * port)
 {
 	NOPOLL_SOCKET   session;
-	noPollConn    * listener;
+	noPollConn    * listener = NULL;
+	noPollConn    * last     = NULL;
+	noPollConn    * conn;
+	nopoll_bool     reuse_port = nopoll_false;
+	int             worker;
 
 	nopoll_return_val_if_fail (ctx, ctx && host, NULL);
 
-	/* call to create the socket */
-	session = __nopoll_listener_sock_listen_internal (ctx, transport, host, port);
-	if (session == NOPOLL_INVALID_SOCKET) {
-		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to start listener error was: errno=%d", errno);
-		return NULL;
+	/* check to open one listener per worker */
+	if (opts && opts->reuse_port && ctx->loops_num > 1) {
+#if defined(SO_REUSEPORT)
+		reuse_port = nopoll_true;
+#else
+		nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "SO_REUSEPORT is not supported, accepted connections will be handed out round robin to workers");
+#endif
 	} /* end if */
 
-	/* create noPollConn ection object */
-	listener           = nopoll_new (noPollConn, 1);
-	listener->refs     = 1;
-	/* create mutex */
-	listener->ref_mutex = nopoll_mutex_create ();
-	listener->handshake_mutex = nopoll_mutex_create ();
-	listener->session   = session;
-	listener->ctx       = ctx;
-	listener->role      = NOPOLL_ROLE_MAIN_LISTENER;
-
-	/* record host and port */
-	listener->host      = nopoll_strdup (host);
-	listener->port      = nopoll_strdup (port);
-
-	/* register connection into context */
-	nopoll_ctx_register_conn (ctx, listener);
-
-	/* configure default handlers */
-	listener->receive   = nopoll_conn_default_receive;
-	listener->send      = nopoll_conn_default_send;
-
-	/* configure connection options */
-	listener->opts      = opts;
+	worker = reuse_port ? 1 : 0;
+	do {
+		/* call to create the socket */
+		session = __nopoll_listener_sock_listen_internal (ctx, transport, host, port, reuse_port);
+		if (session == NOPOLL_INVALID_SOCKET) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to start listener error was: errno=%d", errno);
+
+			/* close listeners already opened */
+			if (listener)
+				nopoll_conn_close (listener);
+			return NULL;
+		} /* end if */
 
-	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Listener created, started: %s:%s (socket: %d, transport: %s)",
-		    listener->host, listener->port, listener->session, (transport == NOPOLL_TRANSPORT_IPV4 ? "IPv4" : "IPv6"));
+		/* listeners opened for other workers hold their own
+		 * reference to the options */
+		if (listener && opts && ! opts->reuse)
+			nopoll_conn_opts_ref (opts);
+
+		/* create noPollConn ection object */
+		conn           = nopoll_new (noPollConn, 1);
+		conn->refs     = 1;
+		/* create mutex */
+		conn->ref_mutex = nopoll_mutex_create ();
+		conn->handshake_mutex = nopoll_mutex_create ();
+		conn->session   = session;
+		conn->ctx       = ctx;
+		conn->role      = NOPOLL_ROLE_MAIN_LISTENER;
+		conn->worker    = worker;
+
+		/* record host and port */
+		conn->host      = nopoll_strdup (host);
+		conn->port      = nopoll_strdup (port);
+
+		/* register connection into context */
+		nopoll_ctx_register_conn (ctx, conn);
+
+		/* configure default handlers */
+		conn->receive   = nopoll_conn_default_receive;
+		conn->send      = nopoll_conn_default_send;
+
+		/* configure connection options */
+		conn->opts      = opts;
+
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Listener created, started: %s:%s (socket: %d, transport: %s, worker: %d)",
+			    conn->host, conn->port, conn->session, (transport == NOPOLL_TRANSPORT_IPV4 ? "IPv4" : "IPv6"), conn->worker);
+
+		/* chain listener */
+		if (last)
+			last->listener_next = conn;
+		else
+			listener = conn;
+		last = conn;
+
+		worker++;
+	} while (reuse_port && worker < ctx->loops_num);
 
 	return listener;
 }
 
-
 /** 
  * @internal Creates a listener socket on the provided port.
  */
@@ -249,7 +298,7 @@ NOPOLL_SOCKET     nopoll_listener_sock_listen      (noPollCtx   * ctx,
 						    const char  * host,
 						    const char  * port)
 {
-	return __nopoll_listener_sock_listen_internal (ctx, NOPOLL_TRANSPORT_IPV4, host, port);
+	return __nopoll_listener_sock_listen_internal (ctx, NOPOLL_TRANSPORT_IPV4, host, port, nopoll_false);
 }
 
 /** 
@@ -396,15 +445,21 @@ noPollConn      * __nopoll_listener_tls_new_opts_internal (noPollCtx      * ctx,
 							   const char     * port)
 {
 	noPollConn * listener;
+	noPollConn * conn;
 
 	/* call to get listener from base function */
 	listener = __nopoll_listener_new_opts_internal (ctx, transport, opts, host, port);
 	if (! listener)
 		return listener;
 
-	/* setup TLS support */
-	listener->tls_on = nopoll_true;
-	listener->opts   = opts;
+	/* setup TLS support (including listeners opened for other
+	 * workers) */
+	conn = listener;
+	while (conn) {
+		conn->tls_on = nopoll_true;
+		conn->opts   = opts;
+		conn         = conn->listener_next;
+	} /* end while */
 
 	return listener;
 }
@@ -529,17 +584,35 @@ nopoll_bool           nopoll_listener_set_certificate (noPollConn * listener,
 }
 
 /** 
- * @brief Creates a websocket listener from the socket provided.
+ * @brief Allows to release TLS contexts cached by the listener so
+ * certificate and key files are read again for next connections
+ * accepted.
  *
- * @param ctx The context where the listener will be associated.
+ * The TLS context (SSL_CTX) used for connections accepted is created
+ * once (reading certificate files from disk) and shared by all
+ * connections accepted with the same certificate, key and chain
+ * files. Call this function after renewing those files (connections
+ * already accepted are not affected).
  *
- * @param session The session to associate to the listener.
- *
- * @return A reference to a listener connection object or NULL if it
- * fails.
+ * @param listener The listener where TLS contexts cached will be released.
  */
-noPollConn   * nopoll_listener_from_socket (noPollCtx      * ctx,
-					    NOPOLL_SOCKET    session)
+void                  nopoll_listener_flush_tls_cache (noPollConn * listener)
+{
+	if (listener == NULL)
+		return;
+
+	__nopoll_conn_release_ssl_ctx_cache (listener);
+	return;
+}
+
+/** 
+ * @internal Creates a websocket listener from the socket provided,
+ * watched by the provided worker loop (0 for the loop run by \ref
+ * nopoll_loop_wait caller).
+ */
+noPollConn   * __nopoll_listener_from_socket_internal (noPollCtx      * ctx,
+						       NOPOLL_SOCKET    session,
+						       int              worker)
 {
 	noPollConn         * listener;
 	struct sockaddr_in   sin;
@@ -562,6 +635,7 @@ noPollConn   * nopoll_listener_from_socket (noPollCtx      * ctx,
 	listener->session   = session;
 	listener->ctx       = ctx;
 	listener->role      = NOPOLL_ROLE_LISTENER;
+	listener->worker    = worker;
 
 	/* get peer value */
 	memset (&sin, 0, sizeof (struct sockaddr_in));
@@ -596,6 +670,22 @@ noPollConn   * nopoll_listener_from_socket (noPollCtx      * ctx,
 	return listener;
 }
 
+/** 
+ * @brief Creates a websocket listener from the socket provided.
+ *
+ * @param ctx The context where the listener will be associated.
+ *
+ * @param session The session to associate to the listener.
+ *
+ * @return A reference to a listener connection object or NULL if it
+ * fails.
+ */
+noPollConn   * nopoll_listener_from_socket (noPollCtx      * ctx,
+					    NOPOLL_SOCKET    session)
+{
+	return __nopoll_listener_from_socket_internal (ctx, session, 0);
+}
+
 /** 
  * @internal Public function that performs a TCP listener accept.
  *
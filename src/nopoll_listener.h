@@ -87,11 +87,18 @@ nopoll_bool       nopoll_listener_set_certificate (noPollConn * listener,
 						   const char * private_key,
 						   const char * chain_file);
 
+void              nopoll_listener_flush_tls_cache (noPollConn * listener);
+
 noPollConn      * nopoll_listener_from_socket (noPollCtx      * ctx,
 					       NOPOLL_SOCKET    session);
 
 NOPOLL_SOCKET     nopoll_listener_accept (NOPOLL_SOCKET server_socket);
 
+/** internal api **/
+noPollConn      * __nopoll_listener_from_socket_internal (noPollCtx      * ctx,
+							  NOPOLL_SOCKET    session,
+							  int              worker);
+
 END_C_DECLS
 
 #endif
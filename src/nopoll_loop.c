@@ -47,12 +47,57 @@
  * @{
  */
 
+/** 
+ * @internal Returns the loop watching the provided connection (see
+ * \ref nopoll_ctx_set_workers). Connections without worker assigned
+ * are watched by the loop running on the thread that calls \ref
+ * nopoll_loop_wait.
+ */
+noPollLoop * __nopoll_loop_get (noPollCtx * ctx, noPollConn * conn)
+{
+	if (conn->worker > 0 && conn->worker < ctx->loops_num)
+		return &(ctx->loops[conn->worker]);
+	return &(ctx->loops[0]);
+}
+
+/** 
+ * @internal Hands the provided connection (accepted by a listener
+ * watched by the main loop) to the next worker loop (round robin).
+ * Nothing is done when no workers are configured.
+ */
+void __nopoll_loop_assign_worker (noPollCtx * ctx, noPollConn * conn)
+{
+	if (ctx->loops_num <= 1 || conn->worker != 0)
+		return;
+
+	/* move the socket between io engines (under the mutex
+	 * because the worker may be running) */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	__nopoll_io_remove_conn (ctx, conn);
+	conn->worker = 1 + (ctx->workers_next % (ctx->loops_num - 1));
+	ctx->workers_next++;
+	if (! __nopoll_io_add_conn (ctx, conn))
+		nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Failed to add socket %d to the io engine of worker %d", conn->session, conn->worker);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Connection id %d handed to worker %d", conn->id, conn->worker);
+	return;
+}
+
 /** 
  * @internal Function used by nopoll_loop_wait to register all
- * connections into the io waiting object.
+ * connections into the io waiting object of the loop provided
+ * (user_data). Connections watched by other loops are skipped.
  */
 nopoll_bool nopoll_loop_register (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
 {
+	noPollLoop * loop = (noPollLoop *) user_data;
+	nopoll_bool  added;
+
+	/* skip connections watched by other loops */
+	if (__nopoll_loop_get (ctx, conn) != loop)
+		return nopoll_false; /* keep foreach, don't stop */
+
 	/* do not add connections that aren't working */
 	if (! nopoll_conn_is_ok (conn)) {
 		
@@ -62,9 +107,21 @@ nopoll_bool nopoll_loop_register (noPollCtx * ctx, noPollConn * conn, noPollPtr
 		return nopoll_false; /* keep foreach, don't stop */
 	}
 
-	/* register the connection socket */
+	/* socket not connected yet (waiting for the host name) */
+	if (conn->connect_state == NOPOLL_CONNECT_RESOLVE)
+		return nopoll_false; /* keep foreach, don't stop */
+
+	/* register the connection socket (under the mutex because
+	 * nopoll_ctx_register_conn may also update the engine) */
 	/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Adding socket id: %d", conn->session);*/
-	if (! ctx->io_engine->add_to (conn->session, ctx, conn, ctx->io_engine->io_object)) {
+	nopoll_mutex_lock (ctx->ref_mutex);
+	added = loop->io_engine->add_to (conn->session, ctx, conn, loop->io_engine->io_object);
+
+	/* keep watching write readiness */
+	if (added && conn->write_watched)
+		loop->io_engine->set_write (conn->session, ctx, conn, nopoll_true, loop->io_engine->io_object);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	if (! added) {
 
 		/* remove this connection from registry */
 		nopoll_ctx_unregister_conn (ctx, conn);
@@ -75,41 +132,189 @@ nopoll_bool nopoll_loop_register (noPollCtx * ctx, noPollConn * conn, noPollPtr
 	return nopoll_false; /* keep foreach, don't stop */
 }
 
+/** 
+ * @internal Function used by nopoll_loop_wait (engines with
+ * persistent registration, where sockets were already added at
+ * engine creation or connection registration) to remove connections
+ * of the loop provided (user_data) that were shutdown.
+ */
+nopoll_bool nopoll_loop_cleanup (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	/* remove this connection from registry */
+	if (__nopoll_loop_get (ctx, conn) == (noPollLoop *) user_data && ! nopoll_conn_is_ok (conn))
+		nopoll_ctx_unregister_conn (ctx, conn);
+
+	return nopoll_false; /* keep foreach, don't stop */
+}
+
+/** 
+ * @internal Function used by nopoll_loop_wait to continue the
+ * connect process of connections of the loop provided (user_data)
+ * that were waiting for a host name resolution (see
+ * nopoll_conn_opts_set_async_connect).
+ */
+nopoll_bool nopoll_loop_process_resolved (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	if (__nopoll_loop_get (ctx, conn) == (noPollLoop *) user_data && conn->connect_state == NOPOLL_CONNECT_RESOLVE)
+		__nopoll_conn_connect_step (conn);
+
+	return nopoll_false; /* keep foreach, don't stop */
+}
+
 /** 
  * @internal Function used to handle incoming data from from the
- * connection and to notify this data on the connection.
+ * connection and to notify this data on the connection. Messages
+ * are read and notified while content is available, up to the
+ * connection read budget (see nopoll_conn_set_read_budget).
  */
 void nopoll_loop_process_data (noPollCtx * ctx, noPollConn * conn)
 {
-	noPollMsg * msg;
+	noPollLoop * loop = __nopoll_loop_get (ctx, conn);
+	noPollMsg  * msg;
+	int          budget;
 
-	/* call to get messages from the connection */
-	msg = nopoll_conn_get_msg (conn);
-	if (msg == NULL)
-		return;
+	budget = nopoll_conn_get_read_budget (conn);
+
+	/* track the connection: handlers may close (and release) it */
+	loop->dispatch_conn = conn;
+	while (budget > 0) {
+		budget--;
 
-	/* found message, notify it */
-	if (conn->on_msg) 
-		conn->on_msg (ctx, conn, msg, conn->on_msg_data);
-	else if (ctx->on_msg)
-		ctx->on_msg (ctx, conn, msg, ctx->on_msg_data);
+		/* call to get messages from the connection */
+		msg = nopoll_conn_get_msg (conn);
+		if (msg) {
+			/* found message, notify it */
+			if (conn->on_msg) 
+				conn->on_msg (ctx, conn, msg, conn->on_msg_data);
+			else if (ctx->on_msg)
+				ctx->on_msg (ctx, conn, msg, ctx->on_msg_data);
+
+			/* release message */
+			nopoll_msg_unref (msg);
+		} /* end if */
+
+		/* connection closed by the handler (including on
+		 * frame chunk handlers notified while reading) */
+		if (loop->dispatch_conn != conn)
+			return;
+
+		/* stop once the socket reported it would block
+		 * (unless content already read is pending) */
+		if (! nopoll_conn_is_ok (conn) || (conn->read_blocked && ! __nopoll_conn_data_pending (conn)))
+			break;
+	} /* end while */
+	loop->dispatch_conn = NULL;
+
+	/* content already read (frames in the connection buffer or
+	 * records retained by OpenSSL) won't be reported by the io
+	 * engine, flag the loop to check them */
+	if (nopoll_conn_is_ok (conn) && __nopoll_conn_data_pending (conn))
+		loop->frames_pending = nopoll_true;
 
-	/* release message */
-	nopoll_msg_unref (msg);
 	return;
 }
 
+/** 
+ * @internal Function used to notify connections of the loop provided
+ * (user_data) with content already read but not reported by the io
+ * engine (see __nopoll_conn_data_pending).
+ */
+nopoll_bool nopoll_loop_process_buffered (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	if (__nopoll_loop_get (ctx, conn) != (noPollLoop *) user_data)
+		return nopoll_false;
+
+	if ((conn->role == NOPOLL_ROLE_CLIENT || conn->role == NOPOLL_ROLE_LISTENER) &&
+	    nopoll_conn_is_ok (conn) && __nopoll_conn_data_pending (conn))
+		nopoll_loop_process_data (ctx, conn);
+
+	return nopoll_false; /* keep foreach, don't stop */
+}
+
+/** 
+ * @internal Function used to flush content queued on a connection
+ * reported as writable. Once the queue is empty (written here or by
+ * a previous operation), write readiness is not watched anymore and
+ * the on writable handler is notified (see
+ * nopoll_conn_set_on_writable).
+ *
+ * @return nopoll_false if the connection was closed (and it can't
+ * be used anymore), otherwise nopoll_true.
+ */
+nopoll_bool nopoll_loop_process_write (noPollCtx * ctx, noPollLoop * loop, noPollConn * conn)
+{
+	if (nopoll_conn_complete_pending_write (conn) == -1 && errno != NOPOLL_EWOULDBLOCK && errno != NOPOLL_EINPROGRESS && errno != NOPOLL_EINTR) {
+		nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Failed to write queued content (errno=%d), shutting down conn-id=%d", errno, conn->id);
+		nopoll_conn_shutdown (conn);
+		return nopoll_true;
+	} /* end if */
+
+	/* notify low watermark crossing (handler may close and
+	 * release the connection) */
+	if (conn->write_above_high) {
+		loop->dispatch_conn = conn;
+		__nopoll_conn_check_watermarks (conn);
+		if (loop->dispatch_conn != conn)
+			return nopoll_false;
+		loop->dispatch_conn = NULL;
+	} /* end if */
+
+	/* still something to write */
+	if (conn->write_queue)
+		return nopoll_true;
+
+	/* queue written: stop watching and notify */
+	nopoll_mutex_lock (conn->ref_mutex);
+	if (conn->write_queue == NULL) {
+		nopoll_mutex_lock (ctx->ref_mutex);
+		__nopoll_io_watch_write (ctx, conn, nopoll_false);
+		nopoll_mutex_unlock (ctx->ref_mutex);
+	} /* end if */
+	nopoll_mutex_unlock (conn->ref_mutex);
+	if (conn->on_writable == NULL)
+		return nopoll_true;
+
+	/* track the connection: handler may close (and release) it */
+	loop->dispatch_conn = conn;
+	conn->on_writable (ctx, conn, conn->on_writable_data);
+	if (loop->dispatch_conn != conn)
+		return nopoll_false;
+	loop->dispatch_conn = NULL;
+
+	return nopoll_true;
+}
+
 /** 
  * @internal Function used to detected which connections has something
- * interesting to be notified.
+ * interesting to be notified on the loop provided (user_data).
  *
  */
 nopoll_bool nopoll_loop_process (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
 {
-	int        * conn_changed = (int *) user_data;
+	noPollLoop * loop = (noPollLoop *) user_data;
+	nopoll_bool  readable;
+
+	/* skip connections watched by other loops */
+	if (__nopoll_loop_get (ctx, conn) != loop)
+		return nopoll_false;
+
+	/* flush queued content first if the socket is writable */
+	readable = loop->io_engine->is_set (ctx, conn->session, loop->io_engine->io_object);
+	if (conn->connect_state != NOPOLL_CONNECT_DONE) {
+		/* client connect in progress: writable means it can
+		 * continue (see __nopoll_conn_connect_step) */
+		if (loop->io_engine->is_writable (ctx, conn->session, loop->io_engine->io_object))
+			readable = nopoll_true;
+	} else if (loop->io_engine->is_writable (ctx, conn->session, loop->io_engine->io_object)) {
+		if (! nopoll_loop_process_write (ctx, loop, conn) || ! readable) {
+			/* reduce connection changed */
+			loop->ready_pending--;
+			return loop->ready_pending == 0;
+		} /* end if */
+	} /* end if */
 
 	/* check if the connection have something to notify */
-	if (ctx->io_engine->is_set (ctx, conn->session, ctx->io_engine->io_object)) {
+	if (readable) {
 
 		/* call to notify action according to role */
 		switch (conn->role) {
@@ -129,16 +334,108 @@ nopoll_bool nopoll_loop_process (noPollCtx * ctx, noPollConn * conn, noPollPtr u
 		}
 		
 		/* reduce connection changed */
-		(*conn_changed)--;
+		loop->ready_pending--;
 	} /* end if */
 	
-	return (*conn_changed) == 0;
+	return loop->ready_pending == 0;
+}
+
+/** 
+ * @internal Creates the wake up channel used by \ref
+ * nopoll_loop_wakeup to unblock the io engine wait operation of the
+ * provided loop (a non-blocking pipe). If the channel can't be
+ * created (or on platforms without support), the loop falls back to
+ * wake up periodically.
+ */
+void __nopoll_loop_wakeup_init (noPollCtx * ctx, noPollLoop * loop)
+{
+#if defined(NOPOLL_OS_UNIX)
+	int fds[2];
+
+	if (loop->wakeup_read != NOPOLL_INVALID_SOCKET)
+		return;
+
+	if (pipe (fds) != 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Unable to create wake up channel, pipe failed, errno=%d", errno);
+		return;
+	} /* end if */
+
+	/* do not block when channel is full (a wake up is already
+	 * pending) or empty */
+	fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl (fds[1], F_SETFL, fcntl (fds[1], F_GETFL) | O_NONBLOCK);
+	fcntl (fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl (fds[1], F_SETFD, FD_CLOEXEC);
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	loop->wakeup_read  = fds[0];
+	loop->wakeup_write = fds[1];
+	nopoll_mutex_unlock (ctx->ref_mutex);
+#endif
+	return;
+}
+
+/** 
+ * @internal Consumes all pending wake ups signaled through the wake
+ * up channel of the provided loop.
+ */
+void __nopoll_loop_wakeup_drain (noPollLoop * loop)
+{
+#if defined(NOPOLL_OS_UNIX)
+	char buffer[64];
+
+	while (read (loop->wakeup_read, buffer, sizeof (buffer)) > 0);
+#endif
+	return;
+}
+
+/** 
+ * @internal Unblocks the wait operation of the provided loop (if
+ * any). Only writes into the wake up channel so it can be called
+ * from any thread or signal handler.
+ */
+void __nopoll_loop_wakeup_loop (noPollLoop * loop)
+{
+#if defined(NOPOLL_OS_UNIX)
+	char value = 1;
+
+	if (loop->wakeup_write == NOPOLL_INVALID_SOCKET)
+		return;
+
+	/* failures are ignored: channel full means there is already a
+	 * wake up pending */
+	if (write (loop->wakeup_write, &value, 1) != 1)
+		return;
+#endif
+	return;
+}
+
+/** 
+ * @internal Releases the io engine of the provided loop. It is
+ * detached under the mutex (to avoid racing with
+ * nopoll_ctx_register_conn) and released after it, so engines can
+ * hand content back to connections (see NOPOLL_IO_ENGINE_IO_URING).
+ */
+void __nopoll_loop_release (noPollCtx * ctx, noPollLoop * loop)
+{
+	noPollIoEngine * engine;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	engine           = loop->io_engine;
+	loop->io_engine  = NULL;
+	loop->io_waiting = nopoll_false;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	if (engine)
+		nopoll_io_release_engine (engine);
+	return;
 }
 
 /** 
  * @internal Function used to init internal io wait mechanism
- * associated to the provided context. If the io wait engine is
- * already initialized, the function does nothing.
+ * associated to the provided context (one io engine for each loop,
+ * see \ref nopoll_ctx_set_workers). Loops with the io wait engine
+ * already initialized are left untouched.
  *
  * @param ctx The noPoll context to be initialized if it wasn't
  *
@@ -152,24 +449,56 @@ nopoll_bool nopoll_loop_process (noPollCtx * ctx, noPollConn * conn, noPollPtr u
  */
 void nopoll_loop_init (noPollCtx * ctx) 
 {
+	noPollIoEngine * engine;
+	noPollLoop     * loop;
+	int              iterator;
+
 	if (ctx == NULL)
 		return;
 
-	/* grab the mutex for the following check */
-	if (ctx->io_engine == NULL) {
-		ctx->io_engine = nopoll_io_get_engine (ctx, NOPOLL_IO_ENGINE_DEFAULT);
-		if (ctx->io_engine == NULL) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to create IO wait engine, unable to implement wait call");
+	iterator = 0;
+	while (iterator < ctx->loops_num) {
+		loop = &(ctx->loops[iterator]);
+		iterator++;
+
+		/* create wake up channel (only once) */
+		__nopoll_loop_wakeup_init (ctx, loop);
+
+		if (loop->io_engine)
+			continue;
+
+		engine = nopoll_io_get_engine (ctx, ctx->io_engine_type);
+		if (engine == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to create IO wait engine for loop %d, unable to implement wait call", loop->id);
 			return;
 		} 
-	} /* end if */
-	/* release the mutex */
+
+		/* install engine: from now on, new connections are
+		 * added by nopoll_ctx_register_conn */
+		nopoll_mutex_lock (ctx->ref_mutex);
+		loop->io_engine         = engine;
+		loop->io_engine_cleanup = nopoll_false;
+
+		/* watch wake up channel (no connection associated) */
+		if (engine->remove_from && loop->wakeup_read != NOPOLL_INVALID_SOCKET) {
+			if (! engine->add_to (loop->wakeup_read, ctx, NULL, engine->io_object))
+				nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Failed to add wake up channel %d to the io engine", loop->wakeup_read);
+		} /* end if */
+		nopoll_mutex_unlock (ctx->ref_mutex);
+
+		/* register connections already created on engines with
+		 * persistent registration (only once) */
+		if (engine->remove_from)
+			nopoll_ctx_foreach_conn (ctx, nopoll_loop_register, loop);
+	} /* end while */
 
 	return;
 }
 
 /** 
- * @brief Flag to stop the current loop implemented (if any) on the provided context.
+ * @brief Flag to stop the current loop implemented (if any) on the
+ * provided context (including worker loops, see \ref
+ * nopoll_ctx_set_workers).
  *
  * @param ctx The context where the loop is being done, and wanted to
  * be stopped.
@@ -177,29 +506,300 @@ void nopoll_loop_init (noPollCtx * ctx)
  */
 void nopoll_loop_stop (noPollCtx * ctx)
 {
+	int iterator;
+
 	if (! ctx)
 		return;
-	ctx->keep_looping = nopoll_false;
+
+	iterator = 0;
+	while (iterator < ctx->loops_num) {
+		ctx->loops[iterator].keep_looping = nopoll_false;
+
+		/* unblock wait operation */
+		__nopoll_loop_wakeup_loop (&(ctx->loops[iterator]));
+		iterator++;
+	} /* end while */
 	return;
 } /* end if */
 
+/** 
+ * @brief Wakes up the loop implemented by \ref nopoll_loop_wait on
+ * the provided context (if any), making it check again its state
+ * (connections registered, stop requested...) without waiting for
+ * network activity or the timeout to expire. Worker loops (see \ref
+ * nopoll_ctx_set_workers) are also woken up.
+ *
+ * The function can be called from any thread (including signal
+ * handlers): it only writes into the wake up channels owned by the
+ * context. If the loop isn't waiting, the next wait operation returns
+ * right away. Several calls before the loop wakes up are notified
+ * once.
+ *
+ * @param ctx The context where the loop is being done.
+ */
+void nopoll_loop_wakeup (noPollCtx * ctx)
+{
+	int iterator;
+
+	if (! ctx)
+		return;
+
+	iterator = 0;
+	while (iterator < ctx->loops_num) {
+		__nopoll_loop_wakeup_loop (&(ctx->loops[iterator]));
+		iterator++;
+	} /* end while */
+	return;
+}
+
+/** 
+ * @internal Implements the wait operation of the provided loop until
+ * it is stopped, the timeout is reached (when defined) or the io
+ * engine fails. The loop io engine is released when finished. See
+ * \ref nopoll_loop_wait for timeout and return codes.
+ */
+int __nopoll_loop_run (noPollCtx * ctx, noPollLoop * loop, long timeout)
+{
+	struct timeval start;
+	struct timeval stop;
+	struct timeval diff;
+	long           ellapsed;
+	long           wait_timeout;
+	int            result = 0;
+
+	/* get as reference current time */
+	if (timeout > 0)
+#if defined(NOPOLL_OS_WIN32)
+		nopoll_win32_gettimeofday (&start, NULL);
+#else
+		gettimeofday (&start, NULL);
+#endif
+
+	while (loop->keep_looping) {
+		/* flag the loop is about to wait: from now on, other
+		 * threads registering connections must wake it up */
+		nopoll_mutex_lock (ctx->ref_mutex);
+		loop->io_waiting = nopoll_true;
+		nopoll_mutex_unlock (ctx->ref_mutex);
+
+		if (loop->io_engine->remove_from) {
+			/* persistent registration: sockets are already
+			 * registered, just remove connections that were
+			 * shutdown since last iteration */
+			if (loop->io_engine_cleanup) {
+				loop->io_engine_cleanup = nopoll_false;
+				nopoll_ctx_foreach_conn (ctx, nopoll_loop_cleanup, loop);
+			} /* end if */
+		} else {
+			/* ok, now implement wait operation */
+			loop->io_engine->clear (ctx, loop->io_engine->io_object);
+		
+			/* add all connections */
+			/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Adding connections to watch: %d", ctx->conn_num);  */
+			nopoll_ctx_foreach_conn (ctx, nopoll_loop_register, loop);
+
+			/* add wake up channel */
+			if (loop->wakeup_read != NOPOLL_INVALID_SOCKET) {
+				nopoll_mutex_lock (ctx->ref_mutex);
+				loop->io_engine->add_to (loop->wakeup_read, ctx, NULL, loop->io_engine->io_object);
+				nopoll_mutex_unlock (ctx->ref_mutex);
+			} /* end if */
+		} /* end if */
+
+		/* get wait period: until timeout expires or blocking
+		 * when no timeout is defined (nopoll_loop_stop and
+		 * nopoll_loop_wakeup unblock the wait) */
+		wait_timeout = -1;
+		if (timeout > 0) {
+#if defined(NOPOLL_OS_WIN32)
+			nopoll_win32_gettimeofday (&stop, NULL);
+#else
+			gettimeofday (&stop, NULL);
+#endif
+			nopoll_timeval_substract (&stop, &start, &diff);
+			ellapsed     = (diff.tv_sec * 1000000) + diff.tv_usec;
+			wait_timeout = ellapsed < timeout ? timeout - ellapsed : 0;
+		} /* end if */
+
+		/* frames pending to be notified or host names
+		 * resolved: do not block */
+		if (loop->frames_pending || loop->resolve_pending)
+			wait_timeout = 0;
+
+		/* without wake up channel, wake up periodically to
+		 * check if the loop was stopped */
+		if (loop->wakeup_read == NOPOLL_INVALID_SOCKET && (wait_timeout < 0 || wait_timeout > 500000))
+			wait_timeout = 500000;
+
+		/* implement wait operation */
+		/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Waiting for changes into %d connections", ctx->conn_num); */
+		loop->ready_pending = loop->io_engine->wait (ctx, loop->io_engine->io_object, wait_timeout);
+		/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Waiting finished with result %d", loop->ready_pending);  */
+
+		nopoll_mutex_lock (ctx->ref_mutex);
+		loop->io_waiting = nopoll_false;
+		nopoll_mutex_unlock (ctx->ref_mutex);
+
+		if (loop->ready_pending == -1) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Received error from wait operation (loop %d), error code was: %d", loop->id, errno);
+			result = -4; /* io wait failure */
+			break;
+		} /* end if */
+
+		/* consume wake ups (not a connection) */
+		if (loop->ready_pending > 0 && loop->wakeup_read != NOPOLL_INVALID_SOCKET &&
+		    loop->io_engine->is_set (ctx, loop->wakeup_read, loop->io_engine->io_object)) {
+			__nopoll_loop_wakeup_drain (loop);
+			loop->ready_pending--;
+		} /* end if */
+
+		/* check how many connections changed and restart */
+		if (loop->ready_pending > 0) {
+			/* check and call for connections with something
+			 * interesting: only ready connections if the
+			 * engine can report them, otherwise check all */
+			if (loop->io_engine->foreach_ready)
+				loop->io_engine->foreach_ready (ctx, loop->io_engine->io_object, nopoll_loop_process, loop);
+			else
+				nopoll_ctx_foreach_conn (ctx, nopoll_loop_process, loop);
+		}
+
+		/* notify content already read into connection buffers
+		 * (up to the read budget of each connection) */
+		if (loop->frames_pending) {
+			loop->frames_pending = nopoll_false;
+			nopoll_ctx_foreach_conn (ctx, nopoll_loop_process_buffered, loop);
+		} /* end if */
+
+		/* continue connections whose host name was resolved */
+		if (loop->resolve_pending) {
+			nopoll_mutex_lock (ctx->ref_mutex);
+			loop->resolve_pending = nopoll_false;
+			nopoll_mutex_unlock (ctx->ref_mutex);
+			nopoll_ctx_foreach_conn (ctx, nopoll_loop_process_resolved, loop);
+		} /* end if */
+
+		/* check to stop wait operation */
+		if (timeout > 0) {
+#if defined(NOPOLL_OS_WIN32)
+			nopoll_win32_gettimeofday (&stop, NULL);
+#else
+			gettimeofday (&stop, NULL);
+#endif
+			nopoll_timeval_substract (&stop, &start, &diff);
+			ellapsed = (diff.tv_sec * 1000000) + diff.tv_usec;
+			if (ellapsed > timeout) {
+				result = -3; /* timeout reached */
+				break;
+			}
+		} /* end if */
+	} /* end while */
+
+	/* release engine */
+	__nopoll_loop_release (ctx, loop);
+
+	/* return result so far */
+	return result;
+}
+
+/** 
+ * @internal Worker thread function: runs the provided loop until
+ * stopped (or its io engine fails).
+ */
+#if defined(NOPOLL_OS_WIN32)
+DWORD WINAPI __nopoll_loop_worker (LPVOID data)
+#else
+noPollPtr __nopoll_loop_worker (noPollPtr data)
+#endif
+{
+	noPollLoop * loop = (noPollLoop *) data;
+
+	loop->result = __nopoll_loop_run (loop->ctx, loop, 0);
+
+	/* io engine failure: stop the main loop to report it */
+	if (loop->result == -4) {
+		loop->ctx->loops[0].keep_looping = nopoll_false;
+		__nopoll_loop_wakeup_loop (&(loop->ctx->loops[0]));
+	} /* end if */
+	return 0;
+}
+
+/** 
+ * @internal Starts the thread running the provided worker loop.
+ */
+nopoll_bool __nopoll_loop_worker_start (noPollCtx * ctx, noPollLoop * loop)
+{
+#if defined(NOPOLL_OS_WIN32)
+	loop->thread = CreateThread (NULL, 0, __nopoll_loop_worker, loop, 0, NULL);
+	if (loop->thread == NULL) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to create worker thread for loop %d, error code was: %d", loop->id, GetLastError ());
+		return nopoll_false;
+	} /* end if */
+#else
+	pthread_t * thread;
+	int         error;
+
+	thread = nopoll_new (pthread_t, 1);
+	if (thread == NULL)
+		return nopoll_false;
+
+	error = pthread_create (thread, NULL, __nopoll_loop_worker, loop);
+	if (error != 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to create worker thread for loop %d, error code was: %d", loop->id, error);
+		nopoll_free (thread);
+		return nopoll_false;
+	} /* end if */
+	loop->thread = thread;
+#endif
+	return nopoll_true;
+}
+
+/** 
+ * @internal Waits for the thread running the provided worker loop to
+ * finish (if it was started).
+ */
+void __nopoll_loop_worker_join (noPollLoop * loop)
+{
+	if (loop->thread == NULL)
+		return;
+#if defined(NOPOLL_OS_WIN32)
+	WaitForSingleObject ((HANDLE) loop->thread, INFINITE);
+	CloseHandle ((HANDLE) loop->thread);
+#else
+	pthread_join (*((pthread_t *) loop->thread), NULL);
+	nopoll_free (loop->thread);
+#endif
+	loop->thread = NULL;
+	return;
+}
+
 /** 
  * @brief Allows to implement a wait over all connections registered
  * under the provided context during the provided timeout until
  * something is detected meaningful to the user, calling to the action
  * handler defined, optionally receving the user data pointer.
  *
+ * When the context was configured with worker loops (see \ref
+ * nopoll_ctx_set_workers), the function starts one thread for each
+ * worker, running its own io engine over the connections assigned to
+ * it (connections accepted by listeners created after the call),
+ * while the calling thread watches the rest. Handlers (on_msg,
+ * on_ready, on_accept...) are called on the thread watching the
+ * connection. Worker threads are stopped and joined before returning.
+ *
  * @param ctx The context object where the wait will be implemented.
  *
  * @param timeout The timeout to wait for changes. If no changes
  * happens, the function returns. The function will block the caller
  * until a call to \ref nopoll_loop_stop is done in the case timeout
- * passed is 0.
+ * passed is 0. The loop doesn't wake up periodically: it blocks until
+ * there is network activity, the timeout expires or \ref
+ * nopoll_loop_stop / \ref nopoll_loop_wakeup are called.
  *
  * @return The function returns 0 when finished without error or -2 in
  * the case ctx is NULL or timeout is negative. Function returns -3 if
- * timeout was reached. Function returns -4 in the case
- * ctx->io_engine->wait failed to implement wait or it reported error.
+ * timeout was reached. Function returns -4 in the case the io wait
+ * engine (of any loop) failed to implement wait or it reported error.
  *
  *
  * <b>Recovering from IO Wait failure (return code -4)</b>
@@ -227,87 +827,64 @@ void nopoll_loop_stop (noPollCtx * ctx)
  */
 int nopoll_loop_wait (noPollCtx * ctx, long timeout)
 {
-	struct timeval start;
-	struct timeval stop;
-	struct timeval diff;
-	long           ellapsed;
-	int            wait_status;
-	int            result = 0;
+	noPollLoop * loop;
+	int          iterator;
+	int          result;
 
 	nopoll_return_val_if_fail (ctx, ctx, -2);
 	nopoll_return_val_if_fail (ctx, timeout >= 0, -2);
 	
-	/* call to init io engine */
+	/* call to init io engines */
 	nopoll_loop_init (ctx);
-
-	/* get as reference current time */
-	if (timeout > 0)
-#if defined(NOPOLL_OS_WIN32)
-		nopoll_win32_gettimeofday (&start, NULL);
-#else
-		gettimeofday (&start, NULL);
-#endif
-	
-	/* set to keep looping everything this function is called */
-	ctx->keep_looping = nopoll_true;
-
-	while (ctx->keep_looping) {
-		/* ok, now implement wait operation */
-		ctx->io_engine->clear (ctx, ctx->io_engine->io_object);
-		
-		/* add all connections */
-		/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Adding connections to watch: %d", ctx->conn_num);  */
-		nopoll_ctx_foreach_conn (ctx, nopoll_loop_register, NULL);
-
-		/* if (errno == EBADF) { */
-			/* detected some descriptor not properly
-			 * working, try to check them */
-			/* nopoll_ctx_foreach_conn (ctx, nopoll_loop_clean_descriptors, NULL); */
-		/* nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Found some descriptor is not valid (errno==%d)", errno);
-		   continue; */ 
-		/* } */ /* end if */
-		
-		/* implement wait operation */
-		/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Waiting for changes into %d connections", ctx->conn_num); */
-		wait_status = ctx->io_engine->wait (ctx, ctx->io_engine->io_object);
-		/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Waiting finished with result %d", wait_status);  */
-		if (wait_status == -1) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Received error from wait operation, error code was: %d", errno);
-			result = -4; /* io wait failure */
-			break;
+	iterator = 0;
+	while (iterator < ctx->loops_num) {
+		if (ctx->loops[iterator].io_engine == NULL) {
+			/* release engines already created */
+			iterator = 0;
+			while (iterator < ctx->loops_num) {
+				__nopoll_loop_release (ctx, &(ctx->loops[iterator]));
+				iterator++;
+			} /* end while */
+			return -4;
 		} /* end if */
 
-		/* check how many connections changed and restart */
-		if (wait_status > 0) {
-			/* check and call for connections with something
-			 * interesting */
-			nopoll_ctx_foreach_conn (ctx, nopoll_loop_process, &wait_status);
-		}
+		/* set to keep looping everything this function is called */
+		ctx->loops[iterator].keep_looping = nopoll_true;
+		ctx->loops[iterator].result       = 0;
+		iterator++;
+	} /* end while */
 
-		/* check to stop wait operation */
-		if (timeout > 0) {
-#if defined(NOPOLL_OS_WIN32)
-			nopoll_win32_gettimeofday (&stop, NULL);
-#else
-			gettimeofday (&stop, NULL);
-#endif
-			nopoll_timeval_substract (&stop, &start, &diff);
-			ellapsed = (diff.tv_sec * 1000000) + diff.tv_usec;
-			if (ellapsed > timeout) {
-				result = -3; /* timeout reached */
-				break;
-			}
+	/* start workers */
+	iterator = 1;
+	while (iterator < ctx->loops_num) {
+		loop = &(ctx->loops[iterator]);
+		if (! __nopoll_loop_worker_start (ctx, loop)) {
+			/* connections of this worker can't be watched */
+			__nopoll_loop_release (ctx, loop);
+			loop->result = -4;
 		} /* end if */
+		iterator++;
 	} /* end while */
 
-	/* release engine */
-	nopoll_io_release_engine (ctx->io_engine);
-	ctx->io_engine = NULL;
+	/* implement wait on the calling thread */
+	result = __nopoll_loop_run (ctx, &(ctx->loops[0]), timeout);
+
+	/* stop workers and wait them to finish */
+	iterator = 1;
+	while (iterator < ctx->loops_num) {
+		loop = &(ctx->loops[iterator]);
+		loop->keep_looping = nopoll_false;
+		__nopoll_loop_wakeup_loop (loop);
+		__nopoll_loop_worker_join (loop);
+
+		/* report worker failures */
+		if (loop->result == -4)
+			result = -4;
+		iterator++;
+	} /* end while */
 
 	/* return result so far */
 	return result;
 }
 
 /* @} */
-
-
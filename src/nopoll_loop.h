@@ -46,6 +46,15 @@ int  nopoll_loop_wait (noPollCtx * ctx, long timeout);
  
 void nopoll_loop_stop (noPollCtx * ctx);
 
+void nopoll_loop_wakeup (noPollCtx * ctx);
+
+/** internal api **/
+noPollLoop * __nopoll_loop_get (noPollCtx * ctx, noPollConn * conn);
+
+void         __nopoll_loop_wakeup_loop (noPollLoop * loop);
+
+void         __nopoll_loop_assign_worker (noPollCtx * ctx, noPollConn * conn);
+
 END_C_DECLS
 
 #endif
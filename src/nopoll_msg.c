@@ -58,7 +58,124 @@ noPollMsg  * nopoll_msg_new (void)
 		return NULL;
 
 	msg->refs = 1;
-	msg->ref_mutex = nopoll_mutex_create ();
+
+	return msg;
+}
+
+/** 
+ * @internal Creates an empty message holder taken from the message
+ * pool of the provided context, where it is returned (along with its
+ * buffer) once released. The message holds a reference to the
+ * context.
+ *
+ * @return A newly created reference or NULL if it fails.
+ */
+noPollMsg  * __nopoll_msg_new (noPollCtx * ctx)
+{
+	noPollMsg * msg = __nopoll_ctx_msg_get (ctx);
+	if (msg == NULL)
+		return NULL;
+
+	nopoll_ctx_ref (ctx);
+	msg->ctx  = ctx;
+	msg->refs = 1;
+
+	return msg;
+}
+
+/** 
+ * @internal Allocates the buffer (payload or frame) owned by the
+ * provided message, taken from the context message pool when
+ * possible (see __nopoll_msg_buffer_release).
+ *
+ * @return A buffer of size bytes at least or NULL if it fails.
+ */
+char       * __nopoll_msg_buffer_get (noPollMsg * msg, long size)
+{
+	if (msg->ctx == NULL) {
+		msg->buffer_class = 0;
+		return nopoll_new (char, size);
+	} /* end if */
+	return __nopoll_ctx_buffer_get (msg->ctx, size, &msg->buffer_class);
+}
+
+/** 
+ * @internal Releases the buffer owned by the provided message (frame
+ * of prepared messages or payload), returning it to the context
+ * message pool when it was taken from there.
+ */
+void         __nopoll_msg_buffer_release (noPollMsg * msg)
+{
+	char * buffer = msg->frame ? msg->frame : msg->payload;
+
+	if (msg->buffer_class > 0)
+		__nopoll_ctx_buffer_release (msg->ctx, buffer, msg->buffer_class);
+	else
+		nopoll_free (buffer);
+
+	msg->frame        = NULL;
+	msg->payload      = NULL;
+	msg->buffer_class = 0;
+	return;
+}
+
+/** 
+ * @brief Creates a prepared message: a complete (unmasked) websocket
+ * frame encoded once that can be sent to many connections with \ref
+ * nopoll_conn_send_prepared or \ref nopoll_ctx_broadcast without
+ * building the header or copying the payload again for each one.
+ *
+ * The message is reference counted: connections that couldn't write
+ * it completely keep a reference until the rest is written, so the
+ * caller can release its reference (\ref nopoll_msg_unref) as soon as
+ * the send operations return.
+ *
+ * @param ctx The context where the operation will take place.
+ *
+ * @param op_code The frame type (usually \ref NOPOLL_TEXT_FRAME or
+ * \ref NOPOLL_BINARY_FRAME).
+ *
+ * @param content The payload to be sent (it is copied).
+ *
+ * @param length The payload length.
+ *
+ * @return A newly created message or NULL if it fails.
+ */
+noPollMsg  * nopoll_msg_prepare (noPollCtx * ctx, noPollOpCode op_code, const char * content, long length)
+{
+	noPollMsg * msg;
+	char        header[14];
+	int         header_size;
+
+	if (ctx == NULL || length < 0 || (content == NULL && length > 0))
+		return NULL;
+
+	/* build header */
+	header_size = __nopoll_conn_build_header (ctx, header, nopoll_true, nopoll_false, 0, op_code, length);
+	if (header_size < 0)
+		return NULL;
+
+	msg = __nopoll_msg_new (ctx);
+	if (msg == NULL)
+		return NULL;
+	msg->frame = __nopoll_msg_buffer_get (msg, header_size + length + 1);
+	if (msg->frame == NULL) {
+		nopoll_msg_unref (msg);
+		return NULL;
+	} /* end if */
+
+	/* encode frame */
+	memcpy (msg->frame, header, header_size);
+	if (length > 0)
+		memcpy (msg->frame + header_size, content, length);
+	/* add string terminator (buffers reused are not cleared) */
+	msg->frame[header_size + length] = 0;
+	msg->header_size  = header_size;
+	msg->frame_size   = header_size + length;
+	msg->has_fin      = nopoll_true;
+	msg->op_code      = op_code;
+	msg->payload      = msg->frame + header_size;
+	msg->payload_size = length;
 
 	return msg;
 }
@@ -109,13 +226,7 @@ nopoll_bool  nopoll_msg_ref (noPollMsg * msg)
 	if (msg == NULL)
 		return nopoll_false;
 
-	/* acquire mutex here */
-	nopoll_mutex_lock (msg->ref_mutex);
-
-	msg->refs++;
-
-	/* release mutex here */
-	nopoll_mutex_unlock (msg->ref_mutex);
+	nopoll_atomic_inc (&msg->refs);
 
 	return nopoll_true;
 }
@@ -132,21 +243,11 @@ nopoll_bool  nopoll_msg_ref (noPollMsg * msg)
  */
 int          nopoll_msg_ref_count (noPollMsg * msg)
 {
-	int result;
-
 	/* check recieved reference */
 	if (msg == NULL)
 		return -1;
 
-	/* acquire mutex here */
-	nopoll_mutex_lock (msg->ref_mutex);
-
-	result = msg->refs;
-
-	/* release mutex here */
-	nopoll_mutex_unlock (msg->ref_mutex);
-
-	return result;
+	return nopoll_atomic_get (&msg->refs);
 }
 
 /** 
@@ -262,7 +363,9 @@ noPollMsg  * nopoll_msg_join (noPollMsg * msg, noPollMsg * msg2)
 	} /* end if */
 	
 	/* now, join content */
-	result            = nopoll_msg_new ();
+	result            = msg->ctx ? __nopoll_msg_new (msg->ctx) : nopoll_msg_new ();
+	if (result == NULL)
+		return NULL;
 	result->has_fin   = msg->has_fin;
 	result->op_code   = msg->op_code;
 	result->is_masked = msg->is_masked;
@@ -271,7 +374,11 @@ noPollMsg  * nopoll_msg_join (noPollMsg * msg, noPollMsg * msg2)
 
 	/* copy payload size and content */
 	result->payload_size = msg->payload_size + msg2->payload_size;
-	result->payload = nopoll_new (char, result->payload_size + 1);
+	result->payload = __nopoll_msg_buffer_get (result, result->payload_size + 1);
+	if (result->payload == NULL) {
+		nopoll_msg_unref (result);
+		return NULL;
+	} /* end if */
 
 	/* copy content from first message */
 	memcpy (result->payload, msg->payload, msg->payload_size);
@@ -279,6 +386,9 @@ noPollMsg  * nopoll_msg_join (noPollMsg * msg, noPollMsg * msg2)
 	/* copy content from second message */
 	memcpy (((unsigned char *) result->payload) + msg->payload_size , msg2->payload, msg2->payload_size);
 
+	/* add string terminator (buffers reused are not cleared) */
+	((char *) result->payload)[result->payload_size] = 0;
+
 	/* return joined message */
 	return result;
 }
@@ -291,27 +401,27 @@ noPollMsg  * nopoll_msg_join (noPollMsg * msg, noPollMsg * msg2)
  */
 void         nopoll_msg_unref (noPollMsg * msg)
 {
+	noPollCtx * ctx;
+
 	if (msg == NULL)
 		return;
 	
-	/* acquire mutex here */
-	nopoll_mutex_lock (msg->ref_mutex);
-
-	msg->refs--;
-	if (msg->refs != 0) {
-		/* release mutex here */
-		nopoll_mutex_unlock (msg->ref_mutex);
+	if (nopoll_atomic_dec (&msg->refs) != 0)
 		return;
-	}
-	/* release mutex */
-	nopoll_mutex_unlock (msg->ref_mutex);
-	nopoll_mutex_destroy (msg->ref_mutex);
 
-	/* free websocket message */
-	nopoll_free (msg->payload);
+	/* free websocket message (payload of prepared messages
+	 * points into the frame) */
+	__nopoll_msg_buffer_release (msg);
+
+	/* return holder to the context pool */
+	ctx = msg->ctx;
+	if (ctx) {
+		__nopoll_ctx_msg_release (ctx, msg);
+		nopoll_ctx_unref (ctx);
+		return;
+	} /* end if */
 	nopoll_free (msg);
 
-	/* release mutex here */
 	return;
 }
 
@@ -48,6 +48,8 @@ int          nopoll_msg_get_payload_size (noPollMsg * msg);
 
 noPollMsg  * nopoll_msg_new (void);
 
+noPollMsg  * nopoll_msg_prepare (noPollCtx * ctx, noPollOpCode op_code, const char * content, long length);
+
 nopoll_bool  nopoll_msg_ref (noPollMsg * msg);
 
 int          nopoll_msg_ref_count (noPollMsg * msg);
@@ -62,6 +64,13 @@ noPollMsg  * nopoll_msg_join (noPollMsg * msg, noPollMsg * msg2);
 
 void         nopoll_msg_unref (noPollMsg * msg);
 
+/** internal api **/
+noPollMsg  * __nopoll_msg_new (noPollCtx * ctx);
+
+char       * __nopoll_msg_buffer_get (noPollMsg * msg, long size);
+
+void         __nopoll_msg_buffer_release (noPollMsg * msg);
+
 END_C_DECLS
 
 #endif
@@ -45,9 +45,93 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/opensslv.h>
+#include <openssl/rand.h>
+
+#if defined(NOPOLL_HAVE_ZLIB)
+#include <zlib.h>
+#endif
 
 #include <nopoll_handlers.h>
 
+/** 
+ * @internal Atomic operations used to update reference counters
+ * (noPollMsg, noPollConn and noPollCtx) without locking. They return
+ * the updated value.
+ */
+#if defined(NOPOLL_OS_WIN32)
+#define nopoll_atomic_inc(counter) InterlockedIncrement ((LONG volatile *) (counter))
+#define nopoll_atomic_dec(counter) InterlockedDecrement ((LONG volatile *) (counter))
+#define nopoll_atomic_get(counter) InterlockedCompareExchange ((LONG volatile *) (counter), 0, 0)
+#else
+#define nopoll_atomic_inc(counter) __sync_add_and_fetch ((counter), 1)
+#define nopoll_atomic_dec(counter) __sync_sub_and_fetch ((counter), 1)
+#define nopoll_atomic_get(counter) __sync_add_and_fetch ((counter), 0)
+#endif
+
+/** 
+ * @internal Payload buffer size classes kept by the context message
+ * pool (128 bytes, 1K, 8K and 64K): bigger payloads are allocated
+ * and released as usual.
+ */
+#define NOPOLL_MSG_BUFFER_CLASSES 4
+#define NOPOLL_MSG_BUFFER_SIZE(buffer_class) (128L << (3 * (buffer_class)))
+
+/** 
+ * @internal zlib stream used to compress or decompress messages
+ * (permessage-deflate), owned by a connection or shared through the
+ * context pool (see nopoll_ctx_set_deflate_pool_size).
+ */
+typedef struct _noPollZStream {
+#if defined(NOPOLL_HAVE_ZLIB)
+	z_stream                 stream;
+#endif
+	nopoll_bool              is_deflate;
+	int                      window_bits;
+	/* returned to the context pool once used */
+	nopoll_bool              pooled;
+	struct _noPollZStream  * next;
+} noPollZStream;
+
+/** 
+ * @internal permessage-deflate extension (RFC 7692) configured and
+ * negotiated for a connection (see
+ * nopoll_conn_opts_set_permessage_deflate).
+ */
+typedef struct _noPollDeflate {
+	/* settings taken from connection options (offered by
+	 * clients, accepted by listeners), window bits 0 when not
+	 * configured */
+	nopoll_bool    client_no_context_takeover;
+	nopoll_bool    server_no_context_takeover;
+	int            client_max_window_bits;
+	int            server_max_window_bits;
+	int            min_size;
+
+	/* negotiated values: extension accepted, window bits used to
+	 * compress and if the compression (deflate_reset) and
+	 * decompression (inflate_reset) contexts are reset after
+	 * each message */
+	nopoll_bool    enabled;
+	int            window_bits;
+	nopoll_bool    deflate_reset;
+	nopoll_bool    inflate_reset;
+
+	/* message being received is compressed, and state of the
+	 * frame being received (compressed, FIN flag) */
+	nopoll_bool    inflating;
+	nopoll_bool    frame_compressed;
+	nopoll_bool    frame_fin;
+
+	/* bytes decompressed of the message being received */
+	long           inflated;
+
+	/* compression contexts, created on first use (or taken
+	 * from the context pool while used when they are reset after
+	 * each message) */
+	noPollZStream * deflate_stream;
+	noPollZStream * inflate_stream;
+} noPollDeflate;
+
 typedef struct _noPollCertificate {
 
 	char * serverName;
@@ -55,13 +139,97 @@ typedef struct _noPollCertificate {
 	char * privateKey;
 	char * optionalChainFile;
 
+	/* next certificate (position) on the same serverName index
+	 * bucket or -1 */
+	int    next;
+
 } noPollCertificate;
 
+/* SSL_CTX configured for the certificate, key and chain provided,
+ * cached on master listeners to be shared by accepted connections */
+typedef struct _noPollSslCtxCache {
+	char                      * certificate;
+	char                      * private_key;
+	char                      * chain_certificate;
+	SSL_CTX                   * ssl_ctx;
+	/* ticket keys generation (see nopoll_ctx_set_tls_ticket_keys)
+	 * configured on ssl_ctx */
+	int                         ticket_keys_generation;
+	struct _noPollSslCtxCache * next;
+} noPollSslCtxCache;
+
+/* size of the session ticket keys (name, HMAC and AES keys) */
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+#define NOPOLL_TLS_TICKET_KEYS_SIZE 80
+#else
+#define NOPOLL_TLS_TICKET_KEYS_SIZE 48
+#endif
+
+/* TLS session saved by client connections to resume it on next
+ * connections to the same site (see nopoll_ctx_set_tls_session_reuse) */
+typedef struct _noPollTlsSession {
+	char                      * key;
+	SSL_SESSION               * session;
+	struct _noPollTlsSession  * next;
+} noPollTlsSession;
+
+/* outbound content (a frame or the part of a frame) not written yet
+ * because the socket wasn't ready, see nopoll_conn_send_frame */
+typedef struct _noPollWriteItem {
+	char                    * buffer;
+	int                       size;
+	int                       desp;
+	/* header bytes (added by noPoll) still not written, that are
+	 * not reported as written to the application */
+	int                       added_header;
+	/* complete message (not fragmented, not a control frame)
+	 * that can be dropped by the slow consumer policy */
+	nopoll_bool               droppable;
+	/* prepared message the buffer belongs to (not copied, see
+	 * nopoll_conn_send_prepared) */
+	noPollMsg               * msg;
+	struct _noPollWriteItem * next;
+} noPollWriteItem;
+
+/* host name resolution cached (see nopoll_ctx_set_dns_cache_ttl) */
+typedef enum {
+	NOPOLL_DNS_RESOLVING = 0,
+	NOPOLL_DNS_RESOLVED  = 1,
+	NOPOLL_DNS_FAILED    = 2
+} noPollDnsState;
+
+typedef struct _noPollDnsEntry {
+	char                    * host;
+	char                    * port;
+	noPollTransport           transport;
+	noPollDnsState            state;
+	struct sockaddr_storage   addr;
+	int                       addr_size;
+	/* time (seconds) when the result is no longer valid */
+	long                      expires;
+	/* references: cache, resolver thread and connections
+	 * waiting for the result (protected by ctx->ref_mutex) */
+	int                       refs;
+	nopoll_bool               cached;
+	noPollCtx               * ctx;
+	struct _noPollDnsEntry  * next;
+} noPollDnsEntry;
+
+/** 
+ * @internal State of a broadcast operation (see nopoll_ctx_broadcast).
+ */
+typedef struct _noPollBroadcast {
+	noPollMsg         * msg;
+	noPollForeachConn   filter;
+	noPollPtr           filter_data;
+	int                 sent;
+} noPollBroadcast;
+
 struct _noPollCtx {
 	/**
 	 * @internal Controls logs output..
 	 */
-	/* context reference counting */
+	/* context reference counting (atomic) */
 	int             refs;
 
 	/* console log */
@@ -72,8 +240,6 @@ struct _noPollCtx {
 	nopoll_bool     not_executed_color;
 	nopoll_bool     debug_color_enabled;
 
-	nopoll_bool     keep_looping;
-
 	/** 
 	 * @internal noPollConn connection timeout.
 	 */
@@ -85,9 +251,32 @@ struct _noPollCtx {
 	int         backlog;
 
 	/** 
-	 * @internal Currently selected io engine on this context.
+	 * @internal The io engine type requested by the user.
+	 */
+	noPollIoEngineType   io_engine_type;
+
+	/** 
+	 * @internal Loops watching connections registered on this
+	 * context: loops[0] is run by the thread calling
+	 * nopoll_loop_wait and the rest by worker threads (see
+	 * nopoll_ctx_set_workers). workers_next is used to hand out
+	 * accepted connections round robin.
 	 */
-	noPollIoEngine * io_engine;
+	noPollLoop         * loops;
+	int                  loops_num;
+	int                  workers_next;
+
+	/** 
+	 * @internal Default messages read from a connection on each
+	 * readiness notification.
+	 */
+	int                  read_budget;
+
+	/** 
+	 * @internal Default max message size accepted by connections
+	 * (0 unlimited).
+	 */
+	long                 max_message_size;
 
 	/** 
 	 * @internal Connection array list and its length.
@@ -124,6 +313,12 @@ struct _noPollCtx {
 	noPollOnMessageHandler on_msg;
 	noPollPtr              on_msg_data;
 
+	/** 
+	 * @internal Reference to the defined on frame chunk handling.
+	 */
+	noPollOnFrameChunkHandler on_frame_chunk;
+	noPollPtr                 on_frame_chunk_data;
+
 	/** 
 	 * @internal Basic fake support for protocol version, by
 	 * default: 13, due to RFC6455 standard
@@ -136,6 +331,13 @@ struct _noPollCtx {
 	noPollCertificate *  certificates;
 	int                  certificates_length;
 
+	/** 
+	 * @internal Index of certificates by serverName (hash
+	 * buckets with the position of the first certificate or -1).
+	 */
+	int               *  certificates_index;
+	int                  certificates_index_size;
+
 	/* mutex */
 	noPollPtr            ref_mutex;
 
@@ -150,14 +352,98 @@ struct _noPollCtx {
 	/* SSL postcheck */
 	noPollSslPostCheck      post_ssl_check;
 	noPollPtr               post_ssl_check_data;
+
+	/** 
+	 * @internal TLS sessions saved by client connections
+	 * (resumed by next connections to the same site) and
+	 * session ticket keys configured on listeners (generation is
+	 * increased each time they are changed).
+	 */
+	nopoll_bool             tls_session_reuse;
+	noPollTlsSession      * tls_sessions;
+	unsigned char           tls_ticket_keys[NOPOLL_TLS_TICKET_KEYS_SIZE];
+	int                     tls_ticket_keys_generation;
+
+	/** 
+	 * @internal TLS handshakes completed (full and resumed).
+	 */
+	long                    tls_full_handshakes;
+	long                    tls_resumed_handshakes;
+
+	/** 
+	 * @internal Host names resolved by client connections
+	 * (positive and negative results, kept the TTL seconds
+	 * configured) and optional resolver handler.
+	 */
+	noPollDnsEntry        * dns_cache;
+	int                     dns_cache_size;
+	int                     dns_positive_ttl;
+	int                     dns_negative_ttl;
+	noPollResolverHandler   resolver;
+	noPollPtr               resolver_data;
+
+	/** 
+	 * @internal Compression streams (permessage-deflate) shared
+	 * by connections that reset them after each message: idle
+	 * streams by window bits (deflate) and inflate streams, max
+	 * idle streams kept, and counters (streams created and
+	 * their estimated memory, content compressed).
+	 */
+	noPollZStream         * deflate_pool[16];
+	noPollZStream         * inflate_pool;
+	int                     deflate_pool_size;
+	long                    zstreams;
+	long                    zstreams_idle;
+	long                    zstreams_memory;
+	long                    deflate_bytes_in;
+	long                    deflate_bytes_out;
+
+	/** 
+	 * @internal Message pool: idle message holders and payload
+	 * buffers by size class (see NOPOLL_MSG_BUFFER_SIZE), max
+	 * idle items (per kind) and buffer memory kept, and counters
+	 * (requests served from the pool or allocated).
+	 */
+	noPollPtr               msg_pool_mutex;
+	noPollMsg             * msg_pool;
+	char                  * buffer_pool[NOPOLL_MSG_BUFFER_CLASSES];
+	int                     msg_pool_idle;
+	int                     buffer_pool_idle[NOPOLL_MSG_BUFFER_CLASSES];
+	int                     msg_pool_size;
+	long                    msg_pool_memory;
+	long                    buffer_pool_memory;
+	long                    msg_pool_hits;
+	long                    msg_pool_misses;
 };
 
+/* progress of the connect process of client connections (see
+ * __nopoll_conn_connect_step) */
+typedef enum {
+	NOPOLL_CONNECT_DONE    = 0,
+	NOPOLL_CONNECT_TCP     = 1,
+	NOPOLL_CONNECT_TLS     = 2,
+	NOPOLL_CONNECT_INIT    = 3,
+	NOPOLL_CONNECT_RESOLVE = 4
+} noPollConnectState;
+
 struct _noPollConn {
 	/** 
 	 * @internal Connection id.
 	 */
 	int              id;
 
+	/** 
+	 * @internal Loop watching this connection (index into
+	 * ctx->loops, 0 for the loop run by nopoll_loop_wait caller).
+	 */
+	int              worker;
+
+	/** 
+	 * @internal Next listener opened on the same port for other
+	 * worker (SO_REUSEPORT, see nopoll_conn_opts_set_reuse_port).
+	 */
+	noPollConn     * listener_next;
+
 	/** 
 	 * @internal The context associated to this connection.
 	 */
@@ -233,6 +519,12 @@ struct _noPollConn {
 	noPollOnMessageHandler on_msg;
 	noPollPtr              on_msg_data;
 
+	/** 
+	 * @internal Reference to the defined on frame chunk handling.
+	 */
+	noPollOnFrameChunkHandler on_frame_chunk;
+	noPollPtr                 on_frame_chunk_data;
+
 	/** 
 	 * @internal Reference to defined on ready handling.
 	 */
@@ -245,6 +537,12 @@ struct _noPollConn {
 	noPollOnCloseHandler   on_close;
 	noPollPtr              on_close_data;
 
+	/** 
+	 * @internal Reference to the defined on writable handling.
+	 */
+	noPollOnWritableHandler on_writable;
+	noPollPtr               on_writable_data;
+
 	/* reference to the handshake */
 	noPollHandShake  * handshake;
 
@@ -252,7 +550,8 @@ struct _noPollConn {
 	char * pending_line;
 
 	/** 
-	 * @internal connection reference counting.
+	 * @internal connection reference counting (atomic, ref_mutex
+	 * protects the rest of the connection state).
 	 */
 	int    refs;
 
@@ -274,18 +573,84 @@ struct _noPollConn {
 	 */
 	nopoll_bool   pending_ssl_accept;
 
+	/** 
+	 * @internal Connect process state of client connections
+	 * and the websocket client init to send once connected.
+	 */
+	noPollConnectState  connect_state;
+	char              * connect_init;
+
+	/** 
+	 * @internal Host name resolution (noPollDnsEntry) the
+	 * connection is waiting for (NOPOLL_CONNECT_RESOLVE state).
+	 */
+	noPollPtr           dns_entry;
+
 	/* SSL support */
 	SSL_CTX        * ssl_ctx;
 	SSL            * ssl;
 
+	/* SSL_CTX configured for accepted connections (master
+	 * listeners), see __nopoll_conn_accept_complete_common */
+	noPollSslCtxCache * ssl_ctx_cache;
+
+	/* key used to save and resume the TLS session (client
+	 * connections) */
+	char           * tls_session_key;
+
 	/* certificates */
 	char           * certificate;
 	char           * private_key;
 	char           * chain_certificate;
 
-	/* pending buffer */
-	char             pending_buf[100];
-	int              pending_buf_bytes;
+	/* read buffer: content received from the wire pending to
+	 * be processed (from read_buf_start to read_buf_end),
+	 * allocated on first read (NOPOLL_READ_BUFFER_SIZE) */
+	char           * read_buf;
+	int              read_buf_start;
+	int              read_buf_end;
+
+	/* set when the socket reported it would block on the last
+	 * read, cleared by nopoll_conn_get_msg before reading */
+	nopoll_bool      read_blocked;
+
+	/* io engine object reading and writing the socket through
+	 * completions (see NOPOLL_IO_ENGINE_IO_URING), NULL when the
+	 * socket is used directly, and content it received pending to
+	 * be read (from io_input_start to io_input_end) */
+	noPollPtr        io_completion;
+	char           * io_input;
+	int              io_input_start;
+	int              io_input_end;
+	int              io_input_size;
+
+	/* messages read on each readiness notification (0 to use
+	 * the context value) */
+	int              read_budget;
+
+	/* max message size accepted (0 to use the context value, -1
+	 * unlimited) and bytes announced by frames of the message
+	 * being received */
+	long             max_message_size;
+	long             message_bytes;
+
+	/* frame being streamed to the on frame chunk handler: op
+	 * code of the message, FIN flag, mask, bytes pending, bytes
+	 * unmasked and offset inside the message, and the handler
+	 * (taken when the message starts and used until it ends) */
+	short            chunk_op_code;
+	nopoll_bool      chunk_fin;
+	nopoll_bool      chunk_masked;
+	char             chunk_mask[4];
+	long             chunk_remain;
+	long             chunk_desp;
+	long             chunk_offset;
+	noPollOnFrameChunkHandler chunk_handler;
+	noPollPtr                 chunk_handler_data;
+
+	/* permessage-deflate settings and state (NULL when not
+	 * configured) */
+	noPollDeflate  * deflate;
 
 	/** 
 	 * @internal Support for an user defined pointer.
@@ -306,11 +671,31 @@ struct _noPollConn {
 	/* allows to track if previous message was a fragment to flag
 	 * next message, even having FIN enabled as a fragment. */
 	nopoll_bool           previous_was_fragment;
-
-	char                * pending_write;
+	/* previous_msg was also returned to the caller (a reference
+	 * was acquired for it) */
+	nopoll_bool           previous_msg_ref;
+
+	/* outbound queue: content pending to be written (in order),
+	 * flushed by the loop when the socket is writable, and total
+	 * bytes queued */
+	noPollWriteItem     * write_queue;
+	noPollWriteItem     * write_queue_last;
 	int                   pending_write_bytes;
-	int                   pending_write_desp;
-        int                   pending_write_added_header;
+	/* write readiness watched by the loop (until it finds the
+	 * queue empty, see nopoll_loop_process_write) */
+	nopoll_bool           write_watched;
+
+	/* outbound queue watermarks and slow consumer policy (taken
+	 * from connection options, see
+	 * nopoll_conn_opts_set_write_watermarks), and if the queue
+	 * is above the high mark (until it goes down to the low mark) */
+	int                        write_high;
+	int                        write_low;
+	noPollSlowConsumerPolicy   write_policy;
+	long                       write_block_timeout;
+	nopoll_bool                write_above_high;
+	noPollOnWatermarkHandler   on_watermark;
+	noPollPtr                  on_watermark_data;
 
 	/** 
 	 * @internal Internal reference to the connection options.
@@ -323,11 +708,6 @@ struct _noPollConn {
 	 */
 	noPollConn          * listener;
 
-	/** 
-	 * @internal Flag to track internal header pending 
-	 */
-	nopoll_bool           read_pending_header;
-
 	
 	/**** debug values ****/
 	/* force stop after header: do not use this, it is just for
@@ -344,6 +724,10 @@ struct _noPollIoEngine {
 	noPollIoMechWait       wait;
 	noPollIoMechAddTo      add_to;
 	noPollIoMechIsSet      is_set;
+	noPollIoMechRemoveFrom remove_from;
+	noPollIoMechForeachReady foreach_ready;
+	noPollIoMechSetWrite   set_write;
+	noPollIoMechIsWritable is_writable;
 };
 
 struct _noPollMsg {
@@ -354,14 +738,28 @@ struct _noPollMsg {
 	noPollPtr      payload;
 	long int       payload_size;
 
+	/* reference counting (atomic) */
 	int            refs;
-	noPollPtr      ref_mutex;
 
 	char           mask[4];
 	int            remain_bytes;
 
 	nopoll_bool    is_fragment;
 	int            unmask_desp;
+
+	/* encoded frame (header and payload) of prepared messages,
+	 * payload points into it (see nopoll_msg_prepare) */
+	char         * frame;
+	long int       frame_size;
+	int            header_size;
+
+	/* context where the message holder and its buffer (frame or
+	 * payload) are returned once released (NULL for messages
+	 * created with nopoll_msg_new), size class of the buffer (0
+	 * when it is not taken from the pool) and next idle holder */
+	noPollCtx    * ctx;
+	int            buffer_class;
+	struct _noPollMsg * next;
 };
 
 struct _noPollHandshake {
@@ -379,6 +777,64 @@ struct _noPollHandshake {
 
 	/* reference to cookie header */
 	char          * cookie;
+
+	/* Sec-WebSocket-Extensions received (values joined when the
+	 * header is repeated) */
+	char          * extensions;
+};
+
+/** 
+ * @internal Loop state: io engine and wake up channel used by
+ * nopoll_loop_wait (or worker threads) to watch a subset of the
+ * connections registered on a context.
+ */
+struct _noPollLoop {
+	/* loop index into ctx->loops and context owning it */
+	int                  id;
+	noPollCtx          * ctx;
+
+	/* io engine currently created (only while running) */
+	noPollIoEngine     * io_engine;
+
+	/* flag used to signal the loop that some connection was
+	 * shutdown and the connection list must be checked to
+	 * remove it (only used by io engines with persistent
+	 * registration) */
+	nopoll_bool          io_engine_cleanup;
+
+	/* wake up channel (pipe) used to unblock the io engine wait
+	 * operation (see nopoll_loop_wakeup). Both descriptors are
+	 * NOPOLL_INVALID_SOCKET when not created. io_waiting flags
+	 * when the loop is about to wait (or waiting) so other
+	 * threads registering connections know they must wake it
+	 * up */
+	NOPOLL_SOCKET        wakeup_read;
+	NOPOLL_SOCKET        wakeup_write;
+	nopoll_bool          io_waiting;
+
+	nopoll_bool          keep_looping;
+
+	/* connections pending to be notified on current
+	 * iteration */
+	int                  ready_pending;
+
+	/* flag used to signal that some connection has complete
+	 * frames already read into its read buffer (not reported
+	 * by the io engine) */
+	nopoll_bool          frames_pending;
+
+	/* flag used to signal that some host name resolution
+	 * finished (connections waiting for it must continue) */
+	nopoll_bool          resolve_pending;
+
+	/* connection being notified by the loop: cleared when the
+	 * connection is unregistered (closed by the handler) so the
+	 * loop knows it must not be used anymore */
+	noPollConn         * dispatch_conn;
+
+	/* worker thread running this loop and its result */
+	noPollPtr            thread;
+	int                  result;
 };
 
 struct _noPollConnOpts {
@@ -411,6 +867,31 @@ struct _noPollConnOpts {
 
 	/* extra HTTP headers to send during the connection */
 	char * extra_headers;
+
+	/* open one listener socket per worker (SO_REUSEPORT) */
+	nopoll_bool reuse_port;
+
+	/* don't wait for the connect process to finish */
+	nopoll_bool async_connect;
+
+	/* permessage-deflate extension settings (window bits 0 when
+	 * not configured, see nopoll_conn_opts_set_permessage_deflate) */
+	nopoll_bool deflate;
+	nopoll_bool deflate_client_no_context_takeover;
+	nopoll_bool deflate_server_no_context_takeover;
+	int         deflate_client_max_window_bits;
+	int         deflate_server_max_window_bits;
+	int         deflate_min_size;
+
+	/* outbound queue watermarks (bytes, 0 disabled), policy
+	 * applied above the high mark (and how long it may block)
+	 * and its notification */
+	int                        write_high;
+	int                        write_low;
+	noPollSlowConsumerPolicy   write_policy;
+	long                       write_block_timeout;
+	noPollOnWatermarkHandler   on_watermark;
+	noPollPtr                  on_watermark_data;
 };
 
 #endif
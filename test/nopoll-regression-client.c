@@ -215,6 +215,54 @@ nopoll_bool test_01_masking (void) {
 	return nopoll_true;
 }
 
+nopoll_bool test_01_masking_sizes (void) {
+
+	char         mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+	char         buffer[300];
+	char         expected[300];
+	int          size;
+	int          offset;
+	int          desp;
+	int          iterator;
+	noPollCtx  * ctx;
+
+	/* create context */
+	ctx = create_ctx ();
+
+	/* check all payload sizes (vector blocks and tails), buffer
+	 * alignments and frame offsets (desp) against a byte by byte
+	 * reference */
+	for (size = 0; size < 260; size++) {
+		for (offset = 0; offset < 4; offset++) {
+			for (desp = 0; desp < 8; desp++) {
+				for (iterator = 0; iterator < size; iterator++) {
+					buffer[offset + iterator]   = (char) (iterator * 7 + size);
+					expected[offset + iterator] = buffer[offset + iterator] ^ mask[(iterator + desp) % 4];
+				} /* end for */
+
+				nopoll_conn_mask_content (ctx, buffer + offset, size, mask, desp);
+				if (size > 0 && memcmp (buffer + offset, expected + offset, size)) {
+					printf ("ERROR: wrong masking found for size=%d, offset=%d, desp=%d..\n", size, offset, desp);
+					return nopoll_false;
+				} /* end if */
+			} /* end for */
+		} /* end for */
+	} /* end for */
+
+	/* mask in two steps (frame received in two reads) */
+	memcpy (buffer, "This is a test value that is masked in two steps", 48);
+	nopoll_conn_mask_content (ctx, buffer, 48, mask, 0);
+	nopoll_conn_mask_content (ctx, buffer, 17, mask, 0);
+	nopoll_conn_mask_content (ctx, buffer + 17, 31, mask, 17);
+	if (! nopoll_ncmp (buffer, "This is a test value that is masked in two steps", 48)) {
+		printf ("ERROR: expected to find SAME values after unmasking in two steps..\n");
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
 nopoll_bool test_01 (void) {
 	noPollCtx  * ctx;
 	noPollConn * conn;
@@ -716,6 +764,10 @@ nopoll_bool test_04b (void) {
 	printf ("Test 04-b: waiting until connection is ok\n");
 	nopoll_conn_wait_until_connection_ready (conn, 5);
 
+	/* small send buffer so local buffers can be flooded */
+	length = 8192;
+	setsockopt (nopoll_conn_socket (conn), SOL_SOCKET, SO_SNDBUF, &length, sizeof (length));
+
 	printf ("Test 04-b: sending was quick as possible to flood local buffers..\n");
 	
 	/* get message length */
@@ -1678,8 +1730,8 @@ nopoll_bool test_17_send_and_receive_test (noPollCtx * ctx, noPollConn * conn, n
 
 	/* printf ("Test 17: sending partial content..\n"); */
 	_socket = nopoll_conn_socket (conn);
-	buffer[0] = 126;
-	buffer[1] = 127;
+	buffer[0] = (char) 129;
+	buffer[1] = (char) 150;
 	send (_socket, buffer, 2, 0);
 
 	if (read_after_header) {
@@ -2864,213 +2916,3056 @@ nopoll_bool test_36 (void) {
 	return nopoll_true;
 }
 
-int main (int argc, char ** argv)
+int test_37_received = 0;
+
+void test_37_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
 {
-	int iterator;
+	printf ("Test 37: received message (size: %d): %s\n", nopoll_msg_get_payload_size (msg), (const char *) nopoll_msg_get_payload (msg));
+	if (nopoll_msg_get_payload_size (msg) == 14 && nopoll_ncmp ((const char *) nopoll_msg_get_payload (msg), "This is a test", 14))
+		test_37_received++;
 
-	printf ("** NoPoll: Websocket toolkit (regression test).\n");
-	printf ("** Copyright (C) 2015 Advanced Software Production Line, S.L.\n**\n");
-	printf ("** NoPoll regression tests: version=%s\n**\n",
-		VERSION);
-	printf ("** To gather information about time performance you can use:\n**\n");
-	printf ("**     >> time ./nopoll-regression-client [--debug,--show-critical-only]\n**\n");
-	printf ("** To gather information about memory consumed (and leaks) use:\n**\n");
-	printf ("**     >> libtool --mode=execute valgrind --leak-check=yes --error-limit=no ./nopoll-regression-client\n**\n");
-	printf ("**\n");
-	printf ("** Report bugs to:\n**\n");
-	printf ("**     <nopoll@lists.aspl.es> noPoll mailing list\n**\n");
-	printf ("**     <info@aspl.es> ASPL's contact \n**\n");
+	/* stop loop */
+	nopoll_loop_stop (ctx);
+	return;
+}
 
-	iterator = 1;
-	while (iterator < argc) {
-		/* check for debug */
-		printf ("Checking agument: %s\n", argv[iterator]);
-		if (nopoll_cmp (argv[iterator], "--debug")) {
-			printf ("Activating debug..\n");
-			debug = nopoll_true;
-		} /* end if */
-		if (nopoll_cmp (argv[iterator], "--show-critical-only")) {
-			printf ("Activating reporting of critical messages..\n");
-			show_critical_only = nopoll_true;
-		} /* end if */
+nopoll_bool test_37_check_engine (noPollIoEngineType engine_type, const char * label)
+{
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	noPollConn     * conn2;
 
-		/* next position */
-		iterator++;
-	}
+	printf ("Test 37: checking %s io engine..\n", label);
 
-#if defined(__NOPOLL_PTHREAD_SUPPORT__)	
-	printf ("INFO: install default threading functions to check noPoll locking code..\n");
-	nopoll_thread_handlers (__nopoll_regtest_mutex_create,
-				__nopoll_regtest_mutex_destroy,
-				__nopoll_regtest_mutex_lock,
-				__nopoll_regtest_mutex_unlock);
-#endif
+	/* create context with the io engine requested */
+	ctx = create_ctx ();
+	nopoll_ctx_set_io_engine (ctx, engine_type);
+	if (nopoll_ctx_get_io_engine (ctx) != engine_type) {
+		printf ("ERROR: expected to find io engine %d configured but found %d\n", engine_type, nopoll_ctx_get_io_engine (ctx));
+		return nopoll_false;
+	} /* end if */
+	nopoll_ctx_set_on_msg (ctx, test_37_on_msg, NULL);
 
-	printf ("INFO: starting tests with pid: %d\n", getpid ());
-	if (test_01_strings ()) {
-		printf ("Test 01-strings: Library strings support [   OK   ]\n");
-	}else {
-		printf ("Test 01-strings: Library strings support [ FAILED ]\n");
-		return -1;
-	}
+	/* create two connections (registered before the io engine is created) */
+	conn  = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	conn2 = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_is_ok (conn) || ! nopoll_conn_is_ok (conn2)) {
+		printf ("ERROR: expected to find proper client connection status, but found error..\n");
+		return nopoll_false;
+	} /* end if */
 
-	if (test_01_base64 ()) {
-		printf ("Test 01-base64: Library base64 support [   OK   ]\n");
-	}else {
-		printf ("Test 01-base64: Library base64 support [ FAILED ]\n");
-		return -1;
-	}
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5) ||
+	    ! nopoll_conn_wait_until_connection_ready (conn2, 5)) {
+		printf ("ERROR: connections not ready..\n");
+		return nopoll_false;
+	} /* end if */
 
-	if (test_01_masking ()) {
-		printf ("Test 01-masking: Library websocket content masking support [   OK   ]\n");
-	}else {
-		printf ("Test 01-masking: Library websocket content masking support [ FAILED ]\n");
-		return -1;
-	}
+	/* send content and wait for the reply through the loop */
+	test_37_received = 0;
+	if (nopoll_conn_send_text (conn, "This is a test", 14) != 14) {
+		printf ("ERROR: failed to send text..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_loop_wait (ctx, 3000000);
+	if (test_37_received != 1) {
+		printf ("ERROR: expected to receive 1 reply but found %d\n", test_37_received);
+		return nopoll_false;
+	} /* end if */
 
-	if (test_01 ()) {	
-		printf ("Test 01: Simple connect and disconnect [   OK   ]\n");
-	}else {
-		printf ("Test 01: Simple connect and disconnect [ FAILED ]\n");
-		return -1;
-	}
+	/* shutdown first connection: the loop must remove it */
+	nopoll_conn_shutdown (conn);
+	if (nopoll_conn_send_text (conn2, "This is a test", 14) != 14) {
+		printf ("ERROR: failed to send text..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_loop_wait (ctx, 3000000);
+	if (test_37_received != 2) {
+		printf ("ERROR: expected to receive 2 replies but found %d\n", test_37_received);
+		return nopoll_false;
+	} /* end if */
 
-	if (test_02 ()) {	
-		printf ("Test 02: Simple request/reply [   OK   ]\n");
-	}else {
-		printf ("Test 02: Simple request/reply [ FAILED ]\n");
-		return -1;
-	}
+	if (nopoll_ctx_conns (ctx) != 1) {
+		printf ("ERROR: expected to find 1 connection registered but found %d\n", nopoll_ctx_conns (ctx));
+		return nopoll_false;
+	} /* end if */
 
-	if (test_02a ()) {	
-		printf ("Test 02a: Simple request/reply (IPv6) [   OK   ]\n");
-	}else {
-		printf ("Test 02a: Simple request/reply (IPv6) [ FAILED ]\n");
-		return -1;
-	}
+	/* finish connections */
+	nopoll_conn_close (conn);
+	nopoll_conn_close (conn2);
 
-	/* test sending ping */
-	if (test_02b ()) {	
-		printf ("Test 02b: test sending ping [   OK   ]\n");
-	}else {
-		printf ("Test 02a: test sending ping [ FAILED ]\n");
-		return -1;
-	}
+	/* finish */
+	nopoll_ctx_unref (ctx);
 
-	/* test sending pong (without ping) */
+	return nopoll_true;
+}
 
-	/* test streaming api */
-	if (test_03 ()) {	
-		printf ("Test 03: test streaming api [   OK   ]\n");
-	}else {
-		printf ("Test 03: test streaming api [ FAILED ]\n");
-		return -1;
-	}
+#if defined(NOPOLL_HAVE_IO_URING)
+nopoll_bool test_37_check_io_uring_tls (void)
+{
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	noPollConn     * conn2;
+	noPollConnOpts * opts;
+	int              iterator;
+	int              tries;
 
-	if (test_04 (1024)) {	
-		printf ("Test 04: test streaming api (II) [   OK   ]\n");
-	}else {
-		printf ("Test 04: test streaming api (II) [ FAILED ]\n");
-		return -1;
-	}
+	printf ("Test 37: checking io_uring(7) io engine with plain and TLS connections..\n");
 
-	if (test_04 (512)) {	
-		printf ("Test 04-a: test streaming api (III) [   OK   ]\n");
-	}else {
-		printf ("Test 04-a: test streaming api (III) [ FAILED ]\n");
-		return -1;
-	}
+	/* plain connection is read and written through completions
+	 * while the TLS one is watched through epoll */
+	ctx = create_ctx ();
+	nopoll_ctx_set_io_engine (ctx, NOPOLL_IO_ENGINE_IO_URING);
+	nopoll_ctx_set_on_msg (ctx, test_37_on_msg, NULL);
 
-	if (test_04 (137)) {	
-		printf ("Test 04-b: test streaming api (IV) [   OK   ]\n");
-	}else {
-		printf ("Test 04-b: test streaming api (IV) [ FAILED ]\n");
-		return -1;
-	}
+	opts  = nopoll_conn_opts_new ();
+	nopoll_conn_opts_ssl_peer_verify (opts, nopoll_false);
+	conn  = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	conn2 = nopoll_conn_tls_new (ctx, opts, "localhost", "1235", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5) ||
+	    ! nopoll_conn_wait_until_connection_ready (conn2, 5)) {
+		printf ("ERROR: connections not ready..\n");
+		return nopoll_false;
+	} /* end if */
 
-	if (test_04 (17)) {	
-		printf ("Test 04-c: test streaming api (V) [   OK   ]\n");
-	}else {
-		printf ("Test 04-c: test streaming api (V) [ FAILED ]\n");
-		return -1;
-	}
+	/* send from both connections several times (the engine is
+	 * created and released by each loop) */
+	test_37_received = 0;
+	iterator         = 0;
+	while (iterator < 3) {
+		if (nopoll_conn_send_text (conn, "This is a test", 14) != 14 ||
+		    nopoll_conn_send_text (conn2, "This is a test", 14) != 14) {
+			printf ("ERROR: failed to send text..\n");
+			return nopoll_false;
+		} /* end if */
+		tries = 0;
+		while (test_37_received < (iterator + 1) * 2 && tries < 10) {
+			nopoll_loop_wait (ctx, 3000000);
+			tries++;
+		} /* end while */
+		iterator++;
+	} /* end while */
 
-	if (test_04a ()) {
-		printf ("Test 04-a: check non-blocking streaming and message based API  [   OK   ]\n");
-	} else {
-		printf ("Test 04-a: check non-blocking streaming and message based API [ FAILED ]\n");
-		return -1;
-	}
+	if (test_37_received != 6) {
+		printf ("ERROR: expected to receive 6 replies but found %d\n", test_37_received);
+		return nopoll_false;
+	} /* end if */
 
-	if (test_04b ()) {
-		printf ("Test 04-b: try to overflow write access and recover from it  [   OK   ]\n");
-	} else {
-		printf ("Test 04-b: try to overflow write access and recover from it [ FAILED ]\n");
-		return -1;
-	}
+	/* finish connections */
+	nopoll_conn_close (conn);
+	nopoll_conn_close (conn2);
 
-	if (test_04c ()) {
-		printf ("Test 04-c: send a file and try to overflow (but retry)  [   OK   ]\n");
-	} else {
-		printf ("Test 04-c: send a file and try to overflow (but retry) [ FAILED ]\n");
-		return -1;
-	}
+	/* finish */
+	nopoll_ctx_unref (ctx);
 
-	if (test_05 ()) {
-		printf ("Test 05: sending utf-8 content [   OK   ]\n");
-	} else {
-		printf ("Test 05: sending utf-8 content [ FAILED ]\n");
-		return -1;
-	}
+	return nopoll_true;
+}
+#endif
 
-	if (test_06 ()) {
-		printf ("Test 06: testing basic TLS connect [   OK   ]\n");
-	} else {
-		printf ("Test 06: testing basic TLS connect [ FAILED ]\n");
-		return -1;
-	}
+nopoll_bool test_37 (void) {
 
-	if (test_06a ()) {
-		printf ("Test 06a: testing basic TLS connect (IPv6) [   OK   ]\n");
-	} else {
-		printf ("Test 06a: testing basic TLS connect (IPv6) [ FAILED ]\n");
-		return -1;
-	}
+	if (! test_37_check_engine (NOPOLL_IO_ENGINE_SELECT, "select(2)"))
+		return nopoll_false;
 
-	if (test_07 ()) {
-		printf ("Test 07: testing TLS request/reply [   OK   ]\n");
-	} else {
-		printf ("Test 07: testing TLS request/reply [ FAILED ]\n");
-		return -1;
-	}
+#if defined(NOPOLL_HAVE_EPOLL)
+	if (! test_37_check_engine (NOPOLL_IO_ENGINE_EPOLL, "epoll(7)"))
+		return nopoll_false;
+#endif
 
-	if (test_08 ()) {
-		printf ("Test 08: test normal connect to TLS port [   OK   ]\n");
-	} else {
-		printf ("Test 08: test normal connect to TLS port [ FAILED ]\n");
-		return -1;
-	}
+#if defined(NOPOLL_HAVE_POLL)
+	if (! test_37_check_engine (NOPOLL_IO_ENGINE_POLL, "poll(2)"))
+		return nopoll_false;
+#endif
 
-	if (test_09 ()) {
-		printf ("Test 09: ensure we only support Sec-WebSocket-Version: 13 [   OK   ]\n");
-	} else {
-		printf ("Test 09: ensure we only support Sec-WebSocket-Version: 13 [ FAILED ]\n");
-		return -1;
-	}
+#if defined(NOPOLL_HAVE_IO_URING)
+	if (! test_37_check_engine (NOPOLL_IO_ENGINE_IO_URING, "io_uring(7)"))
+		return nopoll_false;
 
-	if (test_10 ()) {
-		printf ("Test 10: test checking origing in on open and denying it [   OK   ]\n");
-	} else {
-		printf ("Test 10: test checking origing in on open and denying it [ FAILED ]\n");
-		return -1;
-	}
+	if (! test_37_check_io_uring_tls ())
+		return nopoll_false;
+#endif
 
-	if (test_11 ()) {
-		printf ("Test 11: release context after connection [   OK   ]\n");
-	} else {
-		printf ("Test 11: release context after connection [ FAILED ]\n");
-		return -1;
-	}
+	return nopoll_true;
+}
+
+noPollConn * test_38_conn_notified = NULL;
+int          test_38_notified      = 0;
+
+void test_38_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
+{
+	test_38_conn_notified = conn;
+	test_38_notified++;
+
+	/* stop loop */
+	nopoll_loop_stop (ctx);
+	return;
+}
+
+nopoll_bool test_38_check_engine (noPollIoEngineType engine_type, const char * label) {
+	noPollCtx      * ctx;
+	noPollConn     * conns[20];
+	int              iterator;
+
+	printf ("Test 38: checking only ready connections are dispatched (20 connections, 1 active, %s)..\n", label);
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_io_engine (ctx, engine_type);
+	nopoll_ctx_set_on_msg (ctx, test_38_on_msg, NULL);
+	test_38_notified      = 0;
+	test_38_conn_notified = NULL;
+
+	/* create connections */
+	iterator = 0;
+	while (iterator < 20) {
+		conns[iterator] = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_wait_until_connection_ready (conns[iterator], 5)) {
+			printf ("ERROR: connection %d not ready..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+
+	/* send content over one connection */
+	if (nopoll_conn_send_text (conns[13], "This is a test", 14) != 14) {
+		printf ("ERROR: failed to send text..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_loop_wait (ctx, 3000000);
+
+	if (test_38_notified != 1 || test_38_conn_notified != conns[13]) {
+		printf ("ERROR: expected to be notified once on conn-id=%d, but found %d notifications (last conn: %p)\n", 
+			nopoll_conn_get_id (conns[13]), test_38_notified, test_38_conn_notified);
+		return nopoll_false;
+	} /* end if */
+
+	/* nothing else must be notified */
+	nopoll_loop_wait (ctx, 600000);
+	if (test_38_notified != 1) {
+		printf ("ERROR: expected to be notified once, but found %d notifications\n", test_38_notified);
+		return nopoll_false;
+	} /* end if */
+
+	/* finish connections */
+	iterator = 0;
+	while (iterator < 20) {
+		nopoll_conn_close (conns[iterator]);
+		iterator++;
+	} /* end while */
+
+	/* finish */
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_38 (void) {
+
+	if (! test_38_check_engine (NOPOLL_IO_ENGINE_DEFAULT, "default engine"))
+		return nopoll_false;
+
+#if defined(NOPOLL_HAVE_POLL)
+	if (! test_38_check_engine (NOPOLL_IO_ENGINE_POLL, "poll(2)"))
+		return nopoll_false;
+#endif
+
+#if defined(NOPOLL_HAVE_IO_URING)
+	if (! test_38_check_engine (NOPOLL_IO_ENGINE_IO_URING, "io_uring(7)"))
+		return nopoll_false;
+#endif
+
+	return nopoll_true;
+}
+
+int test_39_replies = 0;
+
+void test_39_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
+{
+	int * total = (int *) user_data;
+
+	test_39_replies++;
+	if (test_39_replies >= (*total)) {
+		nopoll_loop_stop (ctx);
+		return;
+	} /* end if */
+
+	/* send next message over the same connection */
+	nopoll_conn_send_text (conn, "This is a test", 14);
+	return;
+}
+
+nopoll_bool test_39_run_engine (noPollIoEngineType engine_type, const char * label)
+{
+	noPollCtx      * ctx;
+	noPollConn     * conns[10];
+	int              iterator;
+	int              total = 2000;
+	struct timeval   start;
+	struct timeval   stop;
+	struct timeval   diff;
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_io_engine (ctx, engine_type);
+	nopoll_ctx_set_on_msg (ctx, test_39_on_msg, &total);
+
+	/* create connections */
+	iterator = 0;
+	while (iterator < 10) {
+		conns[iterator] = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_wait_until_connection_ready (conns[iterator], 5)) {
+			printf ("ERROR: connection %d not ready..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+
+	/* start one message per connection and let the loop keep
+	 * sending until all replies are received */
+	test_39_replies = 0;
+	gettimeofday (&start, NULL);
+	iterator = 0;
+	while (iterator < 10) {
+		nopoll_conn_send_text (conns[iterator], "This is a test", 14);
+		iterator++;
+	} /* end while */
+	nopoll_loop_wait (ctx, 30000000);
+	gettimeofday (&stop, NULL);
+	nopoll_timeval_substract (&stop, &start, &diff);
+
+	if (test_39_replies < total) {
+		printf ("ERROR: expected to receive %d replies but found %d (%s)\n", total, test_39_replies, label);
+		return nopoll_false;
+	} /* end if */
+
+	printf ("Test 39: %-12s %d echo round trips over 10 connections in %ld.%06ld secs\n", 
+		label, total, (long) diff.tv_sec, (long) diff.tv_usec);
+
+	/* finish connections */
+	iterator = 0;
+	while (iterator < 10) {
+		nopoll_conn_close (conns[iterator]);
+		iterator++;
+	} /* end while */
+
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+nopoll_bool test_39 (void) {
+
+	printf ("Test 39: io engines benchmark..\n");
+
+	if (! test_39_run_engine (NOPOLL_IO_ENGINE_SELECT, "select(2)"))
+		return nopoll_false;
+
+#if defined(NOPOLL_HAVE_POLL)
+	if (! test_39_run_engine (NOPOLL_IO_ENGINE_POLL, "poll(2)"))
+		return nopoll_false;
+#endif
+
+#if defined(NOPOLL_HAVE_EPOLL)
+	if (! test_39_run_engine (NOPOLL_IO_ENGINE_EPOLL, "epoll(7)"))
+		return nopoll_false;
+#endif
+
+#if defined(NOPOLL_HAVE_IO_URING)
+	if (! test_39_run_engine (NOPOLL_IO_ENGINE_IO_URING, "io_uring(7)"))
+		return nopoll_false;
+#endif
+
+	return nopoll_true;
+}
+
+#if defined(__NOPOLL_PTHREAD_SUPPORT__)
+noPollPtr test_40_stop_loop (noPollPtr user_data)
+{
+	noPollCtx * ctx = (noPollCtx *) user_data;
+
+	/* let the loop block and then stop it */
+	nopoll_sleep (100000);
+	nopoll_loop_stop (ctx);
+	return NULL;
+}
+#endif
+
+long test_40_ellapsed (struct timeval * start)
+{
+	struct timeval stop;
+	struct timeval diff;
+
+	gettimeofday (&stop, NULL);
+	nopoll_timeval_substract (&stop, start, &diff);
+	return (diff.tv_sec * 1000000) + diff.tv_usec;
+}
+
+nopoll_bool test_40_check_engine (noPollIoEngineType engine_type, const char * label) {
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	struct timeval   start;
+	long             ellapsed;
+	int              result;
+#if defined(__NOPOLL_PTHREAD_SUPPORT__)
+	pthread_t        thread;
+#endif
+
+	printf ("Test 40: checking loop wait timeout and wake up (%s)..\n", label);
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_io_engine (ctx, engine_type);
+
+	conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: connection not ready..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* wait must last the timeout requested (not rounded to the
+	 * engine default wait period) */
+	gettimeofday (&start, NULL);
+	result   = nopoll_loop_wait (ctx, 200000);
+	ellapsed = test_40_ellapsed (&start);
+	if (result != -3 || ellapsed < 200000 || ellapsed > 450000) {
+		printf ("ERROR: expected timeout (-3) after 200ms but found %d after %ld usecs\n", result, ellapsed);
+		return nopoll_false;
+	} /* end if */
+
+	/* a wake up doesn't stop the loop */
+	nopoll_loop_wakeup (ctx);
+	gettimeofday (&start, NULL);
+	result   = nopoll_loop_wait (ctx, 100000);
+	ellapsed = test_40_ellapsed (&start);
+	if (result != -3 || ellapsed < 100000) {
+		printf ("ERROR: expected timeout (-3) after 100ms but found %d after %ld usecs\n", result, ellapsed);
+		return nopoll_false;
+	} /* end if */
+
+#if defined(__NOPOLL_PTHREAD_SUPPORT__)
+	/* stop from another thread must unblock the loop right away */
+	if (pthread_create (&thread, NULL, test_40_stop_loop, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+	gettimeofday (&start, NULL);
+	result   = nopoll_loop_wait (ctx, 0);
+	ellapsed = test_40_ellapsed (&start);
+	pthread_join (thread, NULL);
+	if (result != 0 || ellapsed > 400000) {
+		printf ("ERROR: expected loop stopped (0) after 100ms but found %d after %ld usecs\n", result, ellapsed);
+		return nopoll_false;
+	} /* end if */
+	printf ("Test 40: loop stopped after %ld usecs (%s)\n", ellapsed, label);
+#endif
+
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+nopoll_bool test_40 (void) {
+
+	if (! test_40_check_engine (NOPOLL_IO_ENGINE_SELECT, "select(2)"))
+		return nopoll_false;
+
+#if defined(NOPOLL_HAVE_POLL)
+	if (! test_40_check_engine (NOPOLL_IO_ENGINE_POLL, "poll(2)"))
+		return nopoll_false;
+#endif
+
+#if defined(NOPOLL_HAVE_EPOLL)
+	if (! test_40_check_engine (NOPOLL_IO_ENGINE_EPOLL, "epoll(7)"))
+		return nopoll_false;
+#endif
+
+#if defined(NOPOLL_HAVE_IO_URING)
+	if (! test_40_check_engine (NOPOLL_IO_ENGINE_IO_URING, "io_uring(7)"))
+		return nopoll_false;
+#endif
+
+	return nopoll_true;
+}
+
+#if defined(__NOPOLL_PTHREAD_SUPPORT__)
+noPollPtr   test_41_mutex = NULL;
+pthread_t   test_41_loop_thread;
+pthread_t   test_41_threads[3];
+int         test_41_msgs[3];
+nopoll_bool test_41_wrong_thread = nopoll_false;
+
+void test_41_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
+{
+	/* messages must be notified on the worker thread watching
+	 * the connection (always the same), never on the thread
+	 * calling nopoll_loop_wait */
+	__nopoll_regtest_mutex_lock (test_41_mutex);
+	if (conn->worker < 1 || conn->worker > 2 || pthread_equal (pthread_self (), test_41_loop_thread)) {
+		test_41_wrong_thread = nopoll_true;
+	} else {
+		if (test_41_msgs[conn->worker] == 0)
+			test_41_threads[conn->worker] = pthread_self ();
+		else if (! pthread_equal (pthread_self (), test_41_threads[conn->worker]))
+			test_41_wrong_thread = nopoll_true;
+		test_41_msgs[conn->worker]++;
+	} /* end if */
+	__nopoll_regtest_mutex_unlock (test_41_mutex);
+
+	/* echo content */
+	nopoll_conn_send_text (conn, (const char *) nopoll_msg_get_payload (msg), nopoll_msg_get_payload_size (msg));
+	return;
+}
+
+noPollPtr test_41_loop (noPollPtr user_data)
+{
+	nopoll_loop_wait ((noPollCtx *) user_data, 0);
+	return NULL;
+}
+
+nopoll_bool test_41_check (const char * port, nopoll_bool reuse_port, const char * label) {
+	noPollCtx      * server;
+	noPollCtx      * ctx;
+	noPollConn     * listener;
+	noPollConn     * conns[4];
+	noPollConnOpts * opts = NULL;
+	noPollMsg      * msg;
+	char             content[50];
+	int              iterator;
+	int              count;
+	int              iter;
+
+	printf ("Test 41: checking worker loops (%s)..\n", label);
+
+	server = create_ctx ();
+	if (! nopoll_ctx_set_workers (server, 2) || nopoll_ctx_get_workers (server) != 2) {
+		printf ("ERROR: failed to configure workers..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_ctx_set_on_msg (server, test_41_on_msg, NULL);
+
+	if (reuse_port) {
+		opts = nopoll_conn_opts_new ();
+		nopoll_conn_opts_set_reuse_port (opts, nopoll_true);
+	} /* end if */
+	listener = nopoll_listener_new_opts (server, opts, "0.0.0.0", port);
+	if (! nopoll_conn_is_ok (listener)) {
+		printf ("ERROR: expected proper listener at 0.0.0.0:%s creation but a failure was found..\n", port);
+		return nopoll_false;
+	} /* end if */
+
+#if defined(SO_REUSEPORT)
+	/* one listener per worker */
+	if (reuse_port && (listener->worker != 1 || listener->listener_next == NULL || listener->listener_next->worker != 2)) {
+		printf ("ERROR: expected one listener per worker..\n");
+		return nopoll_false;
+	} /* end if */
+#endif
+
+	memset (test_41_msgs, 0, sizeof (test_41_msgs));
+	test_41_wrong_thread = nopoll_false;
+	if (pthread_create (&test_41_loop_thread, NULL, test_41_loop, server) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* create connections (first round), send content and check
+	 * echo */
+	ctx   = create_ctx ();
+	count = 0;
+	while (count < 5) {
+		iterator = 0;
+		while (iterator < 4) {
+			if (count == 0) {
+				conns[iterator] = nopoll_conn_new (ctx, "localhost", port, NULL, NULL, NULL, NULL);
+				if (! nopoll_conn_wait_until_connection_ready (conns[iterator], 5)) {
+					printf ("ERROR: connection %d not ready..\n", iterator);
+					return nopoll_false;
+				} /* end if */
+			} /* end if */
+
+			sprintf (content, "Worker test %d-%d", iterator, count);
+			if (nopoll_conn_send_text (conns[iterator], content, strlen (content)) != (int) strlen (content)) {
+				printf ("ERROR: failed to send content..\n");
+				return nopoll_false;
+			} /* end if */
+
+			iter = 0;
+			while ((msg = nopoll_conn_get_msg (conns[iterator])) == NULL) {
+				if (! nopoll_conn_is_ok (conns[iterator]) || iter > 500) {
+					printf ("ERROR: reply not received for connection %d..\n", iterator);
+					return nopoll_false;
+				} /* end if */
+				nopoll_sleep (10000);
+				iter++;
+			} /* end while */
+
+			if (! nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), content)) {
+				printf ("ERROR: expected to find message '%s' but something different was received: '%s'..\n",
+					content, (const char *) nopoll_msg_get_payload (msg));
+				return nopoll_false;
+			} /* end if */
+			nopoll_msg_unref (msg);
+			iterator++;
+		} /* end while */
+		count++;
+	} /* end while */
+
+	nopoll_loop_stop (server);
+	pthread_join (test_41_loop_thread, NULL);
+
+	printf ("Test 41: messages handled by worker 1: %d, worker 2: %d (%s)\n", test_41_msgs[1], test_41_msgs[2], label);
+	if (test_41_wrong_thread) {
+		printf ("ERROR: found messages notified outside the worker thread watching the connection..\n");
+		return nopoll_false;
+	} /* end if */
+	if (test_41_msgs[1] + test_41_msgs[2] != 20) {
+		printf ("ERROR: expected 20 messages handled by workers but found %d..\n", test_41_msgs[1] + test_41_msgs[2]);
+		return nopoll_false;
+	} /* end if */
+
+	/* round robin must use both workers */
+	if (! reuse_port && (test_41_msgs[1] != 10 || test_41_msgs[2] != 10)) {
+		printf ("ERROR: expected connections handed out round robin to workers..\n");
+		return nopoll_false;
+	} /* end if */
+
+	iterator = 0;
+	while (iterator < 4) {
+		nopoll_conn_close (conns[iterator]);
+		iterator++;
+	} /* end while */
+	nopoll_ctx_unref (ctx);
+
+	nopoll_conn_close (listener);
+	nopoll_ctx_unref (server);
+	return nopoll_true;
+}
+
+nopoll_bool test_41 (void) {
+	nopoll_bool result;
+
+	test_41_mutex = __nopoll_regtest_mutex_create ();
+
+	result = test_41_check ("22352", nopoll_false, "round robin") &&
+		test_41_check ("22353", nopoll_true, "SO_REUSEPORT");
+
+	__nopoll_regtest_mutex_destroy (test_41_mutex);
+	return result;
+}
+#endif
+
+int test_42_build_frame (char * buffer, const char * content)
+{
+	int length = strlen (content);
+	int header = 2;
+	int iterator;
+
+	/* final text frame, masked, with a 7 or 16 bit length */
+	buffer[0] = (char) 0x81;
+	if (length < 126) {
+		buffer[1] = (char) (0x80 | length);
+	} else {
+		buffer[1] = (char) (0x80 | 126);
+		buffer[2] = (char) ((length >> 8) & 0xFF);
+		buffer[3] = (char) (length & 0xFF);
+		header   += 2;
+	} /* end if */
+	buffer[header]     = 0x11;
+	buffer[header + 1] = 0x22;
+	buffer[header + 2] = 0x33;
+	buffer[header + 3] = 0x44;
+	for (iterator = 0; iterator < length; iterator++)
+		buffer[header + 4 + iterator] = content[iterator] ^ buffer[header + (iterator % 4)];
+
+	return header + 4 + length;
+}
+
+nopoll_bool test_42_check_reply (noPollConn * conn, const char * content)
+{
+	noPollMsg * msg;
+	int         tries = 10;
+
+	while (tries > 0) {
+		msg = nopoll_conn_get_msg (conn);
+		if (msg)
+			break;
+		nopoll_sleep (500000);
+		tries--;
+	} /* end while */
+
+	if (msg == NULL) {
+		printf ("ERROR: expected to find reply '%s' but NULL was received..\n", content);
+		return nopoll_false;
+	} /* end if */
+
+	if (! nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), content)) {
+		printf ("ERROR: expected to find reply '%s' but found '%s'..\n", content, (const char *) nopoll_msg_get_payload (msg));
+		nopoll_msg_unref (msg);
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_msg_unref (msg);
+	return nopoll_true;
+}
+
+nopoll_bool test_42 (void) {
+	noPollCtx  * ctx;
+	noPollConn * conn;
+	char         buffer[256];
+	int          size;
+
+	/* init context */
+	ctx = create_ctx ();
+
+	/* create connection */
+	conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: Expected to find proper client connection status, but found error..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* write three frames with a single send operation so the
+	 * remote side finds all of them in one read */
+	size  = test_42_build_frame (buffer, "first frame");
+	size += test_42_build_frame (buffer + size, "second frame");
+	size += test_42_build_frame (buffer + size, "third frame");
+	if (send (nopoll_conn_socket (conn), buffer, size, 0) != size) {
+		printf ("ERROR: failed to send coalesced frames..\n");
+		return nopoll_false;
+	} /* end if */
+
+	printf ("Test 42: sent 3 frames in a single write (%d bytes), checking replies..\n", size);
+	if (! test_42_check_reply (conn, "first frame") ||
+	    ! test_42_check_reply (conn, "second frame") ||
+	    ! test_42_check_reply (conn, "third frame"))
+		return nopoll_false;
+
+	/* now send a frame followed by the first byte of the next
+	 * one and then the rest, so the header is split across
+	 * reads */
+	size  = test_42_build_frame (buffer, "before split");
+	size += test_42_build_frame (buffer + size, "split header frame");
+	if (send (nopoll_conn_socket (conn), buffer, 13, 0) != 13) {
+		printf ("ERROR: failed to send first part of the frames..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_sleep (100000);
+	if (send (nopoll_conn_socket (conn), buffer + 13, size - 13, 0) != (size - 13)) {
+		printf ("ERROR: failed to send second part of the frames..\n");
+		return nopoll_false;
+	} /* end if */
+
+	printf ("Test 42: sent frames with a split header, checking replies..\n");
+	if (! test_42_check_reply (conn, "before split") ||
+	    ! test_42_check_reply (conn, "split header frame"))
+		return nopoll_false;
+
+	/* close connection */
+	nopoll_conn_close (conn);
+
+	/* release context */
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_43 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	noPollConnOpts * opts;
+	char             content[10][1001];
+	char           * buffer;
+	int              size;
+	int              iterator;
+
+	/* init context */
+	ctx = create_ctx ();
+
+	/* check read budget configuration */
+	if (nopoll_ctx_get_read_budget (ctx) != 16) {
+		printf ("ERROR: expected default read budget 16 but found %d..\n", nopoll_ctx_get_read_budget (ctx));
+		return nopoll_false;
+	} /* end if */
+
+	/* create connection */
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_ssl_peer_verify (opts, nopoll_false);
+	conn = nopoll_conn_tls_new (ctx, opts, "localhost", "1235", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: Expected to find proper client connection status, but found error..\n");
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_conn_set_read_budget (conn, 2);
+	if (nopoll_conn_get_read_budget (conn) != 2) {
+		printf ("ERROR: expected read budget 2 but found %d..\n", nopoll_conn_get_read_budget (conn));
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_set_read_budget (conn, 0);
+	if (nopoll_conn_get_read_budget (conn) != 16) {
+		printf ("ERROR: expected context read budget (16) but found %d..\n", nopoll_conn_get_read_budget (conn));
+		return nopoll_false;
+	} /* end if */
+
+	/* write 10 frames with a single TLS write: the remote side
+	 * reads them in several steps, leaving content retained by
+	 * OpenSSL that is not reported by the socket */
+	buffer = nopoll_new (char, 10 * 1010);
+	size   = 0;
+	for (iterator = 0; iterator < 10; iterator++) {
+		memset (content[iterator], 'a' + iterator, 1000);
+		content[iterator][1000] = 0;
+		size += test_42_build_frame (buffer + size, content[iterator]);
+	} /* end for */
+
+	if (conn->send (conn, buffer, size) != size) {
+		printf ("ERROR: failed to send coalesced frames over TLS..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_free (buffer);
+
+	printf ("Test 43: sent 10 frames in a single TLS write (%d bytes), checking replies..\n", size);
+	for (iterator = 0; iterator < 10; iterator++) {
+		if (! test_42_check_reply (conn, content[iterator]))
+			return nopoll_false;
+	} /* end for */
+
+	/* close connection */
+	nopoll_conn_close (conn);
+
+	/* release context */
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_44 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	noPollConnOpts * opts;
+	noPollMsg      * msg;
+	char           * content;
+	int              length = 100000;
+	int              received = 0;
+	int              tries = 20;
+
+	/* init context */
+	ctx = create_ctx ();
+
+	/* create connection */
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_ssl_peer_verify (opts, nopoll_false);
+	conn = nopoll_conn_tls_new (ctx, opts, "localhost", "1235", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: Expected to find proper client connection status, but found error..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* send a frame bigger than a TLS record: header and first
+	 * bytes are coalesced, the rest is written from the caller
+	 * buffer */
+	content = nopoll_new (char, length + 1);
+	memset (content, 'z', length);
+	if (nopoll_conn_send_text (conn, content, length) != length) {
+		printf ("ERROR: failed to send %d bytes over TLS..\n", length);
+		return nopoll_false;
+	} /* end if */
+
+	/* get the reply (it may be received in several pieces) */
+	while (received < length && tries > 0) {
+		msg = nopoll_conn_get_msg (conn);
+		if (msg == NULL) {
+			nopoll_sleep (250000);
+			tries--;
+			continue;
+		} /* end if */
+
+		if (memcmp (nopoll_msg_get_payload (msg), content + received, nopoll_msg_get_payload_size (msg))) {
+			printf ("ERROR: found unexpected content in the reply (offset %d)..\n", received);
+			return nopoll_false;
+		} /* end if */
+		received += nopoll_msg_get_payload_size (msg);
+		nopoll_msg_unref (msg);
+	} /* end while */
+
+	if (received != length) {
+		printf ("ERROR: expected to receive %d bytes but received %d..\n", length, received);
+		return nopoll_false;
+	} /* end if */
+	printf ("Test 44: received %d bytes echoed over TLS..\n", received);
+
+	nopoll_free (content);
+
+	/* close connection */
+	nopoll_conn_close (conn);
+
+	/* release context */
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+long test_45_received = 0;
+int  test_45_writable = 0;
+long test_45_total    = 0;
+
+void test_45_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
+{
+	if (nopoll_msg_get_payload_size (msg) > 0 && ((const char *) nopoll_msg_get_payload (msg))[0] != 'w')
+		printf ("ERROR: found unexpected content in the reply (offset %ld)..\n", test_45_received);
+
+	test_45_received += nopoll_msg_get_payload_size (msg);
+	if (test_45_received >= test_45_total)
+		nopoll_loop_stop (ctx);
+	return;
+}
+
+void test_45_on_writable (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	/* notified once the queue was written */
+	if (nopoll_conn_pending_write_bytes (conn) != 0)
+		printf ("ERROR: on writable notified with %d bytes queued..\n", nopoll_conn_pending_write_bytes (conn));
+	test_45_writable++;
+	return;
+}
+
+nopoll_bool test_45_check_engine (noPollIoEngineType engine_type, const char * label) {
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	struct timeval   start;
+	long             ellapsed;
+	char           * content;
+	int              length = 65536;
+	int              iterator;
+	int              result;
+	int              queued;
+	int              size;
+
+	printf ("Test 45: checking outbound queue flushed by the loop (%s)..\n", label);
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_io_engine (ctx, engine_type);
+
+	conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: connection not ready..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_set_on_msg (conn, test_45_on_msg, NULL);
+	nopoll_conn_set_on_writable (conn, test_45_on_writable, NULL);
+
+	/* small send buffer so the socket can't take everything */
+	size = 8192;
+	setsockopt (nopoll_conn_socket (conn), SOL_SOCKET, SO_SNDBUF, &size, sizeof (size));
+
+	test_45_received = 0;
+	test_45_writable = 0;
+	test_45_total    = (long) length * 64;
+
+	/* send more content than the socket can take without
+	 * reading replies: send operations never wait, content not
+	 * written is queued */
+	content = nopoll_new (char, length);
+	memset (content, 'w', length);
+	gettimeofday (&start, NULL);
+	iterator = 0;
+	while (iterator < 64) {
+		result = nopoll_conn_send_text (conn, content, length);
+		if (result < 0 && result != -2) {
+			printf ("ERROR: failed to send frame %d, result=%d, errno=%d..\n", iterator, result, errno);
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+	ellapsed = test_40_ellapsed (&start);
+	queued   = nopoll_conn_pending_write_bytes (conn);
+	nopoll_free (content);
+	printf ("Test 45: sent %ld bytes in %ld usecs, queued %d bytes (%s)\n", test_45_total, ellapsed, queued, label);
+	if (ellapsed > 2000000) {
+		printf ("ERROR: send operations took %ld usecs, expected to never wait..\n", ellapsed);
+		return nopoll_false;
+	} /* end if */
+
+	/* the loop writes the queue while replies are read */
+	result = nopoll_loop_wait (ctx, 20000000);
+	if (result != 0 || test_45_received != test_45_total) {
+		printf ("ERROR: expected to receive %ld bytes but received %ld (loop result %d)..\n", test_45_total, test_45_received, result);
+		return nopoll_false;
+	} /* end if */
+	if (nopoll_conn_pending_write_bytes (conn) != 0) {
+		printf ("ERROR: expected empty queue but found %d bytes..\n", nopoll_conn_pending_write_bytes (conn));
+		return nopoll_false;
+	} /* end if */
+
+	/* the last reply may be received (stopping the loop) before
+	 * the loop handles the writable event that notifies */
+	if (test_45_writable == 0)
+		nopoll_loop_wait (ctx, 500000);
+	if (queued == 0 || test_45_writable == 0) {
+		printf ("ERROR: expected on writable notification after writing the queue..\n");
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+nopoll_bool test_45_listener_side (void) {
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	noPollMsg      * msg;
+	const char     * content;
+	long             received = 0;
+	int              queued   = -1;
+	int              iterator;
+
+	printf ("Test 45: checking outbound queue on the listener side (slow reader)..\n");
+
+	ctx = create_ctx ();
+	conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: connection not ready..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* ask the listener for a burst and don't read for a while */
+	if (nopoll_conn_send_text (conn, "slow-reader-burst", 17) != 17) {
+		printf ("ERROR: failed to send burst request..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_sleep (500000);
+
+	/* now read everything: the listener writes its queue as
+	 * content is read */
+	iterator = 0;
+	while (queued < 0 && iterator < 20000) {
+		msg = nopoll_conn_get_msg (conn);
+		if (msg == NULL) {
+			if (! nopoll_conn_is_ok (conn)) {
+				printf ("ERROR: connection failure while reading the burst..\n");
+				return nopoll_false;
+			} /* end if */
+			nopoll_sleep (1000);
+			iterator++;
+			continue;
+		} /* end if */
+
+		content = (const char *) nopoll_msg_get_payload (msg);
+		if (nopoll_ncmp (content, "queued: ", 8))
+			queued = atoi (content + 8);
+		else
+			received += nopoll_msg_get_payload_size (msg);
+		nopoll_msg_unref (msg);
+	} /* end while */
+
+	printf ("Test 45: received %ld bytes, listener queued %d bytes after the burst\n", received, queued);
+	if (received != 65536 * 64) {
+		printf ("ERROR: expected to receive %d bytes but received %ld..\n", 65536 * 64, received);
+		return nopoll_false;
+	} /* end if */
+	if (queued <= 0) {
+		printf ("ERROR: expected listener to queue content for a slow reader (accepted socket blocking?)..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* connection still working after the queue was written */
+	if (! test_sending_and_check_echo (conn, "Test 45", "This is a test"))
+		return nopoll_false;
+
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+nopoll_bool test_45 (void) {
+
+	if (! test_45_check_engine (NOPOLL_IO_ENGINE_SELECT, "select(2)"))
+		return nopoll_false;
+
+#if defined(NOPOLL_HAVE_POLL)
+	if (! test_45_check_engine (NOPOLL_IO_ENGINE_POLL, "poll(2)"))
+		return nopoll_false;
+#endif
+
+#if defined(NOPOLL_HAVE_EPOLL)
+	if (! test_45_check_engine (NOPOLL_IO_ENGINE_EPOLL, "epoll(7)"))
+		return nopoll_false;
+#endif
+
+#if defined(NOPOLL_HAVE_IO_URING)
+	if (! test_45_check_engine (NOPOLL_IO_ENGINE_IO_URING, "io_uring(7)"))
+		return nopoll_false;
+#endif
+
+	if (! test_45_listener_side ())
+		return nopoll_false;
+
+	return nopoll_true;
+}
+
+int  test_46_above    = 0;
+int  test_46_below    = 0;
+
+void test_46_on_watermark (noPollCtx * ctx, noPollConn * conn, nopoll_bool above, noPollPtr user_data)
+{
+	if (above)
+		test_46_above++;
+	else
+		test_46_below++;
+	return;
+}
+
+noPollConn * test_46_connect (noPollCtx * ctx, noPollSlowConsumerPolicy policy, int high, int low)
+{
+	noPollConnOpts * opts;
+	noPollConn     * conn;
+	int              size;
+
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_write_watermarks (opts, high, low);
+	nopoll_conn_opts_set_slow_consumer_policy (opts, policy);
+	nopoll_conn_opts_set_on_watermark (opts, test_46_on_watermark, NULL);
+
+	conn = nopoll_conn_new_opts (ctx, opts, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: connection not ready..\n");
+		return NULL;
+	} /* end if */
+
+	/* small send buffer so the socket can't take everything */
+	size = 8192;
+	setsockopt (nopoll_conn_socket (conn), SOL_SOCKET, SO_SNDBUF, &size, sizeof (size));
+
+	test_46_above = 0;
+	test_46_below = 0;
+	return conn;
+}
+
+#if defined(NOPOLL_OS_UNIX)
+nopoll_bool test_46_check_high_socket (noPollCtx * ctx, const char * content, int length)
+{
+	struct rlimit    limit;
+	noPollConn     * conn;
+	int              fds[1200];
+	int              count = 0;
+	int              iterator;
+	int              result;
+
+	/* make room for descriptors above FD_SETSIZE */
+	getrlimit (RLIMIT_NOFILE, &limit);
+	if (limit.rlim_cur < 1200) {
+		limit.rlim_cur = limit.rlim_max < 2048 ? limit.rlim_max : 2048;
+		setrlimit (RLIMIT_NOFILE, &limit);
+	} /* end if */
+
+	/* take low descriptors so the next socket is above 1024 */
+	while (count < 1200) {
+		fds[count] = dup (0);
+		if (fds[count] < 0 || fds[count] > FD_SETSIZE)
+			break;
+		count++;
+	} /* end while */
+	if (count < 1200 && fds[count] >= 0)
+		close (fds[count]);
+
+	conn = test_46_connect (ctx, NOPOLL_SLOW_CONSUMER_BLOCK, 131072, 32768);
+
+	/* release descriptors taken */
+	iterator = 0;
+	while (iterator < count) {
+		close (fds[iterator]);
+		iterator++;
+	} /* end while */
+
+	if (conn == NULL)
+		return nopoll_false;
+	if (nopoll_conn_socket (conn) <= FD_SETSIZE) {
+		printf ("Test 46: unable to get a socket above FD_SETSIZE (got %d), skipping check..\n", nopoll_conn_socket (conn));
+		nopoll_conn_close (conn);
+		return nopoll_true;
+	} /* end if */
+
+	nopoll_conn_set_on_msg (conn, test_45_on_msg, NULL);
+	test_45_received = 0;
+	test_45_total    = (long) length * 16;
+	iterator = 0;
+	while (iterator < 16) {
+		result = nopoll_conn_send_text (conn, content, length);
+		if (result < 0 && result != -2) {
+			printf ("ERROR: failed to send frame %d on socket %d, result=%d, errno=%d..\n", iterator, nopoll_conn_socket (conn), result, errno);
+			return nopoll_false;
+		} /* end if */
+		if (nopoll_conn_pending_write_bytes (conn) > 131072) {
+			printf ("ERROR: expected queue below high watermark but found %d bytes..\n", nopoll_conn_pending_write_bytes (conn));
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+	if (test_46_above == 0 || test_46_above != test_46_below) {
+		printf ("ERROR: expected watermark notifications (above=%d, below=%d)..\n", test_46_above, test_46_below);
+		return nopoll_false;
+	} /* end if */
+
+	/* everything sent is received */
+	result = nopoll_loop_wait (ctx, 20000000);
+	if (result != 0 || test_45_received != test_45_total) {
+		printf ("ERROR: expected to receive %ld bytes but received %ld (loop result %d)..\n", test_45_total, test_45_received, result);
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+	return nopoll_true;
+}
+#endif
+
+nopoll_bool test_46 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	noPollMsg      * msg;
+	long             received;
+	char           * content;
+	int              length = 65536;
+	int              iterator;
+	int              result;
+
+	ctx = create_ctx ();
+	content = nopoll_new (char, length);
+	memset (content, 'w', length);
+
+	/* notify policy: content is kept queued, application is
+	 * notified when crossing both watermarks */
+	printf ("Test 46: checking watermark notifications..\n");
+	conn = test_46_connect (ctx, NOPOLL_SLOW_CONSUMER_NOTIFY, 262144, 65536);
+	if (conn == NULL)
+		return nopoll_false;
+	nopoll_conn_set_on_msg (conn, test_45_on_msg, NULL);
+	test_45_received = 0;
+	test_45_total    = (long) length * 32;
+	iterator = 0;
+	while (iterator < 32) {
+		result = nopoll_conn_send_text (conn, content, length);
+		if (result < 0 && result != -2) {
+			printf ("ERROR: failed to send frame %d, result=%d, errno=%d..\n", iterator, result, errno);
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+	if (test_46_above != 1 || test_46_below != 0 || nopoll_conn_pending_write_bytes (conn) <= 262144) {
+		printf ("ERROR: expected high watermark notification (above=%d, below=%d, pending=%d)..\n",
+			test_46_above, test_46_below, nopoll_conn_pending_write_bytes (conn));
+		return nopoll_false;
+	} /* end if */
+
+	/* the loop writes the queue: low watermark notified */
+	result = nopoll_loop_wait (ctx, 20000000);
+	if (result != 0 || test_45_received != test_45_total || test_46_below != 1) {
+		printf ("ERROR: expected to receive %ld bytes but received %ld (loop result %d, below=%d)..\n",
+			test_45_total, test_45_received, result, test_46_below);
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+
+	/* block policy: send operations wait until the queue goes
+	 * down to the low watermark */
+	printf ("Test 46: checking block policy..\n");
+	conn = test_46_connect (ctx, NOPOLL_SLOW_CONSUMER_BLOCK, 131072, 32768);
+	if (conn == NULL)
+		return nopoll_false;
+	nopoll_conn_set_on_msg (conn, test_45_on_msg, NULL);
+	test_45_received = 0;
+	test_45_total    = (long) length * 16;
+	iterator = 0;
+	while (iterator < 16) {
+		result = nopoll_conn_send_text (conn, content, length);
+		if (result < 0 && result != -2) {
+			printf ("ERROR: failed to send frame %d, result=%d, errno=%d..\n", iterator, result, errno);
+			return nopoll_false;
+		} /* end if */
+		if (nopoll_conn_pending_write_bytes (conn) > 131072) {
+			printf ("ERROR: expected queue below high watermark but found %d bytes..\n", nopoll_conn_pending_write_bytes (conn));
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+	if (test_46_above == 0 || test_46_above != test_46_below) {
+		printf ("ERROR: expected watermark notifications (above=%d, below=%d)..\n", test_46_above, test_46_below);
+		return nopoll_false;
+	} /* end if */
+
+	/* everything sent is received */
+	result = nopoll_loop_wait (ctx, 20000000);
+	if (result != 0 || test_45_received != test_45_total) {
+		printf ("ERROR: expected to receive %ld bytes but received %ld (loop result %d)..\n", test_45_total, test_45_received, result);
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+
+#if defined(NOPOLL_OS_UNIX)
+	/* block policy on a socket above FD_SETSIZE */
+	printf ("Test 46: checking block policy on a socket above FD_SETSIZE..\n");
+	if (! test_46_check_high_socket (ctx, content, length))
+		return nopoll_false;
+#endif
+
+	/* drop oldest policy: queue never grows above the high
+	 * watermark (plus the frame being queued) */
+	printf ("Test 46: checking drop oldest policy..\n");
+	conn = test_46_connect (ctx, NOPOLL_SLOW_CONSUMER_DROP_OLDEST, 262144, 131072);
+	if (conn == NULL)
+		return nopoll_false;
+	iterator = 0;
+	while (iterator < 64) {
+		result = nopoll_conn_send_text (conn, content, length);
+		if (result < 0 && result != -2) {
+			printf ("ERROR: failed to send frame %d, result=%d, errno=%d..\n", iterator, result, errno);
+			return nopoll_false;
+		} /* end if */
+		if (nopoll_conn_pending_write_bytes (conn) > 262144) {
+			printf ("ERROR: expected queue below high watermark but found %d bytes..\n", nopoll_conn_pending_write_bytes (conn));
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+	if (test_46_above == 0 || ! nopoll_conn_is_ok (conn)) {
+		printf ("ERROR: expected high watermark notification and connection ok..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_shutdown (conn);
+	nopoll_conn_close (conn);
+
+	/* drop connection policy: send operation fails once the high
+	 * watermark is crossed */
+	printf ("Test 46: checking drop connection policy..\n");
+	conn = test_46_connect (ctx, NOPOLL_SLOW_CONSUMER_DROP_CONN, 262144, 65536);
+	if (conn == NULL)
+		return nopoll_false;
+	iterator = 0;
+	while (iterator < 64) {
+		result = nopoll_conn_send_text (conn, content, length);
+		if (result == -1)
+			break;
+		iterator++;
+	} /* end while */
+	if (result != -1 || nopoll_conn_is_ok (conn) || test_46_above != 1) {
+		printf ("ERROR: expected connection dropped (result=%d, iterator=%d, above=%d)..\n", result, iterator, test_46_above);
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+
+	/* dropped connections leave partial frames on the listener:
+	 * release them */
+	nopoll_sleep (200000);
+	conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: connection not ready..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_send_text (conn, "release-message", 15);
+	nopoll_sleep (200000);
+	nopoll_conn_close (conn);
+
+	/* block policy on the listener side: the listener blocks
+	 * sending to a client that doesn't read until the timeout
+	 * configured (500ms) and then closes the connection */
+	printf ("Test 46: checking block policy timeout (listener side)..\n");
+	conn = nopoll_conn_new (ctx, "localhost", "1243", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: connection not ready..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_send_text (conn, "slow-reader-burst", 17);
+	nopoll_sleep (2000000);
+
+	/* read what was written until the connection is closed */
+	received = 0;
+	iterator = 0;
+	while (nopoll_conn_is_ok (conn) && iterator < 10000) {
+		msg = nopoll_conn_get_msg (conn);
+		if (msg == NULL) {
+			nopoll_sleep (1000);
+			iterator++;
+			continue;
+		} /* end if */
+		if (nopoll_ncmp ((const char *) nopoll_msg_get_payload (msg), "queued: ", 8)) {
+			printf ("ERROR: expected listener to close the connection before completing the burst..\n");
+			return nopoll_false;
+		} /* end if */
+		received += nopoll_msg_get_payload_size (msg);
+		nopoll_msg_unref (msg);
+	} /* end while */
+	printf ("Test 46: received %ld bytes before the listener closed the connection\n", received);
+	if (nopoll_conn_is_ok (conn) || received >= (long) length * 64) {
+		printf ("ERROR: expected connection closed by the listener (block timeout)..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+
+	nopoll_free (content);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+nopoll_bool test_47_filter (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	/* only accepted connections, skipping the one provided */
+	return nopoll_conn_role (conn) == NOPOLL_ROLE_LISTENER && conn != (noPollConn *) user_data;
+}
+
+noPollMsg * test_47_wait_msg (noPollConn * conn, int iterations)
+{
+	noPollMsg * msg;
+	int         iter = 0;
+
+	while ((msg = nopoll_conn_get_msg (conn)) == NULL) {
+		if (! nopoll_conn_is_ok (conn) || iter > iterations)
+			return NULL;
+		nopoll_sleep (10000);
+		iter++;
+	} /* end while */
+	return msg;
+}
+
+nopoll_bool test_47 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * master;
+	noPollConn     * conns[3];
+	noPollConn     * listeners[3];
+	noPollMsg      * prepared;
+	noPollMsg      * msg;
+	int              iterator;
+	int              result;
+
+	ctx = create_ctx ();
+
+	master = nopoll_listener_new (ctx, "0.0.0.0", "22354");
+	if (! nopoll_conn_is_ok (master)) {
+		printf ("ERROR: expected proper master listener at 0.0.0.0:22354 creation but a failure was found..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* create connections and accept them */
+	iterator = 0;
+	while (iterator < 3) {
+		conns[iterator] = nopoll_conn_new (ctx, "localhost", "22354", NULL, NULL, NULL, NULL);
+		listeners[iterator] = nopoll_conn_accept (ctx, master);
+		if (! nopoll_conn_is_ready (listeners[iterator]) || ! nopoll_conn_wait_until_connection_ready (conns[iterator], 5)) {
+			printf ("ERROR: expected to find connection %d ready..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+
+	/* encode the frame once */
+	prepared = nopoll_msg_prepare (ctx, NOPOLL_TEXT_FRAME, "market data update", 18);
+	if (prepared == NULL || nopoll_msg_get_payload_size (prepared) != 18) {
+		printf ("ERROR: expected to create prepared message..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* send it to accepted connections but the last one */
+	result = nopoll_ctx_broadcast (ctx, prepared, test_47_filter, listeners[2]);
+	if (result != 2 || nopoll_msg_ref_count (prepared) != 1) {
+		printf ("ERROR: expected broadcast to 2 connections, but found %d (refs %d)..\n", result, nopoll_msg_ref_count (prepared));
+		return nopoll_false;
+	} /* end if */
+	iterator = 0;
+	while (iterator < 2) {
+		msg = test_47_wait_msg (conns[iterator], 100);
+		if (msg == NULL || ! nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), "market data update")) {
+			printf ("ERROR: expected to receive broadcast on connection %d..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		nopoll_msg_unref (msg);
+		iterator++;
+	} /* end while */
+	msg = test_47_wait_msg (conns[2], 10);
+	if (msg != NULL) {
+		printf ("ERROR: expected filtered connection to not receive broadcast..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* prepared messages sent by clients are masked */
+	result = nopoll_conn_send_prepared (conns[2], prepared);
+	if (result != 18) {
+		printf ("ERROR: expected to send prepared message from client, but found %d..\n", result);
+		return nopoll_false;
+	} /* end if */
+	msg = test_47_wait_msg (listeners[2], 100);
+	if (msg == NULL || ! nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), "market data update")) {
+		printf ("ERROR: expected to receive prepared message sent by client..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_msg_unref (msg);
+
+	/* without filter, every connection but the master listener */
+	result = nopoll_ctx_broadcast (ctx, prepared, NULL, NULL);
+	if (result != 6) {
+		printf ("ERROR: expected broadcast to 6 connections, but found %d..\n", result);
+		return nopoll_false;
+	} /* end if */
+	iterator = 0;
+	while (iterator < 3) {
+		msg = test_47_wait_msg (conns[iterator], 100);
+		if (msg == NULL || ! nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), "market data update")) {
+			printf ("ERROR: expected to receive broadcast on connection %d..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		nopoll_msg_unref (msg);
+		msg = test_47_wait_msg (listeners[iterator], 100);
+		if (msg == NULL || ! nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), "market data update")) {
+			printf ("ERROR: expected to receive broadcast on accepted connection %d..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		nopoll_msg_unref (msg);
+		iterator++;
+	} /* end while */
+
+	/* hard send errors close the connection (nothing is queued
+	 * and reported as sent) */
+#if defined(NOPOLL_OS_WIN32)
+	shutdown (nopoll_conn_socket (listeners[0]), SD_SEND);
+	shutdown (nopoll_conn_socket (conns[1]), SD_SEND);
+#else
+	shutdown (nopoll_conn_socket (listeners[0]), SHUT_WR);
+	shutdown (nopoll_conn_socket (conns[1]), SHUT_WR);
+#endif
+	result = nopoll_conn_send_prepared (listeners[0], prepared);
+	if (result != -1 || nopoll_conn_is_ok (listeners[0]) || nopoll_conn_pending_write_bytes (listeners[0]) != 0) {
+		printf ("ERROR: expected prepared message send failure on broken connection (result %d, pending %d)..\n",
+			result, nopoll_conn_pending_write_bytes (listeners[0]));
+		return nopoll_false;
+	} /* end if */
+	result = nopoll_conn_send_text (conns[1], "market data update", 18);
+	if (result != -1 || nopoll_conn_is_ok (conns[1]) || nopoll_conn_pending_write_bytes (conns[1]) != 0) {
+		printf ("ERROR: expected send failure on broken connection (result %d, pending %d)..\n",
+			result, nopoll_conn_pending_write_bytes (conns[1]));
+		return nopoll_false;
+	} /* end if */
+	nopoll_msg_unref (prepared);
+
+	iterator = 0;
+	while (iterator < 3) {
+		nopoll_conn_close (conns[iterator]);
+		nopoll_conn_close (listeners[iterator]);
+		iterator++;
+	} /* end while */
+	nopoll_conn_close (master);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+NOPOLL_SOCKET test_48_raw_connect (int port)
+{
+	NOPOLL_SOCKET        session;
+	struct sockaddr_in   address;
+
+	memset (&address, 0, sizeof (address));
+	address.sin_family      = AF_INET;
+	address.sin_port        = htons (port);
+	address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	session = socket (AF_INET, SOCK_STREAM, 0);
+	if (session == NOPOLL_INVALID_SOCKET)
+		return NOPOLL_INVALID_SOCKET;
+	if (connect (session, (struct sockaddr *) &address, sizeof (address)) != 0) {
+		nopoll_close_socket (session);
+		return NOPOLL_INVALID_SOCKET;
+	} /* end if */
+	return session;
+}
+
+nopoll_bool test_48 (void) {
+	noPollCtx          * ctx;
+	noPollConn         * master;
+	noPollConn         * listener;
+	noPollMsg          * msg = NULL;
+	NOPOLL_SOCKET        session;
+	char                 buffer[1024];
+	int                  length;
+	int                  iterator;
+	const char         * request = "GET / HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+		"Origin: http://localhost\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"\r\n";
+
+	ctx = create_ctx ();
+
+	master = nopoll_listener_new (ctx, "0.0.0.0", "22355");
+	if (! nopoll_conn_is_ok (master)) {
+		printf ("ERROR: expected proper master listener at 0.0.0.0:22355 creation but a failure was found..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* raw connection to write the upgrade request by hand */
+	session = test_48_raw_connect (22355);
+	if (session == NOPOLL_INVALID_SOCKET) {
+		printf ("ERROR: failed to connect to 0.0.0.0:22355..\n");
+		return nopoll_false;
+	} /* end if */
+	listener = nopoll_conn_accept (ctx, master);
+	if (listener == NULL) {
+		printf ("ERROR: expected to accept connection..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* send the upgrade request followed by a frame (masked with
+	 * a zero mask) in a single write */
+	length = strlen (request);
+	memcpy (buffer, request, length);
+	buffer[length++] = (char) 0x81;
+	buffer[length++] = (char) (0x80 | 11);
+	memset (buffer + length, 0, 4);
+	length += 4;
+	memcpy (buffer + length, "early frame", 11);
+	length += 11;
+	if (send (session, buffer, length, 0) != length) {
+		printf ("ERROR: failed to send upgrade request..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* the frame is read from the content buffered while reading
+	 * the handshake */
+	iterator = 0;
+	while (iterator < 10 && msg == NULL) {
+		msg = nopoll_conn_get_msg (listener);
+		iterator++;
+	} /* end while */
+	if (! nopoll_conn_is_ready (listener) || msg == NULL) {
+		printf ("ERROR: expected handshake completed and early frame received (ready=%d, msg=%p)..\n",
+			nopoll_conn_is_ready (listener), msg);
+		return nopoll_false;
+	} /* end if */
+	if (nopoll_msg_get_payload_size (msg) != 11 || ! nopoll_ncmp ((const char *) nopoll_msg_get_payload (msg), "early frame", 11)) {
+		printf ("ERROR: expected to receive early frame content..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_msg_unref (msg);
+
+	/* check handshake reply */
+	nopoll_sleep (10000);
+	length = recv (session, buffer, sizeof (buffer) - 1, 0);
+	if (length <= 0) {
+		printf ("ERROR: expected handshake reply..\n");
+		return nopoll_false;
+	} /* end if */
+	buffer[length] = 0;
+	if (strstr (buffer, "101") == NULL || strstr (buffer, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") == NULL) {
+		printf ("ERROR: expected handshake accept reply but found: %s\n", buffer);
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_close_socket (session);
+	nopoll_conn_close (listener);
+	nopoll_conn_close (master);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+nopoll_bool test_49 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * master;
+	noPollConn     * listeners[3];
+	NOPOLL_SOCKET    sessions[3];
+	int              iterator;
+
+	ctx = create_ctx ();
+
+	master = nopoll_listener_tls_new (ctx, "0.0.0.0", "22356");
+	if (! nopoll_conn_is_ok (master) || ! nopoll_listener_set_certificate (master, "test-certificate.crt", "test-private.key", NULL)) {
+		printf ("ERROR: expected proper TLS master listener at 0.0.0.0:22356 creation but a failure was found..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* TLS context is configured when accepting (before the TLS
+	 * handshake) */
+	iterator = 0;
+	while (iterator < 3) {
+		if (iterator == 2) {
+			/* certificates read again */
+			nopoll_listener_flush_tls_cache (master);
+		} /* end if */
+
+		sessions[iterator] = test_48_raw_connect (22356);
+		if (sessions[iterator] == NOPOLL_INVALID_SOCKET) {
+			printf ("ERROR: failed to connect to 0.0.0.0:22356..\n");
+			return nopoll_false;
+		} /* end if */
+		listeners[iterator] = nopoll_conn_accept (ctx, master);
+		if (listeners[iterator] == NULL || listeners[iterator]->ssl_ctx == NULL) {
+			printf ("ERROR: expected to accept TLS connection %d..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+
+	if (listeners[0]->ssl_ctx != listeners[1]->ssl_ctx) {
+		printf ("ERROR: expected accepted connections to share the TLS context (%p != %p)..\n", 
+			listeners[0]->ssl_ctx, listeners[1]->ssl_ctx);
+		return nopoll_false;
+	} /* end if */
+	if (listeners[2]->ssl_ctx == listeners[0]->ssl_ctx) {
+		printf ("ERROR: expected a new TLS context after flushing the listener cache..\n");
+		return nopoll_false;
+	} /* end if */
+
+	iterator = 0;
+	while (iterator < 3) {
+		nopoll_close_socket (sessions[iterator]);
+		nopoll_conn_shutdown (listeners[iterator]);
+		nopoll_conn_close (listeners[iterator]);
+		iterator++;
+	} /* end while */
+	nopoll_conn_close (master);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+noPollConn * test_50_connect (noPollCtx * ctx) {
+	noPollConnOpts * opts;
+	noPollConn     * conn;
+
+	/* disable verification */
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_ssl_peer_verify (opts, nopoll_false);
+
+	conn = nopoll_conn_tls_new (ctx, opts, "localhost", "1235", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected proper TLS connection to localhost:1235..\n");
+		return NULL;
+	} /* end if */
+
+	/* exchange content (TLS 1.3 session tickets are received
+	 * after the handshake) */
+	if (! test_sending_and_check_echo (conn, "Test 50", "This is a test"))
+		return NULL;
+
+	return conn;
+}
+
+nopoll_bool test_50 (void) {
+	noPollCtx  * ctx;
+	noPollConn * conn;
+	long         full_handshakes;
+	long         resumed_handshakes;
+
+	ctx = create_ctx ();
+
+	/* wrong ticket keys size */
+	if (nopoll_ctx_set_tls_ticket_keys (ctx, "1234", 4)) {
+		printf ("ERROR: expected to fail configuring ticket keys with a wrong size..\n");
+		return nopoll_false;
+	} /* end if */
+	if (! nopoll_ctx_set_tls_ticket_keys (ctx, NULL, 0)) {
+		printf ("ERROR: expected to generate random ticket keys..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* first connection: full handshake */
+	conn = test_50_connect (ctx);
+	if (conn == NULL)
+		return nopoll_false;
+	if (nopoll_conn_tls_session_reused (conn)) {
+		printf ("ERROR: expected a full TLS handshake on first connection..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+
+	/* second connection: session resumed */
+	conn = test_50_connect (ctx);
+	if (conn == NULL)
+		return nopoll_false;
+	if (! nopoll_conn_tls_session_reused (conn)) {
+		printf ("ERROR: expected TLS session to be resumed on second connection..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+
+	/* sessions not resumed when disabled */
+	nopoll_ctx_set_tls_session_reuse (ctx, nopoll_false);
+	conn = test_50_connect (ctx);
+	if (conn == NULL)
+		return nopoll_false;
+	if (nopoll_conn_tls_session_reused (conn)) {
+		printf ("ERROR: expected a full TLS handshake with session reuse disabled..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+
+	nopoll_ctx_get_tls_stats (ctx, &full_handshakes, &resumed_handshakes);
+	if (full_handshakes != 2 || resumed_handshakes != 1) {
+		printf ("ERROR: expected 2 full and 1 resumed TLS handshakes but found %ld and %ld..\n",
+			full_handshakes, resumed_handshakes);
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+nopoll_bool test_51_check (noPollCtx * ctx, const char * host_name, const char * expected_cn) {
+	noPollConnOpts * opts;
+	noPollConn     * conn;
+	X509           * cert;
+	char             subject[256];
+
+	/* disable verification */
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_ssl_peer_verify (opts, nopoll_false);
+
+	conn = nopoll_conn_tls_new (ctx, opts, "localhost", "1235", host_name, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected proper TLS connection to localhost:1235 (%s)..\n", host_name);
+		return nopoll_false;
+	} /* end if */
+
+	cert = SSL_get_peer_certificate (conn->ssl);
+	if (cert == NULL) {
+		printf ("ERROR: expected to find server certificate (%s)..\n", host_name);
+		return nopoll_false;
+	} /* end if */
+	X509_NAME_get_text_by_NID (X509_get_subject_name (cert), NID_commonName, subject, sizeof (subject));
+	X509_free (cert);
+
+	if (! nopoll_cmp (subject, expected_cn)) {
+		printf ("ERROR: expected certificate %s for %s but found %s..\n", expected_cn, host_name, subject);
+		return nopoll_false;
+	} /* end if */
+
+	if (! test_sending_and_check_echo (conn, "Test 51", "This is a test"))
+		return nopoll_false;
+
+	nopoll_conn_close (conn);
+	return nopoll_true;
+}
+
+nopoll_bool test_51 (void) {
+	noPollCtx  * ctx;
+
+	ctx = create_ctx ();
+
+	/* no server name (IP address) */
+	if (! test_51_check (ctx, "127.0.0.1", "test.nopoll.aspl.es"))
+		return nopoll_false;
+
+	/* wildcard certificate (case insensitive) */
+	if (! test_51_check (ctx, "www.sni.nopoll.test", "server.nopoll.aspl.es"))
+		return nopoll_false;
+	if (! test_51_check (ctx, "WWW.Sni.Nopoll.Test", "server.nopoll.aspl.es"))
+		return nopoll_false;
+
+	/* exact certificate preferred over wildcard */
+	if (! test_51_check (ctx, "exact.sni.nopoll.test", "client.nopoll.aspl.es"))
+		return nopoll_false;
+
+	/* wildcard only matches one label and unknown names use
+	 * default certificate */
+	if (! test_51_check (ctx, "a.b.sni.nopoll.test", "test.nopoll.aspl.es"))
+		return nopoll_false;
+	if (! test_51_check (ctx, "localhost", "test.nopoll.aspl.es"))
+		return nopoll_false;
+
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+int test_52_ready = 0;
+int test_52_expected = 0;
+
+nopoll_bool test_52_on_ready (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	test_52_ready++;
+
+	/* stop loop once all connections are ready */
+	if (test_52_ready == test_52_expected)
+		nopoll_loop_stop (ctx);
+	return nopoll_true;
+}
+
+nopoll_bool test_52 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * conns[60];
+	noPollConnOpts * opts;
+	noPollConnOpts * tls_opts;
+	noPollConn     * conn;
+	int              iterator;
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_on_ready (ctx, test_52_on_ready, NULL);
+
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_reuse (opts, nopoll_true);
+	nopoll_conn_opts_set_async_connect (opts, nopoll_true);
+
+	tls_opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_reuse (tls_opts, nopoll_true);
+	nopoll_conn_opts_set_async_connect (tls_opts, nopoll_true);
+	nopoll_conn_opts_ssl_peer_verify (tls_opts, nopoll_false);
+
+	/* start all connections without waiting for them */
+	test_52_ready    = 0;
+	test_52_expected = 60;
+	iterator         = 0;
+	while (iterator < 60) {
+		if (iterator < 50)
+			conns[iterator] = nopoll_conn_new_opts (ctx, opts, "localhost", "1234", NULL, NULL, NULL, NULL);
+		else
+			conns[iterator] = nopoll_conn_tls_new (ctx, tls_opts, "localhost", "1235", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_is_ok (conns[iterator])) {
+			printf ("ERROR: expected to find connection %d in progress..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+
+	/* connects must not have finished yet */
+	if (test_52_ready != 0) {
+		printf ("ERROR: expected no connection ready before running the loop but found %d\n", test_52_ready);
+		return nopoll_false;
+	} /* end if */
+
+	/* the loop completes connect, TLS and websocket handshake */
+	nopoll_loop_wait (ctx, 10000000);
+	if (test_52_ready != 60) {
+		printf ("ERROR: expected 60 connections ready but found %d\n", test_52_ready);
+		return nopoll_false;
+	} /* end if */
+
+	iterator = 0;
+	while (iterator < 60) {
+		if (! nopoll_conn_is_ready (conns[iterator])) {
+			printf ("ERROR: expected to find connection %d ready..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+
+	if (! test_sending_and_check_echo (conns[0], "Test 52", "This is a test"))
+		return nopoll_false;
+	if (! test_sending_and_check_echo (conns[59], "Test 52", "This is a test"))
+		return nopoll_false;
+
+	iterator = 0;
+	while (iterator < 60) {
+		nopoll_conn_close (conns[iterator]);
+		iterator++;
+	} /* end while */
+
+	/* async connect to a closed port fails while waiting */
+	conn = nopoll_conn_new_opts (ctx, opts, "localhost", "1290", NULL, NULL, NULL, NULL);
+	if (conn != NULL && nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection to fail..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+
+	nopoll_conn_opts_free (opts);
+	nopoll_conn_opts_free (tls_opts);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+int test_53_queries = 0;
+
+nopoll_bool test_53_resolver (noPollCtx       * ctx,
+			      const char      * host,
+			      const char      * port,
+			      noPollTransport   transport,
+			      char            * address,
+			      int               address_size,
+			      int             * ttl,
+			      noPollPtr         user_data)
+{
+	test_53_queries++;
+
+	/* slow resolver */
+	nopoll_sleep (100000);
+
+	if (nopoll_cmp (host, "stub.nopoll.test")) {
+		snprintf (address, address_size, "127.0.0.1");
+		*ttl = 30;
+		return nopoll_true;
+	} /* end if */
+	if (nopoll_cmp (host, "short.nopoll.test")) {
+		snprintf (address, address_size, "127.0.0.1");
+		*ttl = 0;
+		return nopoll_true;
+	} /* end if */
+
+	/* unknown host */
+	return nopoll_false;
+}
+
+nopoll_bool test_53_check_queries (int expected)
+{
+	if (test_53_queries != expected) {
+		printf ("ERROR: expected %d resolver queries but found %d\n", expected, test_53_queries);
+		return nopoll_false;
+	} /* end if */
+	return nopoll_true;
+}
+
+nopoll_bool test_53 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * conns[5];
+	noPollConnOpts * opts;
+	noPollConn     * conn;
+	int              iterator;
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_resolver (ctx, test_53_resolver, NULL);
+	nopoll_ctx_set_on_ready (ctx, test_52_on_ready, NULL);
+
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_reuse (opts, nopoll_true);
+	nopoll_conn_opts_set_async_connect (opts, nopoll_true);
+
+	/* connections to the same host share the resolution, done
+	 * without blocking the caller */
+	test_53_queries  = 0;
+	test_52_ready    = 0;
+	test_52_expected = 5;
+	iterator         = 0;
+	while (iterator < 5) {
+		conns[iterator] = nopoll_conn_new_opts (ctx, opts, "stub.nopoll.test", "1234", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_is_ok (conns[iterator])) {
+			printf ("ERROR: expected to find connection %d in progress..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+#if defined(__NOPOLL_PTHREAD_SUPPORT__)
+	/* resolved by a resolver thread */
+	if (nopoll_conn_is_ready (conns[0])) {
+		printf ("ERROR: expected connection to wait for the host name..\n");
+		return nopoll_false;
+	} /* end if */
+#endif
+
+	nopoll_loop_wait (ctx, 5000000);
+	if (test_52_ready != 5) {
+		printf ("ERROR: expected 5 connections ready but found %d\n", test_52_ready);
+		return nopoll_false;
+	} /* end if */
+	if (! test_53_check_queries (1))
+		return nopoll_false;
+	if (! test_sending_and_check_echo (conns[4], "Test 53", "This is a test"))
+		return nopoll_false;
+
+	iterator = 0;
+	while (iterator < 5) {
+		nopoll_conn_close (conns[iterator]);
+		iterator++;
+	} /* end while */
+
+	/* blocking connections use the cache too */
+	conn = nopoll_conn_new (ctx, "stub.nopoll.test", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection to be ready..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+	if (! test_53_check_queries (1))
+		return nopoll_false;
+
+	/* numeric addresses are not resolved */
+	conn = nopoll_conn_new_opts (ctx, opts, "127.0.0.1", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection to be ready..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+	if (! test_53_check_queries (1))
+		return nopoll_false;
+
+	/* failures are cached too */
+	conn = nopoll_conn_new_opts (ctx, opts, "unknown.nopoll.test", "1234", NULL, NULL, NULL, NULL);
+	if (nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection to fail..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+	conn = nopoll_conn_new (ctx, "unknown.nopoll.test", "1234", NULL, NULL, NULL, NULL);
+	if (nopoll_conn_is_ok (conn)) {
+		printf ("ERROR: expected connection to fail..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+	if (! test_53_check_queries (2))
+		return nopoll_false;
+
+	/* TTL reported by the resolver (0: not cached) */
+	iterator = 0;
+	while (iterator < 2) {
+		conn = nopoll_conn_new (ctx, "short.nopoll.test", "1234", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+			printf ("ERROR: expected connection to be ready..\n");
+			return nopoll_false;
+		} /* end if */
+		nopoll_conn_close (conn);
+		iterator++;
+	} /* end while */
+	if (! test_53_check_queries (4))
+		return nopoll_false;
+
+	/* flushing the cache resolves host names again */
+	nopoll_ctx_dns_cache_flush (ctx);
+	conn = nopoll_conn_new (ctx, "stub.nopoll.test", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection to be ready..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+	if (! test_53_check_queries (5))
+		return nopoll_false;
+
+	/* disable cache */
+	nopoll_ctx_set_dns_cache_ttl (ctx, 0, 0);
+	nopoll_ctx_dns_cache_flush (ctx);
+	iterator = 0;
+	while (iterator < 2) {
+		conn = nopoll_conn_new (ctx, "stub.nopoll.test", "1234", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+			printf ("ERROR: expected connection to be ready..\n");
+			return nopoll_false;
+		} /* end if */
+		nopoll_conn_close (conn);
+		iterator++;
+	} /* end while */
+	if (! test_53_check_queries (7))
+		return nopoll_false;
+
+	nopoll_conn_opts_free (opts);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+nopoll_bool test_54_echo (noPollConn * conn, int size)
+{
+	char * content;
+	char * reply;
+	int    length;
+	int    bytes;
+
+	/* repetitive json content (compresses well) */
+	content = nopoll_new (char, size + 128);
+	reply   = nopoll_new (char, size + 1);
+	length  = 0;
+	while (length < size) {
+		length += sprintf (content + length, "{\"id\": %d, \"name\": \"sensor-%d\", \"status\": \"ok\"},", length % 97, length % 13);
+	} /* end while */
+	length = size;
+	content[length] = 0;
+
+	if (nopoll_conn_send_text (conn, content, length) != length) {
+		printf ("ERROR: expected to send %d bytes..\n", length);
+		return nopoll_false;
+	} /* end if */
+
+	bytes = nopoll_conn_read (conn, reply, length, nopoll_true, 5000);
+	if (bytes != length || memcmp (content, reply, length) != 0) {
+		printf ("ERROR: expected to receive %d bytes echoed but found %d (or different content)..\n", length, bytes);
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_free (content);
+	nopoll_free (reply);
+	return nopoll_true;
+}
+
+nopoll_bool test_54_check (noPollCtx * ctx, noPollConnOpts * opts, const char * port, nopoll_bool expected)
+{
+	noPollConn * conn;
+	int          iterator;
+
+	conn = nopoll_conn_new_opts (ctx, opts, "localhost", port, NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection to port %s to be ready..\n", port);
+		return nopoll_false;
+	} /* end if */
+	if (nopoll_conn_is_deflate_on (conn) != expected) {
+		printf ("ERROR: expected permessage-deflate status %d on port %s..\n", expected, port);
+		return nopoll_false;
+	} /* end if */
+
+	/* small messages (not compressed), and several big ones
+	 * (compression context kept between messages or not) */
+	if (! test_sending_and_check_echo (conn, "Test 54", "This is a test"))
+		return nopoll_false;
+	iterator = 0;
+	while (iterator < 3) {
+		if (! test_54_echo (conn, 100 + iterator))
+			return nopoll_false;
+		if (! test_54_echo (conn, 300000 + iterator))
+			return nopoll_false;
+		iterator++;
+	} /* end while */
+
+	nopoll_conn_close (conn);
+	return nopoll_true;
+}
+
+nopoll_bool test_54 (void) {
+	noPollCtx      * ctx;
+	noPollConnOpts * opts;
+
+	ctx = create_ctx ();
+
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_reuse (opts, nopoll_true);
+	if (! nopoll_conn_opts_set_permessage_deflate (opts, nopoll_true)) {
+		printf ("Test 54: library built without zlib support, skipping..\n");
+		nopoll_conn_opts_free (opts);
+		nopoll_ctx_unref (ctx);
+		return nopoll_true;
+	} /* end if */
+
+	/* negotiated with default settings */
+	if (! test_54_check (ctx, opts, "1241", nopoll_true))
+		return nopoll_false;
+
+	/* listener without the extension */
+	if (! test_54_check (ctx, opts, "1234", nopoll_false))
+		return nopoll_false;
+
+	/* client without the extension */
+	if (! test_54_check (ctx, NULL, "1241", nopoll_false))
+		return nopoll_false;
+
+	/* server without context takeover and smaller windows
+	 * (requested by the server), client without context
+	 * takeover and smaller windows (requested by the client) */
+	if (! test_54_check (ctx, opts, "1242", nopoll_true))
+		return nopoll_false;
+	nopoll_conn_opts_set_deflate_context_takeover (opts, nopoll_false, nopoll_true);
+	nopoll_conn_opts_set_deflate_window_bits (opts, 10, 9);
+	nopoll_conn_opts_set_deflate_min_size (opts, 1);
+	if (! test_54_check (ctx, opts, "1241", nopoll_true))
+		return nopoll_false;
+	if (! test_54_check (ctx, opts, "1242", nopoll_true))
+		return nopoll_false;
+
+	nopoll_conn_opts_free (opts);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+nopoll_bool test_55_check_stats (noPollCtx * ctx, long expected_streams, long expected_idle)
+{
+	long streams;
+	long idle_streams;
+	long memory;
+	long bytes_in;
+	long bytes_out;
+
+	nopoll_ctx_get_deflate_stats (ctx, &streams, &idle_streams, &memory, &bytes_in, &bytes_out);
+	if (streams != expected_streams || idle_streams != expected_idle) {
+		printf ("ERROR: expected %ld streams (%ld idle) but found %ld (%ld idle)..\n", 
+			expected_streams, expected_idle, streams, idle_streams);
+		return nopoll_false;
+	} /* end if */
+	if ((streams > 0 && memory <= 0) || (streams == 0 && memory != 0)) {
+		printf ("ERROR: unexpected memory %ld reported for %ld streams..\n", memory, streams);
+		return nopoll_false;
+	} /* end if */
+	if (bytes_out <= 0 || bytes_in < bytes_out * 10) {
+		printf ("ERROR: expected content compressed but found %ld bytes in, %ld bytes out..\n", bytes_in, bytes_out);
+		return nopoll_false;
+	} /* end if */
+	return nopoll_true;
+}
+
+nopoll_bool test_55 (void) {
+	noPollCtx      * ctx;
+	noPollConnOpts * opts;
+	noPollConn     * conns[3];
+	int              iterator;
+
+	ctx = create_ctx ();
+
+	/* without context takeover (both directions) */
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_reuse (opts, nopoll_true);
+	if (! nopoll_conn_opts_set_permessage_deflate (opts, nopoll_true)) {
+		printf ("Test 55: library built without zlib support, skipping..\n");
+		nopoll_conn_opts_free (opts);
+		nopoll_ctx_unref (ctx);
+		return nopoll_true;
+	} /* end if */
+	nopoll_conn_opts_set_deflate_context_takeover (opts, nopoll_false, nopoll_false);
+
+	/* connections share streams from the pool while messages are
+	 * compressed or decompressed */
+	iterator = 0;
+	while (iterator < 2) {
+		conns[iterator] = nopoll_conn_new_opts (ctx, opts, "localhost", "1241", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_wait_until_connection_ready (conns[iterator], 5) || ! nopoll_conn_is_deflate_on (conns[iterator])) {
+			printf ("ERROR: expected connection with permessage-deflate..\n");
+			return nopoll_false;
+		} /* end if */
+		if (! test_54_echo (conns[iterator], 200000) || ! test_54_echo (conns[iterator], 100000))
+			return nopoll_false;
+		iterator++;
+	} /* end while */
+	if (! test_55_check_stats (ctx, 2, 2))
+		return nopoll_false;
+
+	/* connections with context takeover keep their streams */
+	nopoll_conn_opts_set_deflate_context_takeover (opts, nopoll_true, nopoll_true);
+	conns[2] = nopoll_conn_new_opts (ctx, opts, "localhost", "1241", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conns[2], 5) || ! test_54_echo (conns[2], 200000))
+		return nopoll_false;
+	if (! test_55_check_stats (ctx, 4, 2))
+		return nopoll_false;
+	nopoll_conn_close (conns[2]);
+	if (! test_55_check_stats (ctx, 2, 2))
+		return nopoll_false;
+
+	/* without pool, connections keep their own streams */
+	nopoll_ctx_set_deflate_pool_size (ctx, 0);
+	if (! test_55_check_stats (ctx, 0, 0))
+		return nopoll_false;
+	if (! test_54_echo (conns[0], 200000))
+		return nopoll_false;
+	if (! test_55_check_stats (ctx, 2, 0))
+		return nopoll_false;
+
+	nopoll_conn_close (conns[0]);
+	nopoll_conn_close (conns[1]);
+	if (! test_55_check_stats (ctx, 0, 0))
+		return nopoll_false;
+
+	nopoll_conn_opts_free (opts);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+noPollMsg  * test_56_msg;
+noPollConn * test_56_conn;
+
+noPollPtr test_56_refs (noPollPtr user_data)
+{
+	noPollCtx * ctx = (noPollCtx *) user_data;
+	int         iterator;
+
+	iterator = 0;
+	while (iterator < 200000) {
+		nopoll_msg_ref (test_56_msg);
+		nopoll_conn_ref (test_56_conn);
+		nopoll_ctx_ref (ctx);
+		nopoll_msg_unref (test_56_msg);
+		nopoll_conn_unref (test_56_conn);
+		nopoll_ctx_unref (ctx);
+		iterator++;
+	} /* end while */
+	return NULL;
+}
+
+nopoll_bool test_56 (void) {
+	noPollCtx      * ctx;
+	int              ctx_refs;
+	int              conn_refs;
+#if defined(__NOPOLL_PTHREAD_SUPPORT__)
+	pthread_t        threads[4];
+	int              iterator;
+#endif
+
+	ctx = create_ctx ();
+
+	test_56_conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (test_56_conn, 5)) {
+		printf ("ERROR: expected connection to be ready..\n");
+		return nopoll_false;
+	} /* end if */
+	test_56_msg = nopoll_msg_prepare (ctx, NOPOLL_TEXT_FRAME, "This is a test", 14);
+	ctx_refs    = nopoll_ctx_ref_count (ctx);
+	conn_refs   = nopoll_conn_ref_count (test_56_conn);
+
+	/* references acquired and released concurrently */
+#if defined(__NOPOLL_PTHREAD_SUPPORT__)
+	iterator = 0;
+	while (iterator < 4) {
+		if (pthread_create (&threads[iterator], NULL, test_56_refs, ctx) != 0) {
+			printf ("ERROR: failed to create thread..\n");
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
+	iterator = 0;
+	while (iterator < 4) {
+		pthread_join (threads[iterator], NULL);
+		iterator++;
+	} /* end while */
+#else
+	test_56_refs (ctx);
+#endif
+
+	if (nopoll_msg_ref_count (test_56_msg) != 1 || nopoll_conn_ref_count (test_56_conn) != conn_refs || nopoll_ctx_ref_count (ctx) != ctx_refs) {
+		printf ("ERROR: expected reference counting to be restored but found msg=%d, conn=%d (expected %d), ctx=%d (expected %d)..\n",
+			nopoll_msg_ref_count (test_56_msg), nopoll_conn_ref_count (test_56_conn), conn_refs, nopoll_ctx_ref_count (ctx), ctx_refs);
+		return nopoll_false;
+	} /* end if */
+
+	/* the connection still works */
+	if (! nopoll_conn_send_prepared (test_56_conn, test_56_msg)) {
+		printf ("ERROR: expected to send prepared message..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_msg_unref (test_56_msg);
+
+	nopoll_conn_close (test_56_conn);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+nopoll_bool test_57 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	int              sizes[5] = {100, 900, 5000, 40000, 100000};
+	int              iterator;
+	int              round;
+	int              idle_msgs;
+	int              idle_buffers;
+	long             idle_memory;
+	long             hits;
+	long             misses;
+	long             prev_hits;
+	noPollMsg      * msgs[2];
+	noPollMsg      * joined;
+	char             content[100];
+
+	ctx = create_ctx ();
+
+	conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection to be ready..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* messages received by size classes (and above) */
+	prev_hits = 0;
+	for (round = 0; round < 2; round++) {
+		for (iterator = 0; iterator < 5; iterator++) {
+			if (! test_54_echo (conn, sizes[iterator]))
+				return nopoll_false;
+		} /* end for */
+
+		nopoll_ctx_get_msg_pool_stats (ctx, &idle_msgs, &idle_buffers, &idle_memory, &hits, &misses);
+		printf ("Test 57: round %d, idle msgs=%d, idle buffers=%d, idle memory=%ld, hits=%ld, misses=%ld\n", 
+			round, idle_msgs, idle_buffers, idle_memory, hits, misses);
+		if (idle_msgs < 1 || idle_buffers < 1 || misses < 1 || idle_memory > NOPOLL_MSG_POOL_MEMORY) {
+			printf ("ERROR: expected idle message holders and buffers kept after round %d..\n", round);
+			return nopoll_false;
+		} /* end if */
+
+		/* second round is served from the pool */
+		if (round == 1 && hits - prev_hits < 9) {
+			printf ("ERROR: expected message holders and buffers to be reused (hits %ld, previous %ld)..\n", hits, prev_hits);
+			return nopoll_false;
+		} /* end if */
+		prev_hits = hits;
+	} /* end for */
+
+	/* leave used buffers in the pool, then check messages
+	 * prepared and joined (taken from them) are terminated */
+	memset (content, 'x', 100);
+	msgs[0] = nopoll_msg_prepare (ctx, NOPOLL_TEXT_FRAME, content, 100);
+	msgs[1] = nopoll_msg_prepare (ctx, NOPOLL_TEXT_FRAME, content, 100);
+	joined  = nopoll_msg_join (msgs[0], msgs[1]);
+	nopoll_msg_unref (msgs[0]);
+	nopoll_msg_unref (msgs[1]);
+	nopoll_msg_unref (joined);
+
+	msgs[0] = nopoll_msg_prepare (ctx, NOPOLL_TEXT_FRAME, "Hello ", 6);
+	msgs[1] = nopoll_msg_prepare (ctx, NOPOLL_TEXT_FRAME, "World", 5);
+	joined  = nopoll_msg_join (msgs[0], msgs[1]);
+	if (! nopoll_cmp ((const char *) nopoll_msg_get_payload (msgs[0]), "Hello ") ||
+	    ! nopoll_cmp ((const char *) nopoll_msg_get_payload (msgs[1]), "World") ||
+	    ! nopoll_cmp ((const char *) nopoll_msg_get_payload (joined), "Hello World")) {
+		printf ("ERROR: expected prepared and joined payloads to be terminated..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_msg_unref (msgs[0]);
+	nopoll_msg_unref (msgs[1]);
+	nopoll_msg_unref (joined);
+
+	/* disable pool */
+	nopoll_ctx_set_msg_pool (ctx, 0, 0);
+	nopoll_ctx_get_msg_pool_stats (ctx, &idle_msgs, &idle_buffers, &idle_memory, NULL, NULL);
+	if (idle_msgs != 0 || idle_buffers != 0 || idle_memory != 0) {
+		printf ("ERROR: expected pool to be released (msgs=%d, buffers=%d, memory=%ld)..\n", idle_msgs, idle_buffers, idle_memory);
+		return nopoll_false;
+	} /* end if */
+	for (iterator = 0; iterator < 5; iterator++) {
+		if (! test_54_echo (conn, sizes[iterator]))
+			return nopoll_false;
+	} /* end for */
+	nopoll_ctx_get_msg_pool_stats (ctx, &idle_msgs, &idle_buffers, &idle_memory, NULL, NULL);
+	if (idle_msgs != 0 || idle_buffers != 0) {
+		printf ("ERROR: expected nothing kept with the pool disabled (msgs=%d, buffers=%d)..\n", idle_msgs, idle_buffers);
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+long test_58_mallocs    = 0;
+long test_58_reallocs   = 0;
+long test_58_frees      = 0;
+long test_58_mismatches = 0;
+
+/* blocks handed out are preceded by a tagged header (tag and size)
+ * so memory not taken from these handlers is detected */
+#define TEST_58_TAG    0x58a110c
+#define TEST_58_HEADER 16
+
+nopoll_bool test_58_is_tagged (noPollPtr ref)
+{
+	if (((long *) ((char *) ref - TEST_58_HEADER))[0] == TEST_58_TAG)
+		return nopoll_true;
+
+	/* memory not allocated by these handlers */
+	__sync_add_and_fetch (&test_58_mismatches, 1);
+	return nopoll_false;
+}
+
+noPollPtr test_58_malloc (size_t size)
+{
+	char * block;
+
+	__sync_add_and_fetch (&test_58_mallocs, 1);
+	block = malloc (size + TEST_58_HEADER);
+	if (block == NULL)
+		return NULL;
+	((long *) block)[0] = TEST_58_TAG;
+	((long *) block)[1] = (long) size;
+	return block + TEST_58_HEADER;
+}
+
+noPollPtr test_58_realloc (noPollPtr ref, size_t size)
+{
+	char * block;
+
+	if (ref == NULL)
+		return test_58_malloc (size);
+	__sync_add_and_fetch (&test_58_reallocs, 1);
+	if (! test_58_is_tagged (ref))
+		return NULL;
+
+	block = realloc ((char *) ref - TEST_58_HEADER, size + TEST_58_HEADER);
+	if (block == NULL)
+		return NULL;
+	((long *) block)[1] = (long) size;
+	return block + TEST_58_HEADER;
+}
+
+void test_58_free (noPollPtr ref)
+{
+	if (ref == NULL)
+		return;
+	__sync_add_and_fetch (&test_58_frees, 1);
+	if (! test_58_is_tagged (ref)) {
+		/* leak it: releasing it here would corrupt the heap */
+		return;
+	} /* end if */
+
+	((long *) ((char *) ref - TEST_58_HEADER))[0] = 0;
+	free ((char *) ref - TEST_58_HEADER);
+	return;
+}
+
+size_t test_58_usable_size (noPollPtr ref)
+{
+	if (! test_58_is_tagged (ref))
+		return 0;
+	return (size_t) ((long *) ((char *) ref - TEST_58_HEADER))[1];
+}
+
+nopoll_bool test_58 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	char           * value;
+	long             mallocs;
+
+	/* install allocator before using the library */
+	nopoll_set_allocator (test_58_malloc, test_58_realloc, test_58_free, test_58_usable_size);
+
+	/* strings copied are taken from the allocator */
+	value = nopoll_strdup ("This is a test");
+	if (test_58_mallocs < 1 || ! nopoll_cmp (value, "This is a test")) {
+		printf ("ERROR: expected string to be allocated with the allocator installed (mallocs %ld)..\n", test_58_mallocs);
+		return nopoll_false;
+	} /* end if */
+	if (nopoll_usable_size (value) < 15) {
+		printf ("ERROR: expected usable size reported by the handler installed..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_free (value);
+	if (test_58_frees < 1) {
+		printf ("ERROR: expected string to be released with the allocator installed..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* formatted strings too */
+	value = nopoll_strdup_printf ("%s %d", "This is a test", 58);
+	if (! nopoll_cmp (value, "This is a test 58") || nopoll_usable_size (value) < 18) {
+		printf ("ERROR: expected formatted string to be allocated with the allocator installed..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_free (value);
+	if (test_58_mismatches != 0) {
+		printf ("ERROR: found %ld blocks not allocated by the allocator installed..\n", test_58_mismatches);
+		return nopoll_false;
+	} /* end if */
+
+	ctx = create_ctx ();
+	conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection to be ready..\n");
+		return nopoll_false;
+	} /* end if */
+	if (! test_54_echo (conn, 1000) || ! test_54_echo (conn, 100000))
+		return nopoll_false;
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (ctx);
+
+	printf ("Test 58: allocations: mallocs=%ld, reallocs=%ld, frees=%ld, mismatches=%ld\n", test_58_mallocs, test_58_reallocs, test_58_frees, test_58_mismatches);
+	if (test_58_mallocs < 10 || test_58_frees < 10) {
+		printf ("ERROR: expected context and connection memory to be taken from the allocator installed..\n");
+		return nopoll_false;
+	} /* end if */
+	if (test_58_mismatches != 0) {
+		printf ("ERROR: found %ld blocks released or queried with the allocator installed but not allocated by it..\n", test_58_mismatches);
+		return nopoll_false;
+	} /* end if */
+
+	/* uninstall allocator */
+	nopoll_set_allocator (NULL, NULL, NULL, NULL);
+	mallocs = test_58_mallocs;
+	value   = nopoll_strdup ("This is a test");
+	if (mallocs != test_58_mallocs || nopoll_usable_size (value) != 0) {
+		printf ("ERROR: expected allocator to be uninstalled..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_free (value);
+
+	return nopoll_true;
+}
+
+char        * test_59_received      = NULL;
+long          test_59_received_size = 0;
+int           test_59_chunks        = 0;
+int           test_59_max_chunk     = 0;
+nopoll_bool   test_59_done          = nopoll_false;
+nopoll_bool   test_59_error         = nopoll_false;
+
+nopoll_bool   test_59_clear         = nopoll_false;
+
+void test_59_on_chunk (noPollCtx * ctx, noPollConn * conn, noPollOpCode op_code, const char * chunk, int length, long offset, nopoll_bool is_last, noPollPtr user_data)
+{
+	long size = (long) user_data;
+
+	/* handler cleared while streaming: the rest of the message
+	 * is still delivered here */
+	if (test_59_clear && offset == 0)
+		nopoll_conn_set_on_frame_chunk (conn, NULL, NULL);
+
+	/* chunks are delivered in order */
+	if (op_code != NOPOLL_TEXT_FRAME || offset != test_59_received_size || offset + length > size || test_59_done) {
+		printf ("ERROR: unexpected chunk received (op code %d, offset %ld, length %d, received %ld)..\n", 
+			op_code, offset, length, test_59_received_size);
+		test_59_error = nopoll_true;
+		return;
+	} /* end if */
+
+	memcpy (test_59_received + offset, chunk, length);
+	test_59_received_size += length;
+	test_59_chunks++;
+	if (length > test_59_max_chunk)
+		test_59_max_chunk = length;
+	test_59_done = is_last;
+	return;
+}
+
+nopoll_bool test_59_stream (noPollCtx * ctx, noPollConnOpts * opts, const char * port, long size)
+{
+	noPollConn * conn;
+	char       * content;
+	long         length;
+	int          iterator;
+
+	conn = nopoll_conn_new_opts (ctx, opts, "localhost", port, NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection to port %s to be ready..\n", port);
+		return nopoll_false;
+	} /* end if */
+
+	/* repetitive json content (compresses well) */
+	content = nopoll_new (char, size + 128);
+	length  = 0;
+	while (length < size) {
+		length += sprintf (content + length, "{\"id\": %ld, \"name\": \"sensor-%ld\", \"status\": \"ok\"},", length % 97, length % 13);
+	} /* end while */
+	test_59_received      = nopoll_new (char, size);
+	test_59_received_size = 0;
+	test_59_chunks        = 0;
+	test_59_max_chunk     = 0;
+	test_59_done          = nopoll_false;
+	test_59_error         = nopoll_false;
+	nopoll_conn_set_on_frame_chunk (conn, test_59_on_chunk, (noPollPtr) size);
+
+	if (nopoll_conn_send_text (conn, content, size) != size) {
+		printf ("ERROR: expected to send %ld bytes..\n", size);
+		return nopoll_false;
+	} /* end if */
+
+	/* content is streamed: no message is reported */
+	iterator = 0;
+	while (! test_59_done && ! test_59_error && iterator < 5000) {
+		if (nopoll_conn_get_msg (conn)) {
+			printf ("ERROR: expected no message to be reported while streaming..\n");
+			return nopoll_false;
+		} /* end if */
+		if (! nopoll_conn_is_ok (conn))
+			break;
+		nopoll_sleep (1000);
+		iterator++;
+	} /* end while */
+
+	printf ("Test 59: received %ld bytes in %d chunks (max chunk %d bytes) from port %s\n", test_59_received_size, test_59_chunks, test_59_max_chunk, port);
+	if (! test_59_done || test_59_received_size != size || memcmp (content, test_59_received, size) != 0) {
+		printf ("ERROR: expected to receive %ld bytes echoed in chunks but found %ld (or different content)..\n", size, test_59_received_size);
+		return nopoll_false;
+	} /* end if */
+	if (test_59_chunks < 2 || (opts == NULL && test_59_max_chunk > NOPOLL_READ_BUFFER_SIZE)) {
+		printf ("ERROR: expected content to be received in bounded chunks..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* connection is still working (buffering messages again) */
+	nopoll_conn_set_on_frame_chunk (conn, NULL, NULL);
+	if (! test_sending_and_check_echo (conn, "Test 59", "This is a test"))
+		return nopoll_false;
+
+	nopoll_free (content);
+	nopoll_free (test_59_received);
+	nopoll_conn_close (conn);
+	return nopoll_true;
+}
+
+nopoll_bool test_59_limit (noPollCtx * ctx, noPollConnOpts * opts, const char * port, long limit, long size, nopoll_bool expected)
+{
+	noPollConn * conn;
+	noPollMsg  * msg;
+	char       * content;
+	long         received;
+	int          iterator;
+
+	conn = nopoll_conn_new_opts (ctx, opts, "localhost", port, NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection to port %s to be ready..\n", port);
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_set_max_message_size (conn, limit);
+	if (nopoll_conn_get_max_message_size (conn) != (limit > 0 ? limit : (limit < 0 ? 0 : nopoll_ctx_get_max_message_size (ctx)))) {
+		printf ("ERROR: unexpected max message size %ld (configured %ld)..\n", nopoll_conn_get_max_message_size (conn), limit);
+		return nopoll_false;
+	} /* end if */
+
+	content = nopoll_new (char, size);
+	memset (content, 'a', size);
+	if (nopoll_conn_send_text (conn, content, size) != size) {
+		printf ("ERROR: expected to send %ld bytes..\n", size);
+		return nopoll_false;
+	} /* end if */
+	nopoll_free (content);
+
+	/* wait for the reply (or the connection to be closed) */
+	iterator = 0;
+	received = 0;
+	while (iterator < 5000 && received < size) {
+		msg = nopoll_conn_get_msg (conn);
+		if (msg) {
+			received += nopoll_msg_get_payload_size (msg);
+			nopoll_msg_unref (msg);
+			continue;
+		} /* end if */
+		if (! nopoll_conn_is_ok (conn))
+			break;
+		nopoll_sleep (1000);
+		iterator++;
+	} /* end while */
+
+	if (nopoll_conn_is_ok (conn) != expected || (expected && received != size)) {
+		printf ("ERROR: expected connection status %d after receiving %ld bytes with max message size %ld (port %s)..\n", 
+			expected, size, limit, port);
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_conn_close (conn);
+	return nopoll_true;
+}
+
+nopoll_bool test_59 (void) {
+	noPollCtx      * ctx;
+	noPollConnOpts * opts;
+
+	ctx = create_ctx ();
+
+	/* messages streamed */
+	if (! test_59_stream (ctx, NULL, "1234", 300000))
+		return nopoll_false;
+
+	/* handler cleared on the first chunk */
+	test_59_clear = nopoll_true;
+	if (! test_59_stream (ctx, NULL, "1234", 300000))
+		return nopoll_false;
+	test_59_clear = nopoll_false;
+
+	/* messages above the limit are rejected */
+	if (! test_59_limit (ctx, NULL, "1234", 1000, 500, nopoll_true))
+		return nopoll_false;
+	if (! test_59_limit (ctx, NULL, "1234", 1000, 5000, nopoll_false))
+		return nopoll_false;
+
+	/* limit configured at the context */
+	nopoll_ctx_set_max_message_size (ctx, 1000);
+	if (! test_59_limit (ctx, NULL, "1234", 0, 5000, nopoll_false))
+		return nopoll_false;
+	if (! test_59_limit (ctx, NULL, "1234", -1, 5000, nopoll_true))
+		return nopoll_false;
+	nopoll_ctx_set_max_message_size (ctx, 0);
+
+	/* compressed messages (permessage-deflate) */
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_reuse (opts, nopoll_true);
+	if (nopoll_conn_opts_set_permessage_deflate (opts, nopoll_true)) {
+		if (! test_59_stream (ctx, opts, "1241", 300000))
+			return nopoll_false;
+
+		/* content decompressed is also checked */
+		if (! test_59_limit (ctx, opts, "1241", 10000, 58000, nopoll_false))
+			return nopoll_false;
+	} /* end if */
+	nopoll_conn_opts_free (opts);
+
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+int main (int argc, char ** argv)
+{
+	int iterator;
+
+	printf ("** NoPoll: Websocket toolkit (regression test).\n");
+	printf ("** Copyright (C) 2015 Advanced Software Production Line, S.L.\n**\n");
+	printf ("** NoPoll regression tests: version=%s\n**\n",
+		VERSION);
+	printf ("** To gather information about time performance you can use:\n**\n");
+	printf ("**     >> time ./nopoll-regression-client [--debug,--show-critical-only]\n**\n");
+	printf ("** To gather information about memory consumed (and leaks) use:\n**\n");
+	printf ("**     >> libtool --mode=execute valgrind --leak-check=yes --error-limit=no ./nopoll-regression-client\n**\n");
+	printf ("**\n");
+	printf ("** Report bugs to:\n**\n");
+	printf ("**     <nopoll@lists.aspl.es> noPoll mailing list\n**\n");
+	printf ("**     <info@aspl.es> ASPL's contact \n**\n");
+
+	iterator = 1;
+	while (iterator < argc) {
+		/* check for debug */
+		printf ("Checking agument: %s\n", argv[iterator]);
+		if (nopoll_cmp (argv[iterator], "--debug")) {
+			printf ("Activating debug..\n");
+			debug = nopoll_true;
+		} /* end if */
+		if (nopoll_cmp (argv[iterator], "--show-critical-only")) {
+			printf ("Activating reporting of critical messages..\n");
+			show_critical_only = nopoll_true;
+		} /* end if */
+
+		/* next position */
+		iterator++;
+	}
+
+#if defined(__NOPOLL_PTHREAD_SUPPORT__)	
+	printf ("INFO: install default threading functions to check noPoll locking code..\n");
+	nopoll_thread_handlers (__nopoll_regtest_mutex_create,
+				__nopoll_regtest_mutex_destroy,
+				__nopoll_regtest_mutex_lock,
+				__nopoll_regtest_mutex_unlock);
+#endif
+
+	printf ("INFO: starting tests with pid: %d\n", getpid ());
+	if (test_01_strings ()) {
+		printf ("Test 01-strings: Library strings support [   OK   ]\n");
+	}else {
+		printf ("Test 01-strings: Library strings support [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_01_base64 ()) {
+		printf ("Test 01-base64: Library base64 support [   OK   ]\n");
+	}else {
+		printf ("Test 01-base64: Library base64 support [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_01_masking ()) {
+		printf ("Test 01-masking: Library websocket content masking support [   OK   ]\n");
+	}else {
+		printf ("Test 01-masking: Library websocket content masking support [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_01_masking_sizes ()) {
+		printf ("Test 01-masking-sizes: websocket masking over all sizes and offsets [   OK   ]\n");
+	}else {
+		printf ("Test 01-masking-sizes: websocket masking over all sizes and offsets [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_01 ()) {	
+		printf ("Test 01: Simple connect and disconnect [   OK   ]\n");
+	}else {
+		printf ("Test 01: Simple connect and disconnect [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_02 ()) {	
+		printf ("Test 02: Simple request/reply [   OK   ]\n");
+	}else {
+		printf ("Test 02: Simple request/reply [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_02a ()) {	
+		printf ("Test 02a: Simple request/reply (IPv6) [   OK   ]\n");
+	}else {
+		printf ("Test 02a: Simple request/reply (IPv6) [ FAILED ]\n");
+		return -1;
+	}
+
+	/* test sending ping */
+	if (test_02b ()) {	
+		printf ("Test 02b: test sending ping [   OK   ]\n");
+	}else {
+		printf ("Test 02a: test sending ping [ FAILED ]\n");
+		return -1;
+	}
+
+	/* test sending pong (without ping) */
+
+	/* test streaming api */
+	if (test_03 ()) {	
+		printf ("Test 03: test streaming api [   OK   ]\n");
+	}else {
+		printf ("Test 03: test streaming api [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04 (1024)) {	
+		printf ("Test 04: test streaming api (II) [   OK   ]\n");
+	}else {
+		printf ("Test 04: test streaming api (II) [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04 (512)) {	
+		printf ("Test 04-a: test streaming api (III) [   OK   ]\n");
+	}else {
+		printf ("Test 04-a: test streaming api (III) [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04 (137)) {	
+		printf ("Test 04-b: test streaming api (IV) [   OK   ]\n");
+	}else {
+		printf ("Test 04-b: test streaming api (IV) [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04 (17)) {	
+		printf ("Test 04-c: test streaming api (V) [   OK   ]\n");
+	}else {
+		printf ("Test 04-c: test streaming api (V) [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04a ()) {
+		printf ("Test 04-a: check non-blocking streaming and message based API  [   OK   ]\n");
+	} else {
+		printf ("Test 04-a: check non-blocking streaming and message based API [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04b ()) {
+		printf ("Test 04-b: try to overflow write access and recover from it  [   OK   ]\n");
+	} else {
+		printf ("Test 04-b: try to overflow write access and recover from it [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04c ()) {
+		printf ("Test 04-c: send a file and try to overflow (but retry)  [   OK   ]\n");
+	} else {
+		printf ("Test 04-c: send a file and try to overflow (but retry) [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_05 ()) {
+		printf ("Test 05: sending utf-8 content [   OK   ]\n");
+	} else {
+		printf ("Test 05: sending utf-8 content [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_06 ()) {
+		printf ("Test 06: testing basic TLS connect [   OK   ]\n");
+	} else {
+		printf ("Test 06: testing basic TLS connect [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_06a ()) {
+		printf ("Test 06a: testing basic TLS connect (IPv6) [   OK   ]\n");
+	} else {
+		printf ("Test 06a: testing basic TLS connect (IPv6) [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_07 ()) {
+		printf ("Test 07: testing TLS request/reply [   OK   ]\n");
+	} else {
+		printf ("Test 07: testing TLS request/reply [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_08 ()) {
+		printf ("Test 08: test normal connect to TLS port [   OK   ]\n");
+	} else {
+		printf ("Test 08: test normal connect to TLS port [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_09 ()) {
+		printf ("Test 09: ensure we only support Sec-WebSocket-Version: 13 [   OK   ]\n");
+	} else {
+		printf ("Test 09: ensure we only support Sec-WebSocket-Version: 13 [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_10 ()) {
+		printf ("Test 10: test checking origing in on open and denying it [   OK   ]\n");
+	} else {
+		printf ("Test 10: test checking origing in on open and denying it [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_11 ()) {
+		printf ("Test 11: release context after connection [   OK   ]\n");
+	} else {
+		printf ("Test 11: release context after connection [ FAILED ]\n");
+		return -1;
+	}
 
 	if (test_12 ()) {
 		printf ("Test 12: create huge amount of connections in a short time [   OK   ]\n");
@@ -3249,6 +6144,169 @@ int main (int argc, char ** argv)
 		return -1;
 	} /* end if */
 
+	if (test_37 ()) {
+		printf ("Test 37: check io engines (select, epoll, poll and io_uring)  [   OK    ]\n");
+	} else {
+		printf ("Test 37: check io engines (select, epoll, poll and io_uring) [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_38 ()) {
+		printf ("Test 38: check ready connections dispatch  [   OK    ]\n");
+	} else {
+		printf ("Test 38: check ready connections dispatch [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_39 ()) {
+		printf ("Test 39: io engines benchmark  [   OK    ]\n");
+	} else {
+		printf ("Test 39: io engines benchmark [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_40 ()) {
+		printf ("Test 40: loop wait timeout and wake up  [   OK    ]\n");
+	} else {
+		printf ("Test 40: loop wait timeout and wake up [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+#if defined(__NOPOLL_PTHREAD_SUPPORT__)
+	if (test_41 ()) {
+		printf ("Test 41: multi-reactor worker loops  [   OK    ]\n");
+	} else {
+		printf ("Test 41: multi-reactor worker loops [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+#endif
+
+	if (test_42 ()) {
+		printf ("Test 42: several frames per read and split headers  [   OK    ]\n");
+	} else {
+		printf ("Test 42: several frames per read and split headers [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_43 ()) {
+		printf ("Test 43: drain frames retained by TLS on each read  [   OK    ]\n");
+	} else {
+		printf ("Test 43: drain frames retained by TLS on each read [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_44 ()) {
+		printf ("Test 44: send frames bigger than a TLS record without copying  [   OK    ]\n");
+	} else {
+		printf ("Test 44: send frames bigger than a TLS record without copying [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_45 ()) {
+		printf ("Test 45: outbound queue written by the loop with on writable notification [   OK    ]\n");
+	} else {
+		printf ("Test 45: outbound queue written by the loop with on writable notification [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_46 ()) {
+		printf ("Test 46: write watermarks and slow consumer policies [   OK    ]\n");
+	} else {
+		printf ("Test 46: write watermarks and slow consumer policies [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_47 ()) {
+		printf ("Test 47: broadcast of prepared messages [   OK    ]\n");
+	} else {
+		printf ("Test 47: broadcast of prepared messages [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_48 ()) {
+		printf ("Test 48: handshake read through the connection buffer with early frames [   OK    ]\n");
+	} else {
+		printf ("Test 48: handshake read through the connection buffer with early frames [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_49 ()) {
+		printf ("Test 49: TLS context shared by accepted connections [   OK    ]\n");
+	} else {
+		printf ("Test 49: TLS context shared by accepted connections [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_50 ()) {
+		printf ("Test 50: TLS session resumption [   OK    ]\n");
+	} else {
+		printf ("Test 50: TLS session resumption [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_51 ()) {
+		printf ("Test 51: TLS certificate selected through SNI [   OK    ]\n");
+	} else {
+		printf ("Test 51: TLS certificate selected through SNI [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_52 ()) {
+		printf ("Test 52: asynchronous client connect driven by the loop [   OK    ]\n");
+	} else {
+		printf ("Test 52: asynchronous client connect driven by the loop [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_53 ()) {
+		printf ("Test 53: host names resolved without blocking and cached [   OK    ]\n");
+	} else {
+		printf ("Test 53: host names resolved without blocking and cached [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_54 ()) {
+		printf ("Test 54: permessage-deflate extension [   OK    ]\n");
+	} else {
+		printf ("Test 54: permessage-deflate extension [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_55 ()) {
+		printf ("Test 55: permessage-deflate streams shared through the context pool [   OK    ]\n");
+	} else {
+		printf ("Test 55: permessage-deflate streams shared through the context pool [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_56 ()) {
+		printf ("Test 56: atomic reference counting [   OK    ]\n");
+	} else {
+		printf ("Test 56: atomic reference counting [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_57 ()) {
+		printf ("Test 57: message holders and payload buffers pool [   OK    ]\n");
+	} else {
+		printf ("Test 57: message holders and payload buffers pool [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_58 ()) {
+		printf ("Test 58: pluggable allocator [   OK    ]\n");
+	} else {
+		printf ("Test 58: pluggable allocator [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_59 ()) {
+		printf ("Test 59: streaming receive and max message size [   OK    ]\n");
+	} else {
+		printf ("Test 59: streaming receive and max message size [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
 	/* add support to reply with redirect 301 to an opening
 	 * request: page 19 and 22 */
 
@@ -61,10 +61,8 @@ nopoll_bool on_connection_opened (noPollCtx * ctx, noPollConn * conn, noPollPtr
 	/* set connection close */
 	nopoll_conn_set_on_close (conn, __nopoll_regression_on_close, NULL);
 
-	if (! nopoll_conn_set_sock_block (nopoll_conn_socket (conn), nopoll_false)) {
-		printf ("ERROR: failed to configure non-blocking state to connection..\n");
-		return nopoll_false;
-	} /* end if */
+	/* accepted sockets are already non-blocking (not configured
+	 * here so test_45 checks what the library does) */
 
 	/* check to reject */
 	if (nopoll_cmp (nopoll_conn_get_origin (conn), "http://deny.aspl.es"))  {
@@ -183,6 +181,35 @@ void listener_on_message (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, n
 		return;
 	} /* end if */
 
+	if (nopoll_ncmp (content, "slow-reader-burst", 17)) {
+		/* small send buffer so the socket can't take the burst:
+		 * frames not written are queued (accepted sockets are
+		 * non-blocking) and the loop writes them as the client
+		 * reads */
+		iterator = 8192;
+		setsockopt (nopoll_conn_socket (conn), SOL_SOCKET, SO_SNDBUF, (const char *) &iterator, sizeof (iterator));
+
+		ref = nopoll_new (char, 65536);
+		memset (ref, 'b', 65536);
+		iterator = 0;
+		while (iterator < 64) {
+			sent = nopoll_conn_send_text (conn, ref, 65536);
+			if (sent < 0 && sent != -2) {
+				printf ("Listener: burst stopped at frame %d (result %d, connection closed?)..\n", iterator, sent);
+				break;
+			} /* end if */
+			iterator++;
+		} /* end while */
+		nopoll_free (ref);
+
+		/* report what was queued (this is also queued) */
+		ref = nopoll_strdup_printf ("queued: %d", nopoll_conn_pending_write_bytes (conn));
+		printf ("Listener: slow reader burst sent, %s bytes\n", ref);
+		nopoll_conn_send_text (conn, ref, strlen (ref));
+		nopoll_free (ref);
+		return;
+	} /* end if */
+
 	if (nopoll_ncmp (content, "1234-1) ", 8)) {
 		printf ("Listener: waiting a second to force buffer flooding..\n");
 		nopoll_sleep (100000);
@@ -396,6 +423,9 @@ int main (int argc, char ** argv)
 #if defined(NOPOLL_HAVE_TLSv12_ENABLED)
 	noPollConn     * listener7;
 #endif	
+	noPollConn     * listener8;
+	noPollConn     * listener9;
+	noPollConn     * listener10;
 	int              iterator;
 	noPollConnOpts * opts;
 
@@ -466,6 +496,13 @@ int main (int argc, char ** argv)
 		return -1;
 	}
 
+	/* certificates selected through SNI (see test_51) */
+	if (! nopoll_ctx_set_certificate (ctx, "*.sni.nopoll.test", "server.pem", "server.pem", NULL) ||
+	    ! nopoll_ctx_set_certificate (ctx, "exact.sni.nopoll.test", "client.pem", "client.pem", NULL)) {
+		printf ("ERROR: unable to setup SNI certificates at context level..\n");
+		return -1;
+	}
+
 	/* now start a TLS version */
 	printf ("Test: starting listener with TLS IPv6 (TLSv1) at :2235\n");
 	listener_62 = nopoll_listener_tls_new6 (ctx, "::1", "2235");
@@ -564,6 +601,39 @@ int main (int argc, char ** argv)
 	} /* end if */
 
 
+	/* permessage-deflate listeners (default settings, and
+	 * without context takeover and smaller windows) */
+	opts     = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_permessage_deflate (opts, nopoll_true);
+	listener8 = nopoll_listener_new_opts (ctx, opts, "0.0.0.0", "1241");
+	if (! nopoll_conn_is_ok (listener8)) {
+		printf ("ERROR: Expected to find proper listener connection status (:1241, permessage-deflate), but found..\n");
+		return -1;
+	} /* end if */
+
+	opts     = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_permessage_deflate (opts, nopoll_true);
+	nopoll_conn_opts_set_deflate_context_takeover (opts, nopoll_true, nopoll_false);
+	nopoll_conn_opts_set_deflate_window_bits (opts, 0, 11);
+	nopoll_conn_opts_set_deflate_min_size (opts, 1);
+	listener9 = nopoll_listener_new_opts (ctx, opts, "0.0.0.0", "1242");
+	if (! nopoll_conn_is_ok (listener9)) {
+		printf ("ERROR: Expected to find proper listener connection status (:1242, permessage-deflate), but found..\n");
+		return -1;
+	} /* end if */
+
+	/* slow consumers blocking send operations for a bounded
+	 * time (see test_46) */
+	opts     = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_write_watermarks (opts, 131072, 32768);
+	nopoll_conn_opts_set_slow_consumer_policy (opts, NOPOLL_SLOW_CONSUMER_BLOCK);
+	nopoll_conn_opts_set_slow_consumer_timeout (opts, 500000);
+	listener10 = nopoll_listener_new_opts (ctx, opts, "0.0.0.0", "1243");
+	if (! nopoll_conn_is_ok (listener10)) {
+		printf ("ERROR: Expected to find proper listener connection status (:1243, slow consumer block), but found..\n");
+		return -1;
+	} /* end if */
+
 	/* configure ssl context creator */
 	/* nopoll_ctx_set_ssl_context_creator (ctx, ssl_context_creator, NULL); */
 
@@ -597,6 +667,9 @@ int main (int argc, char ** argv)
 #if defined(NOPOLL_HAVE_TLSv12_ENABLED)
 	nopoll_conn_close (listener7);
 #endif	
+	nopoll_conn_close (listener8);
+	nopoll_conn_close (listener9);
+	nopoll_conn_close (listener10);
 
 	/* finish */
 	printf ("Listener: finishing references: %d\n", nopoll_ctx_ref_count (ctx));